@@ -18,12 +18,14 @@
 
 #define ARRAY_SIZE(x)  (sizeof(x) / sizeof((x)[0]))
 
+constexpr uint32_t MaxFramesInFlight = 3;
+
 #if defined(_MSC_VER)
 #define FORCEINLINE __forceinline
 #elif defined(__GNUC__) || defined(__clang__)
-#define TOY_FORCEINLINE __attribute__((always_inline)) inline
+#define FORCEINLINE __attribute__((always_inline)) inline
 #else
-#define TOY_FORCEINLINE inline
+#define FORCEINLINE inline
 #endif
 
 FORCEINLINE uint32_t divideAndRoundUp(uint32_t numerator, uint32_t denominator)
@@ -31,19 +33,93 @@ FORCEINLINE uint32_t divideAndRoundUp(uint32_t numerator, uint32_t denominator)
 	return (numerator + denominator - 1) / denominator;
 }
 
+// FNV-1a, for cache keys and change detection, not for anything that has to resist collisions.
+// Start from FnvOffsetBasis and hash field by field so struct padding stays out of it
+constexpr uint64_t FnvOffsetBasis = 14695981039346656037ull;
+
+inline void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+}
+
+template <typename T>
+inline void hashValue(uint64_t& hash, const T& value)
+{
+	hashBytes(hash, &value, sizeof(T));
+}
+
+// Two phase occlusion culling: early draws what was visible last frame, late tests the rest against the depth
+// pyramid of the early draws. None is plain frustum + cone culling
+enum class CullPhase : uint32_t
+{
+	None = 0,
+	Early = 1,
+	Late = 2
+};
+
 // This one needs to map to Engine\Shaders\common.glsl layout(push_constant) uniform Constants
+// Mesh buffers come from the mesh table (GpuMesh) through the instance (GpuInstance)
 struct DefaultPipelineLayout
 {
-	VkDeviceAddress VertexDataPtr;
 	VkDeviceAddress CameraDataPtr;
-	VkDeviceAddress MeshletDataPtr;
-	VkDeviceAddress MeshletVertexDataPtr;
-	VkDeviceAddress MeshletTriangleDataPtr;
 	VkDeviceAddress TransformDataPtr;
+	VkDeviceAddress MeshDataPtr;
+	VkDeviceAddress InstanceDataPtr;
+	// GpuDrawCommand array of an indirect draw, the instance comes from gl_DrawID. 0 for direct draws
+	VkDeviceAddress DrawCommandsPtr;
+	// MeshletCounters slot of the frame, 0 when the counters are off
+	VkDeviceAddress StatsDataPtr;
+	// One uint per meshlet of every instance, read by the early phase and rewritten by the late one
+	VkDeviceAddress MeshletVisibilityPtr;
 	uint32_t textureIndex;
 	uint32_t samplerIndex;
-	uint32_t meshletCount;
-	uint32_t TransformIndex;
+	// Direct draws only
+	uint32_t InstanceIndex;
+	uint32_t Phase; // CullPhase
+	// Bindless texture/sampler of the depth pyramid, late phase only
+	uint32_t DepthPyramidIndex;
+	uint32_t DepthPyramidSamplerIndex;
+};
+
+// Maps to Engine\Shaders\cull.comp.glsl
+struct CullPipelineLayout
+{
+	VkDeviceAddress CameraDataPtr;
+	VkDeviceAddress TransformDataPtr;
+	VkDeviceAddress MeshDataPtr;
+	VkDeviceAddress InstanceDataPtr;
+	VkDeviceAddress DrawCommandsPtr;
+	VkDeviceAddress DrawCountPtr;
+	// One uint per instance, read by the early phase and rewritten by the late one
+	VkDeviceAddress InstanceVisibilityPtr;
+	uint32_t instanceCount;
+	uint32_t Phase; // CullPhase
+	uint32_t DepthPyramidIndex;
+	uint32_t DepthPyramidSamplerIndex;
+};
+
+// Maps to Engine\Shaders\visbuffer_resolve.frag.glsl
+struct VisibilityResolveLayout
+{
+	VkDeviceAddress CameraDataPtr;
+	VkDeviceAddress TransformDataPtr;
+	VkDeviceAddress MeshDataPtr;
+	VkDeviceAddress InstanceDataPtr;
+	uint32_t textureIndex;
+	uint32_t samplerIndex;
+	// Bindless texture/sampler of the visibility buffer
+	uint32_t VisibilityIndex;
+	uint32_t VisibilitySamplerIndex;
+};
+
+// Maps to Engine\Shaders\depth_reduce.comp.glsl, size of the mip being written
+struct DepthReduceLayout
+{
+	float imageSize[2];
 };
 
 struct EditorPipelineLayout
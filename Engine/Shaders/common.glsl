@@ -1,6 +1,20 @@
 #extension GL_EXT_buffer_reference : require
 #extension GL_EXT_scalar_block_layout : require
 #extension GL_ARB_gpu_shader_int64 : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Global bindless set, see PipelineManager
+layout(set = 0, binding = 0) uniform texture2D globalTextures[];
+layout(set = 0, binding = 1) uniform sampler globalSamplers[];
+
+// Matches CullPhase in Common.h
+#define CULL_PHASE_NONE 0
+#define CULL_PHASE_EARLY 1
+#define CULL_PHASE_LATE 2
+
+// Specialization constants of the meshlet pipelines, ids match MeshletSpecConstant in main.cpp.
+// Meshlets per task workgroup, one thread each: the task payload size and what the task counts divide by
+layout(constant_id = 1) const uint TaskGroupSize = 32;
 
 struct Meshlet
 {
@@ -20,6 +34,45 @@ struct CameraData
     mat4 proj;
     vec3 eyePos;
     float padding;
+    // World space, normals pointing inside: left, right, bottom, top, near, far
+    vec4 frustumPlanes[6];
+    vec2 viewportSize;
+    // Meshlets whose bounds cover fewer pixels than this are dropped by the task shader, 0 turns it off
+    float minMeshletPixels;
+    float padding2;
+};
+
+// Matches GpuMesh in GpuScene.h
+struct MeshData
+{
+    uint64_t vertexBufferAddress;
+    uint64_t meshletBufferAddress;
+    uint64_t meshletVertexBufferAddress;
+    uint64_t meshletTriangleBufferAddress;
+    uint meshletCount;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+// Matches GpuInstance in GpuScene.h
+struct InstanceData
+{
+    vec4 boundsCenterRadius;
+    uint transformIndex;
+    uint meshIndex;
+    uint meshletVisibilityOffset;
+    uint padding;
+};
+
+// Matches GpuDrawCommand in GpuScene.h, VkDrawMeshTasksIndirectCommandEXT plus the instance it draws
+struct DrawCommand
+{
+    uint groupCountX;
+    uint groupCountY;
+    uint groupCountZ;
+    uint instanceIndex;
+    uint earlyDrawn;
 };
 
 struct TransformData
@@ -31,21 +84,25 @@ struct TransformData
 };
 
 
-// I think might moved this one out of common?
-// might be somethig added at the top of the shaders that needs it?
+// Shaders with their own push constants (compute) define CUSTOM_PUSH_CONSTANTS before the include
+#ifndef CUSTOM_PUSH_CONSTANTS
 layout(push_constant) uniform Constants 
 {
-    uint64_t vertexBufferAddress;           // 8   @ 0
-    uint64_t cameraBufferAddress;           // 8   @ 8
-    uint64_t meshletBufferAddress;          // 8   @ 16
-    uint64_t meshletVertexBufferAddress;    // 8   @ 24
-    uint64_t meshletTriangleBufferAddress;  // 8   @ 32
-    uint64_t TransformDataAddress;          // 8   @ 40
-    uint     textureIndex;                  // 4   @ 44
-    uint     samplerIndex;                  // 4   @ 48
-    uint     meshletCount;                  // 4   @ 52
-    uint     TransformIndex;                // 4   @ 56
+    uint64_t cameraBufferAddress;           // 8   @ 0
+    uint64_t TransformDataAddress;          // 8   @ 8
+    uint64_t meshBufferAddress;             // 8   @ 16
+    uint64_t instanceBufferAddress;         // 8   @ 24
+    uint64_t drawCommandsAddress;           // 8   @ 32, 0 for direct draws
+    uint64_t statsBufferAddress;            // 8   @ 40, 0 when the counters are off
+    uint64_t meshletVisibilityAddress;      // 8   @ 48
+    uint     textureIndex;                  // 4   @ 56
+    uint     samplerIndex;                  // 4   @ 60
+    uint     instanceIndex;                 // 4   @ 64, direct draws only
+    uint     cullPhase;                     // 4   @ 68
+    uint     depthPyramidIndex;             // 4   @ 72, late phase only
+    uint     depthPyramidSamplerIndex;      // 4   @ 76
 } push; // 128 max
+#endif
 
 layout(buffer_reference, std430) readonly buffer CameraBufferPtr
 {
@@ -61,3 +118,149 @@ layout(buffer_reference, std430) readonly buffer TransformDataPtr
 {
     TransformData transforms[];
 };
+
+layout(buffer_reference, std430) readonly buffer MeshBufferPtr
+{
+    MeshData meshes[];
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBufferPtr
+{
+    InstanceData instances[];
+};
+
+layout(buffer_reference, std430) buffer DrawCommandPtr
+{
+    DrawCommand commands[];
+};
+
+layout(buffer_reference, std430) buffer DrawCountPtr
+{
+    uint drawCount;
+};
+
+// Instance or meshlet visibility of the last late phase, 1 visible
+layout(buffer_reference, std430) buffer VisibilityPtr
+{
+    uint visibility[];
+};
+
+// Matches MeshletCounters in PipelineStatistics.h
+layout(buffer_reference, std430) buffer MeshletStatsPtr
+{
+    uint meshletsTested;
+    uint meshletsConeCulled;
+    uint meshletsFrustumCulled;
+    uint meshletsOcclusionCulled;
+    uint meshletsSmallCulled;
+    uint triangles;
+    uint trianglesBackfaceCulled;
+    uint trianglesFrustumCulled;
+    uint trianglesSmallCulled;
+};
+
+// hash for random debug color based on the id of the meshlet
+uint pcg(uint seed)
+{
+    uint state = seed * 747796405u + 2891336453u;
+    uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+vec3 randomColor(uint seed)
+{
+    return vec3(
+        float(pcg(seed))           / float(0xFFFFFFFFu),
+        float(pcg(seed ^ 12345u))  / float(0xFFFFFFFFu),
+        float(pcg(seed * 6789u))   / float(0xFFFFFFFFu)
+    );
+}
+
+// Culling helpers, Engine\src\Culling.cpp does the same on the CPU
+
+// Biggest axis scale of the model matrix, keeps a transformed sphere conservative under non uniform scale
+float getMaxAxisScale(mat4 model)
+{
+    return max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+}
+
+bool isSphereInFrustum(CameraData camera, vec3 center, float radius)
+{
+    bool visible = true;
+    for (uint i = 0; i < 6; ++i)
+    {
+        visible = visible && dot(camera.frustumPlanes[i].xyz, center) + camera.frustumPlanes[i].w > -radius;
+    }
+    return visible;
+}
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere. Michael Mara, Morgan McGuire. 2013
+// c is view space with z forward, aabb comes back in uv space of the depth pyramid. False when the sphere
+// crosses the near plane, there is no bound then
+bool projectSphere(vec3 c, float r, float znear, float P00, float P11, out vec4 aabb)
+{
+    if (c.z < r + znear)
+    {
+        return false;
+    }
+
+    vec3 cr = c * r;
+    float czr2 = c.z * c.z - r * r;
+
+    float vx = sqrt(c.x * c.x + czr2);
+    float minx = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+    float maxx = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+
+    float vy = sqrt(c.y * c.y + czr2);
+    float miny = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+    float maxy = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+
+    // Clip space to uv, the viewport is flipped so +y is the top row
+    aabb = vec4(minx * P00, miny * P11, maxx * P00, maxy * P11);
+    aabb = aabb.xwzy * vec4(0.5, -0.5, 0.5, -0.5) + vec4(0.5);
+    return true;
+}
+
+// World space sphere covering fewer than minPixels on its longer screen side. Near plane crossings are never small
+bool isSphereSmall(CameraData camera, vec3 center, float radius, float minPixels)
+{
+    vec3 viewCenter = (camera.view * vec4(center, 1.0)).xyz;
+    viewCenter.z = -viewCenter.z;
+
+    vec4 aabb;
+    if (!projectSphere(viewCenter, radius, camera.proj[3][2], camera.proj[0][0], camera.proj[1][1], aabb))
+    {
+        return false;
+    }
+
+    vec2 size = (aabb.zw - aabb.xy) * camera.viewportSize;
+    return max(size.x, size.y) < minPixels;
+}
+
+// World space sphere against the depth pyramid (farthest depth per texel, reverse Z). Only occluded when the whole
+// sphere is behind what the pyramid holds, near plane crossings count as visible
+bool isSphereOccluded(CameraData camera, vec3 center, float radius, uint pyramidIndex, uint samplerIndex)
+{
+    vec3 viewCenter = (camera.view * vec4(center, 1.0)).xyz;
+    viewCenter.z = -viewCenter.z;
+
+    // Infinite reverse Z projection, see Camera::setPerspective
+    float znear = camera.proj[3][2];
+    vec4 aabb;
+    if (!projectSphere(viewCenter, radius, znear, camera.proj[0][0], camera.proj[1][1], aabb))
+    {
+        return false;
+    }
+
+    sampler2D pyramid = sampler2D(globalTextures[pyramidIndex], globalSamplers[samplerIndex]);
+    vec2 pyramidSize = vec2(textureSize(pyramid, 0));
+    float width = (aabb.z - aabb.x) * pyramidSize.x;
+    float height = (aabb.w - aabb.y) * pyramidSize.y;
+
+    // Mip where the bounds cover at most 2x2 texels, the min sampler reduces those
+    float level = floor(log2(max(width, height)));
+    float depth = textureLod(pyramid, (aabb.xy + aabb.zw) * 0.5, level).x;
+    float depthSphere = znear / (viewCenter.z - radius);
+
+    return depthSphere < depth;
+}
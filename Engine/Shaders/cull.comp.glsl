@@ -0,0 +1,85 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_KHR_shader_subgroup_ballot : require
+
+#define CUSTOM_PUSH_CONSTANTS
+#include "common.glsl"
+
+// Maps to CullPipelineLayout in Common.h
+layout(push_constant) uniform CullConstants
+{
+    uint64_t cameraBufferAddress;           // 8   @ 0
+    uint64_t TransformDataAddress;          // 8   @ 8
+    uint64_t meshBufferAddress;             // 8   @ 16
+    uint64_t instanceBufferAddress;         // 8   @ 24
+    uint64_t drawCommandsAddress;           // 8   @ 32
+    uint64_t drawCountAddress;              // 8   @ 40, cleared to 0 before the dispatch
+    uint64_t instanceVisibilityAddress;     // 8   @ 48
+    uint     instanceCount;                 // 4   @ 56
+    uint     cullPhase;                     // 4   @ 60
+    uint     depthPyramidIndex;             // 4   @ 64, late phase only
+    uint     depthPyramidSamplerIndex;      // 4   @ 68
+} cull;
+
+layout(local_size_x = 64) in;
+
+// One thread per instance: bounding sphere against the frustum, survivors append a mesh task command.
+// Early phase only keeps what the last late phase saw, late phase adds the depth pyramid test and rewrites the
+// instance visibility. Late emits every visible instance, the task shader skips the meshlets drawn early
+void main()
+{
+    uint instanceIndex = gl_GlobalInvocationID.x;
+
+    bool visible = false;
+    bool wasVisible = false;
+    InstanceData instance;
+    if (instanceIndex < cull.instanceCount)
+    {
+        instance = InstanceBufferPtr(cull.instanceBufferAddress).instances[instanceIndex];
+        TransformData transform = TransformDataPtr(cull.TransformDataAddress).transforms[instance.transformIndex];
+        CameraData camera = CameraBufferPtr(cull.cameraBufferAddress).camera;
+
+        vec3 center = (transform.modelMatrix * vec4(instance.boundsCenterRadius.xyz, 1.0)).xyz;
+        float radius = instance.boundsCenterRadius.w * getMaxAxisScale(transform.modelMatrix);
+        visible = isSphereInFrustum(camera, center, radius);
+
+        if (cull.cullPhase != CULL_PHASE_NONE)
+        {
+            VisibilityPtr instanceVisibility = VisibilityPtr(cull.instanceVisibilityAddress);
+            wasVisible = instanceVisibility.visibility[instanceIndex] != 0;
+            if (cull.cullPhase == CULL_PHASE_EARLY)
+            {
+                visible = visible && wasVisible;
+            }
+            else
+            {
+                visible = visible && !isSphereOccluded(camera, center, radius, cull.depthPyramidIndex,
+                                                       cull.depthPyramidSamplerIndex);
+                instanceVisibility.visibility[instanceIndex] = visible ? 1 : 0;
+            }
+        }
+    }
+
+    // One atomic per subgroup, lanes get their slot from the ballot
+    uvec4 vote = subgroupBallot(visible);
+    uint visibleCount = subgroupBallotBitCount(vote);
+    uint firstSlot = 0;
+    if (subgroupElect() && visibleCount > 0)
+    {
+        firstSlot = atomicAdd(DrawCountPtr(cull.drawCountAddress).drawCount, visibleCount);
+    }
+    firstSlot = subgroupBroadcastFirst(firstSlot);
+
+    if (visible)
+    {
+        uint meshletCount = MeshBufferPtr(cull.meshBufferAddress).meshes[instance.meshIndex].meshletCount;
+
+        DrawCommand command;
+        command.groupCountX = (meshletCount + TaskGroupSize - 1) / TaskGroupSize;
+        command.groupCountY = 1;
+        command.groupCountZ = 1;
+        command.instanceIndex = instanceIndex;
+        command.earlyDrawn = cull.cullPhase == CULL_PHASE_LATE && wasVisible ? 1 : 0;
+        DrawCommandPtr(cull.drawCommandsAddress).commands[firstSlot + subgroupBallotExclusiveBitCount(vote)] = command;
+    }
+}
@@ -0,0 +1,27 @@
+#version 460
+
+// Maps to DepthReduceLayout in Common.h
+layout(push_constant) uniform ReduceConstants
+{
+    vec2 imageSize;                         // 8   @ 0, of the mip being written
+} reduce;
+
+// Set 0 is the global bindless one, unused here
+layout(set = 1, binding = 0) uniform sampler2D inputDepth;
+layout(set = 1, binding = 1, r32f) uniform writeonly image2D outputDepth;
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// One texel of the pyramid per thread. The MIN reduction sampler returns the farthest depth of the 2x2 footprint
+// around the texel center, either the mip above or the depth buffer for mip 0
+void main()
+{
+    uvec2 position = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(vec2(position), reduce.imageSize)))
+    {
+        return;
+    }
+
+    float depth = textureLod(inputDepth, (vec2(position) + vec2(0.5)) / reduce.imageSize, 0.0).x;
+    imageStore(outputDepth, ivec2(position), vec4(depth));
+}
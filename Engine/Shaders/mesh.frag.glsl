@@ -9,9 +9,6 @@ layout(location = 0) in vec2 inUV;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 outMeshletDebugColor;
 
-layout(set = 0, binding = 0) uniform texture2D globalTextures[];
-layout(set = 0, binding = 1) uniform sampler globalSamplers[];
-
 
 layout(location = 0) out vec4 outColor;
 void main()
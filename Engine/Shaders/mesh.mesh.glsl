@@ -3,11 +3,16 @@
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
 #extension GL_KHR_shader_subgroup_ballot : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
 
 #include "common.glsl"
 
-const uint MeshletMaxVertices = 64;
-const uint MeshletMaxTriangles = 124;
+// Per triangle culling, see the triangle loop. Off compiles it out
+layout(constant_id = 0) const bool TriangleCulling = false;
+// Vertex limit the meshlets were built with (MeshletLimits), at most max_vertices below
+layout(constant_id = 3) const uint MeshletMaxVertices = 64;
+// Visibility buffer mode: per primitive IDs for visbuffer.frag instead of the shading attributes
+layout(constant_id = 4) const bool VisibilityBuffer = false;
 
 struct Vertex
 {
@@ -31,43 +36,36 @@ layout(buffer_reference, std430) readonly buffer MeshletTriangleBufferPtr
     uint triangleIndices[];
 };
 
+// Same as the task shader's
 taskPayloadSharedEXT struct TaskPayload
 {
-    uint meshletIndices[32];
+    uint instanceIndex;
+    uint transformIndex;
+    uint meshIndex;
+    uint meshletIndices[TaskGroupSize];
 } payload;
 
-layout(local_size_x = 32) in;
+// Threads per meshlet is constant_id 2. The output limits can't be specialized, they are the ceiling from Mesh.h
+layout(local_size_x = 32, local_size_x_id = 2) in;
 layout(triangles, max_vertices = 64, max_primitives = 124) out;
 
 layout(location = 0) out vec2 outUV[];
 layout(location = 1) out vec3 outNormal[];
 // I want this one just for debugging the meshlets
 layout(location = 2) out vec3 outMeshletDebugColor[];
+// Instance + 1 (0 is the cleared background), meshlet << 7 | triangle. visbuffer_resolve.frag decodes it
+layout(location = 3) perprimitiveEXT flat out uvec2 outPrimitiveId[];
 
-// hash for random debug color based on the id of the meshlet
-uint pcg(uint seed)
-{
-    uint state = seed * 747796405u + 2891336453u;
-    uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
-    return (word >> 22u) ^ word;
-}
-
-vec3 randomColor(uint seed)
-{
-    return vec3(
-        float(pcg(seed))           / float(0xFFFFFFFFu),
-        float(pcg(seed ^ 12345u))  / float(0xFFFFFFFFu),
-        float(pcg(seed * 6789u))   / float(0xFFFFFFFFu)
-    );
-}
+// Clip space positions for the triangle tests, a triangle reads vertices other threads transformed
+shared vec4 clipPositions[MeshletMaxVertices];
 
 void main()
 {
-    const uint TransformIndex = push.TransformIndex;
-    TransformData transform = TransformDataPtr(push.TransformDataAddress).transforms[TransformIndex];
+    TransformData transform = TransformDataPtr(push.TransformDataAddress).transforms[payload.transformIndex];
+    MeshData mesh = MeshBufferPtr(push.meshBufferAddress).meshes[payload.meshIndex];
     
     uint meshletIndex = payload.meshletIndices[gl_WorkGroupID.x];
-    Meshlet meshlet = MeshletBufferPtr(push.meshletBufferAddress).meshlets[meshletIndex];
+    Meshlet meshlet = MeshletBufferPtr(mesh.meshletBufferAddress).meshlets[meshletIndex];
     SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
 
     uint localIndex = gl_LocalInvocationIndex;
@@ -75,26 +73,108 @@ void main()
 
     for (uint i = localIndex; i < meshlet.vertexCount; i += gl_WorkGroupSize.x)
     {
-        uint vertexIndex = MeshletVertexBufferPtr(push.meshletVertexBufferAddress).vertexIndices[meshlet.vertexOffset + i];
-        Vertex vertex = VertexBufferPtr(push.vertexBufferAddress).vertices[vertexIndex];
+        uint vertexIndex = MeshletVertexBufferPtr(mesh.meshletVertexBufferAddress).vertexIndices[meshlet.vertexOffset + i];
+        Vertex vertex = VertexBufferPtr(mesh.vertexBufferAddress).vertices[vertexIndex];
 
         vec3 position = vec3(vertex.vx, vertex.vy, vertex.vz);
-        gl_MeshVerticesEXT[i].gl_Position = cam.proj * cam.view* transform.modelMatrix * vec4(position, 1.0);
+        vec4 clipPosition = cam.proj * cam.view* transform.modelMatrix * vec4(position, 1.0);
+        gl_MeshVerticesEXT[i].gl_Position = clipPosition;
+        if (TriangleCulling)
+        {
+            clipPositions[i] = clipPosition;
+        }
         
-        outUV[i] = vec2(vertex.tu, vertex.tv);
-        outNormal[i] = vec3(vertex.nx, vertex.ny, vertex.nz);
+        // The resolve pass rebuilds these from the IDs
+        if (!VisibilityBuffer)
+        {
+            outUV[i] = vec2(vertex.tu, vertex.tv);
+            outNormal[i] = vec3(vertex.nx, vertex.ny, vertex.nz);
+
+            // since the whole meshlet is in the same group... 
+            const vec3 debugColor = subgroupBroadcastFirst(randomColor(meshletIndex));
+            outMeshletDebugColor[i] = debugColor;
+        }
+    }
 
-        // since the whole meshlet is in the same group... 
-        const vec3 debugColor = subgroupBroadcastFirst(randomColor(meshletIndex));
-        outMeshletDebugColor[i] = debugColor;
+    if (TriangleCulling)
+    {
+        barrier();
     }
 
+    uint backfaceCulled = 0;
+    uint frustumCulled = 0;
+    uint smallCulled = 0;
     for (uint i = localIndex; i < meshlet.triangleCount; i += gl_WorkGroupSize.x)
     {
         uint triangleOffset = meshlet.triangleOffset + i * 3;
-        gl_PrimitiveTriangleIndicesEXT[i] = uvec3(
-            MeshletTriangleBufferPtr(push.meshletTriangleBufferAddress).triangleIndices[triangleOffset + 0],
-            MeshletTriangleBufferPtr(push.meshletTriangleBufferAddress).triangleIndices[triangleOffset + 1],
-            MeshletTriangleBufferPtr(push.meshletTriangleBufferAddress).triangleIndices[triangleOffset + 2]);
+        uvec3 indices = uvec3(
+            MeshletTriangleBufferPtr(mesh.meshletTriangleBufferAddress).triangleIndices[triangleOffset + 0],
+            MeshletTriangleBufferPtr(mesh.meshletTriangleBufferAddress).triangleIndices[triangleOffset + 1],
+            MeshletTriangleBufferPtr(mesh.meshletTriangleBufferAddress).triangleIndices[triangleOffset + 2]);
+        gl_PrimitiveTriangleIndicesEXT[i] = indices;
+
+        // Back facing or zero area, fully off one side of the screen, or too small to cover a pixel center.
+        // Triangles reaching behind the camera (w <= 0) are left to the clipper
+        bool culled = false;
+        if (TriangleCulling)
+        {
+            vec4 c0 = clipPositions[indices.x];
+            vec4 c1 = clipPositions[indices.y];
+            vec4 c2 = clipPositions[indices.z];
+            if (c0.w > 0.0 && c1.w > 0.0 && c2.w > 0.0)
+            {
+                vec2 p0 = c0.xy / c0.w;
+                vec2 p1 = c1.xy / c1.w;
+                vec2 p2 = c2.xy / c2.w;
+
+                // The viewport is flipped, counter clockwise with NDC y up is the front face (VK_CULL_MODE_BACK_BIT)
+                float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+                vec2 ndcMin = min(p0, min(p1, p2));
+                vec2 ndcMax = max(p0, max(p1, p2));
+                // Pixel centers sit at .5, none between the bounds on an axis means nothing gets rasterized
+                vec2 pixelMin = (ndcMin * 0.5 + 0.5) * cam.viewportSize;
+                vec2 pixelMax = (ndcMax * 0.5 + 0.5) * cam.viewportSize;
+
+                if (area <= 0.0)
+                {
+                    culled = true;
+                    ++backfaceCulled;
+                }
+                else if (any(greaterThan(ndcMin, vec2(1.0))) || any(lessThan(ndcMax, vec2(-1.0))))
+                {
+                    culled = true;
+                    ++frustumCulled;
+                }
+                else if (any(equal(round(pixelMin), round(pixelMax))))
+                {
+                    culled = true;
+                    ++smallCulled;
+                }
+            }
+        }
+        gl_MeshPrimitivesEXT[i].gl_CullPrimitiveEXT = culled;
+        if (VisibilityBuffer)
+        {
+            outPrimitiveId[i] = uvec2(payload.instanceIndex + 1, (meshletIndex << 7) | i);
+        }
+    }
+
+    // Sums are per subgroup, the workgroup can be more than one
+    uint totalBackfaceCulled = subgroupAdd(backfaceCulled);
+    uint totalFrustumCulled = subgroupAdd(frustumCulled);
+    uint totalSmallCulled = subgroupAdd(smallCulled);
+    if (push.statsBufferAddress != 0)
+    {
+        MeshletStatsPtr stats = MeshletStatsPtr(push.statsBufferAddress);
+        if (localIndex == 0)
+        {
+            atomicAdd(stats.triangles, meshlet.triangleCount);
+        }
+        if (TriangleCulling && subgroupElect())
+        {
+            atomicAdd(stats.trianglesBackfaceCulled, totalBackfaceCulled);
+            atomicAdd(stats.trianglesFrustumCulled, totalFrustumCulled);
+            atomicAdd(stats.trianglesSmallCulled, totalSmallCulled);
+        }
     }
 }
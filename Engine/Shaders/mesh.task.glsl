@@ -5,16 +5,24 @@
 
 #include "common.glsl"
 
+// Array last, a specialization constant sized member doesn't move the ones after it
 taskPayloadSharedEXT struct TaskPayload
 {
-    uint meshletIndices[32];
+    uint instanceIndex;
+    uint transformIndex;
+    uint meshIndex;
+    uint meshletIndices[TaskGroupSize];
 } payload;
 
-layout(local_size_x = 32) in;
+layout(local_size_x = 32, local_size_x_id = 1) in;
+
+// Meshlets of the workgroup that go to the mesh shader, subgroups append to it
+shared uint emittedCount;
 
 bool coneCull(vec4 coneApexCutoff, vec3 coneAxis, vec3 eyePos)
 {
-    if (coneAxis == vec3(0.0))
+    // Cutoff 1 is meshoptimizer's no usable cone
+    if (coneAxis == vec3(0.0) || coneApexCutoff.w >= 1.0)
     {
         return false;
     }
@@ -29,36 +37,126 @@ bool coneCull(vec4 coneApexCutoff, vec3 coneAxis, vec3 eyePos)
     return dot(v, coneAxis) >= cutoff * d;
 }
 
+// Meshlets get sphere vs frustum, then the normal cone, then the projected size. With occlusion culling the early phase only takes the
+// meshlets visible last frame, the late phase tests the depth pyramid too and rewrites the meshlet visibility.
+// Meshlets the early phase drew are retested in the late one but not drawn again
 void main()
 {
     uint threadId = gl_LocalInvocationID.x;
     uint meshletIndex = gl_WorkGroupID.x * gl_WorkGroupSize.x + threadId;
+    if (threadId == 0)
+    {
+        emittedCount = 0;
+    }
 
-    TransformData transform = TransformDataPtr(push.TransformDataAddress).transforms[push.TransformIndex];
+    // Indirect draws find their instance in the command the cull pass wrote
+    uint instanceIndex = push.instanceIndex;
+    bool earlyDrawn = false;
+    if (push.drawCommandsAddress != 0)
+    {
+        DrawCommand command = DrawCommandPtr(push.drawCommandsAddress).commands[gl_DrawID];
+        instanceIndex = command.instanceIndex;
+        earlyDrawn = command.earlyDrawn != 0;
+    }
+    InstanceData instance = InstanceBufferPtr(push.instanceBufferAddress).instances[instanceIndex];
+    MeshData mesh = MeshBufferPtr(push.meshBufferAddress).meshes[instance.meshIndex];
+    TransformData transform = TransformDataPtr(push.TransformDataAddress).transforms[instance.transformIndex];
 
+    // Only what this phase may draw goes in the stats
+    bool counted = false;
+    bool inFrustum = false;
+    bool frontFacing = false;
+    bool bigEnough = false;
     bool visible = false;
-    if (meshletIndex < push.meshletCount)
+    bool skip = false;
+    if (meshletIndex < mesh.meshletCount)
     {
-        Meshlet meshlet = MeshletBufferPtr(push.meshletBufferAddress).meshlets[meshletIndex];
-        vec3 worldApex = vec3(transform.modelMatrix * vec4(meshlet.coneApexCutoff.xyz, 1.0));
-        vec3 worldAxis = normalize(mat3(transform.modelMatrix) * meshlet.coneAxis.xyz);
-        vec4 worldConeApexCutoff = vec4(worldApex, meshlet.coneApexCutoff.w);
+        VisibilityPtr meshletVisibility = VisibilityPtr(push.meshletVisibilityAddress);
+        uint visibilityIndex = instance.meshletVisibilityOffset + meshletIndex;
+        bool wasVisible = push.cullPhase != CULL_PHASE_NONE && meshletVisibility.visibility[visibilityIndex] != 0;
+        skip = push.cullPhase == CULL_PHASE_LATE && earlyDrawn && wasVisible;
+
+        if (push.cullPhase != CULL_PHASE_EARLY || wasVisible)
+        {
+            Meshlet meshlet = MeshletBufferPtr(mesh.meshletBufferAddress).meshlets[meshletIndex];
+            CameraData camera = CameraBufferPtr(push.cameraBufferAddress).camera;
+
+            // Sphere first, the cone only matters for meshlets that end up on screen
+            vec3 worldCenter = vec3(transform.modelMatrix * vec4(meshlet.centerRadius.xyz, 1.0));
+            float worldRadius = meshlet.centerRadius.w * getMaxAxisScale(transform.modelMatrix);
+            inFrustum = isSphereInFrustum(camera, worldCenter, worldRadius);
 
-        visible = !coneCull(worldConeApexCutoff, worldAxis,
-        CameraBufferPtr(push.cameraBufferAddress).camera.eyePos);
+            if (inFrustum)
+            {
+                vec3 worldApex = vec3(transform.modelMatrix * vec4(meshlet.coneApexCutoff.xyz, 1.0));
+                // No cone stays a zero axis, normalize would make it NaN
+                vec3 worldAxis = meshlet.coneAxis.xyz == vec3(0.0)
+                    ? vec3(0.0)
+                    : normalize(mat3(transform.modelMatrix) * meshlet.coneAxis.xyz);
+                vec4 worldConeApexCutoff = vec4(worldApex, meshlet.coneApexCutoff.w);
+
+                frontFacing = !coneCull(worldConeApexCutoff, worldAxis, camera.eyePos);
+            }
+
+            // Far away meshlets can end up smaller than a pixel, not worth a mesh shader workgroup
+            bigEnough = frontFacing;
+            if (bigEnough && camera.minMeshletPixels > 0.0)
+            {
+                bigEnough = !isSphereSmall(camera, worldCenter, worldRadius, camera.minMeshletPixels);
+            }
+
+            visible = bigEnough;
+            if (push.cullPhase == CULL_PHASE_LATE)
+            {
+                visible = visible && !isSphereOccluded(camera, worldCenter, worldRadius, push.depthPyramidIndex,
+                                                       push.depthPyramidSamplerIndex);
+                meshletVisibility.visibility[visibilityIndex] = visible ? 1 : 0;
+            }
+            counted = !skip;
+        }
     }
 
-    uvec4 vote = subgroupBallot(visible);
-    uint visibleCount = subgroupBallotInclusiveBitCount(vote);
+    // The workgroup can span several subgroups (TaskGroupSize over the subgroup size), each one takes a range of
+    // the payload with one shared atomic. Ballots are uniform, every lane has its subgroup's totals
+    bool draw = visible && !skip;
+    uvec4 vote = subgroupBallot(draw);
     uint totalVisible = subgroupBallotBitCount(vote);
+    uint tested = subgroupBallotBitCount(subgroupBallot(counted));
+    uint totalInFrustum = subgroupBallotBitCount(subgroupBallot(counted && inFrustum));
+    uint totalFrontFacing = subgroupBallotBitCount(subgroupBallot(counted && frontFacing));
+    uint totalBigEnough = subgroupBallotBitCount(subgroupBallot(counted && bigEnough));
+
+    barrier();
 
-    if (visible)
+    uint firstSlot = 0;
+    if (subgroupElect())
     {
-        payload.meshletIndices[visibleCount - 1] = meshletIndex;
+        firstSlot = atomicAdd(emittedCount, totalVisible);
+
+        if (push.statsBufferAddress != 0 && tested > 0)
+        {
+            // One atomic per counter and subgroup
+            MeshletStatsPtr stats = MeshletStatsPtr(push.statsBufferAddress);
+            atomicAdd(stats.meshletsTested, tested);
+            atomicAdd(stats.meshletsFrustumCulled, tested - totalInFrustum);
+            atomicAdd(stats.meshletsConeCulled, totalInFrustum - totalFrontFacing);
+            atomicAdd(stats.meshletsSmallCulled, totalFrontFacing - totalBigEnough);
+            atomicAdd(stats.meshletsOcclusionCulled, totalBigEnough - totalVisible);
+        }
     }
+    firstSlot = subgroupBroadcastFirst(firstSlot);
 
+    if (draw)
+    {
+        payload.meshletIndices[firstSlot + subgroupBallotExclusiveBitCount(vote)] = meshletIndex;
+    }
     if (threadId == 0)
     {
-        EmitMeshTasksEXT(totalVisible, 1, 1);
+        payload.instanceIndex = instanceIndex;
+        payload.transformIndex = instance.transformIndex;
+        payload.meshIndex = instance.meshIndex;
     }
+
+    barrier();
+    EmitMeshTasksEXT(emittedCount, 1, 1);
 }
@@ -21,8 +21,10 @@ layout(location = 1) out vec3 outNormal;
 
 void main()
 {
-	// Get the vertex data
-    Vertex vertex = VertexBufferPtr(push.vertexBufferAddress).vertices[gl_VertexIndex];
+	// Get the vertex data, mesh buffers come from the instance like in the mesh shader path
+    InstanceData instance = InstanceBufferPtr(push.instanceBufferAddress).instances[push.instanceIndex];
+    MeshData mesh = MeshBufferPtr(push.meshBufferAddress).meshes[instance.meshIndex];
+    Vertex vertex = VertexBufferPtr(mesh.vertexBufferAddress).vertices[gl_VertexIndex];
     
     vec3 position = vec3(vertex.vx, vertex.vy, vertex.vz);
     vec3 normal = vec3(vertex.nx, vertex.ny, vertex.nz);
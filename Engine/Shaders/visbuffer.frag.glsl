@@ -0,0 +1,12 @@
+#version 460
+#extension GL_EXT_mesh_shader : require
+
+// Visibility buffer mode of the forward passes, only the IDs the mesh shader wrote per primitive. Shading is
+// done once per pixel by visbuffer_resolve.frag
+layout(location = 3) perprimitiveEXT flat in uvec2 inPrimitiveId;
+
+layout(location = 0) out uvec2 outId;
+void main()
+{
+    outId = inPrimitiveId;
+}
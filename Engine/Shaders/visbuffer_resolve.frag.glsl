@@ -0,0 +1,146 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_ARB_gpu_shader_int64 : require
+
+#define CUSTOM_PUSH_CONSTANTS
+#include "common.glsl"
+
+// Maps to VisibilityResolveLayout in Common.h
+layout(push_constant) uniform ResolveConstants
+{
+    uint64_t cameraBufferAddress;           // 8   @ 0
+    uint64_t TransformDataAddress;          // 8   @ 8
+    uint64_t meshBufferAddress;             // 8   @ 16
+    uint64_t instanceBufferAddress;         // 8   @ 24
+    uint     textureIndex;                  // 4   @ 32
+    uint     samplerIndex;                  // 4   @ 36
+    uint     visibilityIndex;               // 4   @ 40
+    uint     visibilitySamplerIndex;        // 4   @ 44
+} push;
+
+// Same bindless array as globalTextures, the visibility buffer is an integer format
+layout(set = 0, binding = 0) uniform utexture2D globalUintTextures[];
+
+struct Vertex
+{
+    float vx, vy, vz;
+    float nx, ny, nz;
+    float tu, tv;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBufferPtr
+{
+    Vertex vertices[];
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletVertexBufferPtr
+{
+    uint vertexIndices[];
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletTriangleBufferPtr
+{
+    uint triangleIndices[];
+};
+
+layout(location = 0) out vec4 outColor;
+
+// Perspective correct barycentrics of an NDC position inside a clip space triangle, plus their screen space
+// derivatives for the texture gradients. Barycentric derivatives as in The Forge's visibility buffer
+// (Schied, Dachsbacher. Deferred Attribute Interpolation for Memory-Efficient Deferred Shading. 2015)
+void computeBarycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 ndc, vec2 viewportSize,
+                         out vec3 lambda, out vec3 ddx, out vec3 ddy)
+{
+    vec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);
+    vec2 ndc0 = c0.xy * invW.x;
+    vec2 ndc1 = c1.xy * invW.y;
+    vec2 ndc2 = c2.xy * invW.z;
+
+    float invDet = 1.0 / determinant(mat2(ndc2 - ndc1, ndc0 - ndc1));
+    ddx = vec3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * invDet * invW;
+    ddy = vec3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * invDet * invW;
+    float ddxSum = dot(ddx, vec3(1.0));
+    float ddySum = dot(ddy, vec3(1.0));
+
+    vec2 delta = ndc - ndc0;
+    float interpInvW = invW.x + delta.x * ddxSum + delta.y * ddySum;
+    float interpW = 1.0 / interpInvW;
+    lambda = interpW * (vec3(invW.x, 0.0, 0.0) + delta.x * ddx + delta.y * ddy);
+
+    // NDC to pixels, y goes down the screen while NDC y goes up (flipped viewport)
+    ddx *= 2.0 / viewportSize.x;
+    ddy *= -2.0 / viewportSize.y;
+    ddxSum *= 2.0 / viewportSize.x;
+    ddySum *= -2.0 / viewportSize.y;
+
+    float interpWddx = 1.0 / (interpInvW + ddxSum);
+    float interpWddy = 1.0 / (interpInvW + ddySum);
+    ddx = interpWddx * (lambda * interpInvW + ddx) - lambda;
+    ddy = interpWddy * (lambda * interpInvW + ddy) - lambda;
+}
+
+// Material resolve of the visibility buffer: one full screen triangle, every covered pixel fetches the triangle its
+// IDs point at, rebuilds the attributes and shades like mesh.frag. Overdraw never gets here
+void main()
+{
+    uvec2 id = texelFetch(usampler2D(globalUintTextures[push.visibilityIndex], globalSamplers[push.visibilitySamplerIndex]),
+                          ivec2(gl_FragCoord.xy), 0).xy;
+    // Background, the pass cleared the color
+    if (id.x == 0)
+    {
+        discard;
+    }
+
+    uint instanceIndex = id.x - 1;
+    uint meshletIndex = id.y >> 7;
+    uint triangleIndex = id.y & 127;
+
+    InstanceData instance = InstanceBufferPtr(push.instanceBufferAddress).instances[instanceIndex];
+    MeshData mesh = MeshBufferPtr(push.meshBufferAddress).meshes[instance.meshIndex];
+    TransformData transform = TransformDataPtr(push.TransformDataAddress).transforms[instance.transformIndex];
+    Meshlet meshlet = MeshletBufferPtr(mesh.meshletBufferAddress).meshlets[meshletIndex];
+    CameraData cam = CameraBufferPtr(push.cameraBufferAddress).camera;
+
+    mat4 viewProjModel = cam.proj * cam.view * transform.modelMatrix;
+    Vertex vertices[3];
+    vec4 clipPositions[3];
+    for (uint i = 0; i < 3; ++i)
+    {
+        uint localIndex = MeshletTriangleBufferPtr(mesh.meshletTriangleBufferAddress).triangleIndices[meshlet.triangleOffset + triangleIndex * 3 + i];
+        uint vertexIndex = MeshletVertexBufferPtr(mesh.meshletVertexBufferAddress).vertexIndices[meshlet.vertexOffset + localIndex];
+        vertices[i] = VertexBufferPtr(mesh.vertexBufferAddress).vertices[vertexIndex];
+        clipPositions[i] = viewProjModel * vec4(vertices[i].vx, vertices[i].vy, vertices[i].vz, 1.0);
+    }
+
+    // Pixel center to NDC through the flipped viewport
+    vec2 ndc = vec2(gl_FragCoord.x / cam.viewportSize.x * 2.0 - 1.0, 1.0 - gl_FragCoord.y / cam.viewportSize.y * 2.0);
+    vec3 lambda;
+    vec3 ddx;
+    vec3 ddy;
+    computeBarycentrics(clipPositions[0], clipPositions[1], clipPositions[2], ndc, cam.viewportSize, lambda, ddx, ddy);
+
+    vec2 uv0 = vec2(vertices[0].tu, vertices[0].tv);
+    vec2 uv1 = vec2(vertices[1].tu, vertices[1].tv);
+    vec2 uv2 = vec2(vertices[2].tu, vertices[2].tv);
+    vec2 uv = lambda.x * uv0 + lambda.y * uv1 + lambda.z * uv2;
+    vec2 uvDdx = ddx.x * uv0 + ddx.y * uv1 + ddx.z * uv2;
+    vec2 uvDdy = ddy.x * uv0 + ddy.y * uv1 + ddy.z * uv2;
+
+    vec3 normal = lambda.x * vec3(vertices[0].nx, vertices[0].ny, vertices[0].nz) +
+                  lambda.y * vec3(vertices[1].nx, vertices[1].ny, vertices[1].nz) +
+                  lambda.z * vec3(vertices[2].nx, vertices[2].ny, vertices[2].nz);
+
+    vec4 texColor = textureGrad(
+        sampler2D(
+            globalTextures[nonuniformEXT(push.textureIndex)],
+            globalSamplers[nonuniformEXT(push.samplerIndex)]
+        ),
+        uv, uvDdx, uvDdy
+    );
+
+    // Same as mesh.frag
+    float lightIntensity = max(dot(normalize(normal), normalize(vec3(0.5, 1.0, 0.3))), 0.2);
+    outColor = vec4(randomColor(meshletIndex) * lightIntensity, texColor.a);
+}
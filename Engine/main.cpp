@@ -3,11 +3,13 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
 
-#include <Volk/volk.h>
+#include <volk.h>
 
 #include <GLFW/glfw3.h>
-#include <GLFW/glfw3native.h>
 
 #include <extern/stb/stb_image.h>
 #include "Common/Common.h"
@@ -22,23 +24,74 @@
 #include "src/Pass.h"
 #include "src/PassExecutor.h"
 #include "src/EditorLayer.h"
+#include "src/TransientAllocator.h"
+#include "src/TransientTargets.h"
+#include "src/RenderGraph.h"
+#include "src/WorkerPool.h"
+#include "src/ThreadCommandPools.h"
+#include "src/GraphSubmitter.h"
+#include "src/PassTimings.h"
+#include "src/GpuProfiler.h"
+#include "src/PipelineStatistics.h"
+#include "src/GpuScene.h"
+#include "src/DepthPyramid.h"
+#include "src/VisibilityBuffer.h"
+#include "src/InstanceBvh.h"
+#include "src/Culling.h"
+#include "src/CpuProfiler.h"
+#include "src/ChromeTrace.h"
+#include "src/FrameArena.h"
+#include "src/HeapStats.h"
 #include <imgui.h>
 
 
 constexpr uint32_t MaxTransformsPerScene = 1 << 18;
+// --meshes cap, GpuScene uploads the whole mesh table every frame
+constexpr uint32_t MaxMeshesPerScene = 4096;
+// Cap on buffer bytes the defragmenter copies each frame
+constexpr uint32_t DefragmentBytesPerFrame = 4 * 1024 * 1024;
 constexpr uint32_t StartupWidthResolution = 1920;
 constexpr uint32_t StartupHeightResolution = 1080;
+// Meshes per secondary command buffer when the main pass is recorded in parallel
+constexpr uint32_t DrawsPerRecordingChunk = 2048;
+// CPU scratch of a frame (draw lists, barrier batches...), grows on its own if a frame doesn't fit
+constexpr size_t FrameArenaBytes = 1024 * 1024;
 
 using namespace ToyEngine;
 
+// constant_id of the forward and instance cull pipelines, see common.glsl and the mesh shaders
+enum class MeshletSpecConstant : uint32_t
+{
+    TriangleCulling = 0,
+    TaskGroupSize = 1,
+    MeshGroupSize = 2,
+    MaxVertices = 3,
+    VisibilityBuffer = 4,
+    Count
+};
+
+// Visibility buffer IDs keep the triangle in the low 7 bits, see mesh.mesh.glsl
+static_assert(MeshletMaxTriangles <= 128, "Meshlet triangle index doesn't fit the visibility buffer ID");
+
 struct GpuCameraData
 {
     glm::mat4 view;
     glm::mat4 proj;
     glm::vec3 eyePos;
     float padding;
+    glm::vec4 frustumPlanes[6];
+    // Pixels, the mesh shader's small triangle test and the task shader's meshlet size test
+    glm::vec2 viewportSize;
+    float minMeshletPixels;
+    float padding2;
 };
 
+// Worst case of what a frame puts in the transient allocator: camera, every transform, the mesh table and the
+// ImGui geometry, plus up to 16 bytes of alignment for each of those 5 allocations. The counts are capped where
+// they come in, so running out is a bug (TransientAllocator aborts)
+constexpr uint32_t TransientBytesPerFrame = sizeof(GpuCameraData) + sizeof(Transform) * MaxTransformsPerScene +
+                                            sizeof(GpuMesh) * MaxMeshesPerScene + EditorLayer::MaxGeometryBytes + 5 * 16;
+
 struct Swapchain
 {
     VkSwapchainKHR swapchain = VK_NULL_HANDLE;
@@ -61,44 +114,157 @@ public:
     VkSurfaceCapabilitiesKHR SurfaceCaps;
     VkSurfaceFormatKHR surfaceFormat;
     uint32_t FamilyIndex = 0;
+    // Compute only family for async compute, ~0u if the device has none or it is disabled (--no-async-compute)
+    uint32_t ComputeFamilyIndex = ~0u;
+    bool AsyncComputeEnabled = true;
     uint32_t swapchainImagesCount = 0;
 
     Swapchain swapchain;
-    RenderTargetHandle ColorTextureHandle;
-    RenderTargetHandle DepthTextureHandle;
 
     VkPhysicalDeviceMemoryProperties PhysicalMemoryProperties;
-    VkDebugReportCallbackEXT DebugCallback;
+    bool MemoryBudgetSupported = false;
+
+    // Command line: --actors N, --threads N (recording threads, 1 records everything on the main thread),
+    // --actor-spacing S between the actors (100x100 at 30 reaches the far plane), --meshes N loads the model N times
+    // as separate meshes (load phase timing), actors cycle through them
+    uint32_t ActorCount = 10;
+    uint32_t MeshCount = 1;
+    float ActorSpacing = 25.0f;
+    uint32_t RecordingThreadCount = 1;
+    VkDebugReportCallbackEXT DebugCallback = VK_NULL_HANDLE;
+
+    // --headless: no surface or swapchain, renders --frames N into an offscreen target and prints frame timings.
+    // --width/--height set the target size, --dump writes the last frame as a PPM, --report the timings as JSON
+    bool Headless = false;
+    uint32_t HeadlessFrameCount = 300;
+    uint32_t HeadlessWarmupFrames = 10;
+    uint32_t HeadlessWidth = StartupWidthResolution;
+    uint32_t HeadlessHeight = StartupHeightResolution;
+    const char* DumpPath = nullptr;
+    const char* ReportPath = nullptr;
+    RenderTargetHandle OffscreenTarget;
+
+    // --trace N: captures N frames after the warmup into TracePath, same as the button in the profiler panel
+    uint32_t TraceFrameCount = 0;
+    const char* TracePath = "frame_trace.json";
+
+    // --cpu-draws: one direct draw per actor recorded on the CPU instead of the compute cull + indirect count draw
+    bool GpuDrivenDraws = true;
+
+    // --cull-check: runs the CPU culling reference every frame and compares it with the task shader counters
+    // (turns them on). Headless the camera also sweeps a full turn over the run, the summary is printed at the end
+    bool CullCheck = false;
+    CullingValidator cullingValidator;
+
+    // --no-occlusion: single phase frustum + cone culling. Two phase occlusion culling needs GPU driven draws and
+    // MIN reduction samplers, --cull-check turns it off too (the CPU reference has no depth pyramid)
+    bool OcclusionCulling = true;
+    DepthPyramid depthPyramid;
+
+    // --no-triangle-culling: the mesh shader emits every triangle of the meshlets it gets
+    bool TriangleCulling = true;
+
+    // --task-group-size N (meshlets per task workgroup), --mesh-group-size N (mesh shader threads per meshlet),
+    // --meshlet-size V T (meshlet build limits, at most the Mesh.h ceiling). Specialization constants of the forward
+    // and cull pipelines, clamped to the device's mesh shader limits at startup. Group sizes can change at runtime,
+    // the meshlet size only at load
+    uint32_t TaskGroupSize = 32;
+    uint32_t MeshGroupSize = 32;
+    MeshletLimits meshletLimits;
+    VkPhysicalDeviceMeshShaderPropertiesEXT MeshShaderProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT};
+
+    // Asked from the resource manager's variant cache on every graph rebuild with the current constants
+    PipelineConfig ForwardConfig{};
+    PipelineConfig CullConfig{};
+    VkPushConstantRange ForwardPushConstantRange{};
+    VkPushConstantRange CullPushConstantRange{};
+    PipelineHandle ForwardPipeline;
+    PipelineHandle CullPipeline;
+
+    // --no-small-meshlets / --small-meshlet-pixels N: task shader drops meshlets whose bounding sphere covers
+    // fewer pixels than that on screen
+    bool SmallMeshletCulling = true;
+    float SmallMeshletPixels = 1.0f;
+
+    // --visibility-buffer: the forward passes only write triangle IDs, a full screen resolve shades every pixel
+    // once afterwards (visbuffer_resolve.frag). Same culling, draws and depth as the forward path
+    bool VisibilityBufferMode = false;
+    VisibilityBuffer visibilityBuffer;
+    // Fragment shader of the forward variant in that mode
+    VkShaderModule VisibilityFs = VK_NULL_HANDLE;
+    PipelineHandle ResolvePipeline;
+
+    // --stats: pipeline statistics and meshlet counters on from the start, headless puts them in the report
+    bool StatisticsEnabled = false;
+
+    // Refit every frame after the transforms, the crosshair pick below is its ray query
+    InstanceBvh instanceBvh;
+    BvhRayHit CrosshairHit;
+    bool CrosshairHitValid = false;
 
     GpuContext gpuContext;
     PipelineManager pipeline_manager;
     ResourceManager resourceManager;
     Camera camera;
 
-    BufferHandle cameraBufferHandle;
-    BufferHandle TransformBufferHandle;
+    // Per frame data (camera, transforms, imgui...) is suballocated from here
+    TransientAllocator transientAllocator;
+    TransientTargetPool transientTargets;
 
     Scene scene;
+    GpuScene gpuScene;
     EditorLayer editorLayer;
 
-    // Naive manual implementation for now 
+    // Works out barriers/layouts and transient target lifetimes. Only rebuilt when the swapchain changes,
+    // every frame just rebinds the acquired swapchain image
+    RenderGraph renderGraph;
+    GraphResource BackbufferResource = InvalidGraphResource;
+    // Draw commands + count of this frame, only imported with GPU driven draws
+    GraphResource DrawCommandsResource = InvalidGraphResource;
+    GraphResource DrawCountResource = InvalidGraphResource;
+    // Two phase occlusion culling only: late draw list, visibility carried between frames and the depth pyramid
+    GraphResource LateDrawCommandsResource = InvalidGraphResource;
+    GraphResource LateDrawCountResource = InvalidGraphResource;
+    GraphResource InstanceVisibilityResource = InvalidGraphResource;
+    GraphResource MeshletVisibilityResource = InvalidGraphResource;
+    GraphResource DepthPyramidResource = InvalidGraphResource;
+    // Visibility buffer mode only
+    GraphResource VisibilityResource = InvalidGraphResource;
+    GraphResource DepthResource = InvalidGraphResource;
+    bool FrameGraphDirty = true;
     PassExecutor passExecutor;
+
+    WorkerPool workerPool;
+    ThreadCommandPools threadCommandPools;
+    GraphSubmitter graphSubmitter;
+    GpuProfiler gpuProfiler;
+    PipelineStatistics pipelineStatistics;
+    PassTimings passTimings;
+    FrameArena frameArena;
     
     void MainLoop();
     void InitInstance();
     void SelectPhysicalDevice();
     void CreateDevice();
+    bool IsDeviceExtensionSupported(const char* extensionName);
     void CreateSurface();
     void GetSwapchainFormat();
 
     void CreateSwapchain();
-    void CreateDepthTexture();
+    void CreateOffscreenTarget();
+    void DumpOffscreenTarget(const char* path);
+    void ReportHeadlessTimings(std::vector<float>& frameTimes);
+    void WriteFrameTrace();
+    // cullPasses and indirectPasses are indexed by CullPhase
+    void BuildFrameGraph(const Pass& mainPass, const Pass* cullPasses, const Pass* indirectPasses,
+                         const Pass& depthPyramidPass, const Pass& resolvePass, const Pass& editorPass);
+    void ClampMeshletSettings();
+    void UpdateMeshletPipelines();
     uint32_t selectMemoryType(const uint32_t memoryTypeBits, VkMemoryPropertyFlags flags);
     uint32_t getGraphicsQueueFamily();
+    void getAsyncComputeQueueFamily();
     void RegisterDebugCallback();
-
-    static VkImageMemoryBarrier ImageBarrier(VkImage Image, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
-                                             VkImageLayout oldLayout, VkImageLayout newLayout);
+    bool IsInstanceExtensionSupported(const char* extensionName);
 };
 
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
@@ -133,31 +299,34 @@ void EngineInstance::RegisterDebugCallback()
     VK_CHECK(vkCreateDebugReportCallbackEXT(Instance, &CreateInfo, 0, &DebugCallback));
 }
 
-VkImageMemoryBarrier EngineInstance::ImageBarrier(VkImage Image, VkAccessFlags srcAccessMask,
-                                                  VkAccessFlags dstAccessMask,
-                                                  VkImageLayout oldLayout, VkImageLayout newLayout)
+bool EngineInstance::IsInstanceExtensionSupported(const char* extensionName)
 {
-    VkImageMemoryBarrier Result = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-    Result.srcAccessMask = srcAccessMask;
-    Result.dstAccessMask = dstAccessMask;
-    Result.oldLayout = oldLayout;
-    Result.newLayout = newLayout;
-    Result.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    Result.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    Result.image = Image;
-    Result.subresourceRange.aspectMask = (dstAccessMask == VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
-                                             ? VK_IMAGE_ASPECT_DEPTH_BIT
-                                             : VK_IMAGE_ASPECT_COLOR_BIT;
-    Result.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-    Result.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-    return Result;
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 void EngineInstance::InitInstance()
 {
+    if (Headless)
+    {
+        // Null platform needs no display server, the window below only exists for GLFW input/ImGui bookkeeping
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    glfwWindowHint(GLFW_RESIZABLE, Headless ? GLFW_FALSE : GLFW_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, Headless ? GLFW_FALSE : GLFW_TRUE);
     volkInitialize();
 
     VkApplicationInfo ApplicationInfo{VK_STRUCTURE_TYPE_APPLICATION_INFO};
@@ -166,11 +335,24 @@ void EngineInstance::InitInstance()
     VkInstanceCreateInfo InstanceInfo{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
     InstanceInfo.pApplicationInfo = &ApplicationInfo;
 
-    const char* Extensions[] = {
-        VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME, VK_EXT_DEBUG_REPORT_EXTENSION_NAME
-    };
-    InstanceInfo.ppEnabledExtensionNames = Extensions;
-    InstanceInfo.enabledExtensionCount = ARRAY_SIZE(Extensions);
+    // Surface extensions come from GLFW for whatever platform it runs on, none at all headless
+    std::vector<const char*> Extensions;
+    if (!Headless)
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        assert(glfwExtensions);
+        Extensions.insert(Extensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
+
+    // Not every driver/loader combo has it (CI software rasterizers), validation output is optional
+    const bool debugReportSupported = IsInstanceExtensionSupported(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    if (debugReportSupported)
+    {
+        Extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+    }
+    InstanceInfo.ppEnabledExtensionNames = Extensions.data();
+    InstanceInfo.enabledExtensionCount = (uint32_t)Extensions.size();
 
 #ifdef _DEBUG
     const char* DebugLayers[] = {"VK_LAYER_KHRONOS_validation"};
@@ -180,19 +362,25 @@ void EngineInstance::InitInstance()
 
     VK_CHECK(vkCreateInstance(&InstanceInfo, nullptr, &Instance));
     volkLoadInstance(Instance);
-    RegisterDebugCallback();
+    if (debugReportSupported)
+    {
+        RegisterDebugCallback();
+    }
 
     uint32_t DeviceCount = 0;
     vkEnumeratePhysicalDevices(Instance, &DeviceCount, nullptr);
     PhysicalDevices.resize(DeviceCount);
     vkEnumeratePhysicalDevices(Instance, &DeviceCount, PhysicalDevices.data());
 
-    window = glfwCreateWindow(StartupWidthResolution, StartupHeightResolution, "ToyEngine", 0, 0);
+    const uint32_t windowWidth = Headless ? HeadlessWidth : StartupWidthResolution;
+    const uint32_t windowHeight = Headless ? HeadlessHeight : StartupHeightResolution;
+    window = glfwCreateWindow(windowWidth, windowHeight, "ToyEngine", 0, 0);
     glfwSetWindowUserPointer(window, this);
     glfwSetScrollCallback(window, ScrollCallback);
 
     SelectPhysicalDevice();
     getGraphicsQueueFamily();
+    getAsyncComputeQueueFamily();
     CreateDevice();
     volkLoadDevice(Device);
 
@@ -201,33 +389,34 @@ void EngineInstance::InitInstance()
     gpuContext.m_memoryProperties = PhysicalMemoryProperties;
     vkGetDeviceQueue(Device, FamilyIndex, 0, &gpuContext.m_graphicsQueue);
     gpuContext.m_graphicsFamilyIndex = FamilyIndex;
+    if (ComputeFamilyIndex != ~0u)
+    {
+        vkGetDeviceQueue(Device, ComputeFamilyIndex, 0, &gpuContext.m_computeQueue);
+        gpuContext.m_computeFamilyIndex = ComputeFamilyIndex;
+    }
 
-    resourceManager.init(gpuContext);
+    resourceManager.init(gpuContext, MemoryBudgetSupported);
     gpuContext.m_commandPool = resourceManager.createCommandPool(FamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
     pipeline_manager.init(Device);
 
-    camera.setPerspective(70.f, (float)StartupWidthResolution / (float)StartupHeightResolution);
+    camera.setPerspective(70.f, (float)windowWidth / (float)windowHeight);
     camera.update();
 
-    cameraBufferHandle = resourceManager.createBuffer(sizeof(GpuCameraData),
-                                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
-                                                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    // Not the best, since this one is mapped to cpu, so first will got it working,
-    // then will update with a gpu only buffer
-    TransformBufferHandle = resourceManager.createBuffer(sizeof(Transform) * MaxTransformsPerScene,
-                                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
-                                                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    CreateSurface();
-    GetSwapchainFormat();
-    CreateSwapchain();
-
-    editorLayer.init(gpuContext, &resourceManager, window, surfaceFormat.format);
+    transientAllocator.init(resourceManager, TransientBytesPerFrame, MaxFramesInFlight);
+    transientTargets.init(gpuContext, resourceManager);
+
+    if (Headless)
+    {
+        CreateOffscreenTarget();
+    }
+    else
+    {
+        CreateSurface();
+        GetSwapchainFormat();
+        CreateSwapchain();
+    }
+
+    editorLayer.init(gpuContext, &resourceManager, &transientAllocator, window, surfaceFormat.format);
 }
 
 void EngineInstance::SelectPhysicalDevice()
@@ -247,26 +436,91 @@ void EngineInstance::SelectPhysicalDevice()
     vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &PhysicalMemoryProperties);
 }
 
+bool EngineInstance::IsDeviceExtensionSupported(const char* extensionName)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(PhysicalDevice, nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void EngineInstance::CreateDevice()
 {
     constexpr float QueuePriorities[] = {1.0f};
-    VkDeviceQueueCreateInfo DeviceQueueCreateInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-    DeviceQueueCreateInfo.queueFamilyIndex = FamilyIndex;
-    DeviceQueueCreateInfo.queueCount = 1;
-    DeviceQueueCreateInfo.pQueuePriorities = QueuePriorities;
+    VkDeviceQueueCreateInfo DeviceQueueCreateInfos[2] = {};
+    uint32_t QueueCreateInfoCount = 0;
+    for (uint32_t family : {FamilyIndex, ComputeFamilyIndex})
+    {
+        if (family == ~0u)
+        {
+            continue;
+        }
+        VkDeviceQueueCreateInfo& DeviceQueueCreateInfo = DeviceQueueCreateInfos[QueueCreateInfoCount++];
+        DeviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        DeviceQueueCreateInfo.queueFamilyIndex = family;
+        DeviceQueueCreateInfo.queueCount = 1;
+        DeviceQueueCreateInfo.pQueuePriorities = QueuePriorities;
+    }
+
+    std::vector<const char*> Extensions = {VK_EXT_MESH_SHADER_EXTENSION_NAME};
+    if (!Headless)
+    {
+        Extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    // Optional, memory stats just show our own accounting without it
+    MemoryBudgetSupported = IsDeviceExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (MemoryBudgetSupported)
+    {
+        Extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
-    const char* Extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_EXT_MESH_SHADER_EXTENSION_NAME};
     VkDeviceCreateInfo DeviceCreateInfo{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-    DeviceCreateInfo.queueCreateInfoCount = 1;
-    DeviceCreateInfo.pQueueCreateInfos = &DeviceQueueCreateInfo;
-    DeviceCreateInfo.ppEnabledExtensionNames = Extensions;
-    DeviceCreateInfo.enabledExtensionCount = ARRAY_SIZE(Extensions);
+    DeviceCreateInfo.queueCreateInfoCount = QueueCreateInfoCount;
+    DeviceCreateInfo.pQueueCreateInfos = DeviceQueueCreateInfos;
+    DeviceCreateInfo.ppEnabledExtensionNames = Extensions.data();
+    DeviceCreateInfo.enabledExtensionCount = (uint32_t)Extensions.size();
+
+    // Optional, pipeline statistics are skipped without them
+    VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshShaderFeatures{
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT
+    };
+    VkPhysicalDeviceVulkan12Features supportedFeatures12{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    supportedMeshShaderFeatures.pNext = &supportedFeatures12;
+    VkPhysicalDeviceFeatures2 supportedFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    supportedFeatures.pNext = &supportedMeshShaderFeatures;
+    vkGetPhysicalDeviceFeatures2(PhysicalDevice, &supportedFeatures);
+    gpuContext.m_pipelineStatisticsQuery = supportedFeatures.features.pipelineStatisticsQuery == VK_TRUE;
+    gpuContext.m_inheritedQueries = supportedFeatures.features.inheritedQueries == VK_TRUE;
+    gpuContext.m_meshShaderQueries = gpuContext.m_pipelineStatisticsQuery &&
+        supportedMeshShaderFeatures.meshShaderQueries == VK_TRUE;
+    // Optional too, occlusion culling is off without it
+    gpuContext.m_samplerFilterMinmax = supportedFeatures12.samplerFilterMinmax == VK_TRUE;
+
+    // Limits the meshlet specialization constants get clamped to, see ClampMeshletSettings
+    VkPhysicalDeviceProperties2 properties2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    properties2.pNext = &MeshShaderProperties;
+    vkGetPhysicalDeviceProperties2(PhysicalDevice, &properties2);
 
     VkPhysicalDeviceVulkan13Features features13{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
     features13.synchronization2 = VK_TRUE;
     features13.dynamicRendering = VK_TRUE;
     features13.maintenance4 = VK_TRUE;
 
+    // gl_DrawID in the task shader, indirect draws find their instance with it
+    VkPhysicalDeviceVulkan11Features features11{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+    features11.shaderDrawParameters = VK_TRUE;
+    features11.pNext = &features13;
+
     VkPhysicalDeviceVulkan12Features features12{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
     features12.runtimeDescriptorArray = VK_TRUE;
     features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
@@ -275,17 +529,22 @@ void EngineInstance::CreateDevice()
     features12.bufferDeviceAddress = VK_TRUE;
     features12.timelineSemaphore = VK_TRUE;
     features12.drawIndirectCount = VK_TRUE;
-    features12.pNext = &features13;
+    features12.hostQueryReset = VK_TRUE;
+    features12.samplerFilterMinmax = gpuContext.m_samplerFilterMinmax ? VK_TRUE : VK_FALSE;
+    features12.pNext = &features11;
 
     VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{
         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT
     };
     meshShaderFeatures.taskShader = VK_TRUE;
     meshShaderFeatures.meshShader = VK_TRUE;
+    meshShaderFeatures.meshShaderQueries = gpuContext.m_meshShaderQueries ? VK_TRUE : VK_FALSE;
     meshShaderFeatures.pNext = &features12;
 
     VkPhysicalDeviceFeatures2 features2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
     features2.features.shaderInt64 = VK_TRUE;
+    features2.features.pipelineStatisticsQuery = gpuContext.m_pipelineStatisticsQuery ? VK_TRUE : VK_FALSE;
+    features2.features.inheritedQueries = gpuContext.m_inheritedQueries ? VK_TRUE : VK_FALSE;
     features2.pNext = &meshShaderFeatures;
     DeviceCreateInfo.pNext = &features2;
 
@@ -294,10 +553,7 @@ void EngineInstance::CreateDevice()
 
 void EngineInstance::CreateSurface()
 {
-    VkWin32SurfaceCreateInfoKHR WindowCreateInfo{VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR};
-    WindowCreateInfo.hinstance = GetModuleHandle(0);
-    WindowCreateInfo.hwnd = glfwGetWin32Window(window);
-    vkCreateWin32SurfaceKHR(Instance, &WindowCreateInfo, nullptr, &surface);
+    VK_CHECK(glfwCreateWindowSurface(Instance, window, nullptr, &surface));
 }
 
 void EngineInstance::GetSwapchainFormat()
@@ -318,23 +574,294 @@ void EngineInstance::GetSwapchainFormat()
     }
 }
 
-void EngineInstance::CreateDepthTexture()
+// Group sizes to what the device takes, meshlet limits to the compiled ceiling and the device output limits
+void EngineInstance::ClampMeshletSettings()
+{
+    const VkPhysicalDeviceMeshShaderPropertiesEXT& limits = MeshShaderProperties;
+    // Payload is three indices plus one meshlet index per task thread
+    const uint32_t maxPayloadGroupSize = limits.maxTaskPayloadSize / (uint32_t)sizeof(uint32_t) - 3;
+    TaskGroupSize = std::clamp(TaskGroupSize, 1u, std::min({limits.maxTaskWorkGroupInvocations,
+                                                            limits.maxTaskWorkGroupSize[0], maxPayloadGroupSize}));
+    MeshGroupSize = std::clamp(MeshGroupSize, 1u, std::min(limits.maxMeshWorkGroupInvocations,
+                                                           limits.maxMeshWorkGroupSize[0]));
+
+    meshletLimits.m_maxVertices = std::clamp(meshletLimits.m_maxVertices, 3u,
+                                             std::min(MeshletMaxVertices, limits.maxMeshOutputVertices));
+    meshletLimits.m_maxTriangles = std::clamp(meshletLimits.m_maxTriangles, 4u,
+                                              std::min(MeshletMaxTriangles, limits.maxMeshOutputPrimitives));
+    meshletLimits.m_maxTriangles &= ~3u;
+
+    printf("Meshlets: %u per task workgroup, %u mesh threads, %u vertices / %u triangles "
+           "(device prefers %u task / %u mesh threads)\n",
+           TaskGroupSize, MeshGroupSize, meshletLimits.m_maxVertices, meshletLimits.m_maxTriangles,
+           limits.maxPreferredTaskWorkGroupInvocations, limits.maxPreferredMeshWorkGroupInvocations);
+}
+
+// Current variants out of the cache, a setting toggled back and forth only creates each pipeline once. The old
+// handles are released after the new ones are taken, an unchanged variant keeps its reference
+void EngineInstance::UpdateMeshletPipelines()
+{
+    PipelineConfig forwardConfig = ForwardConfig;
+    forwardConfig.m_specConstants[(uint32_t)MeshletSpecConstant::TriangleCulling] = TriangleCulling ? 1 : 0;
+    forwardConfig.m_specConstants[(uint32_t)MeshletSpecConstant::TaskGroupSize] = TaskGroupSize;
+    forwardConfig.m_specConstants[(uint32_t)MeshletSpecConstant::MeshGroupSize] = MeshGroupSize;
+    forwardConfig.m_specConstants[(uint32_t)MeshletSpecConstant::MaxVertices] = meshletLimits.m_maxVertices;
+    forwardConfig.m_specConstants[(uint32_t)MeshletSpecConstant::VisibilityBuffer] = VisibilityBufferMode ? 1 : 0;
+    if (VisibilityBufferMode)
+    {
+        forwardConfig.m_fragmentShader = VisibilityFs;
+        forwardConfig.m_colorFormat = VisibilityBuffer::Format;
+    }
+    forwardConfig.m_specConstantCount = (uint32_t)MeshletSpecConstant::Count;
+
+    // Only the task counts of the indirect commands depend on the constants
+    PipelineConfig cullConfig = CullConfig;
+    cullConfig.m_specConstants[(uint32_t)MeshletSpecConstant::TaskGroupSize] = TaskGroupSize;
+    cullConfig.m_specConstantCount = (uint32_t)MeshletSpecConstant::TaskGroupSize + 1;
+
+    const PipelineHandle forwardPipeline = resourceManager.createPipeline(
+        forwardConfig, pipeline_manager.getGlobalDescriptorSetLayout(), { ForwardPushConstantRange });
+    const PipelineHandle cullPipeline = resourceManager.createPipeline(
+        cullConfig, pipeline_manager.getGlobalDescriptorSetLayout(), { CullPushConstantRange });
+    resourceManager.destroyPipeline(ForwardPipeline);
+    resourceManager.destroyPipeline(CullPipeline);
+    ForwardPipeline = forwardPipeline;
+    CullPipeline = cullPipeline;
+}
+
+// Instance cull (GPU driven only) -> main forward -> editor on top -> copy to the swapchain (or the offscreen target
+// headless). With occlusion culling the cull + forward pair runs twice: early cull/forward on what was visible
+// last frame, depth pyramid of that (on the async compute queue when there is one), late cull/forward on the rest.
+// Barriers, layouts, queue ownership transfers and the transient target lifetimes all come out of the graph compile.
+// In visibility buffer mode the forward passes write IDs instead of color and a full screen resolve shades them
+// before the editor. The swapchain image, the draw buffers, the pyramid
+// and the visibility buffer are bound per frame
+void EngineInstance::BuildFrameGraph(const Pass& mainPass, const Pass* cullPasses, const Pass* indirectPasses,
+                                     const Pass& depthPyramidPass, const Pass& resolvePass, const Pass& editorPass)
 {
-    if (DepthTextureHandle.isValid())
+    UpdateMeshletPipelines();
+    renderGraph.reset();
+    renderGraph.setQueueFamilies(FamilyIndex, ComputeFamilyIndex);
+
+    TransientTargetDesc colorDesc;
+    colorDesc.m_width = swapchain.width;
+    colorDesc.m_height = swapchain.height;
+    colorDesc.m_format = surfaceFormat.format;
+    colorDesc.m_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    colorDesc.m_aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    GraphResource color = renderGraph.createTransientImage("Color", colorDesc);
+
+    // Nothing to cull or draw without instances, the draw buffers don't even exist then
+    const bool gpuDriven = GpuDrivenDraws && gpuScene.getInstanceCount() > 0;
+    const bool occlusion = gpuDriven && OcclusionCulling && !CullCheck && gpuContext.m_samplerFilterMinmax;
+
+    TransientTargetDesc depthDesc;
+    depthDesc.m_width = swapchain.width;
+    depthDesc.m_height = swapchain.height;
+    depthDesc.m_format = VK_FORMAT_D32_SFLOAT;
+    // The depth pyramid samples it
+    depthDesc.m_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    depthDesc.m_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    GraphResource depth = renderGraph.createTransientImage("Depth", depthDesc);
+    DepthResource = depth;
+
+    // Acquire semaphore is waited on the transfer stage, the copy is the only thing touching the swapchain.
+    // Headless the same copy lands on the offscreen target, left ready for the readback
+    GraphResource backbuffer = renderGraph.importImage(Headless ? "Offscreen" : "Swapchain", VK_NULL_HANDLE,
+                                                       VK_NULL_HANDLE, swapchain.width, swapchain.height,
+                                                       surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT,
+                                                       VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                                       Headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                                : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    BackbufferResource = backbuffer;
+
+    DrawCommandsResource = InvalidGraphResource;
+    DrawCountResource = InvalidGraphResource;
+    LateDrawCommandsResource = InvalidGraphResource;
+    LateDrawCountResource = InvalidGraphResource;
+    InstanceVisibilityResource = InvalidGraphResource;
+    MeshletVisibilityResource = InvalidGraphResource;
+    DepthPyramidResource = InvalidGraphResource;
+    if (gpuDriven)
     {
-        resourceManager.destroyRenderTarget(DepthTextureHandle);
+        DrawCommandsResource = renderGraph.importBuffer("DrawCommands", VK_NULL_HANDLE);
+        DrawCountResource = renderGraph.importBuffer("DrawCount", VK_NULL_HANDLE);
     }
-    DepthTextureHandle = resourceManager.createRenderTarget(swapchain.width, swapchain.height, VK_FORMAT_D32_SFLOAT,
-                                                            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                                                            VK_IMAGE_ASPECT_DEPTH_BIT);
+    if (occlusion)
+    {
+        LateDrawCommandsResource = renderGraph.importBuffer("LateDrawCommands", VK_NULL_HANDLE);
+        LateDrawCountResource = renderGraph.importBuffer("LateDrawCount", VK_NULL_HANDLE);
+        // Kept across frames: last frame's late cull/forward wrote them, this frame's early phase reads them first
+        InstanceVisibilityResource = renderGraph.importBuffer("InstanceVisibility", VK_NULL_HANDLE,
+                                                              VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+                                                              VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT,
+                                                              VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+        MeshletVisibilityResource = renderGraph.importBuffer("MeshletVisibility", VK_NULL_HANDLE,
+                                                             VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+                                                             VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT,
+                                                             VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+        // Rebuilt from scratch every frame, only last frame's late cull/forward reads have to be done with it
+        depthPyramid.resize(swapchain.width, swapchain.height);
+        DepthPyramidResource = renderGraph.importImage("DepthPyramid", VK_NULL_HANDLE, VK_NULL_HANDLE,
+                                                       depthPyramid.getWidth(), depthPyramid.getHeight(),
+                                                       VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT,
+                                                       VK_IMAGE_LAYOUT_UNDEFINED,
+                                                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+                                                       VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT,
+                                                       VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+
+    // Persistent so the resolve can sample it through the bindless set, nothing is kept between frames
+    VisibilityResource = InvalidGraphResource;
+    if (VisibilityBufferMode)
+    {
+        visibilityBuffer.resize(swapchain.width, swapchain.height);
+        VisibilityResource = renderGraph.importImage("VisibilityBuffer", VK_NULL_HANDLE, VK_NULL_HANDLE,
+                                                     visibilityBuffer.getWidth(), visibilityBuffer.getHeight(),
+                                                     VisibilityBuffer::Format, VK_IMAGE_ASPECT_COLOR_BIT,
+                                                     VK_IMAGE_LAYOUT_UNDEFINED,
+                                                     VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                     VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                                                     VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+
+    // Count is cleared with a fill inside the pass, then appended to by the dispatch
+    auto addCullPass = [&](CullPhase phase, GraphResource drawCommands, GraphResource drawCount)
+    {
+        Pass cull = cullPasses[(uint32_t)phase];
+        cull.pipeline = CullPipeline;
+        cull.writes = {
+            {drawCommands, ResourceUsage::StorageWrite},
+            {drawCount, ResourceUsage::TransferDst},
+            {drawCount, ResourceUsage::StorageWrite}
+        };
+        if (phase == CullPhase::Early)
+        {
+            cull.reads = {{InstanceVisibilityResource, ResourceUsage::StorageRead}};
+        }
+        else if (phase == CullPhase::Late)
+        {
+            cull.reads = {{DepthPyramidResource, ResourceUsage::ShaderRead}};
+            cull.writes.push_back({InstanceVisibilityResource, ResourceUsage::StorageWrite});
+        }
+        renderGraph.addPass(cull);
+    };
+
+    // Task shader reads its instance back from the command
+    auto addForwardPass = [&](const Pass& forwardPass, CullPhase phase, GraphResource drawCommands,
+                              GraphResource drawCount, VkAttachmentLoadOp loadOp)
+    {
+        Pass forward = forwardPass;
+        forward.pipeline = ForwardPipeline;
+        if (drawCommands != InvalidGraphResource)
+        {
+            forward.reads = {
+                {drawCommands, ResourceUsage::IndirectRead},
+                {drawCommands, ResourceUsage::StorageRead},
+                {drawCount, ResourceUsage::IndirectRead}
+            };
+        }
+        if (phase == CullPhase::Early)
+        {
+            forward.reads.push_back({MeshletVisibilityResource, ResourceUsage::StorageRead});
+        }
+        else if (phase == CullPhase::Late)
+        {
+            forward.reads.push_back({DepthPyramidResource, ResourceUsage::ShaderRead});
+            forward.writes = {{MeshletVisibilityResource, ResourceUsage::StorageWrite}};
+        }
+        forward.colorAttachments = {
+            {color, loadOp, VK_ATTACHMENT_STORE_OP_STORE, {{0.1f, 0.01f, 0.01f, 1.0f}}}
+        };
+        if (VisibilityBufferMode)
+        {
+            // IDs clear to 0, the background of the resolve
+            forward.colorAttachments[0] = {VisibilityResource, loadOp, VK_ATTACHMENT_STORE_OP_STORE, {}};
+        }
+        // The early depth feeds the pyramid and the late forward
+        forward.depthAttachment = {
+            depth, loadOp, phase == CullPhase::Early ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            {0.0f, 0} // reverse depth buffer, clears to 0
+        };
+        forward.useDepth = true;
+        renderGraph.addPass(forward);
+    };
+
+    if (occlusion)
+    {
+        addCullPass(CullPhase::Early, DrawCommandsResource, DrawCountResource);
+        addForwardPass(indirectPasses[(uint32_t)CullPhase::Early], CullPhase::Early, DrawCommandsResource,
+                       DrawCountResource, VK_ATTACHMENT_LOAD_OP_CLEAR);
+
+        Pass pyramid = depthPyramidPass;
+        pyramid.reads = {{depth, ResourceUsage::ShaderRead}};
+        pyramid.writes = {{DepthPyramidResource, ResourceUsage::StorageWrite}};
+        renderGraph.addPass(pyramid);
+
+        addCullPass(CullPhase::Late, LateDrawCommandsResource, LateDrawCountResource);
+        addForwardPass(indirectPasses[(uint32_t)CullPhase::Late], CullPhase::Late, LateDrawCommandsResource,
+                       LateDrawCountResource, VK_ATTACHMENT_LOAD_OP_LOAD);
+    }
+    else if (gpuDriven)
+    {
+        addCullPass(CullPhase::None, DrawCommandsResource, DrawCountResource);
+        addForwardPass(indirectPasses[(uint32_t)CullPhase::None], CullPhase::None, DrawCommandsResource,
+                       DrawCountResource, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }
+    else
+    {
+        addForwardPass(mainPass, CullPhase::None, InvalidGraphResource, InvalidGraphResource,
+                       VK_ATTACHMENT_LOAD_OP_CLEAR);
+    }
+
+    if (VisibilityBufferMode)
+    {
+        Pass resolve = resolvePass;
+        resolve.reads = {{VisibilityResource, ResourceUsage::ShaderRead}};
+        resolve.colorAttachments = {
+            {color, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {{0.1f, 0.01f, 0.01f, 1.0f}}}
+        };
+        renderGraph.addPass(resolve);
+    }
+
+    Pass editor = editorPass;
+    editor.colorAttachments = {{color, VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_STORE, {}}};
+    renderGraph.addPass(editor);
+
+    Pass copyPass;
+    copyPass.name = "CopyToSwapchain";
+    copyPass.type = PassType::Transfer;
+    copyPass.reads = {{color, ResourceUsage::TransferSrc}};
+    copyPass.writes = {{backbuffer, ResourceUsage::TransferDst}};
+    copyPass.execute = [color, backbuffer](VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
+        {
+            const GraphImage& src = ctx.graph.getImage(color);
+            const GraphImage& dst = ctx.graph.getImage(backbuffer);
+
+            VkImageCopy copyRegion{};
+            copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            copyRegion.extent = {dst.width, dst.height, 1};
+            vkCmdCopyImage(cmd, src.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        };
+    renderGraph.addPass(copyPass);
+
+    renderGraph.compile();
+    renderGraph.allocateTransients(transientTargets, resourceManager);
 }
 
+// No device idle here, the old views and swapchain are destroyed once the frames in flight are done with them
 void EngineInstance::CreateSwapchain()
 {
-    vkDeviceWaitIdle(Device);
     if (swapchain.swapchain != VK_NULL_HANDLE)
     {
-        for (auto imageView : swapchain.imageviews) vkDestroyImageView(Device, imageView, nullptr);
+        resourceManager.deferDestruction([device = Device, imageviews = swapchain.imageviews]()
+        {
+            for (auto imageView : imageviews) vkDestroyImageView(device, imageView, nullptr);
+        });
     }
 
     int Width, Height;
@@ -358,7 +885,10 @@ void EngineInstance::CreateSwapchain()
     VK_CHECK(vkCreateSwapchainKHR(Device, &SwapchainCreateInfo, nullptr, &LocalSwapchain));
     if (swapchain.swapchain != VK_NULL_HANDLE)
     {
-        vkDestroySwapchainKHR(Device, swapchain.swapchain, nullptr);
+        resourceManager.deferDestruction([device = Device, oldSwapchain = swapchain.swapchain]()
+        {
+            vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+        });
     }
 
     swapchain.swapchain = LocalSwapchain;
@@ -380,16 +910,211 @@ void EngineInstance::CreateSwapchain()
     }
     swapchain.width = Width;
     swapchain.height = Height;
-    CreateDepthTexture();
+    FrameGraphDirty = true;
+}
 
-    if (ColorTextureHandle.isValid())
+// Stands in for the swapchain headless, same format and size bookkeeping so the rest of the frame doesn't care
+void EngineInstance::CreateOffscreenTarget()
+{
+    surfaceFormat = {VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+    OffscreenTarget = resourceManager.createRenderTarget(HeadlessWidth, HeadlessHeight, surfaceFormat.format,
+                                                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                                         VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                                         VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                                         VK_IMAGE_ASPECT_COLOR_BIT);
+    swapchain.width = HeadlessWidth;
+    swapchain.height = HeadlessHeight;
+    FrameGraphDirty = true;
+}
+
+// Binary PPM of the last frame, expects the device idle and the target in TRANSFER_SRC (graph final layout)
+void EngineInstance::DumpOffscreenTarget(const char* path)
+{
+    const RenderTarget* target = resourceManager.getRenderTarget(OffscreenTarget);
+    const uint32_t size = target->m_width * target->m_height * 4;
+    BufferHandle readbackHandle = resourceManager.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                               nullptr, MemoryCategory::Upload);
+    Buffer* readback = resourceManager.getBuffer(readbackHandle);
+
+    VkCommandBufferAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandPool = gpuContext.m_commandPool;
+    allocateInfo.commandBufferCount = 1;
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    VK_CHECK(vkAllocateCommandBuffers(Device, &allocateInfo, &cmd));
+
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+    // Last frame's copy has to be visible to this one
+    VkMemoryBarrier2 memoryBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memoryBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    memoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+    VkDependencyInfo dependencyInfo{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &memoryBarrier;
+    vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {target->m_width, target->m_height, 1};
+    vkCmdCopyImageToBuffer(cmd, target->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback->m_buffer, 1, &region);
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    VK_CHECK(vkQueueSubmit(gpuContext.m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE));
+    vkQueueWaitIdle(gpuContext.m_graphicsQueue);
+    vkFreeCommandBuffers(Device, gpuContext.m_commandPool, 1, &cmd);
+
+    FILE* file = fopen(path, "wb");
+    if (file)
+    {
+        // BGRA -> RGB, values are already sRGB encoded
+        fprintf(file, "P6\n%u %u\n255\n", target->m_width, target->m_height);
+        const uint8_t* pixels = (const uint8_t*)readback->m_data;
+        std::vector<uint8_t> row(target->m_width * 3);
+        for (uint32_t y = 0; y < target->m_height; ++y)
+        {
+            for (uint32_t x = 0; x < target->m_width; ++x)
+            {
+                const uint8_t* pixel = pixels + (y * target->m_width + x) * 4;
+                row[x * 3 + 0] = pixel[2];
+                row[x * 3 + 1] = pixel[1];
+                row[x * 3 + 2] = pixel[0];
+            }
+            fwrite(row.data(), 1, row.size(), file);
+        }
+        fclose(file);
+        printf("Headless: wrote %s\n", path);
+    }
+    else
+    {
+        printf("Headless: could not open %s\n", path);
+    }
+
+    resourceManager.destroyBuffer(readbackHandle);
+}
+
+// Sorts frameTimes in place. Timings are CPU wall time per frame, which includes waiting on the GPU once the
+// frames in flight are full, so it tracks whichever side is the bottleneck
+void EngineInstance::WriteFrameTrace()
+{
+    ChromeTraceWriter writer;
+    if (!writer.open(TracePath))
+    {
+        return;
+    }
+
+    CpuProfiler::writeTrace(writer);
+    gpuProfiler.writeTrace(writer, CpuProfiler::getCaptureBeginMs(), CpuProfiler::getCaptureEndMs());
+    writer.close();
+    printf("Trace: %.2f ms captured to %s\n", CpuProfiler::getCaptureEndMs() - CpuProfiler::getCaptureBeginMs(),
+           TracePath);
+}
+
+void EngineInstance::ReportHeadlessTimings(std::vector<float>& frameTimes)
+{
+    if (frameTimes.empty())
+    {
+        printf("Headless: no frames measured (%u frames, %u warmup)\n", HeadlessFrameCount, HeadlessWarmupFrames);
+        return;
+    }
+
+    double total = 0.0;
+    for (float frameTime : frameTimes)
+    {
+        total += frameTime;
+    }
+    std::sort(frameTimes.begin(), frameTimes.end());
+    auto percentile = [&frameTimes](float p)
+        {
+            return frameTimes[std::min((size_t)(p * (float)frameTimes.size()), frameTimes.size() - 1)];
+        };
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(PhysicalDevice, &properties);
+
+    const float average = (float)(total / (double)frameTimes.size());
+    printf("Headless: %zu frames measured (%u warmup) at %ux%u on %s\n", frameTimes.size(), HeadlessWarmupFrames,
+           swapchain.width, swapchain.height, properties.deviceName);
+    printf("Frame time: avg %.3f ms, min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n", average, frameTimes.front(),
+           percentile(0.5f), percentile(0.95f), percentile(0.99f), frameTimes.back());
+
+    const std::vector<uint32_t>& order = renderGraph.getExecutionOrder();
+    for (uint32_t passIndex : order)
+    {
+        const PassTiming& timing = passTimings.get(passIndex);
+        if (timing.m_gpuValid)
+        {
+            printf("  %-20s cpu %.3f ms, gpu %.3f ms\n", renderGraph.getPass(passIndex).name.c_str(), timing.m_cpuMs,
+                   timing.m_gpuMs);
+        }
+        else
+        {
+            printf("  %-20s cpu %.3f ms\n", renderGraph.getPass(passIndex).name.c_str(), timing.m_cpuMs);
+        }
+    }
+
+    if (!ReportPath)
+    {
+        return;
+    }
+
+    FILE* file = fopen(ReportPath, "w");
+    if (!file)
+    {
+        printf("Headless: could not open %s\n", ReportPath);
+        return;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"device\": \"%s\",\n", properties.deviceName);
+    fprintf(file, "  \"width\": %u,\n", swapchain.width);
+    fprintf(file, "  \"height\": %u,\n", swapchain.height);
+    fprintf(file, "  \"actors\": %u,\n", ActorCount);
+    fprintf(file, "  \"meshes\": %u,\n", MeshCount);
+    fprintf(file, "  \"threads\": %u,\n", workerPool.getThreadCount());
+    fprintf(file, "  \"frames\": %zu,\n", frameTimes.size());
+    fprintf(file, "  \"warmupFrames\": %u,\n", HeadlessWarmupFrames);
+    fprintf(file, "  \"visibilityBuffer\": %s,\n", VisibilityBufferMode ? "true" : "false");
+    fprintf(file, "  \"asyncPasses\": %u,\n", renderGraph.getAsyncPassCount());
+    fprintf(file, "  \"submits\": %u,\n", graphSubmitter.getSubmitCount());
+    fprintf(file, "  \"frameMs\": { \"avg\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+            average, frameTimes.front(), percentile(0.5f), percentile(0.95f), percentile(0.99f), frameTimes.back());
+    fprintf(file, "  \"passes\": [\n");
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        const PassTiming& timing = passTimings.get(order[i]);
+        fprintf(file, "    { \"name\": \"%s\", \"queue\": \"%s\", \"cpuMs\": %.4f", renderGraph.getPass(order[i]).name.c_str(),
+                getQueueTypeName(renderGraph.getPassQueue(i)), timing.m_cpuMs);
+        if (timing.m_gpuValid)
+        {
+            fprintf(file, ", \"gpuMs\": %.4f", timing.m_gpuMs);
+        }
+        fprintf(file, " }%s\n", i + 1 < order.size() ? "," : "");
+    }
+    fprintf(file, "  ]");
+    if (pipelineStatistics.isEnabled())
     {
-        resourceManager.destroyRenderTarget(ColorTextureHandle);
+        // Last frame read back, the camera doesn't move headless unless --cull-check sweeps it
+        const MeshletCounters& counters = pipelineStatistics.getMeshletCounters();
+        fprintf(file, ",\n  \"smallMeshletPixels\": %.2f,\n", SmallMeshletCulling ? SmallMeshletPixels : 0.0f);
+        fprintf(file, "  \"meshlets\": { \"tested\": %u, \"frustumCulled\": %u, \"coneCulled\": %u, "
+                "\"smallCulled\": %u, \"occlusionCulled\": %u },\n", counters.m_tested, counters.m_frustumCulled,
+                counters.m_coneCulled, counters.m_smallCulled, counters.m_occlusionCulled);
+        fprintf(file, "  \"triangles\": { \"drawn\": %u, \"backfaceCulled\": %u, \"frustumCulled\": %u, "
+                "\"smallCulled\": %u }", counters.m_triangles, counters.m_trianglesBackfaceCulled,
+                counters.m_trianglesFrustumCulled, counters.m_trianglesSmallCulled);
     }
-    ColorTextureHandle = resourceManager.createRenderTarget(swapchain.width, swapchain.height, surfaceFormat.format,
-                                                            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-                                                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-                                                            VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+    fprintf(file, "\n}\n");
+    fclose(file);
 }
 
 uint32_t EngineInstance::getGraphicsQueueFamily()
@@ -409,12 +1134,36 @@ uint32_t EngineInstance::getGraphicsQueueFamily()
     return -1;
 }
 
+// A family with compute but no graphics is the one that runs concurrently with the graphics queue
+void EngineInstance::getAsyncComputeQueueFamily()
+{
+    ComputeFamilyIndex = ~0u;
+    if (!AsyncComputeEnabled)
+    {
+        return;
+    }
+
+    uint32_t queueCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &queueCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queues(queueCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(PhysicalDevice, &queueCount, queues.data());
+    for (uint32_t i = 0; i < queueCount; ++i)
+    {
+        if ((queues[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queues[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            ComputeFamilyIndex = i;
+            return;
+        }
+    }
+}
+
 void EngineInstance::MainLoop()
 {
-    const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
-    VkSemaphore acquireSemaphores[MAX_FRAMES_IN_FLIGHT];
-    VkSemaphore submitSemaphores[MAX_FRAMES_IN_FLIGHT];
-    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    CpuProfiler::setThreadName("Main");
+
+    VkSemaphore acquireSemaphores[MaxFramesInFlight];
+    VkSemaphore submitSemaphores[MaxFramesInFlight];
+    for (uint32_t i = 0; i < MaxFramesInFlight; ++i)
     {
         acquireSemaphores[i] = resourceManager.createBinarySemaphore();
         submitSemaphores[i] = resourceManager.createBinarySemaphore();
@@ -423,117 +1172,314 @@ void EngineInstance::MainLoop()
     VkSemaphore timelineSemaphore = resourceManager.createSemaphore(0);
     uint64_t timelineValue = 0;
 
-    VkCommandPool commandPools[MAX_FRAMES_IN_FLIGHT];
-    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
-    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-    {
-        commandPools[i] = resourceManager.createCommandPool(FamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
-        VkCommandBufferAllocateInfo AllocateInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-        AllocateInfo.commandPool = commandPools[i];
-        AllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        AllocateInfo.commandBufferCount = 1;
-        vkAllocateCommandBuffers(Device, &AllocateInfo, &commandBuffers[i]);
-    }
+    // Per frame command pools for both queues live in there
+    graphSubmitter.init(resourceManager, gpuContext);
+    printf("Async compute queue: %s\n", graphSubmitter.hasAsyncCompute() ? "yes" : "no");
+    gpuProfiler.init(gpuContext);
+    frameArena.init(FrameArenaBytes);
+
+    workerPool.init(RecordingThreadCount);
+    instanceBvh.init();
+    pipelineStatistics.init(resourceManager, gpuContext, workerPool.getThreadCount() > 1);
+    pipelineStatistics.setEnabled(CullCheck || StatisticsEnabled);
+    threadCommandPools.init(resourceManager, Device, FamilyIndex, workerPool.getThreadCount());
+    printf("Recording on %u threads\n", workerPool.getThreadCount());
 
     VkShaderModule MeshTask = Pipeline::loadShader(Device, "Shaders/mesh.task.spv");
     VkShaderModule MeshMesh = Pipeline::loadShader(Device, "Shaders/mesh.mesh.spv");
     VkShaderModule MeshFs = Pipeline::loadShader(Device, "Shaders/mesh.frag.spv");
+    VkShaderModule CullCs = Pipeline::loadShader(Device, "Shaders/cull.comp.spv");
+    VkShaderModule DepthReduceCs = Pipeline::loadShader(Device, "Shaders/depth_reduce.comp.spv");
+    VisibilityFs = Pipeline::loadShader(Device, "Shaders/visbuffer.frag.spv");
+    VkShaderModule FullscreenVs = Pipeline::loadShader(Device, "Shaders/fullscreen.vert.spv");
+    VkShaderModule VisibilityResolveFs = Pipeline::loadShader(Device, "Shaders/visbuffer_resolve.frag.spv");
+
+    depthPyramid.init(gpuContext, resourceManager, pipeline_manager, DepthReduceCs);
+    visibilityBuffer.init(gpuContext, resourceManager, pipeline_manager);
+    if (!gpuContext.m_samplerFilterMinmax)
+    {
+        OcclusionCulling = false;
+        printf("No MIN reduction samplers, occlusion culling disabled\n");
+    }
 
-    
-    Mesh* testMesh = new Mesh();
-    testMesh->loadFromObj("assets/models/kitten.obj");
+    // Load phase, every upload below ends up on a single staging arena + submit
+    double loadStart = glfwGetTime();
+    resourceManager.beginUploadBatch();
+
+    // Meshlets get built for the limits that come out of this
+    ClampMeshletSettings();
+    std::vector<Mesh*> meshes(MeshCount);
+    for (Mesh*& mesh : meshes)
+    {
+        mesh = new Mesh();
+        mesh->loadFromObj("assets/models/kitten.obj", meshletLimits);
+    }
 
     TextureHandle texture = resourceManager.loadTexture("assets/models/Dragon_Bump_Col2.jpg");
     pipeline_manager.AddTextureToGlobalDescriptorSet(*resourceManager.getTexture(texture));
 
-    BufferHandle vb = resourceManager.createBuffer((uint32_t)(testMesh->m_vertices.size() * sizeof(Vertex)),
-                                                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                                                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, testMesh->m_vertices.data());
-
-    BufferHandle meshletBuffer = resourceManager.createBuffer((uint32_t)(testMesh->m_meshlets.size() * sizeof(Meshlet)),
-                                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-                                                              VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                              testMesh->m_meshlets.data());
-
-    BufferHandle meshletVertexBuffer = resourceManager.createBuffer(
-        (uint32_t)(testMesh->m_meshletVertices.size() * sizeof(uint32_t)),
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, testMesh->m_meshletVertices.data());
+    // Mesh buffers and the mesh table entries the instances point at
+    for (Mesh* mesh : meshes)
+    {
+        gpuScene.addMesh(resourceManager, *mesh);
+    }
 
-    BufferHandle meshletTriangleBuffer = resourceManager.createBuffer(
-        (uint32_t)(testMesh->m_meshletTriangles.size() * sizeof(uint32_t)),
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, testMesh->m_meshletTriangles.data());
+    const uint32_t uploadCount = resourceManager.getUploadBatch().getUploadCount();
+    const uint64_t stagedBytes = resourceManager.getUploadBatch().getStagedBytes();
+    resourceManager.submitUploadBatch();
+    printf("Load phase: %.2f ms, %u meshes, %u uploads, %.2f MB staged\n", (glfwGetTime() - loadStart) * 1000.0,
+           MeshCount, uploadCount, (double)stagedBytes / (1024.0 * 1024.0));
 
-    for(uint32_t i = 0; i < 10; ++i)
+    // Rows of 100 along x, extra rows go back on z
+    assert(ActorCount <= MaxTransformsPerScene);
+    for(uint32_t i = 0; i < ActorCount; ++i)
     {
+        Mesh* testMesh = meshes[i % MeshCount];
         Actor dragonActor = scene.createActor();
         dragonActor.addComponent<Mesh*>(testMesh);
         
         Transform& transformData = scene.transformSystem.getTransform(dragonActor);
         transformData.m_scale = glm::vec4(60.0, 60.0, 60.0, 1.0);
-        transformData.m_position = glm::vec4(0.0 + i * 25, 0.0, 0.0, 1.0);
+        transformData.m_position = glm::vec4((i % 100) * ActorSpacing, 0.0f, (i / 100) * ActorSpacing, 1.0f);
+        scene.transformSystem.setLocalBounds(dragonActor, testMesh->m_boundsCenter, testMesh->m_boundsRadius);
     }
-
-    // Main pass config
-    PipelineConfig config{};
-    config.m_taskShader = MeshTask;
-    config.m_meshShader = MeshMesh;
-    config.m_fragmentShader = MeshFs;
-    config.m_colorFormat = surfaceFormat.format;
-    config.m_useMeshShaders = true;
+    gpuScene.buildInstances(resourceManager, scene);
+
+    // Main pass config, the specialization constants go in at UpdateMeshletPipelines
+    ForwardConfig.m_taskShader = MeshTask;
+    ForwardConfig.m_meshShader = MeshMesh;
+    ForwardConfig.m_fragmentShader = MeshFs;
+    ForwardConfig.m_colorFormat = surfaceFormat.format;
+    ForwardConfig.m_useMeshShaders = true;
     
-    VkPushConstantRange mainPushConstantRange{};
-    mainPushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    mainPushConstantRange.offset = 0;
-    mainPushConstantRange.size = sizeof(DefaultPipelineLayout);
+    ForwardPushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    ForwardPushConstantRange.offset = 0;
+    ForwardPushConstantRange.size = sizeof(DefaultPipelineLayout);
+
+    // Both are transient allocations, addresses change every frame
+    VkDeviceAddress cameraDataAddress = 0;
+    VkDeviceAddress transformDataAddress = 0;
+    // CPU path, instances that passed the frustum test this frame. On the frame arena
+    const uint32_t* cpuVisibleInstances = nullptr;
+
+    // GPU driven path: one thread per instance tests its bounding sphere against the frustum and appends a mesh
+    // task command, the forward pass then draws whatever made it with a single indirect count draw.
+    // With occlusion culling that is done twice per frame, see BuildFrameGraph
+    CullConfig.m_computeShader = CullCs;
+
+    CullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    CullPushConstantRange.offset = 0;
+    CullPushConstantRange.size = sizeof(CullPipelineLayout);
+
+    // Graph rebuilds ask again, the passes below only start out with these
+    UpdateMeshletPipelines();
+
+    // Visibility buffer resolve, full screen triangle without depth
+    PipelineConfig resolveConfig{};
+    resolveConfig.m_vertexShader = FullscreenVs;
+    resolveConfig.m_fragmentShader = VisibilityResolveFs;
+    resolveConfig.m_colorFormat = surfaceFormat.format;
+    resolveConfig.m_depthFormat = VK_FORMAT_UNDEFINED;
+    resolveConfig.m_depthTest = false;
+    resolveConfig.m_depthWrite = false;
+    resolveConfig.m_cullMode = VK_CULL_MODE_NONE;
+
+    VkPushConstantRange resolvePushConstantRange{};
+    resolvePushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    resolvePushConstantRange.offset = 0;
+    resolvePushConstantRange.size = sizeof(VisibilityResolveLayout);
+    ResolvePipeline = resourceManager.createPipeline(resolveConfig, pipeline_manager.getGlobalDescriptorSetLayout(),
+                                                     { resolvePushConstantRange });
 
     Pass mainPass;
     mainPass.name = "MainForwardPass";
-    mainPass.pipeline = resourceManager.createPipeline(config, pipeline_manager.getGlobalDescriptorSetLayout(), { mainPushConstantRange });
-    mainPass.execute = [vb, meshletBuffer, meshletVertexBuffer, meshletTriangleBuffer, CameraBufferHandle = cameraBufferHandle, TransformBufferHandle = TransformBufferHandle, texture](
-        VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
+    mainPass.pipeline = ForwardPipeline;
+    // CPU path (--cpu-draws), one direct draw per visible instance. The world bounds are culled before recording,
+    // recordItems only walks the survivors and can index them from any thread
+    mainPass.chunkSize = DrawsPerRecordingChunk;
+    mainPass.prepare = [&gpuScene = gpuScene, &camera = camera, &cpuVisibleInstances](const Pass& pass,
+                                                                                       PassContext& ctx)
         {
-            // obviously not ideal, we could multidraw indirect if mesh is the same
-            // but this is not on that stage yet 
-            auto view = ctx.scene.getRegistry().view<Mesh*, TransformIndex>();            
-            for (const auto& [entity, mesh, transformIndex]  : view.each())
+            TOY_PROFILE_SCOPE("CPU instance culling");
+            glm::vec4 planes[6];
+            camera.getFrustumPlanes(planes);
+
+            // One byte per transform slot, instances look theirs up
+            const SphereBoundsSoA& bounds = ctx.scene.transformSystem.WorldBounds;
+            uint8_t* visibility = ctx.frameArena->allocateArray<uint8_t>(bounds.size());
+            cullSpheres(bounds, planes, visibility);
+
+            const uint32_t instanceCount = gpuScene.getInstanceCount();
+            uint32_t* visible = ctx.frameArena->allocateArray<uint32_t>(instanceCount);
+            uint32_t visibleCount = 0;
+            for (uint32_t i = 0; i < instanceCount; ++i)
+            {
+                if (visibility[gpuScene.getInstance(i).m_transformIndex])
+                {
+                    visible[visibleCount++] = i;
+                }
+            }
+            cpuVisibleInstances = visible;
+            return visibleCount;
+        };
+    mainPass.recordItems = [&gpuScene = gpuScene, &cameraDataAddress, &transformDataAddress, &cpuVisibleInstances,
+                            &taskGroupSize = TaskGroupSize, texture](
+        VkCommandBuffer cmd, const Pass& pass, PassContext& ctx, uint32_t first, uint32_t last)
+        {
+            // Lookups only read the resource manager, fine from several recording threads
+            Texture* mainTexture = ctx.resourceManager.getTexture(texture);
+            Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
+            const VkDeviceAddress meshletCounterAddress = ctx.pipelineStats
+                ? ctx.pipelineStats->getMeshletCounterAddress()
+                : 0;
+
+            DefaultPipelineLayout push = {
+                cameraDataAddress, transformDataAddress, gpuScene.getMeshTableAddress(),
+                gpuScene.getInstanceAddress(), 0, meshletCounterAddress, 0, mainTexture->m_bindlessIndex, 0, 0,
+                (uint32_t)CullPhase::None, 0, 0
+            };
+
+            for (uint32_t i = first; i < last; ++i)
+            {
+                const uint32_t instanceIndex = cpuVisibleInstances[i];
+                const GpuInstance& instance = gpuScene.getInstance(instanceIndex);
+                const uint32_t meshletCount = gpuScene.getMesh(instance.m_meshIndex).m_meshletCount;
+
+                push.InstanceIndex = instanceIndex;
+                vkCmdPushConstants(cmd, pipeline->getLayout(), pipeline->getPipelineStageMask(), 0,
+                                   sizeof(DefaultPipelineLayout), &push);
+                vkCmdDrawMeshTasksEXT(cmd, divideAndRoundUp(meshletCount, taskGroupSize), 1, 1);
+            }
+        };
+
+    // Frame slot being recorded, the depth pyramid writes its descriptors on it
+    uint32_t recordFrameIndex = 0;
+
+    // Indexed by CullPhase. None is single phase frustum culling, Early/Late the two phase occlusion culling
+    const char* cullPassNames[] = {"InstanceCullPass", "EarlyInstanceCullPass", "LateInstanceCullPass"};
+    const char* forwardPassNames[] = {"MainForwardPass", "EarlyForwardPass", "LateForwardPass"};
+    Pass cullPasses[3];
+    Pass indirectPasses[3];
+    for (uint32_t phaseIndex = 0; phaseIndex < 3; ++phaseIndex)
+    {
+        const CullPhase phase = (CullPhase)phaseIndex;
+        const DrawList drawList = phase == CullPhase::Late ? DrawList::Late : DrawList::Early;
+
+        Pass& cullPass = cullPasses[phaseIndex];
+        cullPass.name = cullPassNames[phaseIndex];
+        cullPass.type = PassType::Compute;
+        cullPass.pipeline = CullPipeline;
+        cullPass.execute = [&gpuScene = gpuScene, &depthPyramid = depthPyramid, &cameraDataAddress,
+                            &transformDataAddress, phase, drawList](
+            VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
             {
-                uint32_t meshletCount = (uint32_t)mesh->m_meshlets.size();
-
-                Buffer* vertexBuffer = ctx.resourceManager.getBuffer(vb);
-                Buffer* cameraBuffer = ctx.resourceManager.getBuffer(CameraBufferHandle);
-                Buffer* meshlets = ctx.resourceManager.getBuffer(meshletBuffer);
-                Buffer* Transform = ctx.resourceManager.getBuffer(TransformBufferHandle);
-                Buffer* meshletVertices = ctx.resourceManager.getBuffer(meshletVertexBuffer);
-                Buffer* meshletTriangles = ctx.resourceManager.getBuffer(meshletTriangleBuffer);
+                const uint32_t instanceCount = gpuScene.getInstanceCount();
+                if (instanceCount == 0)
+                {
+                    return;
+                }
+                const Buffer* drawCommands = gpuScene.getDrawCommands(drawList);
+                const Buffer* drawCount = gpuScene.getDrawCount(drawList);
+                Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
+
+                // The graph only syncs between passes, the clear -> append dependency is ours. The early phase
+                // also picks up the visibility the previous frame's late phase wrote, the graph doesn't see
+                // across frames
+                vkCmdFillBuffer(cmd, drawCount->m_buffer, 0, sizeof(uint32_t), 0);
+                VkMemoryBarrier2 clearBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+                clearBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+                clearBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+                clearBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+                clearBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+                if (phase == CullPhase::Early)
+                {
+                    clearBarrier.srcStageMask |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+                        VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+                    clearBarrier.srcAccessMask |= VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+                    clearBarrier.dstStageMask |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+                }
+                VkDependencyInfo dependencyInfo{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+                dependencyInfo.memoryBarrierCount = 1;
+                dependencyInfo.pMemoryBarriers = &clearBarrier;
+                vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+
+                const Buffer* instanceVisibility = gpuScene.getInstanceVisibility();
+                CullPipelineLayout push = {
+                    cameraDataAddress, transformDataAddress, gpuScene.getMeshTableAddress(),
+                    gpuScene.getInstanceAddress(), drawCommands->m_gpuAddress, drawCount->m_gpuAddress,
+                    instanceVisibility->m_gpuAddress, instanceCount, (uint32_t)phase,
+                    depthPyramid.getBindlessIndex(), depthPyramid.getSamplerIndex()
+                };
+                vkCmdPushConstants(cmd, pipeline->getLayout(), pipeline->getPipelineStageMask(), 0,
+                                   sizeof(CullPipelineLayout), &push);
+                vkCmdDispatch(cmd, divideAndRoundUp(instanceCount, 64), 1, 1);
+            };
+
+        Pass& indirectPass = indirectPasses[phaseIndex];
+        indirectPass.name = forwardPassNames[phaseIndex];
+        indirectPass.pipeline = mainPass.pipeline;
+        indirectPass.execute = [&gpuScene = gpuScene, &depthPyramid = depthPyramid, &cameraDataAddress,
+                                &transformDataAddress, texture, phase, drawList](
+            VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
+            {
+                const uint32_t instanceCount = gpuScene.getInstanceCount();
+                if (instanceCount == 0)
+                {
+                    return;
+                }
+                const Buffer* drawCommands = gpuScene.getDrawCommands(drawList);
+                const Buffer* drawCount = gpuScene.getDrawCount(drawList);
                 Texture* mainTexture = ctx.resourceManager.getTexture(texture);
+                Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
+                const VkDeviceAddress meshletCounterAddress = ctx.pipelineStats
+                    ? ctx.pipelineStats->getMeshletCounterAddress()
+                    : 0;
 
                 DefaultPipelineLayout push = {
-                    vertexBuffer->m_gpuAddress, cameraBuffer->m_gpuAddress,
-                    meshlets->m_gpuAddress, meshletVertices->m_gpuAddress,
-                    meshletTriangles->m_gpuAddress, Transform->m_gpuAddress, mainTexture->m_bindlessIndex, 0,
-                    meshletCount, transformIndex.index
+                    cameraDataAddress, transformDataAddress, gpuScene.getMeshTableAddress(),
+                    gpuScene.getInstanceAddress(), drawCommands->m_gpuAddress, meshletCounterAddress,
+                    gpuScene.getMeshletVisibility()->m_gpuAddress, mainTexture->m_bindlessIndex, 0, 0,
+                    (uint32_t)phase, depthPyramid.getBindlessIndex(), depthPyramid.getSamplerIndex()
                 };
-
-                Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
                 vkCmdPushConstants(cmd, pipeline->getLayout(), pipeline->getPipelineStageMask(), 0,
                                    sizeof(DefaultPipelineLayout), &push);
+                vkCmdDrawMeshTasksIndirectCountEXT(cmd, drawCommands->m_buffer, 0, drawCount->m_buffer, 0,
+                                                   instanceCount, sizeof(GpuDrawCommand));
+            };
+    }
 
-                // The idea is to get a list of drawcommands at this stage automatically?
-                // It should be an isolated chunk of gpu commands that can be
-                // executed on parallel and the whole thing should live in this lambda
-                //
-                // Input should be some list of already pre filtered meshes + transforms?
-                // Push constant values, we might get some other variable to fill
-                // later then will assign stuff to the needed DefaultPipelineLayout, maybe?
-                // vkCmdDrawMeshTasksIndirectCountEXT();
-                
-                
-                vkCmdDrawMeshTasksEXT(cmd, divideAndRoundUp(meshletCount, 32), 1, 1);
-            }
+    // Between the two phases: farthest depth of what the early phase drew, the late cull tests against it
+    Pass depthPyramidPass;
+    depthPyramidPass.name = "DepthPyramidPass";
+    depthPyramidPass.type = PassType::Compute;
+    // Only samples depth and writes the pyramid, no mesh shader stages involved. Stays on graphics without a compute
+    // only queue family (or with --no-async-compute)
+    depthPyramidPass.queue = QueueType::AsyncCompute;
+    depthPyramidPass.pipeline = depthPyramid.getReducePipeline();
+    depthPyramidPass.execute = [&depthPyramid = depthPyramid, &recordFrameIndex, &depthResource = DepthResource](
+        VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
+        {
+            depthPyramid.build(cmd, ctx.graph.getImage(depthResource).view, recordFrameIndex);
+        };
+
+    // Visibility buffer mode only: shades every covered pixel once from the IDs the forward passes wrote
+    Pass resolvePass;
+    resolvePass.name = "VisibilityResolvePass";
+    resolvePass.pipeline = ResolvePipeline;
+    resolvePass.execute = [&gpuScene = gpuScene, &visibilityBuffer = visibilityBuffer, &cameraDataAddress,
+                           &transformDataAddress, texture](VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
+        {
+            Texture* mainTexture = ctx.resourceManager.getTexture(texture);
+            Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
+
+            VisibilityResolveLayout push = {
+                cameraDataAddress, transformDataAddress, gpuScene.getMeshTableAddress(),
+                gpuScene.getInstanceAddress(), mainTexture->m_bindlessIndex, 0,
+                visibilityBuffer.getBindlessIndex(), visibilityBuffer.getSamplerIndex()
+            };
+            vkCmdPushConstants(cmd, pipeline->getLayout(), pipeline->getPipelineStageMask(), 0,
+                               sizeof(VisibilityResolveLayout), &push);
+            vkCmdDraw(cmd, 3, 1, 0, 0);
         };
 
     Pass editorPass;
@@ -546,20 +1492,232 @@ void EngineInstance::MainLoop()
             editorLayer.render(cmd, swapchain.width, swapchain.height);
         };
 
+    DefragmentStats defragmentStats;
+    double recordMs = 0.0;
+    uint32_t recordedSecondaries = 0;
+    uint64_t frameHeapAllocations = 0;
+    uint64_t heapAllocationsAtFrameStart = getHeapAllocationCount();
+
+    // Headless only, reserved up front so the measured frames don't allocate
+    std::vector<float> headlessFrameTimes;
+    headlessFrameTimes.reserve(HeadlessFrameCount);
+    uint32_t frameNumber = 0;
+
     double lastFrame = glfwGetTime();
-    while (!glfwWindowShouldClose(window))
+    while (Headless ? frameNumber < HeadlessFrameCount : !glfwWindowShouldClose(window))
     {
         double currentFrame = glfwGetTime();
         float deltaTime = (float)(currentFrame - lastFrame);
         lastFrame = currentFrame;
-        glfwPollEvents();
+
+        // Starts and stops captures, workers are idle here
+        if (CpuProfiler::beginFrame())
+        {
+            WriteFrameTrace();
+        }
+        if (TraceFrameCount > 0 && frameNumber == HeadlessWarmupFrames)
+        {
+            CpuProfiler::requestCapture(TraceFrameCount);
+        }
+        TOY_PROFILE_SCOPE("Frame");
+
+        // Everything the previous frame put on the arena is recorded already
+        frameArena.reset();
+        frameHeapAllocations = getHeapAllocationCount() - heapAllocationsAtFrameStart;
+        heapAllocationsAtFrameStart = getHeapAllocationCount();
+
+        {
+            TOY_PROFILE_SCOPE("glfwPollEvents");
+            glfwPollEvents();
+        }
 
         editorLayer.beginFrame();
 
         ImGui::Begin("Engine Stats");
         ImGui::Text("Delta Time: %.3f ms (%.1f FPS)", deltaTime * 1000.0f, 1.0f / deltaTime);
+        const TransientMemoryReport& transientReport = transientTargets.getReport();
+        ImGui::Text("Transient targets: %.2f MB (%.2f MB saved by aliasing)",
+                    (double)transientReport.m_aliasedBytes / (1024.0 * 1024.0),
+                    (double)transientReport.getSavedBytes() / (1024.0 * 1024.0));
+        ImGui::Text("Render graph: %u passes (%u culled, %u async), %u submits, compiled %u times",
+                    renderGraph.getPassCount(), renderGraph.getCulledPassCount(), renderGraph.getAsyncPassCount(),
+                    graphSubmitter.getSubmitCount(), renderGraph.getCompileCount());
+        ImGui::Text("Recording: %.3f ms on %u threads, %u secondaries, %u actors", recordMs,
+                    workerPool.getThreadCount(), recordedSecondaries, ActorCount);
+        if (!GpuDrivenDraws)
+        {
+            ImGui::Text("CPU instance culling: %s", getSphereCullingPath());
+        }
+        ImGui::Text("Instance BVH: %u items, %u nodes, depth %u, SAH %.1f (%.2fx build), %u rebuilds (last %.1f ms)%s",
+                    instanceBvh.getItemCount(), instanceBvh.getNodeCount(), instanceBvh.getDepth(),
+                    instanceBvh.getSahCost(), instanceBvh.getCostRatio(), instanceBvh.getRebuildCount(),
+                    instanceBvh.getRebuildMs(), instanceBvh.isRebuilding() ? ", rebuilding" : "");
+        if (CrosshairHitValid)
+        {
+            ImGui::Text("Crosshair: transform %u at %.1f", CrosshairHit.m_item, CrosshairHit.m_distance);
+        }
+        else
+        {
+            ImGui::Text("Crosshair: nothing");
+        }
+        if (ImGui::Checkbox("GPU driven draws (instance cull + indirect count)", &GpuDrivenDraws))
+        {
+            FrameGraphDirty = true;
+        }
+        if (gpuContext.m_samplerFilterMinmax && !CullCheck &&
+            ImGui::Checkbox("Occlusion culling (two phase, depth pyramid)", &OcclusionCulling))
+        {
+            FrameGraphDirty = true;
+        }
+        if (ImGui::Checkbox("Triangle culling (mesh shader)", &TriangleCulling))
+        {
+            FrameGraphDirty = true;
+        }
+        if (ImGui::Checkbox("Visibility buffer (IDs + full screen resolve)", &VisibilityBufferMode))
+        {
+            FrameGraphDirty = true;
+        }
+        // Specialization constants, the graph rebuild gets the variant from the pipeline cache
+        const uint32_t groupSizes[] = {16, 32, 64, 128};
+        auto groupSizeCombo = [&](const char* label, uint32_t& groupSize, uint32_t maxGroupSize)
+        {
+            int selected = -1;
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                selected = groupSizes[i] == groupSize ? (int)i : selected;
+            }
+            if (ImGui::Combo(label, &selected, "16\0" "32\0" "64\0" "128\0") && groupSizes[selected] <= maxGroupSize)
+            {
+                groupSize = groupSizes[selected];
+                FrameGraphDirty = true;
+            }
+        };
+        groupSizeCombo("Meshlets per task workgroup", TaskGroupSize,
+                       std::min(MeshShaderProperties.maxTaskWorkGroupInvocations,
+                                MeshShaderProperties.maxTaskPayloadSize / (uint32_t)sizeof(uint32_t) - 3));
+        groupSizeCombo("Mesh shader threads", MeshGroupSize, MeshShaderProperties.maxMeshWorkGroupInvocations);
+        ImGui::Text("Meshlets: %u vertices / %u triangles max, %u pipeline variants cached",
+                    meshletLimits.m_maxVertices, meshletLimits.m_maxTriangles, resourceManager.getPipelineVariantCount());
+
+        // Camera data, no graph rebuild
+        ImGui::Checkbox("Small meshlet culling (task shader)", &SmallMeshletCulling);
+        if (SmallMeshletCulling)
+        {
+            ImGui::SliderFloat("Min meshlet pixels", &SmallMeshletPixels, 0.25f, 16.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+        }
+        ImGui::Text("Frame arena: %.1f KB (peak %.1f KB of %.1f KB, grew %u times)",
+                    (double)frameArena.getUsedBytes() / 1024.0, (double)frameArena.getPeakBytes() / 1024.0,
+                    (double)frameArena.getCapacity() / 1024.0, frameArena.getGrowCount());
+        if (isHeapCountingEnabled())
+        {
+            // Should read 0 once everything warmed up
+            ImGui::Text("Heap allocations last frame: %llu", (unsigned long long)frameHeapAllocations);
+        }
+
+        if (ImGui::CollapsingHeader("Pipeline Statistics"))
+        {
+            bool statisticsEnabled = pipelineStatistics.isEnabled();
+            if (ImGui::Checkbox("Enabled", &statisticsEnabled))
+            {
+                pipelineStatistics.setEnabled(statisticsEnabled);
+            }
+
+            // Both are MaxFramesInFlight frames old
+            if (statisticsEnabled)
+            {
+                const MeshletCounters& counters = pipelineStatistics.getMeshletCounters();
+                const double tested = (double)std::max(counters.m_tested, 1u);
+                ImGui::Text("Meshlets: %u tested, %u frustum culled (%.1f%%), %u cone culled (%.1f%%), "
+                            "%u small culled (%.1f%%), %u occlusion culled (%.1f%%)",
+                            counters.m_tested, counters.m_frustumCulled, 100.0 * counters.m_frustumCulled / tested,
+                            counters.m_coneCulled, 100.0 * counters.m_coneCulled / tested,
+                            counters.m_smallCulled, 100.0 * counters.m_smallCulled / tested,
+                            counters.m_occlusionCulled, 100.0 * counters.m_occlusionCulled / tested);
+                const double triangles = (double)std::max(counters.m_triangles, 1u);
+                ImGui::Text("Triangles: %u in drawn meshlets, %u backface culled (%.1f%%), %u frustum culled (%.1f%%), "
+                            "%u small culled (%.1f%%)",
+                            counters.m_triangles, counters.m_trianglesBackfaceCulled,
+                            100.0 * counters.m_trianglesBackfaceCulled / triangles, counters.m_trianglesFrustumCulled,
+                            100.0 * counters.m_trianglesFrustumCulled / triangles, counters.m_trianglesSmallCulled,
+                            100.0 * counters.m_trianglesSmallCulled / triangles);
+
+                const PassStatistics& totals = pipelineStatistics.getFrameTotals();
+                if (!pipelineStatistics.isSupported())
+                {
+                    ImGui::Text("No pipeline statistics queries on this device");
+                }
+                else if (totals.m_valid)
+                {
+                    const uint32_t statisticCount = pipelineStatistics.hasMeshShaderQueries()
+                        ? (uint32_t)PipelineStatistic::Count
+                        : (uint32_t)PipelineStatistic::TaskInvocations;
+                    for (uint32_t i = 0; i < statisticCount; ++i)
+                    {
+                        ImGui::Text("%-22s %12llu", getPipelineStatisticName((PipelineStatistic)i),
+                                    (unsigned long long)totals.m_values[i]);
+                    }
+                    for (uint32_t passIndex = 0; passIndex < renderGraph.getPassCount(); ++passIndex)
+                    {
+                        const PassStatistics& pass = pipelineStatistics.getPassStatistics(passIndex);
+                        if (pass.m_valid && ImGui::TreeNode(renderGraph.getPass(passIndex).name.c_str()))
+                        {
+                            for (uint32_t i = 0; i < statisticCount; ++i)
+                            {
+                                ImGui::Text("%-22s %12llu", getPipelineStatisticName((PipelineStatistic)i),
+                                            (unsigned long long)pass.m_values[i]);
+                            }
+                            ImGui::TreePop();
+                        }
+                    }
+                }
+            }
+        }
+
+        MemoryTracker& memoryTracker = resourceManager.getMemoryTracker();
+        memoryTracker.updateBudget();
+        if (ImGui::CollapsingHeader("GPU Memory", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            ImGui::Text("Allocated: %.2f MB (peak %.2f MB)", (double)memoryTracker.getTotalBytes() / (1024.0 * 1024.0),
+                        (double)memoryTracker.getPeakBytes() / (1024.0 * 1024.0));
+            for (uint32_t i = 0; i < (uint32_t)MemoryCategory::Count; ++i)
+            {
+                const MemoryCategoryStats& stats = memoryTracker.getCategoryStats((MemoryCategory)i);
+                ImGui::Text("  %-14s %8.2f MB (peak %.2f MB, %u allocs)", getMemoryCategoryName((MemoryCategory)i),
+                            (double)stats.m_currentBytes / (1024.0 * 1024.0),
+                            (double)stats.m_peakBytes / (1024.0 * 1024.0), stats.m_allocationCount);
+            }
+            for (uint32_t i = 0; i < memoryTracker.getHeapCount(); ++i)
+            {
+                const MemoryHeapStats& heap = memoryTracker.getHeapStats(i);
+                const bool deviceLocal = (heap.m_flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+                if (memoryTracker.isBudgetSupported())
+                {
+                    ImGui::Text("Heap %u (%s): ours %.2f MB, usage %.2f / %.2f MB budget", i,
+                                deviceLocal ? "device" : "host", (double)heap.m_allocatedBytes / (1024.0 * 1024.0),
+                                (double)heap.m_usage / (1024.0 * 1024.0), (double)heap.m_budget / (1024.0 * 1024.0));
+                }
+                else
+                {
+                    ImGui::Text("Heap %u (%s): ours %.2f / %.2f MB", i, deviceLocal ? "device" : "host",
+                                (double)heap.m_allocatedBytes / (1024.0 * 1024.0),
+                                (double)heap.m_size / (1024.0 * 1024.0));
+                }
+            }
+            const BufferMemoryPool& bufferPool = resourceManager.getBufferPool();
+            ImGui::Text("Buffer pool: %.2f / %.2f MB on %u blocks, defrag moved %u buffers (%.2f MB) last frame",
+                        (double)bufferPool.getUsedBytes() / (1024.0 * 1024.0),
+                        (double)bufferPool.getReservedBytes() / (1024.0 * 1024.0), bufferPool.getBlockCount(),
+                        defragmentStats.m_movedBuffers, (double)defragmentStats.m_movedBytes / (1024.0 * 1024.0));
+            if (ImGui::Button("Dump memory JSON"))
+            {
+                memoryTracker.dumpJson("gpu_memory.json");
+            }
+        }
         ImGui::End();
 
+        editorLayer.drawRenderGraphPanel(renderGraph, &passTimings);
+        editorLayer.drawGpuProfilerPanel(gpuProfiler);
+
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         {
             glfwSetWindowShouldClose(window, true);
@@ -603,29 +1761,14 @@ void EngineInstance::MainLoop()
 
         int Width, Height;
         glfwGetWindowSize(window, &Width, &Height);
-        if (swapchain.width != (uint32_t)Width || swapchain.height != (uint32_t)Height)
+        if (!Headless && (swapchain.width != (uint32_t)Width || swapchain.height != (uint32_t)Height))
         {
             CreateSwapchain();
             camera.setPerspective(70.f, (float)Width / (float)Height);
         }
 
-        camera.update();
-        GpuCameraData camData;
-        camData.view = camera.getViewMatrix();
-        camData.proj = camera.getProjectionMatrix();
-        camData.eyePos = camera.getPosition();
-        Buffer* cameraBufferRef = resourceManager.getBuffer(cameraBufferHandle);
-        cameraBufferRef->copyDataToBuffer(&camData, sizeof(GpuCameraData));
-        
-        // Iterates and update all transform data
-        // non-optimal at all, no need to do every frame and a lot of reasons, but... shortcuts
-        scene.transformSystem.update();
-        Buffer* TranformBufferRef = resourceManager.getBuffer(TransformBufferHandle);
-        TranformBufferRef->copyDataToBuffer(scene.transformSystem.TransformsData.data(), sizeof(Transform) * scene.transformSystem.TransformsData.size());
-
-        
-        uint32_t frameIndex = timelineValue % MAX_FRAMES_IN_FLIGHT;
-        uint64_t waitValue = timelineValue >= MAX_FRAMES_IN_FLIGHT ? timelineValue - MAX_FRAMES_IN_FLIGHT + 1 : 0;
+        uint32_t frameIndex = timelineValue % MaxFramesInFlight;
+        uint64_t waitValue = timelineValue >= MaxFramesInFlight ? timelineValue - MaxFramesInFlight + 1 : 0;
 
         if (waitValue > 0)
         {
@@ -633,129 +1776,153 @@ void EngineInstance::MainLoop()
             waitInfo.semaphoreCount = 1;
             waitInfo.pSemaphores = &timelineSemaphore;
             waitInfo.pValues = &waitValue;
+            TOY_PROFILE_SCOPE("Wait for frame");
             vkWaitSemaphores(Device, &waitInfo, ~0ull);
         }
 
-        VkSemaphore acquireSemaphore = acquireSemaphores[frameIndex];
-        VkSemaphore submitSemaphore = submitSemaphores[frameIndex];
-        VkCommandPool currentCommandPool = commandPools[frameIndex];
-        VkCommandBuffer currentCommandBuffer = commandBuffers[frameIndex];
-
-        uint32_t ImageIndex;
-        VkResult acquireResult = vkAcquireNextImageKHR(Device, swapchain.swapchain, ~0ull, acquireSemaphore,
-                                                       VK_NULL_HANDLE, &ImageIndex);
-
-        vkResetCommandPool(Device, currentCommandPool, 0);
-
-        VkCommandBufferBeginInfo BeginInfo = {
-            VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-        };
-        vkBeginCommandBuffer(currentCommandBuffer, &BeginInfo);
-
-        RenderTarget* colorTexture = resourceManager.getRenderTarget(ColorTextureHandle);
-        RenderTarget* depthTexture = resourceManager.getRenderTarget(DepthTextureHandle);
-
-        VkImageMemoryBarrier barriers[] = {
-            ImageBarrier(colorTexture->m_image, 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                         VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
-            ImageBarrier(depthTexture->m_image, 0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                         VK_IMAGE_LAYOUT_UNDEFINED,
-                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-        };
-        vkCmdPipelineBarrier(currentCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-                             0, 0, nullptr, 0, nullptr, 2, barriers);
-
-        VkViewport viewport = {0, (float)swapchain.height, (float)swapchain.width, -(float)swapchain.height, 0, 1};
-        vkCmdSetViewport(currentCommandBuffer, 0, 1, &viewport);
-        VkRect2D scissor = {{0, 0}, {swapchain.width, swapchain.height}};
-        vkCmdSetScissor(currentCommandBuffer, 0, 1, &scissor);
-
-        RenderBatch frameBatch;
-        frameBatch.name = "MainFrameBatch";
-        frameBatch.colorAttachments = {
-            {
-                ColorTextureHandle, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
-                {{0.1f, 0.01f, 0.01f, 1.0f}}
-            }
-        };
-        frameBatch.depthAttachment = {
-            DepthTextureHandle, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {0.0f, 0} // reverse depth buffer, clears to 0
-        };
-        frameBatch.useDepth = true;
-        frameBatch.passes.push_back(mainPass);
-        frameBatch.passes.push_back(editorPass);
-
-        BufferHandle camBuffer = cameraBufferHandle;
-        PassContext ctx = {scene, resourceManager, pipeline_manager};
-        passExecutor.execute(currentCommandBuffer, frameBatch, ctx);
+        // Whatever got destroyed up to now and is no longer used by the GPU gets released here
+        uint64_t completedValue = 0;
+        vkGetSemaphoreCounterValue(Device, timelineSemaphore, &completedValue);
+        resourceManager.beginFrame(timelineValue + 1, completedValue);
 
+        // Only safe to write on this frame's region after the wait above
+        transientAllocator.beginFrame(timelineValue + 1, waitValue);
 
+        if (Headless && CullCheck)
+        {
+            // From looking down the actor rows to looking away from all of them
+            const float angle = glm::radians(360.0f * (float)frameNumber / (float)HeadlessFrameCount);
+            camera.setTarget(camera.getPosition() + glm::vec3(std::cos(angle), -0.25f, std::sin(angle)));
+        }
+        camera.update();
+        GpuCameraData camData;
+        camData.view = camera.getViewMatrix();
+        camData.proj = camera.getProjectionMatrix();
+        camData.eyePos = camera.getPosition();
+        camera.getFrustumPlanes(camData.frustumPlanes);
+        camData.viewportSize = glm::vec2((float)swapchain.width, (float)swapchain.height);
+        camData.minMeshletPixels = SmallMeshletCulling ? SmallMeshletPixels : 0.0f;
+        cameraDataAddress = transientAllocator.upload(&camData, 1).m_gpuAddress;
         
-        VkImageCopy copyRegion{};
-        copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.srcOffset = {0, 0, 0};
-        copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        copyRegion.dstOffset = {0, 0, 0};
-        copyRegion.extent = {swapchain.width, swapchain.height, 1};
-
-        VkImageMemoryBarrier srcBarrier = ImageBarrier(colorTexture->m_image, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                                                       VK_ACCESS_TRANSFER_READ_BIT,
-                                                       VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-        VkImageMemoryBarrier dstBarrier = ImageBarrier(swapchain.images[ImageIndex], 0, VK_ACCESS_TRANSFER_WRITE_BIT,
-                                                       VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        // Iterates and update all transform data
+        // non-optimal at all, no need to do every frame and a lot of reasons, but... shortcuts
+        scene.transformSystem.update();
+        instanceBvh.update(scene.transformSystem, &workerPool);
+        CrosshairHitValid = instanceBvh.raycast(camera.getPosition(), camera.getFront(), DefaultFarplane,
+                                                CrosshairHit);
+        const std::vector<Transform>& transforms = scene.transformSystem.TransformsData;
+        assert(transforms.size() <= MaxTransformsPerScene);
+        {
+            TOY_PROFILE_SCOPE("Transform upload");
+            transformDataAddress = transientAllocator.upload(transforms.data(), (uint32_t)transforms.size()).m_gpuAddress;
+        }
 
-        vkCmdPipelineBarrier(currentCommandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &srcBarrier);
-        vkCmdPipelineBarrier(currentCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                             0, nullptr, 0, nullptr, 1, &dstBarrier);
+        VkSemaphore acquireSemaphore = acquireSemaphores[frameIndex];
+        VkSemaphore submitSemaphore = submitSemaphores[frameIndex];
 
-        vkCmdCopyImage(currentCommandBuffer, colorTexture->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                       swapchain.images[ImageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        uint32_t ImageIndex = 0;
+        if (!Headless)
+        {
+            TOY_PROFILE_SCOPE("Acquire");
+            vkAcquireNextImageKHR(Device, swapchain.swapchain, ~0ull, acquireSemaphore, VK_NULL_HANDLE, &ImageIndex);
+        }
 
-        VkImageMemoryBarrier presentBarrier = ImageBarrier(swapchain.images[ImageIndex], VK_ACCESS_TRANSFER_WRITE_BIT,
-                                                           0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                                           VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        VkCommandBuffer frameCommandBuffer = graphSubmitter.beginFrame(frameIndex);
+        threadCommandPools.beginFrame(frameIndex);
+        gpuProfiler.beginFrame(frameIndex);
+        passTimings.update(gpuProfiler);
+        if (pipelineStatistics.beginFrame(frameIndex) && CullCheck)
+        {
+            const MeshletCounters& counters = pipelineStatistics.getMeshletCounters();
+            cullingValidator.compare(frameIndex, {counters.m_tested, counters.m_frustumCulled, counters.m_coneCulled});
+        }
+        // After the compare above, the slot's previous expectation is consumed
+        if (CullCheck)
+        {
+            TOY_PROFILE_SCOPE("Culling reference");
+            cullingValidator.setExpected(frameIndex, cullScene(scene, camData.frustumPlanes, camData.eyePos));
+        }
 
-        vkCmdPipelineBarrier(currentCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                             0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
+        // Before any pass reads buffer addresses, moved buffers get their new address here
+        {
+            GpuProfilerScope zone(&gpuProfiler, frameCommandBuffer, QueueType::Graphics, "Defragment");
+            defragmentStats = resourceManager.defragmentBuffers(frameCommandBuffer, DefragmentBytesPerFrame);
+        }
+        gpuScene.beginFrame(resourceManager, transientAllocator, frameIndex);
 
-        vkEndCommandBuffer(currentCommandBuffer);
+        if (FrameGraphDirty)
+        {
+            BuildFrameGraph(mainPass, cullPasses, indirectPasses, depthPyramidPass, resolvePass, editorPass);
+            FrameGraphDirty = false;
+        }
+        recordFrameIndex = frameIndex;
+        if (DrawCommandsResource != InvalidGraphResource)
+        {
+            renderGraph.setImportedBuffer(DrawCommandsResource, gpuScene.getDrawCommands()->m_buffer);
+            renderGraph.setImportedBuffer(DrawCountResource, gpuScene.getDrawCount()->m_buffer);
+        }
+        if (DepthPyramidResource != InvalidGraphResource)
+        {
+            renderGraph.setImportedBuffer(LateDrawCommandsResource, gpuScene.getDrawCommands(DrawList::Late)->m_buffer);
+            renderGraph.setImportedBuffer(LateDrawCountResource, gpuScene.getDrawCount(DrawList::Late)->m_buffer);
+            renderGraph.setImportedBuffer(InstanceVisibilityResource, gpuScene.getInstanceVisibility()->m_buffer);
+            renderGraph.setImportedBuffer(MeshletVisibilityResource, gpuScene.getMeshletVisibility()->m_buffer);
+            renderGraph.setImportedImage(DepthPyramidResource, depthPyramid.getImage(), depthPyramid.getView(),
+                                         depthPyramid.getWidth(), depthPyramid.getHeight());
+        }
+        if (VisibilityResource != InvalidGraphResource)
+        {
+            renderGraph.setImportedImage(VisibilityResource, visibilityBuffer.getImage(), visibilityBuffer.getView(),
+                                         visibilityBuffer.getWidth(), visibilityBuffer.getHeight());
+        }
+        if (Headless)
+        {
+            const RenderTarget* offscreen = resourceManager.getRenderTarget(OffscreenTarget);
+            renderGraph.setImportedImage(BackbufferResource, offscreen->m_image, offscreen->m_view, swapchain.width,
+                                         swapchain.height);
+        }
+        else
+        {
+            renderGraph.setImportedImage(BackbufferResource, swapchain.images[ImageIndex],
+                                         swapchain.imageviews[ImageIndex], swapchain.width, swapchain.height);
+        }
 
         timelineValue++;
 
-        VkSemaphoreSubmitInfo waitSemaphoreInfo{VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
-        waitSemaphoreInfo.semaphore = acquireSemaphore;
-        waitSemaphoreInfo.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-        VkCommandBufferSubmitInfo cmdBufferInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
-        cmdBufferInfo.commandBuffer = currentCommandBuffer;
-
-        VkSemaphoreSubmitInfo signalSemaphores[2] = {};
-        signalSemaphores[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-        signalSemaphores[0].semaphore = submitSemaphore;
-        signalSemaphores[0].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
-
-        signalSemaphores[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-        signalSemaphores[1].semaphore = timelineSemaphore;
-        signalSemaphores[1].value = timelineValue;
-        signalSemaphores[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-
-        VkSubmitInfo2 submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
-        submitInfo.waitSemaphoreInfoCount = 1;
-        submitInfo.pWaitSemaphoreInfos = &waitSemaphoreInfo;
-        submitInfo.commandBufferInfoCount = 1;
-        submitInfo.pCommandBufferInfos = &cmdBufferInfo;
-        submitInfo.signalSemaphoreInfoCount = 2;
-        submitInfo.pSignalSemaphoreInfos = signalSemaphores;
+        // Acquire semaphore is waited on the transfer stage, the copy is the only thing touching the swapchain
+        GraphSubmitInfo submitInfo;
+        if (!Headless)
+        {
+            submitInfo.acquireSemaphore = acquireSemaphore;
+            submitInfo.acquireStage = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+            submitInfo.presentSemaphore = submitSemaphore;
+        }
+        submitInfo.frameTimeline = timelineSemaphore;
+        submitInfo.frameTimelineValue = timelineValue;
 
-        vkQueueSubmit2(gpuContext.m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        double recordStart = glfwGetTime();
+        PassContext ctx = {scene, resourceManager, pipeline_manager, renderGraph, &workerPool, &threadCommandPools,
+                           &passTimings, &frameArena, &gpuProfiler, &pipelineStatistics};
+        {
+            TOY_PROFILE_SCOPE("Record and submit");
+            graphSubmitter.submit(renderGraph, ctx, passExecutor, submitInfo);
+        }
+        recordMs = (glfwGetTime() - recordStart) * 1000.0;
+        recordedSecondaries = threadCommandPools.getSecondaryCount();
 
-        VkPresentInfoKHR presentInfo = {
-            VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, nullptr, 1, &submitSemaphore, 1, &swapchain.swapchain, &ImageIndex
-        };
-        vkQueuePresentKHR(gpuContext.m_graphicsQueue, &presentInfo);
+        if (!Headless)
+        {
+            VkPresentInfoKHR presentInfo = {
+                VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, nullptr, 1, &submitSemaphore, 1, &swapchain.swapchain, &ImageIndex
+            };
+            TOY_PROFILE_SCOPE("Present");
+            vkQueuePresentKHR(gpuContext.m_graphicsQueue, &presentInfo);
+        }
+        else if (frameNumber >= HeadlessWarmupFrames)
+        {
+            headlessFrameTimes.push_back((float)((glfwGetTime() - currentFrame) * 1000.0));
+        }
+        ++frameNumber;
     }
 
 
@@ -764,13 +1931,177 @@ void EngineInstance::MainLoop()
         vkDeviceWaitIdle(Device);
     }
 
+    // Loop ended before the capture did, write what there is
+    if (CpuProfiler::isCaptureActive())
+    {
+        CpuProfiler::endCapture();
+        WriteFrameTrace();
+    }
+
+    if (CullCheck)
+    {
+        cullingValidator.report();
+    }
+    if (Headless)
+    {
+        ReportHeadlessTimings(headlessFrameTimes);
+        if (DumpPath)
+        {
+            DumpOffscreenTarget(DumpPath);
+        }
+    }
+
+    instanceBvh.destroy();
+    workerPool.destroy();
+    gpuProfiler.destroy();
+    pipelineStatistics.destroy();
+    frameArena.destroy();
     editorLayer.destroy();
+    depthPyramid.destroy();
+    visibilityBuffer.destroy();
+    transientTargets.destroy();
+    transientAllocator.destroy();
     resourceManager.cleanup();
 }
 
-int main()
+int main(int argc, char** argv)
 {
     EngineInstance engine;
+    uint32_t benchCullCount = 0;
+    bool benchBvh = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--actors") == 0 && i + 1 < argc)
+        {
+            engine.ActorCount = std::min((uint32_t)std::max(0, atoi(argv[++i])), MaxTransformsPerScene);
+        }
+        else if (strcmp(argv[i], "--meshes") == 0 && i + 1 < argc)
+        {
+            engine.MeshCount = std::min((uint32_t)std::max(1, atoi(argv[++i])), MaxMeshesPerScene);
+        }
+        else if (strcmp(argv[i], "--actor-spacing") == 0 && i + 1 < argc)
+        {
+            engine.ActorSpacing = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            engine.RecordingThreadCount = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-async-compute") == 0)
+        {
+            engine.AsyncComputeEnabled = false;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            engine.Headless = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            engine.HeadlessFrameCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            engine.HeadlessWarmupFrames = (uint32_t)std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+        {
+            engine.HeadlessWidth = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+        {
+            engine.HeadlessHeight = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+        {
+            engine.DumpPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+        {
+            engine.ReportPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            engine.TraceFrameCount = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--cpu-draws") == 0)
+        {
+            engine.GpuDrivenDraws = false;
+        }
+        else if (strcmp(argv[i], "--cull-check") == 0)
+        {
+            engine.CullCheck = true;
+        }
+        else if (strcmp(argv[i], "--no-occlusion") == 0)
+        {
+            engine.OcclusionCulling = false;
+        }
+        else if (strcmp(argv[i], "--no-triangle-culling") == 0)
+        {
+            engine.TriangleCulling = false;
+        }
+        else if (strcmp(argv[i], "--visibility-buffer") == 0)
+        {
+            engine.VisibilityBufferMode = true;
+        }
+        else if (strcmp(argv[i], "--task-group-size") == 0 && i + 1 < argc)
+        {
+            engine.TaskGroupSize = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--mesh-group-size") == 0 && i + 1 < argc)
+        {
+            engine.MeshGroupSize = (uint32_t)std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--meshlet-size") == 0 && i + 2 < argc)
+        {
+            engine.meshletLimits.m_maxVertices = (uint32_t)std::max(3, atoi(argv[++i]));
+            engine.meshletLimits.m_maxTriangles = (uint32_t)std::max(4, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--no-small-meshlets") == 0)
+        {
+            engine.SmallMeshletCulling = false;
+        }
+        else if (strcmp(argv[i], "--small-meshlet-pixels") == 0 && i + 1 < argc)
+        {
+            engine.SmallMeshletPixels = std::max(0.0f, (float)atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            engine.StatisticsEnabled = true;
+        }
+        else if (strcmp(argv[i], "--bench-cull") == 0)
+        {
+            // Optional sphere count
+            benchCullCount = 1000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                benchCullCount = (uint32_t)std::max(1, atoi(argv[++i]));
+            }
+        }
+        else if (strcmp(argv[i], "--bench-bvh") == 0)
+        {
+            benchBvh = true;
+        }
+    }
+
+    // Benchmarks need no window or device, they run and exit
+    if (benchCullCount > 0 || benchBvh)
+    {
+        if (benchCullCount > 0)
+        {
+            benchmarkSphereCulling(benchCullCount);
+        }
+        if (benchBvh)
+        {
+            // Every core unless --threads says otherwise
+            WorkerPool workers;
+            workers.init(engine.RecordingThreadCount > 1 ? engine.RecordingThreadCount
+                                                         : std::max(1u, std::thread::hardware_concurrency()));
+            benchmarkBvh(workers);
+            workers.destroy();
+        }
+        return 0;
+    }
+
     engine.InitInstance();
     engine.MainLoop();
     return 0;
@@ -0,0 +1,212 @@
+#include "BufferMemoryPool.h"
+#include "GpuResources.h"
+#include "Common/Common.h"
+
+#include <algorithm>
+
+namespace ToyEngine
+{
+
+    void BufferMemoryPool::init(const GpuContext& ctx, VkDeviceSize blockSize)
+    {
+        m_ctx = &ctx;
+        m_blockSize = blockSize;
+    }
+
+    void BufferMemoryPool::destroy()
+    {
+        for (Block& block : m_blocks)
+        {
+            if (block.m_memory != VK_NULL_HANDLE)
+            {
+                assert(block.m_usedBytes == 0);
+                m_ctx->freeMemory(block.m_memory, MemoryCategory::Geometry, block.m_memoryTypeIndex, block.m_size);
+            }
+        }
+        m_blocks.clear();
+    }
+
+    bool BufferMemoryPool::allocateFromBlock(uint32_t blockIndex, VkDeviceSize size, VkDeviceSize alignment,
+                                             VkDeviceSize endOffset, BufferPoolAllocation& allocation)
+    {
+        Block& block = m_blocks[blockIndex];
+        for (uint32_t i = 0; i < block.m_freeRanges.size(); ++i)
+        {
+            const FreeRange range = block.m_freeRanges[i];
+            const VkDeviceSize alignedOffset = (range.m_offset + alignment - 1) / alignment * alignment;
+            const VkDeviceSize rangeEnd = range.m_offset + range.m_size;
+            if (alignedOffset + size > rangeEnd || alignedOffset + size > endOffset)
+            {
+                continue;
+            }
+
+            // Whatever is left on both sides of the allocation stays free
+            block.m_freeRanges.erase(block.m_freeRanges.begin() + i);
+            if (alignedOffset + size < rangeEnd)
+            {
+                block.m_freeRanges.insert(block.m_freeRanges.begin() + i, {alignedOffset + size, rangeEnd - alignedOffset - size});
+            }
+            if (alignedOffset > range.m_offset)
+            {
+                block.m_freeRanges.insert(block.m_freeRanges.begin() + i, {range.m_offset, alignedOffset - range.m_offset});
+            }
+
+            block.m_usedBytes += size;
+            allocation.m_block = blockIndex;
+            allocation.m_offset = alignedOffset;
+            allocation.m_size = size;
+            allocation.m_alignment = alignment;
+            return true;
+        }
+
+        return false;
+    }
+
+    uint32_t BufferMemoryPool::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size)
+    {
+        VkMemoryAllocateFlagsInfo allocFlagsInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
+        allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+
+        VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+        allocInfo.pNext = &allocFlagsInfo;
+
+        Block block;
+        // Blocks can hold any buffer, they are all accounted as geometry
+        block.m_memory = m_ctx->allocateMemory(allocInfo, MemoryCategory::Geometry);
+        block.m_memoryTypeIndex = memoryTypeIndex;
+        block.m_size = size;
+        block.m_freeRanges.push_back({0, size});
+
+        for (uint32_t i = 0; i < m_blocks.size(); ++i)
+        {
+            if (m_blocks[i].m_memory == VK_NULL_HANDLE)
+            {
+                m_blocks[i] = block;
+                return i;
+            }
+        }
+
+        m_blocks.push_back(block);
+        return (uint32_t)m_blocks.size() - 1;
+    }
+
+    BufferPoolAllocation BufferMemoryPool::allocate(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        BufferPoolAllocation allocation;
+        for (uint32_t i = 0; i < m_blocks.size(); ++i)
+        {
+            const Block& block = m_blocks[i];
+            if (block.m_memory != VK_NULL_HANDLE && block.m_memoryTypeIndex == memoryTypeIndex &&
+                allocateFromBlock(i, size, alignment, ~0ull, allocation))
+            {
+                return allocation;
+            }
+        }
+
+        // Buffers bigger than a block just get a block on their own
+        uint32_t blockIndex = createBlock(memoryTypeIndex, std::max(size, m_blockSize));
+        allocateFromBlock(blockIndex, size, alignment, ~0ull, allocation);
+        return allocation;
+    }
+
+    BufferPoolAllocation BufferMemoryPool::allocateBefore(const BufferPoolAllocation& current, uint32_t memoryTypeIndex,
+                                                          VkDeviceSize size, VkDeviceSize alignment)
+    {
+        BufferPoolAllocation allocation;
+        for (uint32_t i = 0; i <= current.m_block && i < m_blocks.size(); ++i)
+        {
+            const Block& block = m_blocks[i];
+            if (block.m_memory == VK_NULL_HANDLE || block.m_memoryTypeIndex != memoryTypeIndex)
+            {
+                continue;
+            }
+
+            const VkDeviceSize endOffset = i == current.m_block ? current.m_offset : ~0ull;
+            if (allocateFromBlock(i, size, alignment, endOffset, allocation))
+            {
+                return allocation;
+            }
+        }
+
+        return allocation;
+    }
+
+    void BufferMemoryPool::free(const BufferPoolAllocation& allocation)
+    {
+        if (!allocation.isValid())
+        {
+            return;
+        }
+
+        Block& block = m_blocks[allocation.m_block];
+        assert(block.m_usedBytes >= allocation.m_size);
+        block.m_usedBytes -= allocation.m_size;
+        m_dirty = true;
+
+        auto it = std::lower_bound(block.m_freeRanges.begin(), block.m_freeRanges.end(), allocation.m_offset,
+                                   [](const FreeRange& range, VkDeviceSize offset) { return range.m_offset < offset; });
+        it = block.m_freeRanges.insert(it, {allocation.m_offset, allocation.m_size});
+
+        // Merge with the next range, then with the previous one
+        auto next = it + 1;
+        if (next != block.m_freeRanges.end() && it->m_offset + it->m_size == next->m_offset)
+        {
+            it->m_size += next->m_size;
+            block.m_freeRanges.erase(next);
+        }
+        if (it != block.m_freeRanges.begin())
+        {
+            auto prev = it - 1;
+            if (prev->m_offset + prev->m_size == it->m_offset)
+            {
+                prev->m_size += it->m_size;
+                block.m_freeRanges.erase(it);
+            }
+        }
+    }
+
+    void BufferMemoryPool::releaseEmptyBlocks()
+    {
+        for (Block& block : m_blocks)
+        {
+            if (block.m_memory != VK_NULL_HANDLE && block.m_usedBytes == 0)
+            {
+                m_ctx->freeMemory(block.m_memory, MemoryCategory::Geometry, block.m_memoryTypeIndex, block.m_size);
+                block = {};
+            }
+        }
+    }
+
+    uint32_t BufferMemoryPool::getBlockCount() const
+    {
+        uint32_t count = 0;
+        for (const Block& block : m_blocks)
+        {
+            count += block.m_memory != VK_NULL_HANDLE ? 1 : 0;
+        }
+        return count;
+    }
+
+    VkDeviceSize BufferMemoryPool::getReservedBytes() const
+    {
+        VkDeviceSize bytes = 0;
+        for (const Block& block : m_blocks)
+        {
+            bytes += block.m_memory != VK_NULL_HANDLE ? block.m_size : 0;
+        }
+        return bytes;
+    }
+
+    VkDeviceSize BufferMemoryPool::getUsedBytes() const
+    {
+        VkDeviceSize bytes = 0;
+        for (const Block& block : m_blocks)
+        {
+            bytes += block.m_usedBytes;
+        }
+        return bytes;
+    }
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <vector>
+
+namespace ToyEngine
+{
+
+    struct GpuContext;
+
+    struct BufferPoolAllocation
+    {
+        uint32_t m_block = ~0u;
+        VkDeviceSize m_offset = 0;
+        VkDeviceSize m_size = 0;
+        VkDeviceSize m_alignment = 1;
+
+        bool isValid() const { return m_block != ~0u; }
+    };
+
+    // Device local buffers are sub-allocated from big VkDeviceMemory blocks instead of getting
+    // an allocation each. First fit over a per block free list sorted by offset, neighbours merge on free.
+    // Block indices stay stable while a block has live allocations, empty blocks are only given back
+    // to the driver on releaseEmptyBlocks()
+    class BufferMemoryPool
+    {
+    public:
+        static constexpr VkDeviceSize DefaultBlockSize = 64 * 1024 * 1024;
+
+        void init(const GpuContext& ctx, VkDeviceSize blockSize = DefaultBlockSize);
+        void destroy();
+
+        BufferPoolAllocation allocate(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize alignment);
+
+        // Like allocate but only succeeds on a spot placed before 'current' (lower block, or same block lower offset).
+        // Never creates blocks, used by the defragmenter to compact towards the start of the pool
+        BufferPoolAllocation allocateBefore(const BufferPoolAllocation& current, uint32_t memoryTypeIndex,
+                                            VkDeviceSize size, VkDeviceSize alignment);
+
+        void free(const BufferPoolAllocation& allocation);
+
+        void releaseEmptyBlocks();
+
+        // Set by free, compaction and releaseEmptyBlocks only have something to do once a range opened up
+        bool isDirty() const { return m_dirty; }
+        void clearDirty() { m_dirty = false; }
+
+        VkDeviceMemory getMemory(uint32_t block) const { return m_blocks[block].m_memory; }
+
+        uint32_t getBlockCount() const;
+        VkDeviceSize getReservedBytes() const;
+        VkDeviceSize getUsedBytes() const;
+
+    private:
+        struct FreeRange
+        {
+            VkDeviceSize m_offset = 0;
+            VkDeviceSize m_size = 0;
+        };
+
+        struct Block
+        {
+            VkDeviceMemory m_memory = VK_NULL_HANDLE;
+            uint32_t m_memoryTypeIndex = 0;
+            VkDeviceSize m_size = 0;
+            VkDeviceSize m_usedBytes = 0;
+            std::vector<FreeRange> m_freeRanges;
+        };
+
+        // endOffset limits the search to ranges ending before it, ~0 means whole block
+        bool allocateFromBlock(uint32_t blockIndex, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize endOffset,
+                               BufferPoolAllocation& allocation);
+        uint32_t createBlock(uint32_t memoryTypeIndex, VkDeviceSize size);
+
+        const GpuContext* m_ctx = nullptr;
+        VkDeviceSize m_blockSize = DefaultBlockSize;
+
+        // Released blocks keep their slot (m_memory null) so other block indices don't move
+        std::vector<Block> m_blocks;
+        bool m_dirty = false;
+    };
+
+}
@@ -50,6 +50,31 @@ namespace ToyEngine
         updateViewMatrix();
     }
 
+    void Camera::getFrustumPlanes(glm::vec4 planes[6]) const
+    {
+        // Gribb/Hartmann on the clip matrix rows, depth is 0..1 (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+        const glm::mat4 clip = m_projMatrix * m_viewMatrix;
+        const glm::vec4 row0 = glm::vec4(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+        const glm::vec4 row1 = glm::vec4(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+        const glm::vec4 row2 = glm::vec4(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+        const glm::vec4 row3 = glm::vec4(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+
+        // Reverse-Z: z <= w is the near plane, z >= 0 the far one
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 - row2;
+        planes[5] = row2;
+
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            const float length = glm::length(glm::vec3(planes[i]));
+            // Infinite far plane has no normal, make it accept everything
+            planes[i] = length > 1e-6f ? planes[i] / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
     void Camera::processKeyboard(CameraMovement direction, float deltaTime)
     {
         float velocity = m_movementSpeed * deltaTime;
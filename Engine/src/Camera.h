@@ -34,6 +34,11 @@ namespace ToyEngine
             return m_position;
         }
 
+        const glm::vec3& getFront() const
+        {
+            return m_front;
+        }
+
         const glm::mat4& getViewMatrix() const
         {
             return m_viewMatrix;
@@ -46,6 +51,10 @@ namespace ToyEngine
 
         void update();
 
+        // World space planes of the view-projection, normals point inside: left, right, bottom, top, near, far.
+        // The projection is infinite reverse-Z, far comes out as an always-pass plane
+        void getFrustumPlanes(glm::vec4 planes[6]) const;
+
         void processKeyboard(CameraMovement direction, float deltaTime);
 
         void processMouseMovement(float xoffset, float yoffset, bool constrainPitch = true);
@@ -0,0 +1,52 @@
+#include "ChromeTrace.h"
+
+namespace ToyEngine
+{
+
+    bool ChromeTraceWriter::open(const char* path)
+    {
+        m_file = fopen(path, "w");
+        if (!m_file)
+        {
+            printf("ChromeTraceWriter: could not open %s\n", path);
+            return false;
+        }
+
+        m_firstEvent = true;
+        fprintf(m_file, "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+        return true;
+    }
+
+    void ChromeTraceWriter::close()
+    {
+        if (!m_file)
+        {
+            return;
+        }
+
+        fprintf(m_file, "\n  ]\n}\n");
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    void ChromeTraceWriter::beginEvent()
+    {
+        fputs(m_firstEvent ? "\n    " : ",\n    ", m_file);
+        m_firstEvent = false;
+    }
+
+    void ChromeTraceWriter::addThreadName(uint32_t pid, uint32_t tid, const char* name)
+    {
+        beginEvent();
+        fprintf(m_file, "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %u, \"tid\": %u, \"args\": { \"name\": \"%s\" } }",
+                pid, tid, name);
+    }
+
+    void ChromeTraceWriter::addZone(const char* name, uint32_t pid, uint32_t tid, double startUs, double durationUs)
+    {
+        beginEvent();
+        fprintf(m_file, "{ \"name\": \"%s\", \"ph\": \"X\", \"pid\": %u, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f }",
+                name, pid, tid, startUs, durationUs);
+    }
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+namespace ToyEngine
+{
+
+    // Writes the Chrome trace event format (chrome://tracing, Perfetto). Zones are complete events ("X"),
+    // nesting comes from the times. pid/tid only group tracks, name them with addThreadName
+    class ChromeTraceWriter
+    {
+    public:
+        bool open(const char* path);
+        void close();
+
+        void addThreadName(uint32_t pid, uint32_t tid, const char* name);
+        void addZone(const char* name, uint32_t pid, uint32_t tid, double startUs, double durationUs);
+
+    private:
+        void beginEvent();
+
+        FILE* m_file = nullptr;
+        bool m_firstEvent = true;
+    };
+
+}
@@ -0,0 +1,224 @@
+#include "CpuProfiler.h"
+#include "ChromeTrace.h"
+#include "Common/Common.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace ToyEngine
+{
+
+    namespace
+    {
+        struct ZoneEvent
+        {
+            char m_name[40];
+            uint64_t m_beginNs;
+            uint64_t m_endNs;
+        };
+
+        struct ThreadBuffer
+        {
+            char m_name[32] = {};
+            std::unique_ptr<ZoneEvent[]> m_events;
+            std::atomic<uint32_t> m_count{0};
+            uint32_t m_dropped = 0;
+        };
+
+        enum class CaptureState : uint8_t
+        {
+            Idle,
+            Capturing,
+            // Captured, waiting for the GPU zones of the last frames to resolve
+            Draining,
+        };
+
+        const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+
+        std::atomic<bool> s_capturing{false};
+        CaptureState s_state = CaptureState::Idle;
+        uint32_t s_requestedFrames = 0;
+        uint32_t s_framesLeft = 0;
+        uint64_t s_captureBeginNs = 0;
+        uint64_t s_captureEndNs = 0;
+
+        // Registration is the only locked part, once per thread
+        std::mutex s_registryMutex;
+        ThreadBuffer s_threads[CpuProfiler::MaxThreads];
+        std::atomic<uint32_t> s_threadCount{0};
+        thread_local ThreadBuffer* t_buffer = nullptr;
+
+        ThreadBuffer* getThreadBuffer()
+        {
+            if (t_buffer)
+            {
+                return t_buffer;
+            }
+
+            std::lock_guard<std::mutex> lock(s_registryMutex);
+            const uint32_t index = s_threadCount.load(std::memory_order_relaxed);
+            if (index >= CpuProfiler::MaxThreads)
+            {
+                return nullptr;
+            }
+
+            ThreadBuffer& buffer = s_threads[index];
+            buffer.m_events.reset(new ZoneEvent[CpuProfiler::MaxEventsPerThread]);
+            snprintf(buffer.m_name, sizeof(buffer.m_name), "Thread %u", index);
+            s_threadCount.store(index + 1, std::memory_order_release);
+            t_buffer = &buffer;
+            return t_buffer;
+        }
+    }
+
+    uint64_t getProfilerTimeNs()
+    {
+        // +1 so a valid time is never 0, scopes use 0 as "not recording"
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count() + 1;
+    }
+
+    void CpuProfiler::setThreadName(const char* name)
+    {
+        ThreadBuffer* buffer = getThreadBuffer();
+        if (buffer)
+        {
+            strncpy(buffer->m_name, name, sizeof(buffer->m_name) - 1);
+        }
+    }
+
+    bool CpuProfiler::isCapturing()
+    {
+        return s_capturing.load(std::memory_order_relaxed);
+    }
+
+    void CpuProfiler::recordZone(const char* name, uint64_t beginNs, uint64_t endNs)
+    {
+        ThreadBuffer* buffer = getThreadBuffer();
+        if (!buffer)
+        {
+            return;
+        }
+
+        // Owner thread is the only writer, the count only has to publish the event to the reader
+        const uint32_t count = buffer->m_count.load(std::memory_order_relaxed);
+        if (count >= MaxEventsPerThread)
+        {
+            ++buffer->m_dropped;
+            return;
+        }
+
+        ZoneEvent& event = buffer->m_events[count];
+        strncpy(event.m_name, name, sizeof(event.m_name) - 1);
+        event.m_name[sizeof(event.m_name) - 1] = 0;
+        event.m_beginNs = beginNs;
+        event.m_endNs = endNs;
+        buffer->m_count.store(count + 1, std::memory_order_release);
+    }
+
+    bool CpuProfiler::beginFrame()
+    {
+        bool ready = false;
+        if (s_state == CaptureState::Capturing)
+        {
+            if (--s_framesLeft == 0)
+            {
+                s_capturing.store(false, std::memory_order_relaxed);
+                s_captureEndNs = getProfilerTimeNs();
+                s_state = CaptureState::Draining;
+                s_framesLeft = MaxFramesInFlight;
+            }
+        }
+        else if (s_state == CaptureState::Draining)
+        {
+            if (--s_framesLeft == 0)
+            {
+                s_state = CaptureState::Idle;
+                ready = true;
+            }
+        }
+
+        if (s_state == CaptureState::Idle && s_requestedFrames > 0)
+        {
+            // Workers are parked between frames, nobody is appending while the counts go back to 0
+            const uint32_t threadCount = s_threadCount.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < threadCount; ++i)
+            {
+                s_threads[i].m_count.store(0, std::memory_order_relaxed);
+                s_threads[i].m_dropped = 0;
+            }
+
+            s_framesLeft = s_requestedFrames;
+            s_requestedFrames = 0;
+            s_captureBeginNs = getProfilerTimeNs();
+            s_state = CaptureState::Capturing;
+            s_capturing.store(true, std::memory_order_relaxed);
+        }
+        return ready;
+    }
+
+    void CpuProfiler::requestCapture(uint32_t frameCount)
+    {
+        if (s_state == CaptureState::Idle && frameCount > 0)
+        {
+            s_requestedFrames = frameCount;
+        }
+    }
+
+    void CpuProfiler::endCapture()
+    {
+        if (s_state == CaptureState::Capturing)
+        {
+            s_capturing.store(false, std::memory_order_relaxed);
+            s_captureEndNs = getProfilerTimeNs();
+        }
+        s_state = CaptureState::Idle;
+        s_requestedFrames = 0;
+    }
+
+    bool CpuProfiler::isCaptureActive()
+    {
+        return s_state != CaptureState::Idle || s_requestedFrames > 0;
+    }
+
+    double CpuProfiler::getCaptureBeginMs()
+    {
+        return (double)s_captureBeginNs / 1000000.0;
+    }
+
+    double CpuProfiler::getCaptureEndMs()
+    {
+        return (double)s_captureEndNs / 1000000.0;
+    }
+
+    void CpuProfiler::writeTrace(ChromeTraceWriter& writer)
+    {
+        const uint32_t threadCount = s_threadCount.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            const ThreadBuffer& buffer = s_threads[i];
+            const uint32_t count = buffer.m_count.load(std::memory_order_acquire);
+            if (count == 0)
+            {
+                continue;
+            }
+
+            // tid 0 of the CPU process is the GPU profiler's recording track
+            writer.addThreadName(0, i + 1, buffer.m_name);
+            for (uint32_t e = 0; e < count; ++e)
+            {
+                const ZoneEvent& event = buffer.m_events[e];
+                writer.addZone(event.m_name, 0, i + 1, (double)event.m_beginNs / 1000.0,
+                               (double)(event.m_endNs - event.m_beginNs) / 1000.0);
+            }
+            if (buffer.m_dropped > 0)
+            {
+                printf("CpuProfiler: %s dropped %u zones, buffer full\n", buffer.m_name, buffer.m_dropped);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ToyEngine
+{
+
+    class ChromeTraceWriter;
+
+    // Nanoseconds since startup on a steady clock, shared by the CPU and GPU profilers so their traces line up
+    uint64_t getProfilerTimeNs();
+
+    // Scoped CPU zones from any thread, captured on demand for N frames and written as a Chrome trace.
+    // Every thread appends to its own fixed size buffer (only the owner writes, the count is published with a
+    // release store), no locks on the recording path. Outside of a capture a zone is one relaxed atomic load.
+    // Captures start and end in beginFrame, where no worker is recording
+    class CpuProfiler
+    {
+    public:
+        static constexpr uint32_t MaxEventsPerThread = 32768;
+        static constexpr uint32_t MaxThreads = 64;
+
+        // Shows up as the track name, call once from the thread itself
+        static void setThreadName(const char* name);
+
+        // Main thread, top of the frame. Returns true once when a finished capture is ready to write: that happens
+        // MaxFramesInFlight frames after the last captured one, so the GPU zones of those frames are resolved too
+        static bool beginFrame();
+
+        static void requestCapture(uint32_t frameCount);
+        // Cuts a capture short (shutdown), no draining: GPU zones of the last frames are missing
+        static void endCapture();
+        static bool isCaptureActive();
+
+        // Time range of the last capture, ms on the getProfilerTimeNs clock
+        static double getCaptureBeginMs();
+        static double getCaptureEndMs();
+
+        // One track per thread that recorded something in the last capture
+        static void writeTrace(ChromeTraceWriter& writer);
+
+        static bool isCapturing();
+        static void recordZone(const char* name, uint64_t beginNs, uint64_t endNs);
+    };
+
+    class CpuProfileScope
+    {
+    public:
+        CpuProfileScope(const char* name) : m_name(name)
+        {
+            m_beginNs = CpuProfiler::isCapturing() ? getProfilerTimeNs() : 0;
+        }
+
+        ~CpuProfileScope()
+        {
+            if (m_beginNs != 0)
+            {
+                CpuProfiler::recordZone(m_name, m_beginNs, getProfilerTimeNs());
+            }
+        }
+
+    private:
+        const char* m_name = nullptr;
+        uint64_t m_beginNs = 0;
+    };
+
+}
+
+// Names are copied, any string works. Compiled out without TOY_CPU_PROFILER
+#ifdef TOY_CPU_PROFILER
+#define TOY_PROFILE_CONCAT_INNER(a, b) a##b
+#define TOY_PROFILE_CONCAT(a, b) TOY_PROFILE_CONCAT_INNER(a, b)
+#define TOY_PROFILE_SCOPE(name) ::ToyEngine::CpuProfileScope TOY_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define TOY_PROFILE_SCOPE(name)
+#endif
@@ -0,0 +1,363 @@
+#include "Culling.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "Camera.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// Picked at compile time, AVX-512 (F + BW + VL, Skylake-X and later) and AVX2 only when the build targets them
+// (-mavx512bw -mavx512vl / -mavx2, /arch:AVX512 / /arch:AVX2). SSE2 is always there on x64
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+    #define TOY_CULL_AVX512 1
+    #include <immintrin.h>
+#elif defined(__AVX2__)
+    #define TOY_CULL_AVX2 1
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TOY_CULL_SSE2 1
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    #define TOY_CULL_NEON 1
+    #include <arm_neon.h>
+#endif
+
+namespace ToyEngine
+{
+
+    // Beyond this share of the tested meshlets a frame counts as a mismatch, below is float noise on the edges
+    constexpr float MismatchTolerance = 0.005f;
+
+    float getMaxAxisScale(const glm::mat4& model)
+    {
+        return std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+                        glm::length(glm::vec3(model[2])));
+    }
+
+    bool isSphereInFrustum(const glm::vec4 planes[6], const glm::vec3& center, float radius)
+    {
+        for (uint32_t i = 0; i < 6; ++i)
+        {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w <= -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Scalar reference, also does the tail the vector loops leave
+    static void cullSpheresScalar(const SphereBoundsSoA& bounds, const glm::vec4 planes[6], uint32_t first,
+                                  uint32_t last, uint8_t* visibility)
+    {
+        for (uint32_t i = first; i < last; ++i)
+        {
+            const glm::vec3 center(bounds.m_centerX[i], bounds.m_centerY[i], bounds.m_centerZ[i]);
+            visibility[i] = isSphereInFrustum(planes, center, bounds.m_radius[i]) ? 1 : 0;
+        }
+    }
+
+    void cullSpheres(const SphereBoundsSoA& bounds, const glm::vec4 planes[6], uint8_t* visibility)
+    {
+        const uint32_t count = bounds.size();
+        const float* centerX = bounds.m_centerX.data();
+        const float* centerY = bounds.m_centerY.data();
+        const float* centerZ = bounds.m_centerZ.data();
+        const float* radius = bounds.m_radius.data();
+        uint32_t i = 0;
+
+        // Multiplies and adds in the scalar order (x, y, z, then w) and no FMA, every path gives the same answers.
+        // A sphere is out as soon as one plane has it fully behind
+#if TOY_CULL_AVX512
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m512 x = _mm512_loadu_ps(centerX + i);
+            const __m512 y = _mm512_loadu_ps(centerY + i);
+            const __m512 z = _mm512_loadu_ps(centerZ + i);
+            const __m512 negRadius = _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(radius + i));
+
+            // Compares straight into a lane mask, every plane narrows it down
+            __mmask16 visible = 0xffff;
+            for (uint32_t p = 0; p < 6; ++p)
+            {
+                __m512 distance = _mm512_mul_ps(x, _mm512_set1_ps(planes[p].x));
+                distance = _mm512_add_ps(distance, _mm512_mul_ps(y, _mm512_set1_ps(planes[p].y)));
+                distance = _mm512_add_ps(distance, _mm512_mul_ps(z, _mm512_set1_ps(planes[p].z)));
+                distance = _mm512_add_ps(distance, _mm512_set1_ps(planes[p].w));
+                visible = _mm512_mask_cmp_ps_mask(visible, distance, negRadius, _CMP_GT_OQ);
+            }
+
+            // One byte store for the 16 results
+            _mm_storeu_si128((__m128i*)(visibility + i), _mm_maskz_mov_epi8(visible, _mm_set1_epi8(1)));
+        }
+#elif TOY_CULL_AVX2
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(centerX + i);
+            const __m256 y = _mm256_loadu_ps(centerY + i);
+            const __m256 z = _mm256_loadu_ps(centerZ + i);
+            const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+
+            __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (uint32_t p = 0; p < 6; ++p)
+            {
+                __m256 distance = _mm256_mul_ps(x, _mm256_set1_ps(planes[p].x));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(y, _mm256_set1_ps(planes[p].y)));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(planes[p].z)));
+                distance = _mm256_add_ps(distance, _mm256_set1_ps(planes[p].w));
+                visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negRadius, _CMP_GT_OQ));
+            }
+
+            // 0 or ~0 per lane, packed down to 0 or 1 bytes and stored at once
+            const __m256i lanes = _mm256_castps_si256(visible);
+            const __m128i visible16 = _mm_packs_epi32(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1));
+            const __m128i visible8 = _mm_and_si128(_mm_packs_epi16(visible16, visible16), _mm_set1_epi8(1));
+            _mm_storel_epi64((__m128i*)(visibility + i), visible8);
+        }
+#elif TOY_CULL_SSE2
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(centerX + i);
+            const __m128 y = _mm_loadu_ps(centerY + i);
+            const __m128 z = _mm_loadu_ps(centerZ + i);
+            const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+            __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (uint32_t p = 0; p < 6; ++p)
+            {
+                __m128 distance = _mm_mul_ps(x, _mm_set1_ps(planes[p].x));
+                distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(planes[p].y)));
+                distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(planes[p].z)));
+                distance = _mm_add_ps(distance, _mm_set1_ps(planes[p].w));
+                visible = _mm_and_ps(visible, _mm_cmpgt_ps(distance, negRadius));
+            }
+
+            const uint32_t mask = (uint32_t)_mm_movemask_ps(visible);
+            for (uint32_t lane = 0; lane < 4; ++lane)
+            {
+                visibility[i + lane] = (uint8_t)((mask >> lane) & 1);
+            }
+        }
+#elif TOY_CULL_NEON
+        for (; i + 4 <= count; i += 4)
+        {
+            const float32x4_t x = vld1q_f32(centerX + i);
+            const float32x4_t y = vld1q_f32(centerY + i);
+            const float32x4_t z = vld1q_f32(centerZ + i);
+            const float32x4_t negRadius = vnegq_f32(vld1q_f32(radius + i));
+
+            uint32x4_t visible = vdupq_n_u32(~0u);
+            for (uint32_t p = 0; p < 6; ++p)
+            {
+                float32x4_t distance = vmulq_n_f32(x, planes[p].x);
+                distance = vaddq_f32(distance, vmulq_n_f32(y, planes[p].y));
+                distance = vaddq_f32(distance, vmulq_n_f32(z, planes[p].z));
+                distance = vaddq_f32(distance, vdupq_n_f32(planes[p].w));
+                visible = vandq_u32(visible, vcgtq_f32(distance, negRadius));
+            }
+
+            // 0 or ~0 per lane, narrowed twice down to 0 or 1 bytes
+            const uint16x4_t visible16 = vmovn_u32(visible);
+            const uint8x8_t visible8 = vmovn_u16(vcombine_u16(visible16, visible16));
+            const uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(vand_u8(visible8, vdup_n_u8(1))), 0);
+            memcpy(visibility + i, &packed, sizeof(packed));
+        }
+#endif
+        cullSpheresScalar(bounds, planes, i, count, visibility);
+    }
+
+    const char* getSphereCullingPath()
+    {
+#if TOY_CULL_AVX512
+        return "AVX-512 x16";
+#elif TOY_CULL_AVX2
+        return "AVX2 x8";
+#elif TOY_CULL_SSE2
+        return "SSE2 x4";
+#elif TOY_CULL_NEON
+        return "NEON x4";
+#else
+        return "scalar";
+#endif
+    }
+
+    void benchmarkSphereCulling(uint32_t count)
+    {
+        constexpr uint32_t Runs = 20;
+
+        // Spread around a camera at the origin looking down -z, roughly half of them end up inside
+        SphereBoundsSoA bounds;
+        bounds.resize(count);
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+        std::uniform_real_distribution<float> size(0.5f, 20.0f);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            bounds.m_centerX[i] = position(rng);
+            bounds.m_centerY[i] = position(rng) * 0.25f;
+            bounds.m_centerZ[i] = position(rng);
+            bounds.m_radius[i] = size(rng);
+        }
+
+        Camera camera;
+        camera.setPosition(glm::vec3(0.0f));
+        camera.setTarget(glm::vec3(0.0f, 0.0f, -1.0f));
+        camera.setPerspective(70.0f, 16.0f / 9.0f);
+        camera.update();
+        glm::vec4 planes[6];
+        camera.getFrustumPlanes(planes);
+
+        std::vector<uint8_t> simdVisibility(count);
+        std::vector<uint8_t> scalarVisibility(count);
+
+        // Best run of each, the first one also pulls the arrays in the cache
+        double simdMs = 1e30;
+        double scalarMs = 1e30;
+        for (uint32_t run = 0; run < Runs; ++run)
+        {
+            auto start = std::chrono::steady_clock::now();
+            cullSpheres(bounds, planes, simdVisibility.data());
+            auto end = std::chrono::steady_clock::now();
+            simdMs = std::min(simdMs, std::chrono::duration<double, std::milli>(end - start).count());
+
+            start = std::chrono::steady_clock::now();
+            cullSpheresScalar(bounds, planes, 0, count, scalarVisibility.data());
+            end = std::chrono::steady_clock::now();
+            scalarMs = std::min(scalarMs, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        uint32_t visible = 0;
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            visible += simdVisibility[i];
+            mismatches += simdVisibility[i] != scalarVisibility[i] ? 1 : 0;
+        }
+
+        const double millions = (double)count / 1e6;
+        printf("Sphere culling, %u spheres, %u visible, best of %u runs\n", count, visible, Runs);
+        printf("  %-8s %8.3f ms  %6.2f M spheres/ms\n", getSphereCullingPath(), simdMs,
+               millions / std::max(simdMs, 1e-6));
+        printf("  %-8s %8.3f ms  %6.2f M spheres/ms\n", "scalar", scalarMs, millions / std::max(scalarMs, 1e-6));
+        if (mismatches > 0)
+        {
+            printf("  %u spheres differ from the scalar path\n", mismatches);
+        }
+    }
+
+    bool isMeshletBackfacing(const Meshlet& meshlet, const glm::mat4& model, const glm::vec3& eyePos)
+    {
+        // Cutoff 1 is meshoptimizer's no usable cone, would still cull an eye sitting exactly on the axis
+        const glm::vec3 axis = glm::vec3(meshlet.m_coneAxis[0], meshlet.m_coneAxis[1], meshlet.m_coneAxis[2]);
+        if (axis == glm::vec3(0.0f) || meshlet.m_coneCutoff >= 1.0f)
+        {
+            return false;
+        }
+
+        const glm::vec3 apex = glm::vec3(model * glm::vec4(meshlet.m_coneApex[0], meshlet.m_coneApex[1],
+                                                           meshlet.m_coneApex[2], 1.0f));
+        const glm::vec3 worldAxis = glm::normalize(glm::mat3(model) * axis);
+        const glm::vec3 v = apex - eyePos;
+        return glm::dot(v, worldAxis) >= meshlet.m_coneCutoff * glm::length(v);
+    }
+
+    void cullMeshlets(const Mesh& mesh, const glm::mat4& model, const glm::vec4 planes[6], const glm::vec3& eyePos,
+                      MeshletCullCounts& counts)
+    {
+        const float scale = getMaxAxisScale(model);
+        for (const Meshlet& meshlet : mesh.m_meshlets)
+        {
+            ++counts.m_tested;
+
+            const glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.m_center[0], meshlet.m_center[1],
+                                                                 meshlet.m_center[2], 1.0f));
+            if (!isSphereInFrustum(planes, center, meshlet.m_radius * scale))
+            {
+                ++counts.m_frustumCulled;
+            }
+            else if (isMeshletBackfacing(meshlet, model, eyePos))
+            {
+                ++counts.m_coneCulled;
+            }
+        }
+    }
+
+    MeshletCullCounts cullScene(Scene& scene, const glm::vec4 planes[6], const glm::vec3& eyePos)
+    {
+        MeshletCullCounts counts;
+        const TransformManager& transformSystem = scene.transformSystem;
+        std::vector<uint8_t> visibility(transformSystem.WorldBounds.size());
+        cullSpheres(transformSystem.WorldBounds, planes, visibility.data());
+
+        auto view = scene.getRegistry().view<Mesh*, TransformIndex>();
+        for (const auto& [entity, mesh, transformIndex] : view.each())
+        {
+            if (!visibility[transformIndex.index])
+            {
+                continue;
+            }
+            cullMeshlets(*mesh, transformSystem.TransformsData[transformIndex.index].modelMatrix, planes, eyePos,
+                         counts);
+        }
+        return counts;
+    }
+
+    void CullingValidator::setExpected(uint32_t frameIndex, const MeshletCullCounts& counts)
+    {
+        m_expected[frameIndex] = counts;
+        m_pending[frameIndex] = true;
+    }
+
+    void CullingValidator::compare(uint32_t frameIndex, const MeshletCullCounts& gpuCounts)
+    {
+        if (!m_pending[frameIndex])
+        {
+            return;
+        }
+        m_pending[frameIndex] = false;
+
+        const MeshletCullCounts& expected = m_expected[frameIndex];
+        const uint32_t difference = (uint32_t)(std::abs((int64_t)gpuCounts.m_tested - (int64_t)expected.m_tested) +
+            std::abs((int64_t)gpuCounts.m_frustumCulled - (int64_t)expected.m_frustumCulled) +
+            std::abs((int64_t)gpuCounts.m_coneCulled - (int64_t)expected.m_coneCulled));
+
+        ++m_comparedFrames;
+        if ((float)difference <= MismatchTolerance * (float)std::max(expected.m_tested, 1u))
+        {
+            ++m_matchingFrames;
+        }
+        else
+        {
+            printf("Culling check: mismatch, gpu %u tested %u frustum %u cone, cpu %u tested %u frustum %u cone\n",
+                   gpuCounts.m_tested, gpuCounts.m_frustumCulled, gpuCounts.m_coneCulled, expected.m_tested,
+                   expected.m_frustumCulled, expected.m_coneCulled);
+        }
+        m_maxDifference = std::max(m_maxDifference, difference);
+
+        m_totalTested += gpuCounts.m_tested;
+        m_totalFrustumCulled += gpuCounts.m_frustumCulled;
+        m_totalConeCulled += gpuCounts.m_coneCulled;
+    }
+
+    void CullingValidator::report() const
+    {
+        if (m_comparedFrames == 0)
+        {
+            printf("Culling check: no frames compared\n");
+            return;
+        }
+
+        const double tested = (double)std::max(m_totalTested, (uint64_t)1);
+        printf("Culling check: %u/%u frames match the CPU reference (max %u meshlets off)\n", m_matchingFrames,
+               m_comparedFrames, m_maxDifference);
+        printf("Meshlets: %llu tested, %.1f%% frustum culled, %.1f%% cone culled, %.1f%% emitted\n",
+               (unsigned long long)m_totalTested, 100.0 * (double)m_totalFrustumCulled / tested,
+               100.0 * (double)m_totalConeCulled / tested,
+               100.0 * (double)(m_totalTested - m_totalFrustumCulled - m_totalConeCulled) / tested);
+    }
+
+}
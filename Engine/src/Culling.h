@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include "Common/Common.h"
+
+namespace ToyEngine
+{
+
+    struct Mesh;
+    struct Meshlet;
+    class Scene;
+    struct SphereBoundsSoA;
+
+    // CPU side of the culling tests the shaders run (cull.comp for instances, mesh.task for meshlets).
+    // Same math and same order as the GLSL in common.glsl, kept in sync by hand
+
+    // Biggest axis scale of the model matrix, keeps a transformed sphere conservative under non uniform scale
+    float getMaxAxisScale(const glm::mat4& model);
+
+    // Planes as Camera::getFrustumPlanes, normals pointing inside
+    bool isSphereInFrustum(const glm::vec4 planes[6], const glm::vec3& center, float radius);
+
+    // Same test as isSphereInFrustum over every sphere of the SoA, 16 (AVX-512), 8 (AVX2) or 4 (SSE2, NEON) at a
+    // time depending on what the build targets (genie --simd). visibility gets 1 for spheres that touch the frustum, 0 for the rest
+    void cullSpheres(const SphereBoundsSoA& bounds, const glm::vec4 planes[6], uint8_t* visibility);
+
+    // Which cullSpheres path this build runs, for logs and the UI
+    const char* getSphereCullingPath();
+
+    // --bench-cull: random spheres against a default camera, SIMD against the scalar loop. Prints the best run
+    void benchmarkSphereCulling(uint32_t count);
+
+    // Normal cone test, true when every triangle of the meshlet faces away from the eye
+    bool isMeshletBackfacing(const Meshlet& meshlet, const glm::mat4& model, const glm::vec3& eyePos);
+
+    // Mirrors MeshletCounters, plus the frustum rejects counted on their own
+    struct MeshletCullCounts
+    {
+        uint32_t m_tested = 0;
+        uint32_t m_frustumCulled = 0;
+        uint32_t m_coneCulled = 0;
+    };
+
+    // Does what the task shader does for one instance draw, sphere against the frustum first then the cone
+    void cullMeshlets(const Mesh& mesh, const glm::mat4& model, const glm::vec4 planes[6], const glm::vec3& eyePos,
+                      MeshletCullCounts& counts);
+
+    // Reference counts for a whole frame. Both draw paths cull instances first, meshlets of rejected instances
+    // never reach the task shader
+    MeshletCullCounts cullScene(Scene& scene, const glm::vec4 planes[6], const glm::vec3& eyePos);
+
+    // Checks the GPU meshlet counters against the CPU reference of the same frame. Counters come back
+    // MaxFramesInFlight frames late, expectations are kept per frame slot until then
+    class CullingValidator
+    {
+    public:
+        void setExpected(uint32_t frameIndex, const MeshletCullCounts& counts);
+
+        // Right after the slot's counters were read back
+        void compare(uint32_t frameIndex, const MeshletCullCounts& gpuCounts);
+
+        // Prints the totals, culled percentages and how often the GPU agreed with the reference
+        void report() const;
+
+    private:
+        MeshletCullCounts m_expected[MaxFramesInFlight];
+        bool m_pending[MaxFramesInFlight] = {};
+
+        // Over every compared frame, can get past 32 bits on long runs
+        uint64_t m_totalTested = 0;
+        uint64_t m_totalFrustumCulled = 0;
+        uint64_t m_totalConeCulled = 0;
+        uint32_t m_comparedFrames = 0;
+        uint32_t m_matchingFrames = 0;
+        // Meshlets decided differently, sphere/cone tests on the edge can flip with float precision
+        uint32_t m_maxDifference = 0;
+    };
+
+}
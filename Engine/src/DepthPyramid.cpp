@@ -0,0 +1,270 @@
+#include "DepthPyramid.h"
+#include "Pipeline.h"
+#include "PipelineManager.h"
+
+#include <algorithm>
+
+namespace ToyEngine
+{
+
+    static uint32_t previousPow2(uint32_t value)
+    {
+        uint32_t result = 1;
+        while (result * 2 <= value)
+        {
+            result *= 2;
+        }
+        return result;
+    }
+
+    void DepthPyramid::init(GpuContext& ctx, ResourceManager& resourceManager, PipelineManager& pipelineManager,
+                            VkShaderModule reduceShader)
+    {
+        m_ctx = &ctx;
+        m_resourceManager = &resourceManager;
+        m_pipelineManager = &pipelineManager;
+
+        // Linear filtering over a 2x2 footprint returns the smallest of the four, farthest in reverse Z
+        VkSamplerReductionModeCreateInfo reductionInfo{VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO};
+        reductionInfo.reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN;
+
+        VkSamplerCreateInfo samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+        samplerInfo.pNext = &reductionInfo;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = (float)MaxMips;
+        VK_CHECK(vkCreateSampler(ctx.m_device, &samplerInfo, nullptr, &m_sampler));
+        m_samplerIndex = pipelineManager.addSampler(m_sampler);
+
+        VkDescriptorSetLayoutBinding bindings[2] = {};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+        layoutInfo.bindingCount = 2;
+        layoutInfo.pBindings = bindings;
+        VK_CHECK(vkCreateDescriptorSetLayout(ctx.m_device, &layoutInfo, nullptr, &m_reduceLayout));
+
+        constexpr uint32_t setCount = MaxFramesInFlight * MaxMips;
+        VkDescriptorPoolSize poolSizes[] = {
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount}
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        poolInfo.maxSets = setCount;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes = poolSizes;
+        VK_CHECK(vkCreateDescriptorPool(ctx.m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+        VkDescriptorSetLayout setLayouts[MaxMips];
+        std::fill(setLayouts, setLayouts + MaxMips, m_reduceLayout);
+        for (uint32_t frame = 0; frame < MaxFramesInFlight; ++frame)
+        {
+            VkDescriptorSetAllocateInfo allocInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+            allocInfo.descriptorPool = m_descriptorPool;
+            allocInfo.descriptorSetCount = MaxMips;
+            allocInfo.pSetLayouts = setLayouts;
+            VK_CHECK(vkAllocateDescriptorSets(ctx.m_device, &allocInfo, m_reduceSets[frame]));
+        }
+
+        PipelineConfig config{};
+        config.m_computeShader = reduceShader;
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(DepthReduceLayout);
+
+        m_reducePipeline = resourceManager.createPipeline(
+            config, {pipelineManager.getGlobalDescriptorSetLayout(), m_reduceLayout}, {pushConstantRange});
+    }
+
+    void DepthPyramid::destroy()
+    {
+        if (!m_ctx)
+        {
+            return;
+        }
+
+        // Device is idle here, the deferred part runs with the resource manager cleanup
+        destroyImage();
+        vkDestroyDescriptorPool(m_ctx->m_device, m_descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(m_ctx->m_device, m_reduceLayout, nullptr);
+        vkDestroySampler(m_ctx->m_device, m_sampler, nullptr);
+        m_descriptorPool = VK_NULL_HANDLE;
+        m_reduceLayout = VK_NULL_HANDLE;
+        m_sampler = VK_NULL_HANDLE;
+        m_ctx = nullptr;
+    }
+
+    void DepthPyramid::resize(uint32_t depthWidth, uint32_t depthHeight)
+    {
+        const uint32_t width = previousPow2(depthWidth);
+        const uint32_t height = previousPow2(depthHeight);
+        if (isValid() && width == m_width && height == m_height)
+        {
+            return;
+        }
+        destroyImage();
+
+        m_width = width;
+        m_height = height;
+        m_mipCount = 1;
+        while ((std::max(m_width, m_height) >> m_mipCount) > 0 && m_mipCount < MaxMips)
+        {
+            ++m_mipCount;
+        }
+
+        VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {m_width, m_height, 1};
+        imageInfo.mipLevels = m_mipCount;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VK_CHECK(vkCreateImage(m_ctx->m_device, &imageInfo, nullptr, &m_image));
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_ctx->m_device, m_image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = m_ctx->findMemoryType(memRequirements.memoryTypeBits,
+                                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        m_memory = m_ctx->allocateMemory(allocInfo, MemoryCategory::RenderTargets);
+        m_memoryTypeIndex = allocInfo.memoryTypeIndex;
+        m_allocationSize = allocInfo.allocationSize;
+        VK_CHECK(vkBindImageMemory(m_ctx->m_device, m_image, m_memory, 0));
+
+        VkImageViewCreateInfo viewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        viewInfo.image = m_image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipCount, 0, 1};
+        VK_CHECK(vkCreateImageView(m_ctx->m_device, &viewInfo, nullptr, &m_view));
+
+        for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+        {
+            viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 1};
+            VK_CHECK(vkCreateImageView(m_ctx->m_device, &viewInfo, nullptr, &m_mipViews[mip]));
+        }
+
+        m_bindlessIndex = m_pipelineManager->addImage(m_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    void DepthPyramid::destroyImage()
+    {
+        if (m_image == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // Frames in flight can still be sampling it, the bindless slot is only handed out again after them too
+        VkImageView mipViews[MaxMips];
+        std::copy(m_mipViews, m_mipViews + MaxMips, mipViews);
+        m_resourceManager->deferDestruction(
+            [ctx = m_ctx, pipelineManager = m_pipelineManager, image = m_image, view = m_view, mipViews,
+             mipCount = m_mipCount, memory = m_memory, memoryTypeIndex = m_memoryTypeIndex,
+             allocationSize = m_allocationSize, bindlessIndex = m_bindlessIndex]()
+            {
+                for (uint32_t mip = 0; mip < mipCount; ++mip)
+                {
+                    vkDestroyImageView(ctx->m_device, mipViews[mip], nullptr);
+                }
+                vkDestroyImageView(ctx->m_device, view, nullptr);
+                vkDestroyImage(ctx->m_device, image, nullptr);
+                ctx->freeMemory(memory, MemoryCategory::RenderTargets, memoryTypeIndex, allocationSize);
+                pipelineManager->releaseImage(bindlessIndex);
+            });
+
+        m_image = VK_NULL_HANDLE;
+        m_view = VK_NULL_HANDLE;
+        std::fill(m_mipViews, m_mipViews + MaxMips, VK_NULL_HANDLE);
+        m_memory = VK_NULL_HANDLE;
+        m_mipCount = 0;
+    }
+
+    void DepthPyramid::build(VkCommandBuffer cmd, VkImageView depthView, uint32_t frameIndex)
+    {
+        Pipeline* pipeline = m_resourceManager->getPipeline(m_reducePipeline);
+        VkDescriptorSet* sets = m_reduceSets[frameIndex];
+
+        // Source of every mip is the one above, mip 0 reads the depth buffer itself
+        VkDescriptorImageInfo sourceInfos[MaxMips] = {};
+        VkDescriptorImageInfo targetInfos[MaxMips] = {};
+        VkWriteDescriptorSet writes[MaxMips * 2] = {};
+        for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+        {
+            sourceInfos[mip].sampler = m_sampler;
+            sourceInfos[mip].imageView = mip == 0 ? depthView : m_mipViews[mip - 1];
+            sourceInfos[mip].imageLayout = mip == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+            targetInfos[mip].imageView = m_mipViews[mip];
+            targetInfos[mip].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet& source = writes[mip * 2];
+            source.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            source.dstSet = sets[mip];
+            source.dstBinding = 0;
+            source.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            source.descriptorCount = 1;
+            source.pImageInfo = &sourceInfos[mip];
+
+            VkWriteDescriptorSet& target = writes[mip * 2 + 1];
+            target.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            target.dstSet = sets[mip];
+            target.dstBinding = 1;
+            target.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            target.descriptorCount = 1;
+            target.pImageInfo = &targetInfos[mip];
+        }
+        vkUpdateDescriptorSets(m_ctx->m_device, m_mipCount * 2, writes, 0, nullptr);
+
+        for (uint32_t mip = 0; mip < m_mipCount; ++mip)
+        {
+            const uint32_t mipWidth = std::max(m_width >> mip, 1u);
+            const uint32_t mipHeight = std::max(m_height >> mip, 1u);
+
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->getLayout(), 1, 1, &sets[mip], 0,
+                                    nullptr);
+            DepthReduceLayout push = {{(float)mipWidth, (float)mipHeight}};
+            vkCmdPushConstants(cmd, pipeline->getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReduceLayout),
+                               &push);
+            vkCmdDispatch(cmd, divideAndRoundUp(mipWidth, 8), divideAndRoundUp(mipHeight, 8), 1);
+
+            // Next mip samples this one, the graph only syncs the pyramid as a whole between passes
+            VkImageMemoryBarrier2 barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = m_image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 1, 0, 1};
+
+            VkDependencyInfo dependencyInfo{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+            dependencyInfo.imageMemoryBarrierCount = 1;
+            dependencyInfo.pImageMemoryBarriers = &barrier;
+            vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+        }
+    }
+
+}
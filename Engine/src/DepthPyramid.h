@@ -0,0 +1,75 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+
+#include "Common/Common.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    class PipelineManager;
+
+    // Hierarchical depth for occlusion culling: R32 mip chain where every texel holds the farthest (reverse Z, so
+    // smallest) depth of the area it covers. Mip 0 is the previous power of two of the depth buffer, each mip is
+    // reduced from the one above with a MIN reduction sampler (needs samplerFilterMinmax).
+    // Culling shaders sample it through the bindless set in SHADER_READ_ONLY_OPTIMAL
+    class DepthPyramid
+    {
+    public:
+        static constexpr uint32_t MaxMips = 16;
+
+        // reduceShader: Shaders/depth_reduce.comp.spv
+        void init(GpuContext& ctx, ResourceManager& resourceManager, PipelineManager& pipelineManager,
+                  VkShaderModule reduceShader);
+        void destroy();
+
+        // Recreates the pyramid for a new depth size, the old one is destroyed once the frames in flight are done
+        void resize(uint32_t depthWidth, uint32_t depthHeight);
+
+        // Inside a compute pass with depth in SHADER_READ_ONLY_OPTIMAL and the whole pyramid in GENERAL
+        void build(VkCommandBuffer cmd, VkImageView depthView, uint32_t frameIndex);
+
+        VkImage getImage() const { return m_image; }
+        VkImageView getView() const { return m_view; }
+        uint32_t getWidth() const { return m_width; }
+        uint32_t getHeight() const { return m_height; }
+        uint32_t getMipCount() const { return m_mipCount; }
+        bool isValid() const { return m_image != VK_NULL_HANDLE; }
+
+        uint32_t getBindlessIndex() const { return m_bindlessIndex; }
+        uint32_t getSamplerIndex() const { return m_samplerIndex; }
+        PipelineHandle getReducePipeline() const { return m_reducePipeline; }
+
+    private:
+        void destroyImage();
+
+        GpuContext* m_ctx = nullptr;
+        ResourceManager* m_resourceManager = nullptr;
+        PipelineManager* m_pipelineManager = nullptr;
+
+        VkImage m_image = VK_NULL_HANDLE;
+        VkDeviceMemory m_memory = VK_NULL_HANDLE;
+        uint32_t m_memoryTypeIndex = 0;
+        VkDeviceSize m_allocationSize = 0;
+        // Whole chain for sampling, one per mip for the reduction writes
+        VkImageView m_view = VK_NULL_HANDLE;
+        VkImageView m_mipViews[MaxMips] = {};
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_mipCount = 0;
+        uint32_t m_bindlessIndex = 0;
+
+        VkSampler m_sampler = VK_NULL_HANDLE;
+        uint32_t m_samplerIndex = 0;
+
+        // Set 1 of the reduce pipeline, set 0 is the global one the pass executor binds
+        VkDescriptorSetLayout m_reduceLayout = VK_NULL_HANDLE;
+        VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+        // Written right before use, the frame slot is free again after the timeline wait
+        VkDescriptorSet m_reduceSets[MaxFramesInFlight][MaxMips] = {};
+        PipelineHandle m_reducePipeline;
+    };
+
+}
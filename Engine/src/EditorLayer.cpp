@@ -4,19 +4,44 @@
 #include <imgui_impl_glfw.h>
 
 #include "Common/Common.h"
+#include "RenderGraph.h"
+#include "PassTimings.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "HeapStats.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 
 namespace ToyEngine
 {
 
-    void EditorLayer::init(const GpuContext& ctx, ResourceManager* resourceManager, GLFWwindow* window, VkFormat colorFormat)
+    // ImGui goes through malloc, not operator new, count it by hand so the frame heap counter sees it
+    static void* imguiAlloc(size_t size, void*)
+    {
+        countHeapAllocation();
+        return malloc(size);
+    }
+
+    static void imguiFree(void* pointer, void*)
+    {
+        free(pointer);
+    }
+
+    void EditorLayer::init(const GpuContext& ctx, ResourceManager* resourceManager, TransientAllocator* transientAllocator, GLFWwindow* window, VkFormat colorFormat)
     {
         m_window = window;
         m_ctx = &ctx;
         m_resourceManager = resourceManager;
+        m_transientAllocator = transientAllocator;
 
         // Setup Dear ImGui context
         IMGUI_CHECKVERSION();
+        if (isHeapCountingEnabled())
+        {
+            ImGui::SetAllocatorFunctions(imguiAlloc, imguiFree);
+        }
         ImGui::CreateContext();
         ImGuiIO& io = ImGui::GetIO();
         io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
@@ -29,9 +54,6 @@ namespace ToyEngine
 
         createPipeline(ctx, colorFormat);
         createFontAtlas(ctx);
-
-        m_vertexBuffer = m_resourceManager->createBuffer(1024 * 1024, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        m_indexBuffer = m_resourceManager->createBuffer(1024 * 1024, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     }
 
     void EditorLayer::beginFrame()
@@ -50,28 +72,24 @@ namespace ToyEngine
             return;
         }
 
-        // Update vertex/index buffers
-        size_t vertexSize = drawData->TotalVtxCount * sizeof(ImDrawVert);
-        size_t indexSize = drawData->TotalIdxCount * sizeof(ImDrawIdx);
-        Buffer* vertexBuffer = m_resourceManager->getBuffer(m_vertexBuffer);
-        Buffer* indexBuffer = m_resourceManager->getBuffer(m_indexBuffer);
-
-        if (vertexBuffer->m_size < vertexSize)
+        // Geometry lives in this frame's transient region, no buffers to regrow
+        uint32_t vertexSize = (uint32_t)(drawData->TotalVtxCount * sizeof(ImDrawVert));
+        uint32_t indexSize = (uint32_t)(drawData->TotalIdxCount * sizeof(ImDrawIdx));
+        if (vertexSize + indexSize > MaxGeometryBytes)
         {
-            m_resourceManager->destroyBuffer(m_vertexBuffer);
-            m_vertexBuffer = m_resourceManager->createBuffer((uint32_t)vertexSize * 2, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-            vertexBuffer = m_resourceManager->getBuffer(m_vertexBuffer);
-        }
-
-        if (indexBuffer->m_size < indexSize)
-        {
-            m_resourceManager->destroyBuffer(m_indexBuffer);
-            m_indexBuffer = m_resourceManager->createBuffer((uint32_t)indexSize * 2, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-            indexBuffer = m_resourceManager->getBuffer(m_indexBuffer);
+            if (!m_geometryOverflowReported)
+            {
+                printf("EditorLayer: %u bytes of UI geometry over the %u budget, UI not drawn\n", vertexSize + indexSize,
+                       MaxGeometryBytes);
+                m_geometryOverflowReported = true;
+            }
+            return;
         }
+        TransientAllocation vertexAllocation = m_transientAllocator->allocate(vertexSize);
+        TransientAllocation indexAllocation = m_transientAllocator->allocate(indexSize);
 
-        ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer->map(*m_ctx);
-        ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer->map(*m_ctx);
+        ImDrawVert* vtxDst = (ImDrawVert*)vertexAllocation.m_data;
+        ImDrawIdx* idxDst = (ImDrawIdx*)indexAllocation.m_data;
 
         for (int n = 0; n < drawData->CmdListsCount; n++)
         {
@@ -82,9 +100,6 @@ namespace ToyEngine
             idxDst += cmdList->IdxBuffer.Size;
         }
 
-        vertexBuffer->unmap(*m_ctx);
-        indexBuffer->unmap(*m_ctx);
-
         // Bind pipeline and descriptor sets
         Pipeline* pipeline = m_resourceManager->getPipeline(m_pipeline);
         if (pipeline)
@@ -97,14 +112,12 @@ namespace ToyEngine
             pc.scale[1] = 2.0f / drawData->DisplaySize.y;
             pc.translate[0] = -1.0f - drawData->DisplayPos.x * pc.scale[0];
             pc.translate[1] = -1.0f - drawData->DisplayPos.y * pc.scale[1];
-            pc.VertexDataPtr = vertexBuffer->m_gpuAddress;
+            pc.VertexDataPtr = vertexAllocation.m_gpuAddress;
             
             vkCmdPushConstants(cmd, pipeline->getLayout(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pc), &pc);
         }
 
-        VkDeviceSize offset = 0;
-        //vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer->m_buffer, &offset);
-        vkCmdBindIndexBuffer(cmd, indexBuffer->m_buffer, 0, sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(cmd, indexAllocation.m_buffer, indexAllocation.m_offset, sizeof(ImDrawIdx) == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
 
         int vtxOffset = 0;
         int idxOffset = 0;
@@ -140,13 +153,153 @@ namespace ToyEngine
         }
     }
 
+    void EditorLayer::drawRenderGraphPanel(const RenderGraph& graph, const PassTimings* timings)
+    {
+        ImGui::Begin("Render Graph");
+        ImGui::Text("%u passes, %u culled, %u async, compiled %u times", graph.getPassCount(),
+                    graph.getCulledPassCount(), graph.getAsyncPassCount(), graph.getCompileCount());
+        if (timings && !timings->hasGpuTimings())
+        {
+            ImGui::Text("No timestamp support, CPU timings only");
+        }
+
+        if (ImGui::BeginTable("Passes", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit))
+        {
+            ImGui::TableSetupColumn("Pass", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Queue");
+            ImGui::TableSetupColumn("CPU ms");
+            ImGui::TableSetupColumn("GPU ms");
+            ImGui::TableSetupColumn("Barriers");
+            ImGui::TableHeadersRow();
+
+            const std::vector<uint32_t>& order = graph.getExecutionOrder();
+            for (uint32_t orderIndex = 0; orderIndex < order.size(); ++orderIndex)
+            {
+                const uint32_t passIndex = order[orderIndex];
+                const PassTiming* timing = timings ? &timings->get(passIndex) : nullptr;
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(graph.getPass(passIndex).name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(getQueueTypeName(graph.getPassQueue(orderIndex)));
+                ImGui::TableNextColumn();
+                if (timing)
+                {
+                    ImGui::Text("%.3f", timing->m_cpuMs);
+                }
+                ImGui::TableNextColumn();
+                if (timing && timing->m_gpuValid)
+                {
+                    ImGui::Text("%.3f", timing->m_gpuMs);
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text("%u", (uint32_t)graph.getBarriers(orderIndex).size());
+            }
+
+            // Culled ones at the end, greyed out
+            for (uint32_t passIndex = 0; passIndex < graph.getPassCount(); ++passIndex)
+            {
+                if (!graph.isPassCulled(passIndex))
+                {
+                    continue;
+                }
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextDisabled("%s (culled)", graph.getPass(passIndex).name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::TextDisabled("%s", getQueueTypeName(graph.getPass(passIndex).queue));
+            }
+            ImGui::EndTable();
+        }
+
+        if (ImGui::Button("Export dot"))
+        {
+            graph.exportDot("frame_graph.dot", timings);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export JSON"))
+        {
+            graph.exportJson("frame_graph.json", timings);
+        }
+        ImGui::End();
+    }
+
+    void EditorLayer::drawGpuProfilerPanel(const GpuProfiler& profiler)
+    {
+        ImGui::Begin("GPU Profiler");
+        if (!profiler.isSupported())
+        {
+            ImGui::Text("No timestamp support, CPU recording times only");
+        }
+
+        // Zones come in opening order with their depth, children of a collapsed node are skipped
+        const std::vector<GpuZone>& zones = profiler.getResolvedZones();
+        uint32_t openDepth = 0;
+        for (uint32_t i = 0; i < zones.size(); ++i)
+        {
+            const GpuZone& zone = zones[i];
+            while (openDepth > zone.m_depth)
+            {
+                ImGui::TreePop();
+                --openDepth;
+            }
+            if (zone.m_depth > openDepth)
+            {
+                continue;
+            }
+
+            const bool hasChildren = i + 1 < zones.size() && zones[i + 1].m_depth > zone.m_depth &&
+                zones[i + 1].m_queue == zone.m_queue;
+            ImGuiTreeNodeFlags flags = hasChildren
+                ? ImGuiTreeNodeFlags_DefaultOpen
+                : ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+
+            bool open = false;
+            if (zone.m_gpuValid)
+            {
+                open = ImGui::TreeNodeEx((void*)(intptr_t)i, flags, "%s: gpu %.3f ms, cpu %.3f ms", zone.m_name,
+                                         zone.m_gpuEndMs - zone.m_gpuBeginMs, zone.m_cpuEndMs - zone.m_cpuBeginMs);
+            }
+            else
+            {
+                open = ImGui::TreeNodeEx((void*)(intptr_t)i, flags, "%s: cpu %.3f ms", zone.m_name,
+                                         zone.m_cpuEndMs - zone.m_cpuBeginMs);
+            }
+            if (hasChildren && open)
+            {
+                ++openDepth;
+            }
+        }
+        while (openDepth > 0)
+        {
+            ImGui::TreePop();
+            --openDepth;
+        }
+
+        // The main loop writes the trace once the capture and its GPU results are done
+        static int captureFrames = 8;
+        ImGui::SetNextItemWidth(100.0f);
+        ImGui::InputInt("Frames", &captureFrames);
+        captureFrames = std::clamp(captureFrames, 1, (int)GpuProfiler::HistoryFrameCount);
+        ImGui::SameLine();
+        if (CpuProfiler::isCaptureActive())
+        {
+            ImGui::Text("Capturing...");
+        }
+        else if (ImGui::Button("Capture Chrome trace"))
+        {
+            CpuProfiler::requestCapture((uint32_t)captureFrames);
+        }
+        ImGui::End();
+    }
+
     void EditorLayer::destroy()
     {
         m_resourceManager->destroyPipeline(m_pipeline);
         
         m_resourceManager->destroyTexture(m_fontTexture);
-        m_resourceManager->destroyBuffer(m_vertexBuffer);
-        m_resourceManager->destroyBuffer(m_indexBuffer);
 
         if (m_sampler)
         {
@@ -206,6 +359,8 @@ namespace ToyEngine
         config.m_colorFormat = colorFormat;
         config.m_depthTest = false;
         config.m_depthWrite = false;
+        // Editor pass renders on its own scope with only the color attachment
+        config.m_depthFormat = VK_FORMAT_UNDEFINED;
         config.m_blending = true;
         config.m_cullMode = VK_CULL_MODE_NONE;
 
@@ -224,9 +379,9 @@ namespace ToyEngine
         int width, height;
         io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
 
-        m_fontTexture = m_resourceManager->createTexture(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+        m_fontTexture = m_resourceManager->createTexture(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT, MemoryCategory::UI);
+        m_resourceManager->uploadTextureData(m_fontTexture, pixels, width * height * 4);
         Texture* fontTexture = m_resourceManager->getTexture(m_fontTexture);
-        fontTexture->uploadData(ctx, pixels, width * height * 4);
 
         // Create sampler
         VkSamplerCreateInfo samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
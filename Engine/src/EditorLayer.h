@@ -9,19 +9,33 @@
 #include "GpuResources.h"
 #include "Pipeline.h"
 #include "ResourceManager.h"
+#include "TransientAllocator.h"
 
 namespace ToyEngine
 {
 
+    class RenderGraph;
+    class PassTimings;
+    class GpuProfiler;
+
     class EditorLayer
     {
     public:
-        void init(const GpuContext& ctx, ResourceManager* resourceManager, GLFWwindow* window, VkFormat colorFormat);
+        // ImGui vertex + index bytes of a frame in the transient allocator, a frame over that isn't drawn
+        static constexpr uint32_t MaxGeometryBytes = 2 * 1024 * 1024;
+
+        void init(const GpuContext& ctx, ResourceManager* resourceManager, TransientAllocator* transientAllocator, GLFWwindow* window, VkFormat colorFormat);
 
         void beginFrame();
 
         void render(VkCommandBuffer cmd, uint32_t width, uint32_t height);
 
+        // Live pass list in compiled order with their timings, plus dot/JSON export of the graph
+        void drawRenderGraphPanel(const RenderGraph& graph, const PassTimings* timings);
+
+        // Zone tree of the newest resolved frame (a few frames old) plus the CPU+GPU Chrome trace capture
+        void drawGpuProfilerPanel(const GpuProfiler& profiler);
+
         void destroy();
 
         const PipelineHandle& GetPipeline() const {return m_pipeline;};
@@ -32,15 +46,10 @@ namespace ToyEngine
 
         void createFontAtlas(const GpuContext& ctx);
 
-        void updateBuffers(const GpuContext& ctx, ImDrawData* drawData);
-
         // that way will enforce the proper constructor (since I want config to be passed on constructor time)
         PipelineHandle m_pipeline;
         TextureHandle m_fontTexture;
 
-        BufferHandle m_vertexBuffer;
-        BufferHandle m_indexBuffer;
-
         VkDescriptorSetLayout m_textureLayout = VK_NULL_HANDLE;
         VkDescriptorSetLayout m_samplerLayout = VK_NULL_HANDLE;
         VkDescriptorSet m_fontDescriptorSet = VK_NULL_HANDLE;
@@ -51,6 +60,8 @@ namespace ToyEngine
         GLFWwindow* m_window = nullptr;
         const GpuContext* m_ctx = nullptr;
         ResourceManager* m_resourceManager = nullptr;
+        TransientAllocator* m_transientAllocator = nullptr;
+        bool m_geometryOverflowReported = false;
     };
 
 }
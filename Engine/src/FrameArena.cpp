@@ -0,0 +1,102 @@
+#include "FrameArena.h"
+#include "Common/Common.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace ToyEngine
+{
+
+    static size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    void FrameArena::init(size_t capacity)
+    {
+        assert(m_block == nullptr);
+        m_capacity = capacity;
+        m_block = (uint8_t*)malloc(capacity);
+        assert(m_block);
+        m_offset = 0;
+    }
+
+    void FrameArena::destroy()
+    {
+        reset();
+        free(m_block);
+        m_block = nullptr;
+        m_capacity = 0;
+    }
+
+    void* FrameArena::allocate(size_t size, size_t alignment)
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+        if (size == 0)
+        {
+            size = 1;
+        }
+
+        // Pointers are aligned, not offsets, malloc only guarantees max_align_t for the block itself
+        size_t offset = alignUp((size_t)m_block + m_offset, alignment) - (size_t)m_block;
+        if (m_overflowBlocks.empty() && offset + size <= m_capacity)
+        {
+            m_offset = offset + size;
+            m_usedBytes = m_offset;
+            return m_block + offset;
+        }
+
+        uint8_t* overflow = m_overflowBlocks.empty() ? nullptr : m_overflowBlocks.back();
+        offset = overflow ? alignUp((size_t)overflow + m_overflowOffset, alignment) - (size_t)overflow : 0;
+        if (!overflow || offset + size > m_overflowCapacity)
+        {
+            // At least as big as the main block, a frame should only need a couple of these
+            m_overflowCapacity = size + alignment > m_capacity ? size + alignment : m_capacity;
+            overflow = (uint8_t*)malloc(m_overflowCapacity);
+            assert(overflow);
+            m_overflowBlocks.push_back(overflow);
+            m_overflowBytes += m_overflowCapacity;
+            offset = alignUp((size_t)overflow, alignment) - (size_t)overflow;
+        }
+
+        m_overflowOffset = offset + size;
+        m_usedBytes = m_offset + m_overflowBytes - m_overflowCapacity + m_overflowOffset;
+        return overflow + offset;
+    }
+
+    void FrameArena::reset()
+    {
+        if (m_usedBytes > m_peakBytes)
+        {
+            m_peakBytes = m_usedBytes;
+        }
+
+        if (!m_overflowBlocks.empty())
+        {
+            // Last frame didn't fit, grow once so the next ones do
+            for (uint8_t* block : m_overflowBlocks)
+            {
+                free(block);
+            }
+            const size_t capacity = m_capacity + m_overflowBytes;
+            printf("FrameArena: grew from %zu to %zu bytes\n", m_capacity, capacity);
+            m_overflowBlocks.clear();
+            m_overflowBytes = 0;
+            m_overflowOffset = 0;
+            m_overflowCapacity = 0;
+            ++m_growCount;
+
+            if (m_block)
+            {
+                free(m_block);
+                m_block = (uint8_t*)malloc(capacity);
+                assert(m_block);
+                m_capacity = capacity;
+            }
+        }
+
+        m_offset = 0;
+        m_usedBytes = 0;
+    }
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace ToyEngine
+{
+
+    // Bump allocator for CPU data that only lives for one frame (pass scratch, draw lists, barrier batches).
+    // Nothing is freed on its own, reset() at the start of the frame drops everything at once.
+    // Running out of space chains one more block for the rest of the frame, the next reset folds them all into
+    // a single bigger block so steady state is one block and no heap traffic.
+    // Not thread safe, allocate from the thread driving the frame
+    class FrameArena
+    {
+    public:
+        void init(size_t capacity);
+        void destroy();
+
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        template<typename T>
+        T* allocateArray(size_t count)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "arena memory is never destroyed");
+            return (T*)allocate(sizeof(T) * count, alignof(T));
+        }
+
+        void reset();
+
+        size_t getCapacity() const { return m_capacity; }
+        size_t getUsedBytes() const { return m_usedBytes; }
+        size_t getPeakBytes() const { return m_peakBytes; }
+        // Frames that didn't fit in the main block, should stop growing after the first few
+        uint32_t getGrowCount() const { return m_growCount; }
+
+    private:
+        uint8_t* m_block = nullptr;
+        size_t m_capacity = 0;
+        size_t m_offset = 0;
+
+        // Extra blocks of the frame that overflowed, gone on the next reset
+        std::vector<uint8_t*> m_overflowBlocks;
+        size_t m_overflowBytes = 0;
+        size_t m_overflowOffset = 0;
+        size_t m_overflowCapacity = 0;
+
+        size_t m_usedBytes = 0;
+        size_t m_peakBytes = 0;
+        uint32_t m_growCount = 0;
+    };
+
+    // std allocator over a FrameArena, deallocate is a no-op. Without an arena it falls back to the heap so the
+    // same containers work outside of a frame
+    template<typename T>
+    struct ArenaAllocator
+    {
+        using value_type = T;
+        // Containers moved/swapped take the arena of the source along
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        FrameArena* m_arena = nullptr;
+
+        ArenaAllocator() = default;
+        ArenaAllocator(FrameArena* arena) : m_arena(arena) {}
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+        T* allocate(size_t count)
+        {
+            if (m_arena)
+            {
+                return (T*)m_arena->allocate(sizeof(T) * count, alignof(T));
+            }
+            return std::allocator<T>().allocate(count);
+        }
+
+        void deallocate(T* pointer, size_t count)
+        {
+            if (!m_arena)
+            {
+                std::allocator<T>().deallocate(pointer, count);
+            }
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+    };
+
+    // Only valid until the arena resets, don't keep one across frames
+    template<typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}
@@ -0,0 +1,225 @@
+#include "GpuProfiler.h"
+#include "GpuResources.h"
+#include "ChromeTrace.h"
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace ToyEngine
+{
+
+    void GpuProfiler::init(const GpuContext& ctx)
+    {
+        m_device = ctx.m_device;
+
+        for (FrameZones& frame : m_frames)
+        {
+            frame.m_zones.reserve(MaxZonesPerFrame);
+        }
+        for (std::vector<GpuZone>& resolved : m_history)
+        {
+            resolved.reserve(MaxZonesPerFrame);
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(ctx.m_physicalDevice, &properties);
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(ctx.m_physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(ctx.m_physicalDevice, &familyCount, families.data());
+
+        // Families without valid bits can't write timestamps, their zones only get CPU time
+        const uint32_t familyIndices[(uint32_t)QueueType::Count] = {ctx.m_graphicsFamilyIndex, ctx.m_computeFamilyIndex};
+        for (uint32_t i = 0; i < (uint32_t)QueueType::Count; ++i)
+        {
+            const uint32_t validBits = familyIndices[i] < familyCount ? families[familyIndices[i]].timestampValidBits : 0;
+            m_timestampMasks[i] = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        }
+
+        if (m_timestampMasks[(uint32_t)QueueType::Graphics] == 0)
+        {
+            printf("GpuProfiler: no timestamp support on the graphics queue, CPU timings only\n");
+            return;
+        }
+        m_timestampPeriod = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = MaxZonesPerFrame * 2;
+        for (FrameZones& frame : m_frames)
+        {
+            VK_CHECK(vkCreateQueryPool(m_device, &poolInfo, nullptr, &frame.m_pool));
+            // Host reset, nothing to record before the first use
+            vkResetQueryPool(m_device, frame.m_pool, 0, MaxZonesPerFrame * 2);
+        }
+    }
+
+    void GpuProfiler::destroy()
+    {
+        for (FrameZones& frame : m_frames)
+        {
+            if (frame.m_pool != VK_NULL_HANDLE)
+            {
+                vkDestroyQueryPool(m_device, frame.m_pool, nullptr);
+                frame.m_pool = VK_NULL_HANDLE;
+            }
+            frame.m_zones.clear();
+        }
+        m_resolvedCount = 0;
+    }
+
+    double GpuProfiler::getCpuMs() const
+    {
+        return (double)getProfilerTimeNs() / 1000000.0;
+    }
+
+    void GpuProfiler::beginFrame(uint32_t frameIndex)
+    {
+        for (uint32_t depth : m_openDepth)
+        {
+            assert(depth == 0 && "GpuProfiler: scope left open over a frame");
+            (void)depth;
+        }
+
+        m_frameIndex = frameIndex;
+        FrameZones& frame = m_frames[frameIndex];
+
+        if (!frame.m_zones.empty())
+        {
+            // The frame timeline wait already happened, everything written here is done
+            uint64_t results[MaxZonesPerFrame * 2];
+            bool gpuResults = false;
+            if (frame.m_pool != VK_NULL_HANDLE && frame.m_queryCount > 0)
+            {
+                VkResult result = vkGetQueryPoolResults(m_device, frame.m_pool, 0, frame.m_queryCount, sizeof(results),
+                                                        results, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+                gpuResults = result == VK_SUCCESS;
+            }
+
+            uint64_t base = ~0ull;
+            for (const GpuZone& zone : frame.m_zones)
+            {
+                if (gpuResults && zone.m_query != ~0u)
+                {
+                    base = std::min(base, results[zone.m_query]);
+                }
+            }
+
+            m_newestResolved = (m_newestResolved + 1) % HistoryFrameCount;
+            m_resolvedCount = std::min(m_resolvedCount + 1, HistoryFrameCount);
+            ++m_totalResolved;
+            std::vector<GpuZone>& resolved = m_history[m_newestResolved];
+            resolved.assign(frame.m_zones.begin(), frame.m_zones.end());
+
+            const double msPerTick = (double)m_timestampPeriod / 1000000.0;
+            for (GpuZone& zone : resolved)
+            {
+                if (!gpuResults || zone.m_query == ~0u)
+                {
+                    continue;
+                }
+
+                const uint64_t mask = m_timestampMasks[(uint32_t)zone.m_queue];
+                zone.m_gpuBeginMs = (double)((results[zone.m_query] - base) & mask) * msPerTick;
+                zone.m_gpuEndMs = (double)((results[zone.m_query + 1] - base) & mask) * msPerTick;
+                zone.m_gpuValid = true;
+            }
+        }
+
+        if (frame.m_pool != VK_NULL_HANDLE)
+        {
+            vkResetQueryPool(m_device, frame.m_pool, 0, MaxZonesPerFrame * 2);
+        }
+        frame.m_zones.clear();
+        frame.m_queryCount = 0;
+    }
+
+    uint32_t GpuProfiler::beginScope(VkCommandBuffer cmd, QueueType queue, const char* name, uint32_t passIndex)
+    {
+        FrameZones& frame = m_frames[m_frameIndex];
+        if (frame.m_zones.size() >= MaxZonesPerFrame)
+        {
+            return ~0u;
+        }
+
+        const uint32_t zoneIndex = (uint32_t)frame.m_zones.size();
+        frame.m_zones.emplace_back();
+        GpuZone& zone = frame.m_zones.back();
+        strncpy(zone.m_name, name, sizeof(zone.m_name) - 1);
+        zone.m_queue = queue;
+        zone.m_depth = m_openDepth[(uint32_t)queue]++;
+        zone.m_passIndex = passIndex;
+        zone.m_cpuBeginMs = getCpuMs();
+
+        if (frame.m_pool != VK_NULL_HANDLE && m_timestampMasks[(uint32_t)queue] != 0)
+        {
+            zone.m_query = frame.m_queryCount;
+            frame.m_queryCount += 2;
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.m_pool, zone.m_query);
+        }
+        return zoneIndex;
+    }
+
+    void GpuProfiler::endScope(VkCommandBuffer cmd, uint32_t zoneIndex)
+    {
+        if (zoneIndex == ~0u)
+        {
+            return;
+        }
+
+        FrameZones& frame = m_frames[m_frameIndex];
+        GpuZone& zone = frame.m_zones[zoneIndex];
+        if (zone.m_query != ~0u)
+        {
+            vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.m_pool, zone.m_query + 1);
+        }
+        zone.m_cpuEndMs = getCpuMs();
+        --m_openDepth[(uint32_t)zone.m_queue];
+    }
+
+    const std::vector<GpuZone>& GpuProfiler::getResolvedZones() const
+    {
+        return m_history[m_newestResolved];
+    }
+
+    void GpuProfiler::writeTrace(ChromeTraceWriter& writer, double fromMs, double toMs) const
+    {
+        // pid 0 is the CPU side, pid 1 the GPU with one track per queue
+        writer.addThreadName(0, 0, "GPU zone recording");
+        writer.addThreadName(1, (uint32_t)QueueType::Graphics, "GPU Graphics");
+        writer.addThreadName(1, (uint32_t)QueueType::AsyncCompute, "GPU AsyncCompute");
+
+        for (uint32_t i = 0; i < m_resolvedCount; ++i)
+        {
+            const uint32_t historyIndex = (m_newestResolved + HistoryFrameCount - m_resolvedCount + 1 + i) % HistoryFrameCount;
+            const std::vector<GpuZone>& zones = m_history[historyIndex];
+            if (zones.empty() || zones.front().m_cpuBeginMs < fromMs || zones.front().m_cpuBeginMs > toMs)
+            {
+                continue;
+            }
+
+            // No calibrated timestamps, GPU time is placed from the end of the frame's recording (about when it
+            // got submitted). Real start is at or after that
+            double gpuBaseMs = 0.0;
+            for (const GpuZone& zone : zones)
+            {
+                gpuBaseMs = std::max(gpuBaseMs, zone.m_cpuEndMs);
+            }
+
+            for (const GpuZone& zone : zones)
+            {
+                writer.addZone(zone.m_name, 0, 0, zone.m_cpuBeginMs * 1000.0,
+                               (zone.m_cpuEndMs - zone.m_cpuBeginMs) * 1000.0);
+                if (zone.m_gpuValid)
+                {
+                    writer.addZone(zone.m_name, 1, (uint32_t)zone.m_queue, (gpuBaseMs + zone.m_gpuBeginMs) * 1000.0,
+                                   (zone.m_gpuEndMs - zone.m_gpuBeginMs) * 1000.0);
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <volk.h>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "Common/Common.h"
+#include "Pass.h"
+
+namespace ToyEngine
+{
+
+    struct GpuContext;
+    class ChromeTraceWriter;
+
+    struct GpuZone
+    {
+        char m_name[48] = {};
+        QueueType m_queue = QueueType::Graphics;
+        // Nesting on its queue, 0 is top level
+        uint32_t m_depth = 0;
+        // Graph pass the zone wraps, ~0u for user scopes
+        uint32_t m_passIndex = ~0u;
+
+        // CPU time the scope was open while recording, ms since the profiler init
+        double m_cpuBeginMs = 0.0;
+        double m_cpuEndMs = 0.0;
+
+        // GPU time, ms from the first timestamp of the frame. Only when the queue has timestamps
+        double m_gpuBeginMs = 0.0;
+        double m_gpuEndMs = 0.0;
+        bool m_gpuValid = false;
+
+        uint32_t m_query = ~0u;
+    };
+
+    // Timestamp pairs around passes and user scopes (nestable), one query pool per frame in flight.
+    // A frame's results are read back when its slot comes around again after the timeline wait,
+    // MaxFramesInFlight frames late, so nothing ever stalls. The last HistoryFrameCount resolved frames are kept
+    // for the Chrome trace. Scopes are recorded from the thread driving the frame only
+    class GpuProfiler
+    {
+    public:
+        static constexpr uint32_t MaxZonesPerFrame = 256;
+        static constexpr uint32_t HistoryFrameCount = 32;
+
+        void init(const GpuContext& ctx);
+        void destroy();
+
+        // After the frame timeline wait, resolves what the slot recorded last time and resets it
+        void beginFrame(uint32_t frameIndex);
+
+        // Outside of rendering scopes. Returns the zone to close, zones past MaxZonesPerFrame are dropped
+        uint32_t beginScope(VkCommandBuffer cmd, QueueType queue, const char* name, uint32_t passIndex = ~0u);
+        void endScope(VkCommandBuffer cmd, uint32_t zone);
+
+        // Zones of the newest resolved frame, in the order they were opened
+        const std::vector<GpuZone>& getResolvedZones() const;
+        // Bumped on every resolved frame, to tell a new one from the same one seen again
+        uint64_t getResolvedFrameCount() const { return m_totalResolved; }
+        bool isSupported() const { return m_timestampPeriod > 0.0f; }
+
+        // CPU recording track plus one GPU track per queue, for the history frames recorded in [fromMs, toMs]
+        // (getProfilerTimeNs clock, same as the CPU profiler)
+        void writeTrace(ChromeTraceWriter& writer, double fromMs = 0.0, double toMs = DBL_MAX) const;
+
+    private:
+        struct FrameZones
+        {
+            VkQueryPool m_pool = VK_NULL_HANDLE;
+            std::vector<GpuZone> m_zones;
+            uint32_t m_queryCount = 0;
+        };
+
+        double getCpuMs() const;
+
+        VkDevice m_device = VK_NULL_HANDLE;
+        // ns per tick, 0 when the graphics queue has no timestamps
+        float m_timestampPeriod = 0.0f;
+        uint64_t m_timestampMasks[(uint32_t)QueueType::Count] = {};
+
+        FrameZones m_frames[MaxFramesInFlight];
+        uint32_t m_frameIndex = 0;
+        uint32_t m_openDepth[(uint32_t)QueueType::Count] = {};
+
+        // Ring of resolved frames, m_resolvedCount of them valid, newest at m_newestResolved
+        std::vector<GpuZone> m_history[HistoryFrameCount];
+        uint32_t m_newestResolved = 0;
+        uint32_t m_resolvedCount = 0;
+        uint64_t m_totalResolved = 0;
+    };
+
+    // Closes the scope at the end of the C++ scope
+    class GpuProfilerScope
+    {
+    public:
+        GpuProfilerScope(GpuProfiler* profiler, VkCommandBuffer cmd, QueueType queue, const char* name)
+            : m_profiler(profiler), m_cmd(cmd)
+        {
+            m_zone = m_profiler ? m_profiler->beginScope(cmd, queue, name) : ~0u;
+        }
+
+        ~GpuProfilerScope()
+        {
+            if (m_profiler)
+            {
+                m_profiler->endScope(m_cmd, m_zone);
+            }
+        }
+
+    private:
+        GpuProfiler* m_profiler = nullptr;
+        VkCommandBuffer m_cmd = VK_NULL_HANDLE;
+        uint32_t m_zone = ~0u;
+    };
+
+}
@@ -1,5 +1,6 @@
 #include "GpuResources.h"
 #include "Common/Common.h"
+#include "UploadBatch.h"
 #include <cstring>
 #include <stdexcept>
 #include <string>
@@ -22,10 +23,41 @@ namespace ToyEngine
         throw std::runtime_error("failed to find suitable memory type!");
     }
 
+    VkDeviceMemory GpuContext::allocateMemory(const VkMemoryAllocateInfo& allocInfo, MemoryCategory category) const
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory));
+
+        if (m_memoryTracker && memory != VK_NULL_HANDLE)
+        {
+            m_memoryTracker->trackAllocation(category, allocInfo.memoryTypeIndex, allocInfo.allocationSize);
+        }
+
+        return memory;
+    }
+
+    void GpuContext::freeMemory(VkDeviceMemory memory, MemoryCategory category, uint32_t memoryTypeIndex, VkDeviceSize size) const
+    {
+        if (memory == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        vkFreeMemory(m_device, memory, nullptr);
+
+        if (m_memoryTracker)
+        {
+            m_memoryTracker->trackFree(category, memoryTypeIndex, size);
+        }
+    }
+
     void Buffer::create(const GpuContext& ctx, uint32_t size, VkBufferUsageFlags usage,
-                        VkMemoryPropertyFlags properties, const void* initialData)
+                        VkMemoryPropertyFlags properties, const void* initialData, UploadBatch* batch,
+                        MemoryCategory category, BufferMemoryPool* pool)
     {
         m_size = size;
+        m_category = category;
+        m_pool = pool;
 
         VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
         bufferInfo.size = size;
@@ -36,6 +68,13 @@ namespace ToyEngine
         {
             bufferInfo.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
         }
+        // Pooled buffers can get moved around by the defragmenter with a buffer to buffer copy
+        if (m_pool)
+        {
+            assert(!(properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT));
+            bufferInfo.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        }
+        m_usage = bufferInfo.usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         VK_CHECK(vkCreateBuffer(ctx.m_device, &bufferInfo, nullptr, &m_buffer));
 
@@ -45,16 +84,27 @@ namespace ToyEngine
         VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
         allocInfo.allocationSize = memRequirements.size;
         allocInfo.memoryTypeIndex = ctx.findMemoryType(memRequirements.memoryTypeBits, properties);
+        m_memoryTypeIndex = allocInfo.memoryTypeIndex;
+        m_allocationSize = allocInfo.allocationSize;
 
-        VkMemoryAllocateFlagsInfo allocFlagsInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
-        if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) // Enable pointer to buffers if needed
+        if (m_pool)
         {
-            allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
-            allocInfo.pNext = &allocFlagsInfo;
+            m_poolAllocation = m_pool->allocate(m_memoryTypeIndex, memRequirements.size, memRequirements.alignment);
+            m_memory = m_pool->getMemory(m_poolAllocation.m_block);
+            VK_CHECK(vkBindBufferMemory(ctx.m_device, m_buffer, m_memory, m_poolAllocation.m_offset));
         }
+        else
+        {
+            VkMemoryAllocateFlagsInfo allocFlagsInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO};
+            if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) // Enable pointer to buffers if needed
+            {
+                allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+                allocInfo.pNext = &allocFlagsInfo;
+            }
 
-        VK_CHECK(vkAllocateMemory(ctx.m_device, &allocInfo, nullptr, &m_memory));
-        VK_CHECK(vkBindBufferMemory(ctx.m_device, m_buffer, m_memory, 0));
+            m_memory = ctx.allocateMemory(allocInfo, m_category);
+            VK_CHECK(vkBindBufferMemory(ctx.m_device, m_buffer, m_memory, 0));
+        }
 
         if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
         {
@@ -73,37 +123,17 @@ namespace ToyEngine
         }
         else if (initialData)
         {
-            Buffer staging;
-            staging.create(ctx, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, initialData);
-
-            VkCommandBufferAllocateInfo cbAllocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-            cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            cbAllocInfo.commandPool = ctx.m_commandPool;
-            cbAllocInfo.commandBufferCount = 1;
-
-            VkCommandBuffer cmd;
-            vkAllocateCommandBuffers(ctx.m_device, &cbAllocInfo, &cmd);
-
-            VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-            vkBeginCommandBuffer(cmd, &beginInfo);
-
-            VkBufferCopy copyRegion{};
-            copyRegion.size = size;
-            vkCmdCopyBuffer(cmd, staging.m_buffer, m_buffer, 1, &copyRegion);
-
-            vkEndCommandBuffer(cmd);
-
-            VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &cmd;
-
-            vkQueueSubmit(ctx.m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-            vkQueueWaitIdle(ctx.m_graphicsQueue);
-
-            vkFreeCommandBuffers(ctx.m_device, ctx.m_commandPool, 1, &cmd);
-            staging.destroy(ctx);
+            if (batch && batch->isRecording())
+            {
+                batch->uploadBuffer(m_buffer, initialData, size);
+            }
+            else
+            {
+                UploadBatch immediate;
+                immediate.begin(ctx);
+                immediate.uploadBuffer(m_buffer, initialData, size);
+                immediate.submit();
+            }
         }
     }
 
@@ -121,11 +151,17 @@ namespace ToyEngine
             m_buffer = VK_NULL_HANDLE;
         }
 
-        if (m_memory)
+        if (m_pool)
+        {
+            m_pool->free(m_poolAllocation);
+            m_poolAllocation = {};
+            m_pool = nullptr;
+        }
+        else if (m_memory)
         {
-            vkFreeMemory(ctx.m_device, m_memory, nullptr);
-            m_memory = VK_NULL_HANDLE;
+            ctx.freeMemory(m_memory, m_category, m_memoryTypeIndex, m_allocationSize);
         }
+        m_memory = VK_NULL_HANDLE;
     }
 
     void* Buffer::map(const GpuContext& ctx)
@@ -155,7 +191,7 @@ namespace ToyEngine
         }
     }
 
-    void Texture::load(const GpuContext& ctx, const char* path)
+    void Texture::load(const GpuContext& ctx, const char* path, UploadBatch* batch)
     {
         std::string fullPath = std::string(ENGINE_PROJECT_ROOT) + "/" + path;
 
@@ -167,118 +203,21 @@ namespace ToyEngine
             throw std::runtime_error("failed to load texture image!");
         }
 
-        m_width = static_cast<uint32_t>(texWidth);
-        m_height = static_cast<uint32_t>(texHeight);
-
-        uint32_t imageSize = m_width * m_height * 4;
+        create(ctx, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), VK_FORMAT_R8G8B8A8_SRGB,
+               VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        Buffer staging;
-        staging.create(ctx, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, pixels);
+        // pixels are copied into staging memory here, so they can go right after
+        uploadData(ctx, pixels, m_width * m_height * 4, batch);
 
         stbi_image_free(pixels);
-
-        VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
-        imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = m_width;
-        imageInfo.extent.height = m_height;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = 1;
-        imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
-        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-        VK_CHECK(vkCreateImage(ctx.m_device, &imageInfo, nullptr, &m_image));
-
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(ctx.m_device, m_image, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = ctx.findMemoryType(memRequirements.memoryTypeBits,
-                                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        VK_CHECK(vkAllocateMemory(ctx.m_device, &allocInfo, nullptr, &m_memory));
-        vkBindImageMemory(ctx.m_device, m_image, m_memory, 0);
-
-        // Transition and copy
-        VkCommandBufferAllocateInfo cbAllocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-        cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        cbAllocInfo.commandPool = ctx.m_commandPool;
-        cbAllocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer cmd;
-        vkAllocateCommandBuffers(ctx.m_device, &cbAllocInfo, &cmd);
-
-        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        vkBeginCommandBuffer(cmd, &beginInfo);
-
-        VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = m_image;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
-                             nullptr, 1, &barrier);
-
-        VkBufferImageCopy region{};
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.layerCount = 1;
-        region.imageExtent = {m_width, m_height, 1};
-        vkCmdCopyBufferToImage(cmd, staging.m_buffer, m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
-                             0, nullptr, 1, &barrier);
-
-        vkEndCommandBuffer(cmd);
-
-        VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &cmd;
-
-        vkQueueSubmit(ctx.m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(ctx.m_graphicsQueue);
-
-        vkFreeCommandBuffers(ctx.m_device, ctx.m_commandPool, 1, &cmd);
-        staging.destroy(ctx);
-
-        VkImageViewCreateInfo viewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-        viewInfo.image = m_image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
-        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
-        viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = 1;
-
-        VK_CHECK(vkCreateImageView(ctx.m_device, &viewInfo, nullptr, &m_view));
     }
 
     void Texture::create(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format,
-                         VkImageUsageFlags usage, VkImageAspectFlags aspect)
+                         VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryCategory category)
     {
         m_width = width;
         m_height = height;
+        m_category = category;
 
         VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -303,7 +242,9 @@ namespace ToyEngine
         allocInfo.memoryTypeIndex = ctx.findMemoryType(memRequirements.memoryTypeBits,
                                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        VK_CHECK(vkAllocateMemory(ctx.m_device, &allocInfo, nullptr, &m_memory));
+        m_memory = ctx.allocateMemory(allocInfo, m_category);
+        m_memoryTypeIndex = allocInfo.memoryTypeIndex;
+        m_allocationSize = allocInfo.allocationSize;
         vkBindImageMemory(ctx.m_device, m_image, m_memory, 0);
 
         VkImageViewCreateInfo viewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
@@ -319,68 +260,18 @@ namespace ToyEngine
         VK_CHECK(vkCreateImageView(ctx.m_device, &viewInfo, nullptr, &m_view));
     }
 
-    void Texture::uploadData(const GpuContext& ctx, const void* data, uint32_t size)
+    void Texture::uploadData(const GpuContext& ctx, const void* data, uint32_t size, UploadBatch* batch)
     {
-        Buffer staging;
-        staging.create(ctx, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, data);
-
-        // Transition and copy
-        VkCommandBufferAllocateInfo cbAllocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-        cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        cbAllocInfo.commandPool = ctx.m_commandPool;
-        cbAllocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer cmd;
-        vkAllocateCommandBuffers(ctx.m_device, &cbAllocInfo, &cmd);
-
-        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        vkBeginCommandBuffer(cmd, &beginInfo);
-
-        VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = m_image;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
-                             nullptr, 1, &barrier);
-
-        VkBufferImageCopy region{};
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.layerCount = 1;
-        region.imageExtent = {m_width, m_height, 1};
-
-        vkCmdCopyBufferToImage(cmd, staging.m_buffer, m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
-                             0, nullptr, 1, &barrier);
-
-        vkEndCommandBuffer(cmd);
-
-        VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &cmd;
-
-        vkQueueSubmit(ctx.m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(ctx.m_graphicsQueue);
-
-        vkFreeCommandBuffers(ctx.m_device, ctx.m_commandPool, 1, &cmd);
-        staging.destroy(ctx);
+        if (batch && batch->isRecording())
+        {
+            batch->uploadImage(m_image, m_width, m_height, data, size);
+            return;
+        }
+
+        UploadBatch immediate;
+        immediate.begin(ctx);
+        immediate.uploadImage(m_image, m_width, m_height, data, size);
+        immediate.submit();
     }
 
     void Texture::destroy(const GpuContext& ctx)
@@ -397,7 +288,7 @@ namespace ToyEngine
 
         if (m_memory)
         {
-            vkFreeMemory(ctx.m_device, m_memory, nullptr);
+            ctx.freeMemory(m_memory, m_category, m_memoryTypeIndex, m_allocationSize);
         }
 
         m_image = VK_NULL_HANDLE;
@@ -406,11 +297,34 @@ namespace ToyEngine
     }
 
     void RenderTarget::create(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format,
-                              VkImageUsageFlags usage, VkImageAspectFlags aspect)
+                              VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryCategory category)
+    {
+        m_category = category;
+        createImage(ctx, width, height, format, usage, aspect);
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(ctx.m_device, m_image, &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = ctx.findMemoryType(memRequirements.memoryTypeBits,
+                                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkDeviceMemory memory = ctx.allocateMemory(allocInfo, m_category);
+        m_memoryTypeIndex = allocInfo.memoryTypeIndex;
+        m_allocationSize = allocInfo.allocationSize;
+
+        bindMemory(ctx, memory, 0);
+        m_ownsMemory = true;
+    }
+
+    void RenderTarget::createImage(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format,
+                                   VkImageUsageFlags usage, VkImageAspectFlags aspect)
     {
         m_width = width;
         m_height = height;
         m_format = format;
+        m_aspect = aspect;
 
         VkImageCreateInfo imageInfo{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -427,23 +341,18 @@ namespace ToyEngine
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
         VK_CHECK(vkCreateImage(ctx.m_device, &imageInfo, nullptr, &m_image));
+    }
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(ctx.m_device, m_image, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = ctx.findMemoryType(memRequirements.memoryTypeBits,
-                                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        VK_CHECK(vkAllocateMemory(ctx.m_device, &allocInfo, nullptr, &m_memory));
-        vkBindImageMemory(ctx.m_device, m_image, m_memory, 0);
+    void RenderTarget::bindMemory(const GpuContext& ctx, VkDeviceMemory memory, VkDeviceSize offset)
+    {
+        m_memory = memory;
+        VK_CHECK(vkBindImageMemory(ctx.m_device, m_image, memory, offset));
 
         VkImageViewCreateInfo viewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
         viewInfo.image = m_image;
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.format = m_format;
-        viewInfo.subresourceRange.aspectMask = aspect;
+        viewInfo.subresourceRange.aspectMask = m_aspect;
         viewInfo.subresourceRange.baseMipLevel = 0;
         viewInfo.subresourceRange.levelCount = 1;
         viewInfo.subresourceRange.baseArrayLayer = 0;
@@ -464,14 +373,15 @@ namespace ToyEngine
             vkDestroyImage(ctx.m_device, m_image, nullptr);
         }
 
-        if (m_memory)
+        if (m_memory && m_ownsMemory)
         {
-            vkFreeMemory(ctx.m_device, m_memory, nullptr);
+            ctx.freeMemory(m_memory, m_category, m_memoryTypeIndex, m_allocationSize);
         }
 
         m_image = VK_NULL_HANDLE;
         m_view = VK_NULL_HANDLE;
         m_memory = VK_NULL_HANDLE;
+        m_ownsMemory = true;
     }
 
 }
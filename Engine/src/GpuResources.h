@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "MemoryTracker.h"
+#include "BufferMemoryPool.h"
+
 namespace ToyEngine
 {
 
@@ -15,11 +18,28 @@ namespace ToyEngine
         VkCommandPool m_commandPool = VK_NULL_HANDLE;
         VkQueue m_graphicsQueue = VK_NULL_HANDLE;
         uint32_t m_graphicsFamilyIndex = 0;
+        // Compute only family for async work, null/~0u when the device has none
+        VkQueue m_computeQueue = VK_NULL_HANDLE;
+        uint32_t m_computeFamilyIndex = ~0u;
+
+        // Optional features, only true when supported and enabled on the device
+        bool m_pipelineStatisticsQuery = false;
+        bool m_inheritedQueries = false;
+        bool m_meshShaderQueries = false;
+        // MIN/MAX reduction samplers, the depth pyramid needs them
+        bool m_samplerFilterMinmax = false;
+
+        MemoryTracker* m_memoryTracker = nullptr;
 
         uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+        // Every device allocation goes through these two, so the memory tracker sees all of them
+        VkDeviceMemory allocateMemory(const VkMemoryAllocateInfo& allocInfo, MemoryCategory category) const;
+        void freeMemory(VkDeviceMemory memory, MemoryCategory category, uint32_t memoryTypeIndex, VkDeviceSize size) const;
     };
 
     class ResourceManager;
+    class UploadBatch;
 
     struct Buffer
     {
@@ -28,6 +48,15 @@ namespace ToyEngine
         VkDeviceAddress m_gpuAddress = 0;
         void* m_data = nullptr;
         uint32_t m_size = 0;
+        VkBufferUsageFlags m_usage = 0;
+
+        MemoryCategory m_category = MemoryCategory::Geometry;
+        uint32_t m_memoryTypeIndex = 0;
+        VkDeviceSize m_allocationSize = 0;
+
+        // Set when the buffer lives on a pool block instead of its own allocation (m_memory is the block memory then)
+        BufferMemoryPool* m_pool = nullptr;
+        BufferPoolAllocation m_poolAllocation;
 
         void* map(const GpuContext& ctx);
         void unmap(const GpuContext& ctx);
@@ -35,8 +64,11 @@ namespace ToyEngine
 
     private:
         friend class ResourceManager;
+        friend class UploadBatch;
         friend struct Texture;
-        void create(const GpuContext& ctx, uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const void* initialData = nullptr);
+        // With a recording batch the initial data is staged on it, otherwise it is uploaded right away.
+        // With a pool (device local only) memory is sub-allocated from it
+        void create(const GpuContext& ctx, uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const void* initialData = nullptr, UploadBatch* batch = nullptr, MemoryCategory category = MemoryCategory::Geometry, BufferMemoryPool* pool = nullptr);
         void destroy(const GpuContext& ctx);
     };
 
@@ -50,12 +82,16 @@ namespace ToyEngine
         uint32_t m_height = 0;
         uint32_t m_bindlessIndex = 0;
 
-        void uploadData(const GpuContext& ctx, const void* data, uint32_t size);
+        MemoryCategory m_category = MemoryCategory::Textures;
+        uint32_t m_memoryTypeIndex = 0;
+        VkDeviceSize m_allocationSize = 0;
+
+        void uploadData(const GpuContext& ctx, const void* data, uint32_t size, UploadBatch* batch = nullptr);
 
     private:
         friend class ResourceManager;
-        void load(const GpuContext& ctx, const char* path);
-        void create(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+        void load(const GpuContext& ctx, const char* path, UploadBatch* batch = nullptr);
+        void create(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryCategory category = MemoryCategory::Textures);
         void destroy(const GpuContext& ctx);
     };
 
@@ -66,13 +102,24 @@ namespace ToyEngine
         VkDeviceMemory m_memory = VK_NULL_HANDLE;
 
         VkFormat m_format;
+        VkImageAspectFlags m_aspect = 0;
 
         uint32_t m_width = 0;
         uint32_t m_height = 0;
 
+        // false when bound to memory owned by someone else (aliased transient targets)
+        bool m_ownsMemory = true;
+
+        MemoryCategory m_category = MemoryCategory::RenderTargets;
+        uint32_t m_memoryTypeIndex = 0;
+        VkDeviceSize m_allocationSize = 0;
+
     private:
         friend class ResourceManager;
-        void create(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+        void create(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryCategory category = MemoryCategory::RenderTargets);
+        // Split version of create, image first, then memory is bound externally and the view gets created
+        void createImage(const GpuContext& ctx, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+        void bindMemory(const GpuContext& ctx, VkDeviceMemory memory, VkDeviceSize offset);
         void destroy(const GpuContext& ctx);
     };
 
@@ -0,0 +1,135 @@
+#include "GpuScene.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "TransientAllocator.h"
+
+#include <algorithm>
+
+namespace ToyEngine
+{
+
+    uint32_t GpuScene::addMesh(ResourceManager& resourceManager, const Mesh& mesh)
+    {
+        const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+        MeshBuffers buffers;
+        buffers.m_vertices = resourceManager.createBuffer((uint32_t)(mesh.m_vertices.size() * sizeof(Vertex)),
+                                                          usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh.m_vertices.data());
+        buffers.m_meshlets = resourceManager.createBuffer((uint32_t)(mesh.m_meshlets.size() * sizeof(Meshlet)), usage,
+                                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh.m_meshlets.data());
+        buffers.m_meshletVertices = resourceManager.createBuffer(
+            (uint32_t)(mesh.m_meshletVertices.size() * sizeof(uint32_t)), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            mesh.m_meshletVertices.data());
+        buffers.m_meshletTriangles = resourceManager.createBuffer(
+            (uint32_t)(mesh.m_meshletTriangles.size() * sizeof(uint32_t)), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            mesh.m_meshletTriangles.data());
+
+        const uint32_t meshIndex = (uint32_t)m_meshes.size();
+        m_meshBuffers.push_back(buffers);
+        m_meshes.emplace_back();
+        m_meshes.back().m_meshletCount = (uint32_t)mesh.m_meshlets.size();
+        m_meshIndices[&mesh] = meshIndex;
+        return meshIndex;
+    }
+
+    void GpuScene::buildInstances(ResourceManager& resourceManager, Scene& scene)
+    {
+        m_instances.clear();
+        uint32_t meshletVisibilityCount = 0;
+        auto view = scene.getRegistry().view<Mesh*, TransformIndex>();
+        for (const auto& [entity, mesh, transformIndex] : view.each())
+        {
+            auto found = m_meshIndices.find(mesh);
+            assert(found != m_meshIndices.end() && "GpuScene: actor mesh was never added");
+
+            GpuInstance instance;
+            instance.m_boundsCenter[0] = mesh->m_boundsCenter[0];
+            instance.m_boundsCenter[1] = mesh->m_boundsCenter[1];
+            instance.m_boundsCenter[2] = mesh->m_boundsCenter[2];
+            instance.m_boundsRadius = mesh->m_boundsRadius;
+            instance.m_transformIndex = transformIndex.index;
+            instance.m_meshIndex = found->second;
+            instance.m_meshletVisibilityOffset = meshletVisibilityCount;
+            meshletVisibilityCount += m_meshes[found->second].m_meshletCount;
+            m_instances.push_back(instance);
+        }
+
+        // Old buffers go through the deferred destruction, frames in flight can still be reading them
+        resourceManager.destroyBuffer(m_instanceBuffer);
+        resourceManager.destroyBuffer(m_instanceVisibility);
+        resourceManager.destroyBuffer(m_meshletVisibility);
+        m_instanceBuffer = BufferHandle();
+        m_instanceVisibility = BufferHandle();
+        m_meshletVisibility = BufferHandle();
+        if (m_instances.empty())
+        {
+            return;
+        }
+        m_instanceBuffer = resourceManager.createBuffer((uint32_t)(m_instances.size() * sizeof(GpuInstance)),
+                                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_instances.data());
+
+        // Nothing visible yet, the first late phase tests everything
+        std::vector<uint32_t> invisible(std::max((uint32_t)m_instances.size(), meshletVisibilityCount), 0);
+        m_instanceVisibility = resourceManager.createBuffer((uint32_t)(m_instances.size() * sizeof(uint32_t)),
+                                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, invisible.data());
+        m_meshletVisibility = resourceManager.createBuffer(std::max(meshletVisibilityCount, 1u) * sizeof(uint32_t),
+                                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, invisible.data());
+
+        if (m_instances.size() > m_drawCapacity)
+        {
+            m_drawCapacity = (uint32_t)m_instances.size();
+            for (uint32_t list = 0; list < (uint32_t)DrawList::Count; ++list)
+            {
+                for (uint32_t i = 0; i < MaxFramesInFlight; ++i)
+                {
+                    resourceManager.destroyBuffer(m_drawCommands[list][i]);
+                    resourceManager.destroyBuffer(m_drawCounts[list][i]);
+                    m_drawCommands[list][i] = resourceManager.createBuffer(m_drawCapacity * sizeof(GpuDrawCommand),
+                                                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                           VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                    m_drawCounts[list][i] = resourceManager.createBuffer(sizeof(uint32_t),
+                                                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                                         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                }
+            }
+        }
+    }
+
+    void GpuScene::beginFrame(ResourceManager& resourceManager, TransientAllocator& transientAllocator,
+                              uint32_t frameIndex)
+    {
+        for (uint32_t i = 0; i < m_meshes.size(); ++i)
+        {
+            const MeshBuffers& buffers = m_meshBuffers[i];
+            GpuMesh& mesh = m_meshes[i];
+            mesh.m_vertexAddress = resourceManager.getBuffer(buffers.m_vertices)->m_gpuAddress;
+            mesh.m_meshletAddress = resourceManager.getBuffer(buffers.m_meshlets)->m_gpuAddress;
+            mesh.m_meshletVertexAddress = resourceManager.getBuffer(buffers.m_meshletVertices)->m_gpuAddress;
+            mesh.m_meshletTriangleAddress = resourceManager.getBuffer(buffers.m_meshletTriangles)->m_gpuAddress;
+        }
+        m_meshTableAddress = transientAllocator.upload(m_meshes.data(), (uint32_t)m_meshes.size()).m_gpuAddress;
+
+        const Buffer* instances = resourceManager.getBuffer(m_instanceBuffer);
+        m_instanceAddress = instances ? instances->m_gpuAddress : 0;
+        for (uint32_t list = 0; list < (uint32_t)DrawList::Count; ++list)
+        {
+            m_frameDrawCommands[list] = resourceManager.getBuffer(m_drawCommands[list][frameIndex]);
+            m_frameDrawCount[list] = resourceManager.getBuffer(m_drawCounts[list][frameIndex]);
+        }
+        m_frameInstanceVisibility = resourceManager.getBuffer(m_instanceVisibility);
+        m_frameMeshletVisibility = resourceManager.getBuffer(m_meshletVisibility);
+    }
+
+}
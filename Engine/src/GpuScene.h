@@ -0,0 +1,122 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Common/Common.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    struct Mesh;
+    class Scene;
+    class TransientAllocator;
+
+    // Matches MeshData in common.glsl
+    struct GpuMesh
+    {
+        VkDeviceAddress m_vertexAddress = 0;
+        VkDeviceAddress m_meshletAddress = 0;
+        VkDeviceAddress m_meshletVertexAddress = 0;
+        VkDeviceAddress m_meshletTriangleAddress = 0;
+        uint32_t m_meshletCount = 0;
+        uint32_t m_padding[3] = {};
+    };
+
+    // Matches InstanceData in common.glsl. Bounds are the mesh's object space sphere
+    struct GpuInstance
+    {
+        float m_boundsCenter[3] = {};
+        float m_boundsRadius = 0.0f;
+        uint32_t m_transformIndex = 0;
+        uint32_t m_meshIndex = 0;
+        // First uint of the instance's meshlets in the meshlet visibility buffer
+        uint32_t m_meshletVisibilityOffset = 0;
+        uint32_t m_padding = 0;
+    };
+
+    // Matches DrawCommand in common.glsl: VkDrawMeshTasksIndirectCommandEXT plus the instance for the task shader
+    struct GpuDrawCommand
+    {
+        uint32_t m_groupCountX = 0;
+        uint32_t m_groupCountY = 0;
+        uint32_t m_groupCountZ = 0;
+        uint32_t m_instanceIndex = 0;
+        // Late phase only, the early phase already drew the meshlets visible last frame
+        uint32_t m_earlyDrawn = 0;
+    };
+
+    // Two phase occlusion culling fills both, single phase culling only the early one
+    enum class DrawList : uint32_t
+    {
+        Early,
+        Late,
+        Count
+    };
+
+    // What the GPU needs to cull and draw the scene on its own: a mesh table, one instance per drawable actor,
+    // the instance/meshlet visibility occlusion culling carries from a frame to the next and, per frame in flight,
+    // the indirect command + count buffers the cull passes fill.
+    // Buffers can be moved by the defragmentation, addresses are resolved again every frame in beginFrame
+    class GpuScene
+    {
+    public:
+        // Inside the load upload batch, returns the mesh index instances refer to
+        uint32_t addMesh(ResourceManager& resourceManager, const Mesh& mesh);
+
+        // Rebuilds the instance buffer from every actor with a mesh, call again after adding/removing actors
+        void buildInstances(ResourceManager& resourceManager, Scene& scene);
+
+        // After the defragmentation, uploads the mesh table with this frame's addresses
+        void beginFrame(ResourceManager& resourceManager, TransientAllocator& transientAllocator, uint32_t frameIndex);
+
+        uint32_t getInstanceCount() const { return (uint32_t)m_instances.size(); }
+        const GpuInstance& getInstance(uint32_t index) const { return m_instances[index]; }
+        const GpuMesh& getMesh(uint32_t index) const { return m_meshes[index]; }
+
+        // Valid between beginFrame and the end of the frame's recording
+        VkDeviceAddress getMeshTableAddress() const { return m_meshTableAddress; }
+        VkDeviceAddress getInstanceAddress() const { return m_instanceAddress; }
+        const Buffer* getDrawCommands(DrawList list = DrawList::Early) const { return m_frameDrawCommands[(uint32_t)list]; }
+        const Buffer* getDrawCount(DrawList list = DrawList::Early) const { return m_frameDrawCount[(uint32_t)list]; }
+        const Buffer* getInstanceVisibility() const { return m_frameInstanceVisibility; }
+        const Buffer* getMeshletVisibility() const { return m_frameMeshletVisibility; }
+
+    private:
+        struct MeshBuffers
+        {
+            BufferHandle m_vertices;
+            BufferHandle m_meshlets;
+            BufferHandle m_meshletVertices;
+            BufferHandle m_meshletTriangles;
+        };
+
+        std::vector<MeshBuffers> m_meshBuffers;
+        // CPU copy, addresses refreshed every frame
+        std::vector<GpuMesh> m_meshes;
+        std::unordered_map<const Mesh*, uint32_t> m_meshIndices;
+
+        std::vector<GpuInstance> m_instances;
+        BufferHandle m_instanceBuffer;
+
+        // Persistent across frames, reset to all invisible when the instances are rebuilt
+        BufferHandle m_instanceVisibility;
+        BufferHandle m_meshletVisibility;
+
+        // Sized for the instance count, every instance can be visible
+        BufferHandle m_drawCommands[(uint32_t)DrawList::Count][MaxFramesInFlight];
+        BufferHandle m_drawCounts[(uint32_t)DrawList::Count][MaxFramesInFlight];
+        uint32_t m_drawCapacity = 0;
+
+        VkDeviceAddress m_meshTableAddress = 0;
+        VkDeviceAddress m_instanceAddress = 0;
+        const Buffer* m_frameDrawCommands[(uint32_t)DrawList::Count] = {};
+        const Buffer* m_frameDrawCount[(uint32_t)DrawList::Count] = {};
+        const Buffer* m_frameInstanceVisibility = nullptr;
+        const Buffer* m_frameMeshletVisibility = nullptr;
+    };
+
+}
@@ -0,0 +1,216 @@
+#include "GraphSubmitter.h"
+#include "GpuResources.h"
+#include "ResourceManager.h"
+#include "RenderGraph.h"
+#include "PassExecutor.h"
+#include "FrameArena.h"
+#include "GpuProfiler.h"
+#include "PipelineStatistics.h"
+#include "CpuProfiler.h"
+
+#include <cstdio>
+
+namespace ToyEngine
+{
+
+    static VkSemaphoreSubmitInfo semaphoreSubmitInfo(VkSemaphore semaphore, uint64_t value, VkPipelineStageFlags2 stage)
+    {
+        VkSemaphoreSubmitInfo info{VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO};
+        info.semaphore = semaphore;
+        info.value = value;
+        info.stageMask = stage;
+        return info;
+    }
+
+    void GraphSubmitter::init(ResourceManager& resourceManager, const GpuContext& ctx)
+    {
+        m_device = ctx.m_device;
+
+        QueueState& graphics = m_queues[(uint32_t)QueueType::Graphics];
+        graphics.m_queue = ctx.m_graphicsQueue;
+        graphics.m_timeline = resourceManager.createSemaphore(0);
+        for (uint32_t i = 0; i < MaxFramesInFlight; ++i)
+        {
+            graphics.m_pools[i] = resourceManager.createCommandPool(ctx.m_graphicsFamilyIndex,
+                                                                    VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        }
+
+        if (ctx.m_computeQueue != VK_NULL_HANDLE)
+        {
+            QueueState& async = m_queues[(uint32_t)QueueType::AsyncCompute];
+            async.m_queue = ctx.m_computeQueue;
+            async.m_timeline = resourceManager.createSemaphore(0);
+            for (uint32_t i = 0; i < MaxFramesInFlight; ++i)
+            {
+                async.m_pools[i] = resourceManager.createCommandPool(ctx.m_computeFamilyIndex,
+                                                                     VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            }
+        }
+    }
+
+    VkCommandBuffer GraphSubmitter::acquireCommandBuffer(QueueType queueType)
+    {
+        QueueState& queue = m_queues[(uint32_t)queueType];
+        std::vector<VkCommandBuffer>& buffers = queue.m_buffers[m_frameIndex];
+        if (queue.m_used == buffers.size())
+        {
+            VkCommandBufferAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+            allocateInfo.commandPool = queue.m_pools[m_frameIndex];
+            allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocateInfo.commandBufferCount = 1;
+
+            VkCommandBuffer buffer = VK_NULL_HANDLE;
+            VK_CHECK(vkAllocateCommandBuffers(m_device, &allocateInfo, &buffer));
+            buffers.push_back(buffer);
+        }
+
+        VkCommandBuffer cmd = buffers[queue.m_used++];
+        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+        return cmd;
+    }
+
+    VkCommandBuffer GraphSubmitter::beginFrame(uint32_t frameIndex)
+    {
+        // The frame timeline is only signaled once both queues are done with the frame, pools are free to reset
+        m_frameIndex = frameIndex;
+        for (QueueState& queue : m_queues)
+        {
+            if (queue.m_queue != VK_NULL_HANDLE)
+            {
+                vkResetCommandPool(m_device, queue.m_pools[frameIndex], 0);
+                queue.m_used = 0;
+            }
+        }
+
+        m_frameCommandBuffer = acquireCommandBuffer(QueueType::Graphics);
+        return m_frameCommandBuffer;
+    }
+
+    void GraphSubmitter::submit(const RenderGraph& graph, PassContext& ctx, PassExecutor& executor,
+                                const GraphSubmitInfo& info)
+    {
+        const std::vector<GraphSegment>& segments = graph.getSegments();
+        assert(!segments.empty() && segments[0].queue == QueueType::Graphics);
+
+        uint32_t lastGraphicsSegment = 0;
+        bool usesAsync = false;
+        for (uint32_t i = 0; i < segments.size(); ++i)
+        {
+            if (segments[i].queue == QueueType::Graphics)
+            {
+                lastGraphicsSegment = i;
+            }
+            else
+            {
+                usesAsync = true;
+            }
+        }
+
+        QueueState& async = m_queues[(uint32_t)QueueType::AsyncCompute];
+        ArenaVector<uint64_t> segmentValues(segments.size(), 0, ArenaAllocator<uint64_t>(ctx.frameArena));
+        ArenaVector<VkSemaphoreSubmitInfo> waits{ArenaAllocator<VkSemaphoreSubmitInfo>(ctx.frameArena)};
+        ArenaVector<VkSemaphoreSubmitInfo> signals{ArenaAllocator<VkSemaphoreSubmitInfo>(ctx.frameArena)};
+        // Own waits + previous frame async + acquire, own signal + present + frame timeline
+        waits.reserve(segments.size() + 2);
+        signals.reserve(3);
+        m_submitCount = 0;
+
+        for (uint32_t i = 0; i < segments.size(); ++i)
+        {
+            const GraphSegment& segment = segments[i];
+            QueueState& queue = m_queues[(uint32_t)segment.queue];
+            assert(queue.m_queue != VK_NULL_HANDLE);
+
+            VkCommandBuffer cmd = i == 0 ? m_frameCommandBuffer : acquireCommandBuffer(segment.queue);
+            {
+                // Passes nest under their submit in the profiler tree
+                char zoneName[32];
+                snprintf(zoneName, sizeof(zoneName), "%s submit %u", getQueueTypeName(segment.queue), i);
+                TOY_PROFILE_SCOPE(zoneName);
+                GpuProfilerScope zone(ctx.gpuProfiler, cmd, segment.queue, zoneName);
+                graph.executeSegment(cmd, i, ctx, executor);
+            }
+            if (i == lastGraphicsSegment && ctx.pipelineStats)
+            {
+                ctx.pipelineStats->endFrame(cmd);
+            }
+            VK_CHECK(vkEndCommandBuffer(cmd));
+
+            waits.clear();
+            signals.clear();
+            for (const GraphSegmentWait& wait : segment.waits)
+            {
+                const QueueState& waited = m_queues[(uint32_t)segments[wait.segment].queue];
+                waits.push_back(semaphoreSubmitInfo(waited.m_timeline, segmentValues[wait.segment], wait.stage));
+            }
+            if (segment.queue == QueueType::Graphics && m_lastFrameAsyncValue > 0)
+            {
+                // Targets the async queue touched last frame are the same images this frame
+                waits.push_back(semaphoreSubmitInfo(async.m_timeline, m_lastFrameAsyncValue,
+                                                    VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+            }
+
+            segmentValues[i] = ++queue.m_timelineValue;
+            signals.push_back(semaphoreSubmitInfo(queue.m_timeline, segmentValues[i], VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+
+            // Swapchain is only touched at the end of the frame, the last graphics submit takes acquire and present.
+            // Headless there is neither
+            if (i == lastGraphicsSegment)
+            {
+                if (info.acquireSemaphore != VK_NULL_HANDLE)
+                {
+                    waits.push_back(semaphoreSubmitInfo(info.acquireSemaphore, 0, info.acquireStage));
+                }
+                if (info.presentSemaphore != VK_NULL_HANDLE)
+                {
+                    signals.push_back(semaphoreSubmitInfo(info.presentSemaphore, 0, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+                }
+                if (!usesAsync)
+                {
+                    signals.push_back(semaphoreSubmitInfo(info.frameTimeline, info.frameTimelineValue,
+                                                          VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+                }
+            }
+
+            VkCommandBufferSubmitInfo cmdBufferInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO};
+            cmdBufferInfo.commandBuffer = cmd;
+
+            VkSubmitInfo2 submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+            submitInfo.waitSemaphoreInfoCount = (uint32_t)waits.size();
+            submitInfo.pWaitSemaphoreInfos = waits.data();
+            submitInfo.commandBufferInfoCount = 1;
+            submitInfo.pCommandBufferInfos = &cmdBufferInfo;
+            submitInfo.signalSemaphoreInfoCount = (uint32_t)signals.size();
+            submitInfo.pSignalSemaphoreInfos = signals.data();
+            {
+                TOY_PROFILE_SCOPE("vkQueueSubmit2");
+                VK_CHECK(vkQueueSubmit2(queue.m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+            }
+            ++m_submitCount;
+        }
+
+        m_lastFrameAsyncValue = 0;
+        if (usesAsync)
+        {
+            // Frame timeline has to cover the async queue too (command pools, deferred destruction),
+            // an empty graphics submit joins both
+            m_lastFrameAsyncValue = async.m_timelineValue;
+
+            VkSemaphoreSubmitInfo wait = semaphoreSubmitInfo(async.m_timeline, async.m_timelineValue,
+                                                             VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+            VkSemaphoreSubmitInfo signal = semaphoreSubmitInfo(info.frameTimeline, info.frameTimelineValue,
+                                                               VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+            VkSubmitInfo2 submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO_2};
+            submitInfo.waitSemaphoreInfoCount = 1;
+            submitInfo.pWaitSemaphoreInfos = &wait;
+            submitInfo.signalSemaphoreInfoCount = 1;
+            submitInfo.pSignalSemaphoreInfos = &signal;
+            VK_CHECK(vkQueueSubmit2(m_queues[(uint32_t)QueueType::Graphics].m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+            ++m_submitCount;
+        }
+    }
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <vector>
+
+#include "Common/Common.h"
+#include "Pass.h"
+
+namespace ToyEngine
+{
+
+    struct GpuContext;
+    class ResourceManager;
+    class RenderGraph;
+    class PassExecutor;
+
+    struct GraphSubmitInfo
+    {
+        // Waited by the last graphics submit
+        VkSemaphore acquireSemaphore = VK_NULL_HANDLE;
+        VkPipelineStageFlags2 acquireStage = VK_PIPELINE_STAGE_2_NONE;
+        // Signaled by the last graphics submit, for present. Both left null headless
+        VkSemaphore presentSemaphore = VK_NULL_HANDLE;
+        // Signaled once all the frame work (both queues) is done
+        VkSemaphore frameTimeline = VK_NULL_HANDLE;
+        uint64_t frameTimelineValue = 0;
+    };
+
+    // Submits a compiled RenderGraph segment by segment, each on a primary command buffer of its queue.
+    // Every queue has a timeline semaphore bumped on each of its submits, segment waits are waits on the other
+    // queue's timeline. Without async compute the graph is a single segment and this is one submit like before
+    class GraphSubmitter
+    {
+    public:
+        void init(ResourceManager& resourceManager, const GpuContext& ctx);
+
+        // After the frame timeline wait. Returns the command buffer of segment 0, already begun, for the frame's
+        // own work before the graph
+        VkCommandBuffer beginFrame(uint32_t frameIndex);
+
+        void submit(const RenderGraph& graph, PassContext& ctx, PassExecutor& executor, const GraphSubmitInfo& info);
+
+        bool hasAsyncCompute() const { return m_queues[(uint32_t)QueueType::AsyncCompute].m_queue != VK_NULL_HANDLE; }
+        uint32_t getSubmitCount() const { return m_submitCount; }
+
+    private:
+        struct QueueState
+        {
+            VkQueue m_queue = VK_NULL_HANDLE;
+            VkSemaphore m_timeline = VK_NULL_HANDLE;
+            uint64_t m_timelineValue = 0;
+
+            VkCommandPool m_pools[MaxFramesInFlight] = {};
+            std::vector<VkCommandBuffer> m_buffers[MaxFramesInFlight];
+            uint32_t m_used = 0;
+        };
+
+        VkCommandBuffer acquireCommandBuffer(QueueType queue);
+
+        VkDevice m_device = VK_NULL_HANDLE;
+        uint32_t m_frameIndex = 0;
+        QueueState m_queues[(uint32_t)QueueType::Count];
+
+        VkCommandBuffer m_frameCommandBuffer = VK_NULL_HANDLE;
+        // Async compute timeline value the previous frame ended on, 0 when it had no async work
+        uint64_t m_lastFrameAsyncValue = 0;
+        uint32_t m_submitCount = 0;
+    };
+
+}
@@ -0,0 +1,145 @@
+#include "HeapStats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace ToyEngine
+{
+
+    static std::atomic<uint64_t> s_heapAllocationCount{0};
+
+    bool isHeapCountingEnabled()
+    {
+#ifdef TOY_COUNT_HEAP_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint64_t getHeapAllocationCount()
+    {
+        return s_heapAllocationCount.load(std::memory_order_relaxed);
+    }
+
+    void countHeapAllocation()
+    {
+        s_heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+}
+
+#ifdef TOY_COUNT_HEAP_ALLOCATIONS
+
+// Every other new/delete overload forwards to these
+static void* countedAllocate(size_t size, size_t alignment)
+{
+    ToyEngine::countHeapAllocation();
+    if (size == 0)
+    {
+        size = 1;
+    }
+#if defined(_MSC_VER)
+    void* pointer = alignment > alignof(std::max_align_t) ? _aligned_malloc(size, alignment) : malloc(size);
+#else
+    void* pointer = alignment > alignof(std::max_align_t) ? aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1))
+                                                          : malloc(size);
+#endif
+    return pointer;
+}
+
+static void countedFree(void* pointer, size_t alignment)
+{
+#if defined(_MSC_VER)
+    if (alignment > alignof(std::max_align_t))
+    {
+        _aligned_free(pointer);
+        return;
+    }
+#endif
+    (void)alignment;
+    free(pointer);
+}
+
+void* operator new(size_t size)
+{
+    void* pointer = countedAllocate(size, alignof(std::max_align_t));
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* pointer = countedAllocate(size, (size_t)alignment);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    countedFree(pointer, alignof(std::max_align_t));
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    countedFree(pointer, alignof(std::max_align_t));
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    countedFree(pointer, alignof(std::max_align_t));
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    countedFree(pointer, alignof(std::max_align_t));
+}
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept
+{
+    countedFree(pointer, (size_t)alignment);
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept
+{
+    countedFree(pointer, (size_t)alignment);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept
+{
+    countedFree(pointer, (size_t)alignment);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept
+{
+    countedFree(pointer, (size_t)alignment);
+}
+
+#endif
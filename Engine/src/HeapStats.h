@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ToyEngine
+{
+
+    // Global heap allocation counter, only counts when built with TOY_COUNT_HEAP_ALLOCATIONS (debug builds),
+    // which replaces the global operator new/delete. Meant to check the frame loop stays allocation free
+    bool isHeapCountingEnabled();
+    uint64_t getHeapAllocationCount();
+
+    // For allocations that don't go through operator new (ImGui uses malloc)
+    void countHeapAllocation();
+
+}
@@ -0,0 +1,965 @@
+#include "InstanceBvh.h"
+#include "Camera.h"
+#include "CpuProfiler.h"
+#include "Culling.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace ToyEngine
+{
+
+    constexpr uint32_t BinCount = 16;
+    constexpr uint32_t MaxLeafItems = 4;
+    // SAH weights, a node visit against one sphere test
+    constexpr float TraversalCost = 1.0f;
+    // Past this depth splits go to the object median, the traversal stacks stay under MaxDepth
+    constexpr uint32_t ForceMedianDepth = 32;
+    // Nodes with more items bin on the worker pool, in chunks of BinChunkItems
+    constexpr uint32_t ParallelBinItems = 1u << 16;
+    constexpr uint32_t BinChunkItems = 1u << 14;
+    // Past this share of moved items the refit goes over the whole tree instead of walking up from each leaf
+    constexpr float FullRefitShare = 0.1f;
+    // Rebuild once the refit tree costs this much more than the fresh one
+    constexpr float RebuildCostRatio = 1.5f;
+
+    struct BvhBin
+    {
+        BvhBounds m_bounds;
+        BvhBounds m_centroids;
+        uint32_t m_count = 0;
+    };
+
+    struct BvhBinSet
+    {
+        BvhBin m_bins[3][BinCount];
+
+        void merge(const BvhBinSet& other)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t i = 0; i < BinCount; ++i)
+                {
+                    m_bins[axis][i].m_bounds.grow(other.m_bins[axis][i].m_bounds);
+                    m_bins[axis][i].m_centroids.grow(other.m_bins[axis][i].m_centroids);
+                    m_bins[axis][i].m_count += other.m_bins[axis][i].m_count;
+                }
+            }
+        }
+    };
+
+    // Item range under a node, and the bounds of the item centers the bins are laid over
+    struct BvhBuildTask
+    {
+        uint32_t m_node = 0;
+        uint32_t m_first = 0;
+        uint32_t m_count = 0;
+        uint32_t m_depth = 0;
+        BvhBounds m_centroids;
+    };
+
+    // Spheres are copied next to their slot for the build and partitioned with it, the binning passes then read
+    // memory in order instead of gathering from the SoA
+    struct BvhBuildItem
+    {
+        glm::vec3 m_center;
+        float m_radius;
+        uint32_t m_item;
+    };
+
+    static glm::vec3 getCenter(const SphereBoundsSoA& bounds, uint32_t item)
+    {
+        return glm::vec3(bounds.m_centerX[item], bounds.m_centerY[item], bounds.m_centerZ[item]);
+    }
+
+    static uint32_t getBin(float center, float min, float scale)
+    {
+        return std::min((uint32_t)((center - min) * scale), BinCount - 1);
+    }
+
+    static void binItems(const BvhBuildItem* items, uint32_t count, const glm::vec3& min, const glm::vec3& scale,
+                         BvhBinSet& bins)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const glm::vec3 center = items[i].m_center;
+            const glm::vec3 radius = glm::vec3(items[i].m_radius);
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                BvhBin& bin = bins.m_bins[axis][getBin(center[axis], min[axis], scale[axis])];
+                bin.m_bounds.grow(center - radius, center + radius);
+                bin.m_centroids.grow(center, center);
+                ++bin.m_count;
+            }
+        }
+    }
+
+    static void computeRangeBounds(const BvhBuildItem* items, uint32_t count, BvhBounds& box, BvhBounds& centroids)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const glm::vec3 radius = glm::vec3(items[i].m_radius);
+            box.grow(items[i].m_center - radius, items[i].m_center + radius);
+            centroids.grow(items[i].m_center, items[i].m_center);
+        }
+    }
+
+    // Over the worker pool for big ranges, partial bounds per chunk merged at the end
+    static void computeRangeBounds(const BvhBuildItem* items, uint32_t count, WorkerPool* workers, BvhBounds& box,
+                                   BvhBounds& centroids)
+    {
+        if (!workers || count < ParallelBinItems)
+        {
+            computeRangeBounds(items, count, box, centroids);
+            return;
+        }
+
+        const uint32_t chunkCount = (count + BinChunkItems - 1) / BinChunkItems;
+        std::vector<BvhBounds> chunkBoxes(chunkCount);
+        std::vector<BvhBounds> chunkCentroids(chunkCount);
+        workers->parallelFor(chunkCount, [&](uint32_t chunk, uint32_t thread)
+            {
+                const uint32_t first = chunk * BinChunkItems;
+                computeRangeBounds(items + first, std::min(BinChunkItems, count - first), chunkBoxes[chunk],
+                                   chunkCentroids[chunk]);
+            });
+        for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            box.grow(chunkBoxes[chunk]);
+            centroids.grow(chunkCentroids[chunk]);
+        }
+    }
+
+    static void makeLeaf(BvhTree& tree, const BvhBuildItem* buildItems, const BvhBuildTask& task)
+    {
+        BvhNode& node = tree.m_nodes[task.m_node];
+        node.m_leftFirst = task.m_first;
+        node.m_count = task.m_count;
+        for (uint32_t i = task.m_first; i < task.m_first + task.m_count; ++i)
+        {
+            tree.m_items[i] = buildItems[i].m_item;
+            tree.m_itemLeaf[buildItems[i].m_item] = task.m_node;
+        }
+    }
+
+    // Splits the task's node in two, false when it should stay a leaf. Children get their bounds here, the node
+    // itself already has them
+    static bool splitNode(BvhTree& tree, BvhBuildItem* buildItems, const BvhBuildTask& task, WorkerPool* workers,
+                          std::atomic<uint32_t>& nodeCount, BvhBuildTask children[2])
+    {
+        if (task.m_count <= 1)
+        {
+            return false;
+        }
+
+        BvhNode& node = tree.m_nodes[task.m_node];
+        BvhBuildItem* items = buildItems + task.m_first;
+        const glm::vec3 extent = task.m_centroids.m_max - task.m_centroids.m_min;
+        uint32_t leftCount = 0;
+        BvhBounds childBounds[2];
+        BvhBounds childCentroids[2];
+
+        // All centers in one spot leaves nothing to bin on
+        bool median = task.m_depth >= ForceMedianDepth || std::max(std::max(extent.x, extent.y), extent.z) <= 0.0f;
+        if (!median)
+        {
+            const glm::vec3 min = task.m_centroids.m_min;
+            glm::vec3 scale = glm::vec3(0.0f);
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                scale[axis] = extent[axis] > 0.0f ? (float)BinCount / extent[axis] : 0.0f;
+            }
+
+            BvhBinSet bins;
+            if (workers && task.m_count >= ParallelBinItems)
+            {
+                const uint32_t chunkCount = (task.m_count + BinChunkItems - 1) / BinChunkItems;
+                std::vector<BvhBinSet> chunkBins(chunkCount);
+                workers->parallelFor(chunkCount, [&](uint32_t chunk, uint32_t thread)
+                    {
+                        const uint32_t first = chunk * BinChunkItems;
+                        binItems(items + first, std::min(BinChunkItems, task.m_count - first), min, scale,
+                                 chunkBins[chunk]);
+                    });
+                for (const BvhBinSet& chunk : chunkBins)
+                {
+                    bins.merge(chunk);
+                }
+            }
+            else
+            {
+                binItems(items, task.m_count, min, scale, bins);
+            }
+
+            // Split after bin i puts bins 0..i on the left. Sweep from the right first for the right side areas
+            float bestCost = FLT_MAX;
+            uint32_t bestAxis = 0;
+            uint32_t bestSplit = 0;
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                if (scale[axis] == 0.0f)
+                {
+                    continue;
+                }
+
+                float rightArea[BinCount - 1];
+                uint32_t rightCount[BinCount - 1];
+                BvhBounds accumulated;
+                uint32_t count = 0;
+                for (uint32_t i = BinCount - 1; i > 0; --i)
+                {
+                    accumulated.grow(bins.m_bins[axis][i].m_bounds);
+                    count += bins.m_bins[axis][i].m_count;
+                    rightArea[i - 1] = accumulated.area();
+                    rightCount[i - 1] = count;
+                }
+
+                accumulated = BvhBounds();
+                count = 0;
+                for (uint32_t i = 0; i < BinCount - 1; ++i)
+                {
+                    accumulated.grow(bins.m_bins[axis][i].m_bounds);
+                    count += bins.m_bins[axis][i].m_count;
+                    if (count == 0 || rightCount[i] == 0)
+                    {
+                        continue;
+                    }
+
+                    const float cost = accumulated.area() * (float)count + rightArea[i] * (float)rightCount[i];
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = i;
+                    }
+                }
+            }
+
+            const float nodeArea = BvhBounds{node.m_min, node.m_max}.area();
+            if (bestCost == FLT_MAX)
+            {
+                median = true;
+            }
+            else if (task.m_count <= MaxLeafItems &&
+                     (float)task.m_count <= TraversalCost + bestCost / std::max(nodeArea, FLT_MIN))
+            {
+                return false;
+            }
+            else
+            {
+                const BvhBuildItem* end = std::partition(items, items + task.m_count, [&](const BvhBuildItem& item)
+                    {
+                        return getBin(item.m_center[bestAxis], min[bestAxis], scale[bestAxis]) <= bestSplit;
+                    });
+                leftCount = (uint32_t)(end - items);
+                for (uint32_t i = 0; i < BinCount; ++i)
+                {
+                    const BvhBin& bin = bins.m_bins[bestAxis][i];
+                    childBounds[i <= bestSplit ? 0 : 1].grow(bin.m_bounds);
+                    childCentroids[i <= bestSplit ? 0 : 1].grow(bin.m_centroids);
+                }
+            }
+        }
+
+        if (median)
+        {
+            if (task.m_count <= MaxLeafItems)
+            {
+                return false;
+            }
+
+            uint32_t axis = 0;
+            if (extent.y > extent[axis])
+            {
+                axis = 1;
+            }
+            if (extent.z > extent[axis])
+            {
+                axis = 2;
+            }
+            leftCount = task.m_count / 2;
+            std::nth_element(items, items + leftCount, items + task.m_count,
+                             [&](const BvhBuildItem& a, const BvhBuildItem& b)
+                {
+                    return a.m_center[axis] < b.m_center[axis];
+                });
+            computeRangeBounds(items, leftCount, childBounds[0], childCentroids[0]);
+            computeRangeBounds(items + leftCount, task.m_count - leftCount, childBounds[1], childCentroids[1]);
+        }
+
+        const uint32_t left = nodeCount.fetch_add(2);
+        node.m_leftFirst = left;
+        node.m_count = 0;
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            BvhNode& child = tree.m_nodes[left + i];
+            child.m_min = childBounds[i].m_min;
+            child.m_max = childBounds[i].m_max;
+            tree.m_parents[left + i] = task.m_node;
+
+            children[i].m_node = left + i;
+            children[i].m_depth = task.m_depth + 1;
+            children[i].m_centroids = childCentroids[i];
+        }
+        children[0].m_first = task.m_first;
+        children[0].m_count = leftCount;
+        children[1].m_first = task.m_first + leftCount;
+        children[1].m_count = task.m_count - leftCount;
+        return true;
+    }
+
+    // Depth first on the calling thread, returns the deepest level reached
+    static uint32_t buildSubtree(BvhTree& tree, BvhBuildItem* buildItems, const BvhBuildTask& root,
+                                 std::atomic<uint32_t>& nodeCount)
+    {
+        uint32_t depth = 0;
+        BvhBuildTask stack[InstanceBvh::MaxDepth * 2];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = root;
+        while (stackSize > 0)
+        {
+            const BvhBuildTask task = stack[--stackSize];
+            depth = std::max(depth, task.m_depth);
+
+            BvhBuildTask children[2];
+            if (splitNode(tree, buildItems, task, nullptr, nodeCount, children))
+            {
+                assert(stackSize + 2 <= InstanceBvh::MaxDepth * 2);
+                stack[stackSize++] = children[1];
+                stack[stackSize++] = children[0];
+            }
+            else
+            {
+                makeLeaf(tree, buildItems, task);
+            }
+        }
+        return depth;
+    }
+
+    static float getNodeWeight(const BvhNode& node)
+    {
+        return node.m_count > 0 ? (float)node.m_count : TraversalCost;
+    }
+
+    static double computeCost(const BvhTree& tree)
+    {
+        double cost = 0.0;
+        for (uint32_t i = 0; i < tree.m_nodeCount; ++i)
+        {
+            const BvhNode& node = tree.m_nodes[i];
+            cost += (double)(BvhBounds{node.m_min, node.m_max}.area() * getNodeWeight(node));
+        }
+        return cost;
+    }
+
+    static float getNormalizedCost(const BvhTree& tree, double cost)
+    {
+        if (tree.m_nodeCount == 0)
+        {
+            return 0.0f;
+        }
+        const BvhNode& root = tree.m_nodes[0];
+        return (float)(cost / std::max((double)BvhBounds{root.m_min, root.m_max}.area(), (double)FLT_MIN));
+    }
+
+    static void buildTree(BvhTree& tree, const SphereBoundsSoA& bounds, WorkerPool* workers)
+    {
+        std::vector<BvhBuildItem> buildItems;
+        buildItems.reserve(bounds.size());
+        for (uint32_t i = 0; i < bounds.size(); ++i)
+        {
+            if (bounds.m_radius[i] > 0.0f)
+            {
+                buildItems.push_back({getCenter(bounds, i), bounds.m_radius[i], i});
+            }
+        }
+        tree.m_items.resize(buildItems.size());
+        tree.m_itemLeaf.assign(bounds.size(), ~0u);
+        tree.m_nodeCount = 0;
+        tree.m_depth = 0;
+        tree.m_cost = 0.0;
+        tree.m_buildCost = 0.0f;
+
+        const uint32_t itemCount = (uint32_t)buildItems.size();
+        if (itemCount == 0)
+        {
+            return;
+        }
+
+        // A binary tree with single item leaves at worst
+        tree.m_nodes.resize(2 * itemCount - 1);
+        tree.m_parents.resize(2 * itemCount - 1);
+        tree.m_parents[0] = ~0u;
+
+        BvhBuildTask root;
+        root.m_count = itemCount;
+        BvhBounds rootBounds;
+        computeRangeBounds(buildItems.data(), itemCount, workers, rootBounds, root.m_centroids);
+        tree.m_nodes[0].m_min = rootBounds.m_min;
+        tree.m_nodes[0].m_max = rootBounds.m_max;
+        std::atomic<uint32_t> nodeCount{1};
+
+        // Top of the tree one node at a time with the binning spread over the pool, until the nodes are small
+        // enough to hand one subtree to each job
+        const uint32_t threadCount = workers ? workers->getThreadCount() : 1;
+        const uint32_t subtreeItems = threadCount > 1 ? std::max(itemCount / (threadCount * 4), 4096u) : ~0u;
+        std::vector<BvhBuildTask> open = {root};
+        std::vector<BvhBuildTask> subtrees;
+        uint32_t depth = 0;
+        while (!open.empty())
+        {
+            const BvhBuildTask task = open.back();
+            open.pop_back();
+            if (task.m_count <= subtreeItems)
+            {
+                subtrees.push_back(task);
+                continue;
+            }
+
+            depth = std::max(depth, task.m_depth);
+            BvhBuildTask children[2];
+            if (splitNode(tree, buildItems.data(), task, workers, nodeCount, children))
+            {
+                open.push_back(children[0]);
+                open.push_back(children[1]);
+            }
+            else
+            {
+                makeLeaf(tree, buildItems.data(), task);
+            }
+        }
+
+        std::vector<uint32_t> subtreeDepths(subtrees.size());
+        if (workers)
+        {
+            workers->parallelFor((uint32_t)subtrees.size(), [&](uint32_t job, uint32_t thread)
+                {
+                    subtreeDepths[job] = buildSubtree(tree, buildItems.data(), subtrees[job], nodeCount);
+                });
+        }
+        else
+        {
+            for (uint32_t i = 0; i < subtrees.size(); ++i)
+            {
+                subtreeDepths[i] = buildSubtree(tree, buildItems.data(), subtrees[i], nodeCount);
+            }
+        }
+        for (uint32_t subtreeDepth : subtreeDepths)
+        {
+            depth = std::max(depth, subtreeDepth);
+        }
+
+        tree.m_nodeCount = nodeCount.load();
+        tree.m_depth = depth;
+        tree.m_cost = computeCost(tree);
+        tree.m_buildCost = getNormalizedCost(tree, tree.m_cost);
+    }
+
+    // Recomputes one node from its items or children, false when its bounds did not change
+    static bool refitNode(BvhTree& tree, const SphereBoundsSoA& bounds, uint32_t index)
+    {
+        BvhNode& node = tree.m_nodes[index];
+        BvhBounds box;
+        if (node.m_count > 0)
+        {
+            for (uint32_t i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; ++i)
+            {
+                const glm::vec3 center = getCenter(bounds, tree.m_items[i]);
+                const glm::vec3 radius = glm::vec3(bounds.m_radius[tree.m_items[i]]);
+                box.grow(center - radius, center + radius);
+            }
+        }
+        else
+        {
+            box.grow(tree.m_nodes[node.m_leftFirst].m_min, tree.m_nodes[node.m_leftFirst].m_max);
+            box.grow(tree.m_nodes[node.m_leftFirst + 1].m_min, tree.m_nodes[node.m_leftFirst + 1].m_max);
+        }
+
+        if (box.m_min == node.m_min && box.m_max == node.m_max)
+        {
+            return false;
+        }
+        tree.m_cost += (double)((box.area() - BvhBounds{node.m_min, node.m_max}.area()) * getNodeWeight(node));
+        node.m_min = box.m_min;
+        node.m_max = box.m_max;
+        return true;
+    }
+
+    void InstanceBvh::init()
+    {
+        assert(!m_rebuildThread.joinable());
+        m_rebuildQuit = false;
+        m_rebuildThread = std::thread(&InstanceBvh::rebuildLoop, this);
+    }
+
+    // No profiler zones in here: the thread runs across frames, and CpuProfiler::beginFrame resets the buffers
+    // assuming nobody but parked workers has one
+    void InstanceBvh::rebuildLoop()
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_rebuildMutex);
+                m_rebuildWake.wait(lock, [&]() { return m_rebuildQuit || m_rebuildRequested; });
+                if (m_rebuildQuit)
+                {
+                    return;
+                }
+                m_rebuildRequested = false;
+            }
+
+            const uint64_t beginNs = getProfilerTimeNs();
+            buildTree(m_pending, m_snapshot, nullptr);
+            m_pendingMs = (float)(getProfilerTimeNs() - beginNs) / 1000000.0f;
+            m_rebuildDone.store(true, std::memory_order_release);
+        }
+    }
+
+    void InstanceBvh::build(const SphereBoundsSoA& bounds, WorkerPool* workers)
+    {
+        TOY_PROFILE_SCOPE("InstanceBvh build");
+        buildTree(m_tree, bounds, workers);
+        m_bounds = &bounds;
+        m_built = true;
+    }
+
+    void InstanceBvh::refit(const SphereBoundsSoA& bounds, const std::vector<uint32_t>* moved)
+    {
+        TOY_PROFILE_SCOPE("InstanceBvh refit");
+        m_bounds = &bounds;
+        if (m_tree.m_nodeCount == 0)
+        {
+            return;
+        }
+
+        if (!moved || (float)moved->size() > FullRefitShare * (float)m_tree.m_items.size())
+        {
+            // Children always come after their parent, going backwards refits them first
+            for (uint32_t i = m_tree.m_nodeCount; i-- > 0;)
+            {
+                refitNode(m_tree, bounds, i);
+            }
+            m_tree.m_cost = computeCost(m_tree);
+            return;
+        }
+
+        // Up from the leaf of every moved item, until a node comes out the same
+        for (uint32_t item : *moved)
+        {
+            uint32_t node = item < m_tree.m_itemLeaf.size() ? m_tree.m_itemLeaf[item] : ~0u;
+            while (node != ~0u && refitNode(m_tree, bounds, node))
+            {
+                node = m_tree.m_parents[node];
+            }
+        }
+    }
+
+    void InstanceBvh::update(const TransformManager& transforms, WorkerPool* workers)
+    {
+        TOY_PROFILE_SCOPE("InstanceBvh update");
+        const SphereBoundsSoA& bounds = transforms.WorldBounds;
+        if (!m_built)
+        {
+            build(bounds, workers);
+            m_version = transforms.BoundsVersion;
+            return;
+        }
+
+        if (m_rebuildDone.load(std::memory_order_acquire))
+        {
+            m_rebuildDone.store(false, std::memory_order_relaxed);
+            m_rebuildPending = false;
+            std::swap(m_tree, m_pending);
+            m_version = m_pendingVersion;
+            m_rebuildMs = m_pendingMs;
+            ++m_rebuildCount;
+            // Built from bounds a few frames old, the moved lists of those frames are gone
+            refit(bounds);
+        }
+        else
+        {
+            refit(bounds, &transforms.MovedBounds);
+        }
+
+        // Slots added or removed only show up after a rebuild, until then queries don't see them
+        if (!m_rebuildPending && (transforms.BoundsVersion != m_version || getCostRatio() > RebuildCostRatio))
+        {
+            assert(m_rebuildThread.joinable());
+            m_snapshot = bounds;
+            m_pendingVersion = transforms.BoundsVersion;
+            m_rebuildPending = true;
+            {
+                std::lock_guard<std::mutex> lock(m_rebuildMutex);
+                m_rebuildRequested = true;
+            }
+            m_rebuildWake.notify_one();
+        }
+    }
+
+    void InstanceBvh::destroy()
+    {
+        if (!m_rebuildThread.joinable())
+        {
+            return;
+        }
+
+        // A rebuild already running finishes first, a requested one that did not start is dropped
+        {
+            std::lock_guard<std::mutex> lock(m_rebuildMutex);
+            m_rebuildQuit = true;
+            m_rebuildRequested = false;
+        }
+        m_rebuildWake.notify_one();
+        m_rebuildThread.join();
+        m_rebuildDone.store(false, std::memory_order_relaxed);
+        m_rebuildPending = false;
+    }
+
+    float InstanceBvh::getSahCost() const
+    {
+        return getNormalizedCost(m_tree, m_tree.m_cost);
+    }
+
+    float InstanceBvh::getCostRatio() const
+    {
+        return m_tree.m_buildCost > 0.0f ? getSahCost() / m_tree.m_buildCost : 1.0f;
+    }
+
+    void InstanceBvh::appendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& items) const
+    {
+        // The subtree's items are contiguous, from its leftmost leaf to the end of its rightmost one
+        uint32_t first = nodeIndex;
+        while (m_tree.m_nodes[first].m_count == 0)
+        {
+            first = m_tree.m_nodes[first].m_leftFirst;
+        }
+        uint32_t last = nodeIndex;
+        while (m_tree.m_nodes[last].m_count == 0)
+        {
+            last = m_tree.m_nodes[last].m_leftFirst + 1;
+        }
+
+        const uint32_t end = m_tree.m_nodes[last].m_leftFirst + m_tree.m_nodes[last].m_count;
+        for (uint32_t i = m_tree.m_nodes[first].m_leftFirst; i < end; ++i)
+        {
+            // Slots freed since the build stay in the tree with a 0 radius
+            if (m_bounds->m_radius[m_tree.m_items[i]] > 0.0f)
+            {
+                items.push_back(m_tree.m_items[i]);
+            }
+        }
+    }
+
+    void InstanceBvh::queryFrustum(const glm::vec4 planes[6], std::vector<uint32_t>& items) const
+    {
+        items.clear();
+        if (m_tree.m_nodeCount == 0)
+        {
+            return;
+        }
+
+        uint32_t stack[MaxDepth + 1];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const uint32_t nodeIndex = stack[--stackSize];
+            const BvhNode& node = m_tree.m_nodes[nodeIndex];
+
+            // Per plane the corner furthest along the normal decides if the box is out, the nearest one if it
+            // is fully in. Both keep the same answer as isSphereInFrustum for the spheres inside
+            bool inside = true;
+            bool outside = false;
+            for (uint32_t p = 0; p < 6 && !outside; ++p)
+            {
+                const glm::vec3 normal = glm::vec3(planes[p]);
+                const glm::vec3 farCorner = glm::vec3(normal.x >= 0.0f ? node.m_max.x : node.m_min.x,
+                                                      normal.y >= 0.0f ? node.m_max.y : node.m_min.y,
+                                                      normal.z >= 0.0f ? node.m_max.z : node.m_min.z);
+                const glm::vec3 nearCorner = glm::vec3(normal.x >= 0.0f ? node.m_min.x : node.m_max.x,
+                                                       normal.y >= 0.0f ? node.m_min.y : node.m_max.y,
+                                                       normal.z >= 0.0f ? node.m_min.z : node.m_max.z);
+                outside = glm::dot(normal, farCorner) + planes[p].w < 0.0f;
+                inside = inside && glm::dot(normal, nearCorner) + planes[p].w > 0.0f;
+            }
+
+            if (outside)
+            {
+                continue;
+            }
+            if (inside)
+            {
+                appendSubtree(nodeIndex, items);
+            }
+            else if (node.m_count > 0)
+            {
+                for (uint32_t i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; ++i)
+                {
+                    const uint32_t item = m_tree.m_items[i];
+                    const float radius = m_bounds->m_radius[item];
+                    if (radius > 0.0f && isSphereInFrustum(planes, getCenter(*m_bounds, item), radius))
+                    {
+                        items.push_back(item);
+                    }
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.m_leftFirst + 1;
+                stack[stackSize++] = node.m_leftFirst;
+            }
+        }
+    }
+
+    void InstanceBvh::queryAabb(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& items) const
+    {
+        items.clear();
+        if (m_tree.m_nodeCount == 0)
+        {
+            return;
+        }
+
+        uint32_t stack[MaxDepth + 1];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const BvhNode& node = m_tree.m_nodes[stack[--stackSize]];
+            if (glm::any(glm::greaterThan(node.m_min, max)) || glm::any(glm::lessThan(node.m_max, min)))
+            {
+                continue;
+            }
+
+            if (node.m_count == 0)
+            {
+                stack[stackSize++] = node.m_leftFirst + 1;
+                stack[stackSize++] = node.m_leftFirst;
+                continue;
+            }
+
+            for (uint32_t i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; ++i)
+            {
+                // Sphere against the box through the closest point of the box
+                const uint32_t item = m_tree.m_items[i];
+                const float radius = m_bounds->m_radius[item];
+                const glm::vec3 center = getCenter(*m_bounds, item);
+                const glm::vec3 offset = glm::clamp(center, min, max) - center;
+                if (radius > 0.0f && glm::dot(offset, offset) <= radius * radius)
+                {
+                    items.push_back(item);
+                }
+            }
+        }
+    }
+
+    bool InstanceBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                              BvhRayHit& hit) const
+    {
+        hit = BvhRayHit();
+        if (m_tree.m_nodeCount == 0)
+        {
+            return false;
+        }
+
+        // Entry distance of the ray in the node's box, FLT_MAX when it misses or only enters past the best hit
+        float best = maxDistance;
+        const glm::vec3 invDirection = 1.0f / direction;
+        auto intersectNode = [&](const BvhNode& node)
+            {
+                const glm::vec3 t0 = (node.m_min - origin) * invDirection;
+                const glm::vec3 t1 = (node.m_max - origin) * invDirection;
+                const glm::vec3 tNear = glm::min(t0, t1);
+                const glm::vec3 tFar = glm::max(t0, t1);
+                const float enter = std::max(std::max(std::max(tNear.x, tNear.y), tNear.z), 0.0f);
+                const float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+                return enter <= exit && enter < best ? enter : FLT_MAX;
+            };
+
+        struct StackEntry
+        {
+            uint32_t m_node;
+            float m_distance;
+        };
+        StackEntry stack[MaxDepth + 1];
+        uint32_t stackSize = 0;
+        const float rootDistance = intersectNode(m_tree.m_nodes[0]);
+        if (rootDistance != FLT_MAX)
+        {
+            stack[stackSize++] = {0, rootDistance};
+        }
+
+        while (stackSize > 0)
+        {
+            const StackEntry entry = stack[--stackSize];
+            if (entry.m_distance >= best)
+            {
+                continue;
+            }
+
+            const BvhNode& node = m_tree.m_nodes[entry.m_node];
+            if (node.m_count > 0)
+            {
+                for (uint32_t i = node.m_leftFirst; i < node.m_leftFirst + node.m_count; ++i)
+                {
+                    const uint32_t item = m_tree.m_items[i];
+                    const float radius = m_bounds->m_radius[item];
+                    const glm::vec3 toCenter = getCenter(*m_bounds, item) - origin;
+                    const float along = glm::dot(toCenter, direction);
+                    const float distanceSq = glm::dot(toCenter, toCenter) - along * along;
+                    if (radius <= 0.0f || distanceSq > radius * radius)
+                    {
+                        continue;
+                    }
+
+                    // Far side when the ray starts inside the sphere
+                    const float halfChord = std::sqrt(radius * radius - distanceSq);
+                    const float t = along - halfChord >= 0.0f ? along - halfChord : along + halfChord;
+                    if (t >= 0.0f && t < best)
+                    {
+                        best = t;
+                        hit.m_item = item;
+                        hit.m_distance = t;
+                    }
+                }
+                continue;
+            }
+
+            // Nearest child on top so it is visited first and tightens best for the other one
+            const float leftDistance = intersectNode(m_tree.m_nodes[node.m_leftFirst]);
+            const float rightDistance = intersectNode(m_tree.m_nodes[node.m_leftFirst + 1]);
+            const bool leftFirst = leftDistance <= rightDistance;
+            const StackEntry nearEntry = {leftFirst ? node.m_leftFirst : node.m_leftFirst + 1,
+                                          leftFirst ? leftDistance : rightDistance};
+            const StackEntry farEntry = {leftFirst ? node.m_leftFirst + 1 : node.m_leftFirst,
+                                         leftFirst ? rightDistance : leftDistance};
+            if (farEntry.m_distance != FLT_MAX)
+            {
+                stack[stackSize++] = farEntry;
+            }
+            if (nearEntry.m_distance != FLT_MAX)
+            {
+                stack[stackSize++] = nearEntry;
+            }
+        }
+        return hit.m_item != ~0u;
+    }
+
+    template<typename Function>
+    static double measureMs(const Function& function)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void benchmarkBvh(WorkerPool& workers)
+    {
+        constexpr uint32_t QueryCount = 10000;
+        const uint32_t counts[] = {10000, 100000, 1000000};
+
+        printf("Instance BVH on %u threads, %u rays and %u box queries per size\n", workers.getThreadCount(),
+               QueryCount, QueryCount);
+        for (uint32_t count : counts)
+        {
+            // Same density at every size, about one sphere every 25 units like the actor rows
+            const float halfExtent = 12.5f * std::cbrt((float)count);
+            std::mt19937 rng(1234);
+            std::uniform_real_distribution<float> position(-halfExtent, halfExtent);
+            std::uniform_real_distribution<float> size(1.0f, 10.0f);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+            SphereBoundsSoA bounds;
+            bounds.resize(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                bounds.m_centerX[i] = position(rng);
+                bounds.m_centerY[i] = position(rng);
+                bounds.m_centerZ[i] = position(rng);
+                bounds.m_radius[i] = size(rng);
+            }
+
+            InstanceBvh bvh;
+            const double serialBuildMs = measureMs([&]() { bvh.build(bounds, nullptr); });
+            const double buildMs = measureMs([&]() { bvh.build(bounds, &workers); });
+            printf("%u instances: %u nodes, depth %u, SAH %.1f\n", count, bvh.getNodeCount(), bvh.getDepth(),
+                   bvh.getSahCost());
+            printf("  build     %8.2f ms (%.2f ms on one thread)\n", buildMs, serialBuildMs);
+
+            // Everything drifts a bit, then 1% moves on its own
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                bounds.m_centerX[i] += unit(rng) * 2.0f;
+                bounds.m_centerZ[i] += unit(rng) * 2.0f;
+            }
+            const double fullRefitMs = measureMs([&]() { bvh.refit(bounds); });
+
+            std::vector<uint32_t> moved(count / 100);
+            for (uint32_t& item : moved)
+            {
+                item = (uint32_t)(rng() % count);
+                bounds.m_centerY[item] += unit(rng) * 10.0f;
+            }
+            const double movedRefitMs = measureMs([&]() { bvh.refit(bounds, &moved); });
+            printf("  refit     %8.2f ms all, %.3f ms for %u moved (SAH %.2fx the build)\n", fullRefitMs,
+                   movedRefitMs, (uint32_t)moved.size(), bvh.getCostRatio());
+
+            // Camera in the middle, about half of everything in front of it
+            Camera camera;
+            camera.setPosition(glm::vec3(0.0f));
+            camera.setTarget(glm::vec3(0.0f, 0.0f, -1.0f));
+            camera.setPerspective(70.0f, 16.0f / 9.0f);
+            camera.update();
+            glm::vec4 planes[6];
+            camera.getFrustumPlanes(planes);
+
+            std::vector<uint32_t> visible;
+            visible.reserve(count);
+            std::vector<uint8_t> visibility(count);
+            const double frustumMs = measureMs([&]() { bvh.queryFrustum(planes, visible); });
+            const double flatMs = measureMs([&]() { cullSpheres(bounds, planes, visibility.data()); });
+            uint32_t flatVisible = 0;
+            for (uint8_t v : visibility)
+            {
+                flatVisible += v;
+            }
+            printf("  frustum   %8.3f ms, %u visible (flat SIMD cull %.3f ms, %u visible)\n", frustumMs,
+                   (uint32_t)visible.size(), flatMs, flatVisible);
+
+            uint32_t hits = 0;
+            const double rayMs = measureMs([&]()
+                {
+                    std::mt19937 rayRng(42);
+                    for (uint32_t i = 0; i < QueryCount; ++i)
+                    {
+                        const glm::vec3 origin = glm::vec3(position(rayRng), position(rayRng), position(rayRng));
+                        glm::vec3 direction = glm::vec3(unit(rayRng), unit(rayRng), unit(rayRng));
+                        direction = glm::normalize(direction + glm::vec3(0.0f, 0.0f, 1e-3f));
+                        BvhRayHit hit;
+                        hits += bvh.raycast(origin, direction, halfExtent * 4.0f, hit) ? 1 : 0;
+                    }
+                });
+            printf("  raycast   %8.3f us per ray, %u/%u hit\n", rayMs * 1000.0 / QueryCount, hits, QueryCount);
+
+            uint64_t found = 0;
+            const double boxMs = measureMs([&]()
+                {
+                    std::mt19937 boxRng(7);
+                    std::vector<uint32_t> items;
+                    for (uint32_t i = 0; i < QueryCount; ++i)
+                    {
+                        const glm::vec3 center = glm::vec3(position(boxRng), position(boxRng), position(boxRng));
+                        bvh.queryAabb(center - glm::vec3(50.0f), center + glm::vec3(50.0f), items);
+                        found += items.size();
+                    }
+                });
+            printf("  aabb      %8.3f us per query, %.1f instances each\n", boxMs * 1000.0 / QueryCount,
+                   (double)found / QueryCount);
+        }
+    }
+
+}
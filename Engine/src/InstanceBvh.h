@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cfloat>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Common/Common.h"
+#include "Scene.h"
+
+namespace ToyEngine
+{
+
+    class WorkerPool;
+
+    struct BvhBounds
+    {
+        glm::vec3 m_min = glm::vec3(FLT_MAX);
+        glm::vec3 m_max = glm::vec3(-FLT_MAX);
+
+        void grow(const glm::vec3& min, const glm::vec3& max)
+        {
+            m_min = glm::min(m_min, min);
+            m_max = glm::max(m_max, max);
+        }
+        void grow(const BvhBounds& other) { grow(other.m_min, other.m_max); }
+
+        // Half the surface area, what the SAH compares. 0 for empty bounds
+        float area() const
+        {
+            if (m_min.x > m_max.x)
+            {
+                return 0.0f;
+            }
+            const glm::vec3 size = m_max - m_min;
+            return size.x * size.y + size.y * size.z + size.z * size.x;
+        }
+    };
+
+    // 32 bytes. Children are allocated in pairs, always after their parent
+    struct BvhNode
+    {
+        glm::vec3 m_min = glm::vec3(0.0f);
+        // First child when m_count is 0, first entry of the item list otherwise
+        uint32_t m_leftFirst = 0;
+        glm::vec3 m_max = glm::vec3(0.0f);
+        uint32_t m_count = 0;
+    };
+
+    // Node and item storage of an InstanceBvh. Every subtree owns a contiguous range of m_items
+    struct BvhTree
+    {
+        std::vector<BvhNode> m_nodes;
+        std::vector<uint32_t> m_parents;
+        std::vector<uint32_t> m_items;
+        // Leaf holding every transform slot, ~0u for slots left out
+        std::vector<uint32_t> m_itemLeaf;
+        uint32_t m_nodeCount = 0;
+        uint32_t m_depth = 0;
+        // Area times SAH weight summed over the nodes, kept up to date by the refits
+        double m_cost = 0.0;
+        float m_buildCost = 0.0f;
+    };
+
+    struct BvhRayHit
+    {
+        uint32_t m_item = ~0u;
+        float m_distance = 0.0f;
+    };
+
+    // Instance BVH over the world bounding spheres of TransformManager, items are transform slots (slots without
+    // bounds are left out). Built with a binned SAH, refit every frame above the spheres that moved, rebuilt on
+    // its own thread once the structure changed or the refit tree got too loose
+    class InstanceBvh
+    {
+    public:
+        static constexpr uint32_t MaxDepth = 64;
+
+        ~InstanceBvh() { destroy(); }
+
+        // Starts the background rebuild thread, update() needs it. It sleeps until a rebuild is kicked
+        void init();
+
+        // Synchronous build. With workers the binning of big nodes and then the subtrees are spread over the pool,
+        // nullptr builds everything on the calling thread
+        void build(const SphereBoundsSoA& bounds, WorkerPool* workers = nullptr);
+
+        // Refits the nodes above the moved slots, or the whole tree when moved is nullptr or too many moved
+        void refit(const SphereBoundsSoA& bounds, const std::vector<uint32_t>* moved = nullptr);
+
+        // Once per frame after TransformManager::update, on the main thread. Builds on the first call, refits
+        // after that and kicks a background rebuild when needed. A finished rebuild is swapped in here
+        void update(const TransformManager& transforms, WorkerPool* workers);
+
+        // Waits for a background rebuild still running and stops the thread
+        void destroy();
+
+        // Queries use the bounds of the last build/refit. items is cleared first
+        void queryFrustum(const glm::vec4 planes[6], std::vector<uint32_t>& items) const;
+        void queryAabb(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& items) const;
+        // Nearest sphere along a normalized direction, closer than maxDistance
+        bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhRayHit& hit) const;
+
+        uint32_t getItemCount() const { return (uint32_t)m_tree.m_items.size(); }
+        uint32_t getNodeCount() const { return m_tree.m_nodeCount; }
+        uint32_t getDepth() const { return m_tree.m_depth; }
+        // SAH cost relative to the root area, and how much worse than right after the build it got
+        float getSahCost() const;
+        float getCostRatio() const;
+        uint32_t getRebuildCount() const { return m_rebuildCount; }
+        // Wall time of the last background rebuild, it has no zone in the CPU traces
+        float getRebuildMs() const { return m_rebuildMs; }
+        bool isRebuilding() const { return m_rebuildPending; }
+
+    private:
+        void appendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& items) const;
+        void rebuildLoop();
+
+        BvhTree m_tree;
+        const SphereBoundsSoA* m_bounds = nullptr;
+        // TransformManager::BoundsVersion the tree was built from
+        uint64_t m_version = 0;
+        bool m_built = false;
+
+        // Background rebuild, only touches the snapshot, m_pending and m_pendingMs until it sets m_rebuildDone.
+        // One thread for the whole run, woken through m_rebuildRequested
+        std::thread m_rebuildThread;
+        std::mutex m_rebuildMutex;
+        std::condition_variable m_rebuildWake;
+        bool m_rebuildRequested = false;
+        bool m_rebuildQuit = false;
+        std::atomic<bool> m_rebuildDone{false};
+        SphereBoundsSoA m_snapshot;
+        BvhTree m_pending;
+        float m_pendingMs = 0.0f;
+        uint64_t m_pendingVersion = 0;
+        // Main thread only, kicked and not swapped in yet
+        bool m_rebuildPending = false;
+        uint32_t m_rebuildCount = 0;
+        float m_rebuildMs = 0.0f;
+    };
+
+    // --bench-bvh: build, refit and queries on random spheres at 10k, 100k and 1M instances
+    void benchmarkBvh(WorkerPool& workers);
+
+}
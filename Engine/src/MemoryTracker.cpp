@@ -0,0 +1,128 @@
+#include "MemoryTracker.h"
+#include "Common/Common.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace ToyEngine
+{
+
+    const char* getMemoryCategoryName(MemoryCategory category)
+    {
+        switch (category)
+        {
+        case MemoryCategory::Geometry: return "Geometry";
+        case MemoryCategory::Textures: return "Textures";
+        case MemoryCategory::RenderTargets: return "RenderTargets";
+        case MemoryCategory::Upload: return "Upload";
+        case MemoryCategory::UI: return "UI";
+        default: return "Unknown";
+        }
+    }
+
+    void MemoryTracker::init(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+                             bool budgetSupported)
+    {
+        m_physicalDevice = physicalDevice;
+        m_memoryProperties = memoryProperties;
+        m_budgetSupported = budgetSupported;
+
+        m_heapCount = memoryProperties.memoryHeapCount;
+        for (uint32_t i = 0; i < m_heapCount; ++i)
+        {
+            m_heaps[i].m_flags = memoryProperties.memoryHeaps[i].flags;
+            m_heaps[i].m_size = memoryProperties.memoryHeaps[i].size;
+        }
+
+        updateBudget();
+    }
+
+    void MemoryTracker::trackAllocation(MemoryCategory category, uint32_t memoryTypeIndex, uint64_t size)
+    {
+        MemoryCategoryStats& stats = m_categories[(uint32_t)category];
+        stats.m_currentBytes += size;
+        stats.m_peakBytes = std::max(stats.m_peakBytes, stats.m_currentBytes);
+        ++stats.m_allocationCount;
+
+        const uint32_t heapIndex = m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        m_heaps[heapIndex].m_allocatedBytes += size;
+
+        m_totalBytes += size;
+        m_peakBytes = std::max(m_peakBytes, m_totalBytes);
+    }
+
+    void MemoryTracker::trackFree(MemoryCategory category, uint32_t memoryTypeIndex, uint64_t size)
+    {
+        MemoryCategoryStats& stats = m_categories[(uint32_t)category];
+        assert(stats.m_currentBytes >= size && stats.m_allocationCount > 0);
+        stats.m_currentBytes -= size;
+        --stats.m_allocationCount;
+
+        const uint32_t heapIndex = m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        m_heaps[heapIndex].m_allocatedBytes -= size;
+
+        m_totalBytes -= size;
+    }
+
+    void MemoryTracker::updateBudget()
+    {
+        if (!m_budgetSupported)
+        {
+            return;
+        }
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+        VkPhysicalDeviceMemoryProperties2 memoryProperties2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+        memoryProperties2.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memoryProperties2);
+
+        for (uint32_t i = 0; i < m_heapCount; ++i)
+        {
+            m_heaps[i].m_budget = budgetProperties.heapBudget[i];
+            m_heaps[i].m_usage = budgetProperties.heapUsage[i];
+        }
+    }
+
+    bool MemoryTracker::dumpJson(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+        {
+            printf("MemoryTracker: could not open %s\n", path);
+            return false;
+        }
+
+        fprintf(file, "{\n");
+        fprintf(file, "  \"totalBytes\": %llu,\n", (unsigned long long)m_totalBytes);
+        fprintf(file, "  \"peakBytes\": %llu,\n", (unsigned long long)m_peakBytes);
+        fprintf(file, "  \"budgetSupported\": %s,\n", m_budgetSupported ? "true" : "false");
+
+        fprintf(file, "  \"categories\": {\n");
+        for (uint32_t i = 0; i < (uint32_t)MemoryCategory::Count; ++i)
+        {
+            const MemoryCategoryStats& stats = m_categories[i];
+            fprintf(file, "    \"%s\": { \"currentBytes\": %llu, \"peakBytes\": %llu, \"allocations\": %u }%s\n",
+                    getMemoryCategoryName((MemoryCategory)i), (unsigned long long)stats.m_currentBytes,
+                    (unsigned long long)stats.m_peakBytes, stats.m_allocationCount,
+                    i + 1 < (uint32_t)MemoryCategory::Count ? "," : "");
+        }
+        fprintf(file, "  },\n");
+
+        fprintf(file, "  \"heaps\": [\n");
+        for (uint32_t i = 0; i < m_heapCount; ++i)
+        {
+            const MemoryHeapStats& heap = m_heaps[i];
+            fprintf(file, "    { \"index\": %u, \"deviceLocal\": %s, \"size\": %llu, \"allocatedBytes\": %llu, \"budget\": %llu, \"usage\": %llu }%s\n",
+                    i, (heap.m_flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false",
+                    (unsigned long long)heap.m_size, (unsigned long long)heap.m_allocatedBytes,
+                    (unsigned long long)heap.m_budget, (unsigned long long)heap.m_usage,
+                    i + 1 < m_heapCount ? "," : "");
+        }
+        fprintf(file, "  ]\n");
+        fprintf(file, "}\n");
+
+        fclose(file);
+        return true;
+    }
+
+}
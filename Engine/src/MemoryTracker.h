@@ -0,0 +1,76 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+
+namespace ToyEngine
+{
+
+    enum class MemoryCategory : uint8_t
+    {
+        Geometry,
+        Textures,
+        RenderTargets,
+        Upload,
+        UI,
+        Count
+    };
+
+    const char* getMemoryCategoryName(MemoryCategory category);
+
+    struct MemoryCategoryStats
+    {
+        uint64_t m_currentBytes = 0;
+        uint64_t m_peakBytes = 0;
+        uint32_t m_allocationCount = 0;
+    };
+
+    struct MemoryHeapStats
+    {
+        VkMemoryHeapFlags m_flags = 0;
+        uint64_t m_size = 0;
+        // what we allocated through the tracker
+        uint64_t m_allocatedBytes = 0;
+        // VK_EXT_memory_budget values, whole process (0 if not supported)
+        uint64_t m_budget = 0;
+        uint64_t m_usage = 0;
+    };
+
+    // Accounts every vkAllocateMemory/vkFreeMemory done through GpuContext, by category and heap.
+    // Budget/usage come from VK_EXT_memory_budget when the device has it
+    class MemoryTracker
+    {
+    public:
+        void init(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceMemoryProperties& memoryProperties, bool budgetSupported);
+
+        void trackAllocation(MemoryCategory category, uint32_t memoryTypeIndex, uint64_t size);
+        void trackFree(MemoryCategory category, uint32_t memoryTypeIndex, uint64_t size);
+
+        // Refreshes budget/usage numbers, cheap enough to be called every frame
+        void updateBudget();
+
+        uint64_t getTotalBytes() const { return m_totalBytes; }
+        uint64_t getPeakBytes() const { return m_peakBytes; }
+        bool isBudgetSupported() const { return m_budgetSupported; }
+
+        const MemoryCategoryStats& getCategoryStats(MemoryCategory category) const { return m_categories[(uint32_t)category]; }
+
+        uint32_t getHeapCount() const { return m_heapCount; }
+        const MemoryHeapStats& getHeapStats(uint32_t heapIndex) const { return m_heaps[heapIndex]; }
+
+        bool dumpJson(const char* path) const;
+
+    private:
+        VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+        bool m_budgetSupported = false;
+
+        MemoryCategoryStats m_categories[(uint32_t)MemoryCategory::Count];
+        MemoryHeapStats m_heaps[VK_MAX_MEMORY_HEAPS];
+        uint32_t m_heapCount = 0;
+
+        uint64_t m_totalBytes = 0;
+        uint64_t m_peakBytes = 0;
+    };
+
+}
@@ -8,11 +8,13 @@
 #include <cstdio>
 #include <vector>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 
 namespace ToyEngine
 {
 
-    bool Mesh::loadFromObj(const char* path)
+    bool Mesh::loadFromObj(const char* path, const MeshletLimits& limits)
     {
         if (!path)
         {
@@ -101,15 +103,19 @@ namespace ToyEngine
         meshopt_remapVertexBuffer(m_vertices.data(), unrolledVertices.data(), totalIndices, sizeof(Vertex), remap.data());
 
         meshopt_optimizeVertexCache(m_indices.data(), m_indices.data(), totalIndices, uniqueVertexCount);
-        buildMeshlets();
+        buildMeshlets(limits);
+        computeBounds();
 
         fast_obj_destroy(mesh);
 
         return true;
     }
 
-    void Mesh::buildMeshlets()
+    void Mesh::buildMeshlets(const MeshletLimits& limits)
     {
+        assert(limits.m_maxVertices <= MeshletMaxVertices && limits.m_maxTriangles <= MeshletMaxTriangles);
+        assert(limits.m_maxTriangles % 4 == 0);
+
         m_meshlets.clear();
         m_meshletVertices.clear();
         m_meshletTriangles.clear();
@@ -119,11 +125,11 @@ namespace ToyEngine
             return;
         }
 
-        size_t meshletBound = meshopt_buildMeshletsBound(m_indices.size(), MeshletMaxVertices, MeshletMaxTriangles);
+        size_t meshletBound = meshopt_buildMeshletsBound(m_indices.size(), limits.m_maxVertices, limits.m_maxTriangles);
 
         std::vector<meshopt_Meshlet> meshoptMeshlets(meshletBound);
-        std::vector<unsigned int> meshletVertices(meshletBound * MeshletMaxVertices);
-        std::vector<unsigned char> meshletTriangles(meshletBound * MeshletMaxTriangles * 3);
+        std::vector<unsigned int> meshletVertices(meshletBound * limits.m_maxVertices);
+        std::vector<unsigned char> meshletTriangles(meshletBound * limits.m_maxTriangles * 3);
 
         size_t meshletCount = meshopt_buildMeshlets(
             meshoptMeshlets.data(),
@@ -134,14 +140,14 @@ namespace ToyEngine
             &m_vertices[0].m_vx,
             m_vertices.size(),
             sizeof(Vertex),
-            MeshletMaxVertices,
-            MeshletMaxTriangles,
+            limits.m_maxVertices,
+            limits.m_maxTriangles,
             0.0f
         );
 
         m_meshlets.reserve(meshletCount);
-        m_meshletVertices.reserve(meshletCount * MeshletMaxVertices);
-        m_meshletTriangles.reserve(meshletCount * MeshletMaxTriangles * 3);
+        m_meshletVertices.reserve(meshletCount * limits.m_maxVertices);
+        m_meshletTriangles.reserve(meshletCount * limits.m_maxTriangles * 3);
 
         for (size_t i = 0; i < meshletCount; ++i)
         {
@@ -186,4 +192,35 @@ namespace ToyEngine
         }
     }
 
+    void Mesh::computeBounds()
+    {
+        if (m_vertices.empty())
+        {
+            return;
+        }
+
+        // Box center, not the tightest sphere but good enough to cull whole instances
+        glm::vec3 minPosition(m_vertices[0].m_vx, m_vertices[0].m_vy, m_vertices[0].m_vz);
+        glm::vec3 maxPosition = minPosition;
+        for (const Vertex& vertex : m_vertices)
+        {
+            const glm::vec3 position(vertex.m_vx, vertex.m_vy, vertex.m_vz);
+            minPosition = glm::min(minPosition, position);
+            maxPosition = glm::max(maxPosition, position);
+        }
+
+        const glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (const Vertex& vertex : m_vertices)
+        {
+            const glm::vec3 offset = glm::vec3(vertex.m_vx, vertex.m_vy, vertex.m_vz) - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+
+        m_boundsCenter[0] = center.x;
+        m_boundsCenter[1] = center.y;
+        m_boundsCenter[2] = center.z;
+        m_boundsRadius = sqrtf(radiusSquared);
+    }
+
 }
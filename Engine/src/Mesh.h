@@ -5,9 +5,19 @@
 
 namespace ToyEngine
 {
+    // Ceiling the mesh shader is compiled for (max_vertices/max_primitives in mesh.mesh.glsl, SPIR-V can't
+    // specialize those). Keep both in sync
     constexpr uint32_t MeshletMaxVertices = 64;
     constexpr uint32_t MeshletMaxTriangles = 124;
 
+    // What meshlets actually get built with, at most the ceiling above. The mesh pipeline is specialized for the
+    // same vertex count. meshoptimizer wants the triangle count a multiple of 4
+    struct MeshletLimits
+    {
+        uint32_t m_maxVertices = MeshletMaxVertices;
+        uint32_t m_maxTriangles = MeshletMaxTriangles;
+    };
+
     struct Vertex
     {
         float m_vx, m_vy, m_vz;
@@ -40,10 +50,15 @@ namespace ToyEngine
         std::vector<uint32_t> m_meshletVertices;
         std::vector<uint32_t> m_meshletTriangles;
 
-        bool loadFromObj(const char* path);
+        // Object space bounding sphere of the whole mesh, for instance culling
+        float m_boundsCenter[3] = {};
+        float m_boundsRadius = 0.0f;
+
+        bool loadFromObj(const char* path, const MeshletLimits& limits = {});
 
     private:
-        void buildMeshlets();
+        void buildMeshlets(const MeshletLimits& limits);
+        void computeBounds();
     };
 
     class MeshManager
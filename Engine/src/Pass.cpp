@@ -4,6 +4,100 @@
 namespace ToyEngine
 {
 
-    
+    ResourceState getResourceState(ResourceUsage usage, PassType passType)
+    {
+        const VkPipelineStageFlags2 shaderStages = passType == PassType::Compute
+            ? VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+            : VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT |
+              VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+        switch (usage)
+        {
+        case ResourceUsage::ColorAttachment:
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        case ResourceUsage::DepthAttachment:
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        case ResourceUsage::DepthRead:
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+        case ResourceUsage::ShaderRead:
+            return {shaderStages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        case ResourceUsage::StorageRead:
+            return {shaderStages, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL};
+        case ResourceUsage::StorageWrite:
+            return {shaderStages, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL};
+        case ResourceUsage::IndirectRead:
+            return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED};
+        case ResourceUsage::TransferSrc:
+            return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        case ResourceUsage::TransferDst:
+            return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+        case ResourceUsage::Present:
+            // Presentation engine syncs through the semaphore, only the layout matters here
+            return {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        }
+
+        return {};
+    }
+
+    bool isWriteUsage(ResourceUsage usage)
+    {
+        switch (usage)
+        {
+        case ResourceUsage::ColorAttachment:
+        case ResourceUsage::DepthAttachment:
+        case ResourceUsage::StorageWrite:
+        case ResourceUsage::TransferDst:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    const char* getPassTypeName(PassType type)
+    {
+        switch (type)
+        {
+        case PassType::Graphics: return "Graphics";
+        case PassType::Compute: return "Compute";
+        case PassType::Transfer: return "Transfer";
+        default: return "Unknown";
+        }
+    }
+
+    const char* getQueueTypeName(QueueType queue)
+    {
+        switch (queue)
+        {
+        case QueueType::Graphics: return "Graphics";
+        case QueueType::AsyncCompute: return "AsyncCompute";
+        default: return "Unknown";
+        }
+    }
+
+    const char* getResourceUsageName(ResourceUsage usage)
+    {
+        switch (usage)
+        {
+        case ResourceUsage::ColorAttachment: return "ColorAttachment";
+        case ResourceUsage::DepthAttachment: return "DepthAttachment";
+        case ResourceUsage::DepthRead: return "DepthRead";
+        case ResourceUsage::ShaderRead: return "ShaderRead";
+        case ResourceUsage::StorageRead: return "StorageRead";
+        case ResourceUsage::StorageWrite: return "StorageWrite";
+        case ResourceUsage::IndirectRead: return "IndirectRead";
+        case ResourceUsage::TransferSrc: return "TransferSrc";
+        case ResourceUsage::TransferDst: return "TransferDst";
+        case ResourceUsage::Present: return "Present";
+        default: return "Unknown";
+        }
+    }
 
 }
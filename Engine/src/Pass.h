@@ -12,10 +12,75 @@ namespace ToyEngine
     class ResourceManager;
     class PipelineManager;
     class Scene;
+    class RenderGraph;
+    class WorkerPool;
+    class ThreadCommandPools;
+    class PassTimings;
+    class FrameArena;
+    class GpuProfiler;
+    class PipelineStatistics;
 
+    // Index of a resource inside a RenderGraph
+    using GraphResource = uint32_t;
+    constexpr GraphResource InvalidGraphResource = 0xffffffffu;
+
+    enum class PassType : uint8_t
+    {
+        Graphics,
+        Compute,
+        Transfer
+    };
+
+    // Queue a pass gets scheduled on. AsyncCompute only applies to compute passes, and only on devices with
+    // a compute only queue family, everything else stays on the graphics queue
+    enum class QueueType : uint8_t
+    {
+        Graphics,
+        AsyncCompute,
+        Count
+    };
+
+    // How a pass touches a resource, the render graph turns these into stages/access/layouts
+    enum class ResourceUsage : uint8_t
+    {
+        ColorAttachment,
+        DepthAttachment,
+        DepthRead,
+        ShaderRead,
+        StorageRead,
+        StorageWrite,
+        IndirectRead,
+        TransferSrc,
+        TransferDst,
+        Present
+    };
+
+    struct ResourceState
+    {
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    // Shader stages depend on the pass type (compute vs task/mesh/vertex/fragment)
+    ResourceState getResourceState(ResourceUsage usage, PassType passType);
+    bool isWriteUsage(ResourceUsage usage);
+
+    // Debug names, for graph dumps and the editor
+    const char* getPassTypeName(PassType type);
+    const char* getQueueTypeName(QueueType queue);
+    const char* getResourceUsageName(ResourceUsage usage);
+
+    struct PassResourceAccess
+    {
+        GraphResource resource = InvalidGraphResource;
+        ResourceUsage usage = ResourceUsage::ShaderRead;
+    };
+
+    // Attachments are implicit accesses, ColorAttachment/DepthAttachment usage
     struct PassAttachment
     {
-        RenderTargetHandle handle;
+        GraphResource resource = InvalidGraphResource;
         VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         VkClearValue clearValue;
@@ -26,27 +91,49 @@ namespace ToyEngine
         Scene& scene;
         ResourceManager& resourceManager;
         PipelineManager& pipelineManager;
+        const RenderGraph& graph;
+
+        // Both set to record passes with recordItems on several threads, serial on the primary otherwise
+        WorkerPool* workers = nullptr;
+        ThreadCommandPools* commandPools = nullptr;
+        // Optional, rolling CPU/GPU time per pass
+        PassTimings* timings = nullptr;
+        // Scratch for this frame's recording (draw lists, attachment infos, barrier batches), reset by the frame
+        FrameArena* frameArena = nullptr;
+        // Optional, every pass and queue submit gets a timestamp zone
+        GpuProfiler* gpuProfiler = nullptr;
+        // Optional, pipeline statistics queries around graphics passes and the task shader counters
+        PipelineStatistics* pipelineStats = nullptr;
     };
 
     struct Pass
     {
         std::string name;
+        PassType type = PassType::Graphics;
+        QueueType queue = QueueType::Graphics;
         PipelineHandle pipeline;
 
-        std::vector<TextureHandle> inputTextures;
-        std::vector<BufferHandle> inputBuffers;
-        std::vector<VkDescriptorSet> descriptorSets;
-
-        std::function<void(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)> execute;
-    };
-
-    struct RenderBatch
-    {
-        std::string name;
+        // Graphics passes get their own rendering scope on these
         std::vector<PassAttachment> colorAttachments;
         PassAttachment depthAttachment;
         bool useDepth = false;
 
-        std::vector<Pass> passes;
+        std::vector<PassResourceAccess> reads;
+        std::vector<PassResourceAccess> writes;
+        std::vector<VkDescriptorSet> descriptorSets;
+
+        // Passes nobody consumes get culled by the graph, set this for passes that matter on their own
+        // (readbacks, queries...) and don't write an imported resource
+        bool sideEffects = false;
+
+        std::function<void(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)> execute;
+
+        // Optional chunked recording for big graphics passes. prepare runs first on the recording thread and returns
+        // how many items there are, recordItems then gets [first, last) ranges of up to chunkSize items, each range
+        // on its own secondary command buffer from a worker thread. Has to be safe to call concurrently.
+        // Passes are built once with the graph, whatever prepare collects per frame belongs on ctx.frameArena
+        std::function<uint32_t(const Pass& pass, PassContext& ctx)> prepare;
+        std::function<void(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx, uint32_t first, uint32_t last)> recordItems;
+        uint32_t chunkSize = 1024;
     };
 }
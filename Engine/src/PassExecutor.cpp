@@ -2,83 +2,189 @@
 #include "Pipeline.h"
 #include "PipelineManager.h"
 #include "ResourceManager.h"
+#include "RenderGraph.h"
+#include "ThreadCommandPools.h"
+#include "WorkerPool.h"
+#include "FrameArena.h"
+#include "PipelineStatistics.h"
+#include "CpuProfiler.h"
+#include "Common/Common.h"
 
 namespace ToyEngine
 {
-    void PassExecutor::execute(VkCommandBuffer cmd, const RenderBatch& batch, PassContext& ctx)
+    void PassExecutor::bindPassState(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx) const
     {
-        std::vector<VkRenderingAttachmentInfo> colorInfos;
-        for (const auto& attachment : batch.colorAttachments)
+        if (!pass.pipeline.isValid())
         {
-            RenderTarget* rt = ctx.resourceManager.getRenderTarget(attachment.handle);
+            return;
+        }
+
+        Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
+        pipeline->bind(cmd);
+
+        if (!pass.descriptorSets.empty())
+        {
+            vkCmdBindDescriptorSets(cmd, pipeline->getBindPoint(), pipeline->getLayout(), 0,
+                                    (uint32_t)pass.descriptorSets.size(), pass.descriptorSets.data(),
+                                    0, nullptr);
+        }
+        else
+        {
+            VkDescriptorSet globalSet = ctx.pipelineManager.getGlobalDescriptorSet();
+            vkCmdBindDescriptorSets(cmd, pipeline->getBindPoint(), pipeline->getLayout(), 0, 1, &globalSet,
+                                    0, nullptr);
+        }
+    }
+
+    void PassExecutor::recordChunks(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx, uint32_t itemCount,
+                                    uint32_t width, uint32_t height)
+    {
+        // Secondaries inherit nothing but the rendering scope, they need the attachment formats up front
+        ArenaVector<VkFormat> colorFormats{ArenaAllocator<VkFormat>(ctx.frameArena)};
+        colorFormats.reserve(pass.colorAttachments.size());
+        for (const auto& attachment : pass.colorAttachments)
+        {
+            colorFormats.push_back(ctx.graph.getImage(attachment.resource).format);
+        }
+
+        VkCommandBufferInheritanceRenderingInfo renderingInheritance{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+        renderingInheritance.colorAttachmentCount = (uint32_t)colorFormats.size();
+        renderingInheritance.pColorAttachmentFormats = colorFormats.data();
+        renderingInheritance.depthAttachmentFormat = pass.useDepth
+            ? ctx.graph.getImage(pass.depthAttachment.resource).format
+            : VK_FORMAT_UNDEFINED;
+        renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+        inheritanceInfo.pNext = &renderingInheritance;
+        // The primary's statistics query stays open across vkCmdExecuteCommands
+        inheritanceInfo.pipelineStatistics = ctx.pipelineStats ? ctx.pipelineStats->getActiveFlags() : 0;
+
+        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        // Dynamic state doesn't carry over from the primary
+        const VkViewport viewport = {0, (float)height, (float)width, -(float)height, 0, 1};
+        const VkRect2D scissor = {{0, 0}, {width, height}};
+
+        const uint32_t chunkSize = pass.chunkSize > 0 ? pass.chunkSize : itemCount;
+        const uint32_t chunkCount = divideAndRoundUp(itemCount, chunkSize);
+        m_secondaries.resize(chunkCount);
+
+        ctx.workers->parallelFor(chunkCount, [&](uint32_t chunk, uint32_t thread)
+        {
+            TOY_PROFILE_SCOPE("Record chunk");
+            VkCommandBuffer secondary = ctx.commandPools->acquireSecondary(thread);
+            VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo));
+            vkCmdSetViewport(secondary, 0, 1, &viewport);
+            vkCmdSetScissor(secondary, 0, 1, &scissor);
+            bindPassState(secondary, pass, ctx);
+
+            const uint32_t first = chunk * chunkSize;
+            const uint32_t last = first + chunkSize < itemCount ? first + chunkSize : itemCount;
+            pass.recordItems(secondary, pass, ctx, first, last);
+
+            VK_CHECK(vkEndCommandBuffer(secondary));
+            // Slot per chunk, execution order doesn't depend on which thread got what
+            m_secondaries[chunk] = secondary;
+        });
+
+        vkCmdExecuteCommands(cmd, chunkCount, m_secondaries.data());
+    }
+
+    void PassExecutor::execute(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx)
+    {
+        const bool rendering = pass.type == PassType::Graphics;
+
+        // Item count has to be known before the rendering scope, it decides how the scope is recorded
+        const uint32_t itemCount = pass.prepare ? pass.prepare(pass, ctx) : 0;
+        const bool parallel = rendering && pass.recordItems && itemCount > 0 && ctx.workers && ctx.commandPools &&
+            ctx.workers->getThreadCount() > 1;
+        assert(!parallel || !pass.execute);
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        ArenaVector<VkRenderingAttachmentInfo> colorInfos{ArenaAllocator<VkRenderingAttachmentInfo>(ctx.frameArena)};
+        colorInfos.reserve(pass.colorAttachments.size());
+        for (const auto& attachment : pass.colorAttachments)
+        {
+            const GraphImage& image = ctx.graph.getImage(attachment.resource);
             VkRenderingAttachmentInfo info = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-            info.imageView = rt->m_view;
+            info.imageView = image.view;
             info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
             info.loadOp = attachment.loadOp;
             info.storeOp = attachment.storeOp;
             info.clearValue = attachment.clearValue;
             colorInfos.push_back(info);
+
+            width = image.width;
+            height = image.height;
         }
 
         VkRenderingAttachmentInfo depthInfo = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-        if (batch.useDepth)
+        if (pass.useDepth)
         {
-            RenderTarget* rt = ctx.resourceManager.getRenderTarget(batch.depthAttachment.handle);
-            depthInfo.imageView = rt->m_view;
+            const GraphImage& image = ctx.graph.getImage(pass.depthAttachment.resource);
+            depthInfo.imageView = image.view;
             depthInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-            depthInfo.loadOp = batch.depthAttachment.loadOp;
-            depthInfo.storeOp = batch.depthAttachment.storeOp;
-            depthInfo.clearValue = batch.depthAttachment.clearValue;
-        }
+            depthInfo.loadOp = pass.depthAttachment.loadOp;
+            depthInfo.storeOp = pass.depthAttachment.storeOp;
+            depthInfo.clearValue = pass.depthAttachment.clearValue;
 
-        uint32_t width = 0;
-        uint32_t height = 0;
-        if (!colorInfos.empty())
-        {
-            RenderTarget* rt = ctx.resourceManager.getRenderTarget(batch.colorAttachments[0].handle);
-            width = rt->m_width;
-            height = rt->m_height;
+            width = image.width;
+            height = image.height;
         }
 
-        VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
-        renderingInfo.renderArea = {{0, 0}, {width, height}};
-        renderingInfo.layerCount = 1;
-        renderingInfo.colorAttachmentCount = (uint32_t)colorInfos.size();
-        renderingInfo.pColorAttachments = colorInfos.data();
-        if (batch.useDepth)
+        if (rendering)
         {
-            renderingInfo.pDepthAttachment = &depthInfo;
-        }
+            VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
+            renderingInfo.renderArea = {{0, 0}, {width, height}};
+            renderingInfo.layerCount = 1;
+            renderingInfo.flags = parallel ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+            renderingInfo.colorAttachmentCount = (uint32_t)colorInfos.size();
+            renderingInfo.pColorAttachments = colorInfos.data();
+            if (pass.useDepth)
+            {
+                renderingInfo.pDepthAttachment = &depthInfo;
+            }
 
-        vkCmdBeginRendering(cmd, &renderingInfo);
+            vkCmdBeginRendering(cmd, &renderingInfo);
 
-        for (const auto& pass : batch.passes)
-        {
-            if (pass.pipeline.isValid())
+            // Passes can end up on different command buffers (one per queue segment), every graphics pass sets
+            // its own flipped viewport over the render area
+            if (!parallel)
             {
-                Pipeline* pipeline = ctx.resourceManager.getPipeline(pass.pipeline);
-                pipeline->bind(cmd);
-
-                if (!pass.descriptorSets.empty())
-                {
-                    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0,
-                                            (uint32_t)pass.descriptorSets.size(), pass.descriptorSets.data(),
-                                            0, nullptr);
-                }
-                else
-                {
-                    VkDescriptorSet globalSet = ctx.pipelineManager.getGlobalDescriptorSet();
-                    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0, 1, &globalSet,
-                                            0, nullptr);
-                }
+                const VkViewport viewport = {0, (float)height, (float)width, -(float)height, 0, 1};
+                const VkRect2D scissor = {{0, 0}, {width, height}};
+                vkCmdSetViewport(cmd, 0, 1, &viewport);
+                vkCmdSetScissor(cmd, 0, 1, &scissor);
             }
+        }
+
+        if (parallel)
+        {
+            // Nothing but vkCmdExecuteCommands allowed inside a secondary contents scope
+            recordChunks(cmd, pass, ctx, itemCount, width, height);
+        }
+        else
+        {
+            bindPassState(cmd, pass, ctx);
 
             if (pass.execute)
             {
                 pass.execute(cmd, pass, ctx);
             }
+            if (pass.recordItems && itemCount > 0)
+            {
+                pass.recordItems(cmd, pass, ctx, 0, itemCount);
+            }
         }
 
-        vkCmdEndRendering(cmd);
+        if (rendering)
+        {
+            vkCmdEndRendering(cmd);
+        }
     }
 }
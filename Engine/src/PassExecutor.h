@@ -5,9 +5,21 @@
 
 namespace ToyEngine
 {
+    // Runs a single pass: rendering scope on its attachments for graphics passes, pipeline/descriptor binding
+    // and the pass callback. Barriers are the render graph's job.
+    // Passes with recordItems get split in chunks recorded on the worker threads into secondaries
+    // (rendering scope opened with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT) when the context has workers
     class PassExecutor
     {
     public:
-        void execute(VkCommandBuffer cmd, const RenderBatch& batch, PassContext& ctx);
+        void execute(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx);
+
+    private:
+        void bindPassState(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx) const;
+        void recordChunks(VkCommandBuffer cmd, const Pass& pass, PassContext& ctx, uint32_t itemCount,
+                          uint32_t width, uint32_t height);
+
+        // Kept between passes/frames so recording doesn't allocate
+        std::vector<VkCommandBuffer> m_secondaries;
     };
 }
@@ -0,0 +1,57 @@
+#include "PassTimings.h"
+#include "GpuProfiler.h"
+
+namespace ToyEngine
+{
+
+    // Weight of the newest sample in the rolling averages
+    constexpr float RollingFactor = 0.1f;
+
+    static void accumulate(float& average, float sample)
+    {
+        average = average == 0.0f ? sample : average + (sample - average) * RollingFactor;
+    }
+
+    PassTiming& PassTimings::getOrAdd(uint32_t passIndex)
+    {
+        if (passIndex >= m_timings.size())
+        {
+            m_timings.resize(passIndex + 1);
+        }
+        return m_timings[passIndex];
+    }
+
+    const PassTiming& PassTimings::get(uint32_t passIndex) const
+    {
+        static const PassTiming empty;
+        return passIndex < m_timings.size() ? m_timings[passIndex] : empty;
+    }
+
+    void PassTimings::update(const GpuProfiler& profiler)
+    {
+        m_gpuTimings = profiler.isSupported();
+        if (profiler.getResolvedFrameCount() == m_lastResolvedFrame)
+        {
+            return;
+        }
+        m_lastResolvedFrame = profiler.getResolvedFrameCount();
+
+        for (const GpuZone& zone : profiler.getResolvedZones())
+        {
+            if (zone.m_passIndex == ~0u || !zone.m_gpuValid)
+            {
+                continue;
+            }
+
+            PassTiming& timing = getOrAdd(zone.m_passIndex);
+            accumulate(timing.m_gpuMs, (float)(zone.m_gpuEndMs - zone.m_gpuBeginMs));
+            timing.m_gpuValid = true;
+        }
+    }
+
+    void PassTimings::addCpuTime(uint32_t passIndex, double cpuMs)
+    {
+        accumulate(getOrAdd(passIndex).m_cpuMs, (float)cpuMs);
+    }
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ToyEngine
+{
+
+    class GpuProfiler;
+
+    // Rolling averages, indexed by the graph's pass index
+    struct PassTiming
+    {
+        float m_cpuMs = 0.0f;
+        float m_gpuMs = 0.0f;
+        bool m_gpuValid = false;
+    };
+
+    // CPU record time and GPU execution time of every graph pass. GPU side comes from the profiler zones the
+    // graph opens around each pass, so it is MaxFramesInFlight frames behind the CPU side
+    class PassTimings
+    {
+    public:
+        // After GpuProfiler::beginFrame, folds in the frame it just resolved
+        void update(const GpuProfiler& profiler);
+
+        void addCpuTime(uint32_t passIndex, double cpuMs);
+
+        const PassTiming& get(uint32_t passIndex) const;
+        bool hasGpuTimings() const { return m_gpuTimings; }
+
+    private:
+        PassTiming& getOrAdd(uint32_t passIndex);
+
+        std::vector<PassTiming> m_timings;
+        bool m_gpuTimings = false;
+        uint64_t m_lastResolvedFrame = 0;
+    };
+
+}
@@ -23,6 +23,32 @@ namespace ToyEngine
 
         VK_CHECK(vkCreatePipelineLayout(ctx.m_device, &layoutInfo, nullptr, &m_layout));
 
+        assert(m_config.m_specConstantCount <= PipelineConfig::MaxSpecConstants);
+        VkSpecializationMapEntry specEntries[PipelineConfig::MaxSpecConstants];
+        for (uint32_t i = 0; i < m_config.m_specConstantCount; ++i)
+        {
+            specEntries[i] = {i, i * (uint32_t)sizeof(uint32_t), sizeof(uint32_t)};
+        }
+        VkSpecializationInfo specInfo{};
+        specInfo.mapEntryCount = m_config.m_specConstantCount;
+        specInfo.pMapEntries = specEntries;
+        specInfo.dataSize = m_config.m_specConstantCount * sizeof(uint32_t);
+        specInfo.pData = m_config.m_specConstants;
+        const VkSpecializationInfo* specialization = m_config.m_specConstantCount > 0 ? &specInfo : nullptr;
+
+        if (m_config.m_computeShader != VK_NULL_HANDLE)
+        {
+            VkComputePipelineCreateInfo computeInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+            computeInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            computeInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            computeInfo.stage.module = m_config.m_computeShader;
+            computeInfo.stage.pName = "main";
+            computeInfo.stage.pSpecializationInfo = specialization;
+            computeInfo.layout = m_layout;
+            VK_CHECK(vkCreateComputePipelines(ctx.m_device, VK_NULL_HANDLE, 1, &computeInfo, nullptr, &m_pipeline));
+            return;
+        }
+
         VkPipelineShaderStageCreateInfo shaderStages[3] = {};
         uint32_t shaderStageCount = 0;
 
@@ -32,12 +58,14 @@ namespace ToyEngine
             shaderStages[shaderStageCount].stage = VK_SHADER_STAGE_TASK_BIT_EXT;
             shaderStages[shaderStageCount].module = m_config.m_taskShader;
             shaderStages[shaderStageCount].pName = "main";
+            shaderStages[shaderStageCount].pSpecializationInfo = specialization;
             ++shaderStageCount;
 
             shaderStages[shaderStageCount].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
             shaderStages[shaderStageCount].stage = VK_SHADER_STAGE_MESH_BIT_EXT;
             shaderStages[shaderStageCount].module = m_config.m_meshShader;
             shaderStages[shaderStageCount].pName = "main";
+            shaderStages[shaderStageCount].pSpecializationInfo = specialization;
             ++shaderStageCount;
         }
         else
@@ -46,6 +74,7 @@ namespace ToyEngine
             shaderStages[shaderStageCount].stage = VK_SHADER_STAGE_VERTEX_BIT;
             shaderStages[shaderStageCount].module = m_config.m_vertexShader;
             shaderStages[shaderStageCount].pName = "main";
+            shaderStages[shaderStageCount].pSpecializationInfo = specialization;
             ++shaderStageCount;
         }
 
@@ -53,6 +82,7 @@ namespace ToyEngine
         shaderStages[shaderStageCount].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         shaderStages[shaderStageCount].module = m_config.m_fragmentShader;
         shaderStages[shaderStageCount].pName = "main";
+        shaderStages[shaderStageCount].pSpecializationInfo = specialization;
         ++shaderStageCount;
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
@@ -145,6 +175,7 @@ namespace ToyEngine
         ShaderStageFlags |= (m_config.m_vertexShader != VK_NULL_HANDLE) ? VK_SHADER_STAGE_VERTEX_BIT : 0;
         ShaderStageFlags |= (m_config.m_meshShader != VK_NULL_HANDLE) ? VK_SHADER_STAGE_MESH_BIT_EXT : 0;
         ShaderStageFlags |= (m_config.m_taskShader != VK_NULL_HANDLE) ? VK_SHADER_STAGE_TASK_BIT_EXT : 0;
+        ShaderStageFlags |= (m_config.m_computeShader != VK_NULL_HANDLE) ? VK_SHADER_STAGE_COMPUTE_BIT : 0;
         
         return ShaderStageFlags;
     };
@@ -167,7 +198,7 @@ namespace ToyEngine
 
     void Pipeline::bind(VkCommandBuffer cmd) const
     {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        vkCmdBindPipeline(cmd, getBindPoint(), m_pipeline);
     }
 
     VkShaderModule Pipeline::loadShader(VkDevice device, const char* path)
@@ -11,11 +11,15 @@ namespace ToyEngine
 
     struct PipelineConfig
     {
+        static constexpr uint32_t MaxSpecConstants = 8;
+
         VkShaderModule m_vertexShader = VK_NULL_HANDLE;
         VkShaderModule m_taskShader = VK_NULL_HANDLE;
         VkShaderModule m_meshShader = VK_NULL_HANDLE;
         VkShaderModule m_fragmentShader = VK_NULL_HANDLE;
-        VkFormat m_colorFormat;
+        // Set alone for a compute pipeline, everything else in the config is ignored then
+        VkShaderModule m_computeShader = VK_NULL_HANDLE;
+        VkFormat m_colorFormat = VK_FORMAT_UNDEFINED;
         VkFormat m_depthFormat = VK_FORMAT_D32_SFLOAT;
         VkCullModeFlags m_cullMode = VK_CULL_MODE_BACK_BIT;
         VkFrontFace m_frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
@@ -24,6 +28,13 @@ namespace ToyEngine
         bool m_blending = false;
         bool m_useMeshShaders = false;
         VkCompareOp m_depthCompareOp = VK_COMPARE_OP_GREATER; // Reverse depth by default
+        // Specialization constants, constant_id N takes m_specConstants[N] in every stage that declares it.
+        // All 32 bit, bool constants read 0 or 1
+        uint32_t m_specConstants[MaxSpecConstants] = {};
+        uint32_t m_specConstantCount = 0;
+
+        // ResourceManager's pipeline variant cache compares whole configs
+        bool operator==(const PipelineConfig& other) const = default;
     };
 
     class Pipeline
@@ -39,6 +50,12 @@ namespace ToyEngine
 
         void bind(VkCommandBuffer cmd) const;
 
+        VkPipelineBindPoint getBindPoint() const
+        {
+            return m_config.m_computeShader != VK_NULL_HANDLE ? VK_PIPELINE_BIND_POINT_COMPUTE
+                                                              : VK_PIPELINE_BIND_POINT_GRAPHICS;
+        }
+
         VkPipeline getVkPipeline() const
         {
             return m_pipeline;
@@ -49,6 +66,11 @@ namespace ToyEngine
             return m_layout;
         }
 
+        const PipelineConfig& getConfig() const
+        {
+            return m_config;
+        }
+
         static VkShaderModule loadShader(VkDevice device, const char* path);
 
         VkShaderStageFlags getPipelineStageMask( )const;
@@ -19,12 +19,14 @@ namespace ToyEngine
         bindings[0].binding = 0;
         bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
         bindings[0].descriptorCount = 1000;
-        bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        // Culling reads the depth pyramid from compute and task shaders
+        bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT |
+            VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
 
         bindings[1].binding = 1;
         bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
         bindings[1].descriptorCount = 10;
-        bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings[1].stageFlags = bindings[0].stageFlags;
 
         VkDescriptorBindingFlags bindingFlags[2] = {
             VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
@@ -63,23 +65,7 @@ namespace ToyEngine
 
     void PipelineManager::AddTextureToGlobalDescriptorSet(Texture& texture)
     {
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = texture.m_view;
-        imageInfo.sampler = nullptr;
-
-        uint32_t currentSlot = m_textureCount++;
-        texture.m_bindlessIndex = currentSlot;
-
-        VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-        descriptorWrite.dstSet = m_globalBindlessDescriptorSet;
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = currentSlot;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+        texture.m_bindlessIndex = addImage(texture.m_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
         // Default sampler
         static VkSampler linearSampler = VK_NULL_HANDLE;
@@ -110,6 +96,63 @@ namespace ToyEngine
         }
     }
 
+    uint32_t PipelineManager::addImage(VkImageView view, VkImageLayout layout)
+    {
+        uint32_t slot = 0;
+        if (!m_freeTextureSlots.empty())
+        {
+            slot = m_freeTextureSlots.back();
+            m_freeTextureSlots.pop_back();
+        }
+        else
+        {
+            slot = m_textureCount++;
+        }
+        assert(slot < 1000 && "PipelineManager: out of bindless texture slots");
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = layout;
+        imageInfo.imageView = view;
+        imageInfo.sampler = nullptr;
+
+        VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        descriptorWrite.dstSet = m_globalBindlessDescriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = slot;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+        return slot;
+    }
+
+    void PipelineManager::releaseImage(uint32_t slot)
+    {
+        // Partially bound, the stale descriptor is fine as long as nothing reads the slot
+        m_freeTextureSlots.push_back(slot);
+    }
+
+    uint32_t PipelineManager::addSampler(VkSampler sampler)
+    {
+        assert(m_samplerCount < 10 && "PipelineManager: out of bindless sampler slots");
+        const uint32_t slot = m_samplerCount++;
+
+        VkDescriptorImageInfo samplerInfo{};
+        samplerInfo.sampler = sampler;
+
+        VkWriteDescriptorSet samplerWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        samplerWrite.dstSet = m_globalBindlessDescriptorSet;
+        samplerWrite.dstBinding = 1;
+        samplerWrite.dstArrayElement = slot;
+        samplerWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+        samplerWrite.descriptorCount = 1;
+        samplerWrite.pImageInfo = &samplerInfo;
+
+        vkUpdateDescriptorSets(m_device, 1, &samplerWrite, 0, nullptr);
+        return slot;
+    }
+
     void PipelineManager::setupGlobalDescriptorSet()
     {
         VkDescriptorPoolSize poolSizes[2] = {
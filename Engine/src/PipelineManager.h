@@ -19,6 +19,14 @@ namespace ToyEngine
 
         void AddTextureToGlobalDescriptorSet(Texture& texture);
 
+        // Bindless slot for any sampled view (depth pyramid...), layout is the one it has when shaders read it.
+        // Slots can still be in use by frames in flight, release them through the deferred destruction
+        uint32_t addImage(VkImageView view, VkImageLayout layout);
+        void releaseImage(uint32_t slot);
+
+        // Slot 0 is the default linear sampler
+        uint32_t addSampler(VkSampler sampler);
+
         VkDescriptorSetLayout getGlobalDescriptorSetLayout()
         {
             return m_globalBindlessLayout;
@@ -36,6 +44,8 @@ namespace ToyEngine
     private:
         VkDevice m_device;
         uint32_t m_textureCount = 0;
+        std::vector<uint32_t> m_freeTextureSlots;
+        uint32_t m_samplerCount = 1;
     };
 
 }
@@ -0,0 +1,203 @@
+#include "PipelineStatistics.h"
+#include "GpuResources.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace ToyEngine
+{
+
+    const char* getPipelineStatisticName(PipelineStatistic statistic)
+    {
+        switch (statistic)
+        {
+        case PipelineStatistic::ClippingInvocations: return "Clipping invocations";
+        case PipelineStatistic::ClippingPrimitives: return "Clipping primitives";
+        case PipelineStatistic::FragmentInvocations: return "Fragment invocations";
+        case PipelineStatistic::ComputeInvocations: return "Compute invocations";
+        case PipelineStatistic::TaskInvocations: return "Task invocations";
+        case PipelineStatistic::MeshInvocations: return "Mesh invocations";
+        default: return "Unknown";
+        }
+    }
+
+    void PipelineStatistics::init(ResourceManager& resourceManager, const GpuContext& ctx, bool parallelRecording)
+    {
+        m_device = ctx.m_device;
+
+        // Owned by the resource manager, goes away with the rest on cleanup
+        m_counterBuffer = resourceManager.createBuffer(sizeof(MeshletCounters) * MaxFramesInFlight,
+                                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                       nullptr, MemoryCategory::Upload);
+        Buffer* counterBuffer = resourceManager.getBuffer(m_counterBuffer);
+        m_counters = (MeshletCounters*)counterBuffer->m_data;
+        m_counterAddress = counterBuffer->m_gpuAddress;
+        memset(m_counters, 0, sizeof(MeshletCounters) * MaxFramesInFlight);
+
+        if (!ctx.m_pipelineStatisticsQuery)
+        {
+            printf("PipelineStatistics: no pipelineStatisticsQuery, meshlet counters only\n");
+            return;
+        }
+        if (parallelRecording && !ctx.m_inheritedQueries)
+        {
+            printf("PipelineStatistics: no inheritedQueries for the recording threads, meshlet counters only\n");
+            return;
+        }
+
+        m_flags = VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+        m_statisticCount = (uint32_t)PipelineStatistic::TaskInvocations;
+        m_meshShaderQueries = ctx.m_meshShaderQueries;
+        if (m_meshShaderQueries)
+        {
+            m_flags |= VK_QUERY_PIPELINE_STATISTIC_TASK_SHADER_INVOCATIONS_BIT_EXT |
+                VK_QUERY_PIPELINE_STATISTIC_MESH_SHADER_INVOCATIONS_BIT_EXT;
+            m_statisticCount = (uint32_t)PipelineStatistic::Count;
+        }
+
+        VkQueryPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = MaxQueriesPerFrame;
+        poolInfo.pipelineStatistics = m_flags;
+        for (FrameQueries& frame : m_frames)
+        {
+            VK_CHECK(vkCreateQueryPool(m_device, &poolInfo, nullptr, &frame.m_pool));
+            // Host reset, nothing to record before the first use
+            vkResetQueryPool(m_device, frame.m_pool, 0, MaxQueriesPerFrame);
+        }
+    }
+
+    void PipelineStatistics::destroy()
+    {
+        for (FrameQueries& frame : m_frames)
+        {
+            if (frame.m_pool != VK_NULL_HANDLE)
+            {
+                vkDestroyQueryPool(m_device, frame.m_pool, nullptr);
+                frame.m_pool = VK_NULL_HANDLE;
+            }
+        }
+        m_flags = 0;
+        m_counters = nullptr;
+    }
+
+    bool PipelineStatistics::beginFrame(uint32_t frameIndex)
+    {
+        assert(!m_queryOpen && "PipelineStatistics: query left open over a frame");
+
+        m_frameIndex = frameIndex;
+        FrameQueries& frame = m_frames[frameIndex];
+
+        // The frame timeline wait already happened, everything written here is done
+        if (frame.m_queryCount > 0)
+        {
+            uint64_t results[MaxQueriesPerFrame * (uint32_t)PipelineStatistic::Count];
+            const VkResult result = vkGetQueryPoolResults(m_device, frame.m_pool, 0, frame.m_queryCount,
+                                                          sizeof(results), results,
+                                                          sizeof(uint64_t) * m_statisticCount, VK_QUERY_RESULT_64_BIT);
+            if (result == VK_SUCCESS)
+            {
+                for (PassStatistics& pass : m_passStatistics)
+                {
+                    pass.m_valid = false;
+                }
+                m_frameTotals = PassStatistics();
+                m_frameTotals.m_valid = true;
+
+                for (uint32_t query = 0; query < frame.m_queryCount; ++query)
+                {
+                    const uint32_t passIndex = frame.m_passIndices[query];
+                    if (passIndex >= m_passStatistics.size())
+                    {
+                        m_passStatistics.resize(passIndex + 1);
+                    }
+
+                    PassStatistics& pass = m_passStatistics[passIndex];
+                    for (uint32_t i = 0; i < m_statisticCount; ++i)
+                    {
+                        pass.m_values[i] = results[query * m_statisticCount + i];
+                        m_frameTotals.m_values[i] += pass.m_values[i];
+                    }
+                    pass.m_valid = true;
+                }
+            }
+            vkResetQueryPool(m_device, frame.m_pool, 0, frame.m_queryCount);
+            frame.m_queryCount = 0;
+        }
+
+        const bool countersRead = frame.m_countersWritten;
+        if (frame.m_countersWritten)
+        {
+            m_meshletCounters = m_counters[frameIndex];
+            frame.m_countersWritten = false;
+        }
+        // Also covers frames that ran with the counters disabled, the slot must start at 0 when enabled
+        m_counters[frameIndex] = MeshletCounters();
+        return countersRead;
+    }
+
+    void PipelineStatistics::endFrame(VkCommandBuffer cmd)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+
+        VkMemoryBarrier2 barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+        barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+        VkDependencyInfo dependency{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        dependency.memoryBarrierCount = 1;
+        dependency.pMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2(cmd, &dependency);
+        m_frames[m_frameIndex].m_countersWritten = true;
+    }
+
+    uint32_t PipelineStatistics::beginQuery(VkCommandBuffer cmd, uint32_t passIndex)
+    {
+        FrameQueries& frame = m_frames[m_frameIndex];
+        if (!m_enabled || frame.m_pool == VK_NULL_HANDLE || frame.m_queryCount >= MaxQueriesPerFrame)
+        {
+            return ~0u;
+        }
+
+        assert(!m_queryOpen);
+        const uint32_t query = frame.m_queryCount++;
+        frame.m_passIndices[query] = passIndex;
+        vkCmdBeginQuery(cmd, frame.m_pool, query, 0);
+        m_queryOpen = true;
+        return query;
+    }
+
+    void PipelineStatistics::endQuery(VkCommandBuffer cmd, uint32_t query)
+    {
+        if (query == ~0u)
+        {
+            return;
+        }
+
+        vkCmdEndQuery(cmd, m_frames[m_frameIndex].m_pool, query);
+        m_queryOpen = false;
+    }
+
+    VkDeviceAddress PipelineStatistics::getMeshletCounterAddress() const
+    {
+        return m_enabled ? m_counterAddress + sizeof(MeshletCounters) * m_frameIndex : 0;
+    }
+
+    const PassStatistics& PipelineStatistics::getPassStatistics(uint32_t passIndex) const
+    {
+        static const PassStatistics empty;
+        return passIndex < m_passStatistics.size() ? m_passStatistics[passIndex] : empty;
+    }
+
+}
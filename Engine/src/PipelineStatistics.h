@@ -0,0 +1,118 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <vector>
+
+#include "Common/Common.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    struct GpuContext;
+
+    // Same order as the results come back in, bit order of the query flags. Task/mesh only with meshShaderQueries
+    enum class PipelineStatistic : uint8_t
+    {
+        ClippingInvocations,
+        ClippingPrimitives,
+        FragmentInvocations,
+        ComputeInvocations,
+        TaskInvocations,
+        MeshInvocations,
+        Count
+    };
+
+    const char* getPipelineStatisticName(PipelineStatistic statistic);
+
+    struct PassStatistics
+    {
+        uint64_t m_values[(uint32_t)PipelineStatistic::Count] = {};
+        bool m_valid = false;
+    };
+
+    // Written by the task and mesh shaders with one atomic per workgroup, matches MeshletStatsPtr in common.glsl
+    struct MeshletCounters
+    {
+        uint32_t m_tested = 0;
+        uint32_t m_coneCulled = 0;
+        uint32_t m_frustumCulled = 0;
+        // Late phase of the two phase occlusion culling only
+        uint32_t m_occlusionCulled = 0;
+        // Under the projected size threshold of the camera data
+        uint32_t m_smallCulled = 0;
+        // Triangles of the meshlets that reached the mesh shader, then what its triangle culling removed
+        uint32_t m_triangles = 0;
+        uint32_t m_trianglesBackfaceCulled = 0;
+        uint32_t m_trianglesFrustumCulled = 0;
+        uint32_t m_trianglesSmallCulled = 0;
+    };
+
+    // Pipeline statistics queries around graphics passes plus the task shader's meshlet counters, one query pool
+    // and counter slot per frame in flight. Read back like the GpuProfiler, when the slot comes around again after
+    // the timeline wait, so the numbers are MaxFramesInFlight frames old. Off until enabled
+    class PipelineStatistics
+    {
+    public:
+        static constexpr uint32_t MaxQueriesPerFrame = 64;
+
+        // parallelRecording: passes may run secondaries inside the query, needs inheritedQueries then
+        void init(ResourceManager& resourceManager, const GpuContext& ctx, bool parallelRecording);
+        void destroy();
+
+        // After the frame timeline wait, reads back what the slot recorded last time and resets it.
+        // Returns true when the slot had meshlet counters to read back
+        bool beginFrame(uint32_t frameIndex);
+        // On the last graphics command buffer of the frame, makes the counters visible to the host
+        void endFrame(VkCommandBuffer cmd);
+
+        // Graphics queue only, outside of rendering scopes. Returns the query to end, ~0u when not querying
+        uint32_t beginQuery(VkCommandBuffer cmd, uint32_t passIndex);
+        void endQuery(VkCommandBuffer cmd, uint32_t query);
+        // For secondaries recorded while a query is open
+        VkQueryPipelineStatisticFlags getActiveFlags() const { return m_queryOpen ? m_flags : 0; }
+
+        // This frame's counter slot for the task shader push constants, 0 when disabled
+        VkDeviceAddress getMeshletCounterAddress() const;
+
+        void setEnabled(bool enabled) { m_enabled = enabled; }
+        bool isEnabled() const { return m_enabled; }
+        bool isSupported() const { return m_flags != 0; }
+        bool hasMeshShaderQueries() const { return m_meshShaderQueries; }
+
+        // Newest resolved frame, indexed by the graph's pass index
+        const PassStatistics& getPassStatistics(uint32_t passIndex) const;
+        const PassStatistics& getFrameTotals() const { return m_frameTotals; }
+        const MeshletCounters& getMeshletCounters() const { return m_meshletCounters; }
+
+    private:
+        struct FrameQueries
+        {
+            VkQueryPool m_pool = VK_NULL_HANDLE;
+            uint32_t m_passIndices[MaxQueriesPerFrame] = {};
+            uint32_t m_queryCount = 0;
+            bool m_countersWritten = false;
+        };
+
+        VkDevice m_device = VK_NULL_HANDLE;
+        VkQueryPipelineStatisticFlags m_flags = 0;
+        uint32_t m_statisticCount = 0;
+        bool m_meshShaderQueries = false;
+        bool m_enabled = false;
+        bool m_queryOpen = false;
+
+        FrameQueries m_frames[MaxFramesInFlight];
+        uint32_t m_frameIndex = 0;
+
+        // MaxFramesInFlight MeshletCounters, host visible
+        BufferHandle m_counterBuffer;
+        MeshletCounters* m_counters = nullptr;
+        VkDeviceAddress m_counterAddress = 0;
+
+        std::vector<PassStatistics> m_passStatistics;
+        PassStatistics m_frameTotals;
+        MeshletCounters m_meshletCounters;
+    };
+
+}
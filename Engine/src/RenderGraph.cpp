@@ -0,0 +1,1076 @@
+#include "RenderGraph.h"
+#include "PassExecutor.h"
+#include "PassTimings.h"
+#include "GpuProfiler.h"
+#include "PipelineStatistics.h"
+#include "FrameArena.h"
+#include "CpuProfiler.h"
+#include "Common/Common.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace ToyEngine
+{
+
+    void RenderGraph::reset()
+    {
+        m_resources.clear();
+        m_passes.clear();
+        m_transientsBound = false;
+    }
+
+    GraphResource RenderGraph::createTransientImage(const char* name, const TransientTargetDesc& desc)
+    {
+        Resource resource;
+        resource.m_name = name;
+        resource.m_transient = true;
+        resource.m_transientDesc = desc;
+        resource.m_aspect = desc.m_aspect;
+        // Memory might have been used by an aliased target right before, first use waits on everything
+        resource.m_initialStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        m_resources.push_back(resource);
+        return (GraphResource)m_resources.size() - 1;
+    }
+
+    GraphResource RenderGraph::importImage(const char* name, VkImage image, VkImageView view, uint32_t width,
+                                           uint32_t height, VkFormat format, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+                                           VkPipelineStageFlags2 initialStage, VkImageLayout finalLayout)
+    {
+        Resource resource;
+        resource.m_name = name;
+        resource.m_aspect = aspect;
+        resource.m_initialLayout = initialLayout;
+        resource.m_initialStage = initialStage;
+        resource.m_finalLayout = finalLayout;
+        resource.m_image = {image, view, width, height, format};
+        m_resources.push_back(resource);
+        return (GraphResource)m_resources.size() - 1;
+    }
+
+    GraphResource RenderGraph::importBuffer(const char* name, VkBuffer buffer, VkPipelineStageFlags2 initialStage,
+                                            VkAccessFlags2 initialAccess)
+    {
+        Resource resource;
+        resource.m_name = name;
+        resource.m_isImage = false;
+        resource.m_initialStage = initialStage;
+        resource.m_initialAccess = initialAccess;
+        resource.m_buffer = buffer;
+        m_resources.push_back(resource);
+        return (GraphResource)m_resources.size() - 1;
+    }
+
+    void RenderGraph::setImportedImage(GraphResource resource, VkImage image, VkImageView view, uint32_t width,
+                                       uint32_t height)
+    {
+        assert(resource < m_resources.size() && m_resources[resource].m_isImage && !m_resources[resource].m_transient);
+        m_resources[resource].m_image = {image, view, width, height, m_resources[resource].m_image.format};
+    }
+
+    void RenderGraph::setImportedBuffer(GraphResource resource, VkBuffer buffer)
+    {
+        assert(resource < m_resources.size() && !m_resources[resource].m_isImage);
+        m_resources[resource].m_buffer = buffer;
+    }
+
+    uint32_t RenderGraph::addPass(const Pass& pass)
+    {
+        m_passes.push_back(pass);
+        return (uint32_t)m_passes.size() - 1;
+    }
+
+    void RenderGraph::setQueueFamilies(uint32_t graphicsFamily, uint32_t asyncComputeFamily)
+    {
+        m_queueFamilies[(uint32_t)QueueType::Graphics] = graphicsFamily;
+        m_queueFamilies[(uint32_t)QueueType::AsyncCompute] = asyncComputeFamily != graphicsFamily ? asyncComputeFamily : ~0u;
+    }
+
+    uint32_t RenderGraph::getAsyncPassCount() const
+    {
+        return (uint32_t)std::count(m_orderQueues.begin(), m_orderQueues.end(), QueueType::AsyncCompute);
+    }
+
+    void RenderGraph::collectAccesses(const Pass& pass, std::vector<MergedAccess>& accesses) const
+    {
+        accesses.clear();
+
+        auto addAccess = [&](GraphResource resource, ResourceUsage usage, bool readsContents)
+        {
+            assert(resource < m_resources.size());
+            const ResourceState state = getResourceState(usage, pass.type);
+            const bool write = isWriteUsage(usage);
+
+            auto it = std::find_if(accesses.begin(), accesses.end(),
+                                   [resource](const MergedAccess& access) { return access.resource == resource; });
+            if (it == accesses.end())
+            {
+                accesses.push_back({resource, state, write, readsContents});
+                return;
+            }
+
+            // Same image used in two ways on one pass, only GENERAL fits both
+            it->state.stage |= state.stage;
+            it->state.access |= state.access;
+            if (it->state.layout != state.layout)
+            {
+                it->state.layout = VK_IMAGE_LAYOUT_GENERAL;
+            }
+            it->write |= write;
+            it->readsContents |= readsContents;
+        };
+
+        for (const PassAttachment& attachment : pass.colorAttachments)
+        {
+            addAccess(attachment.resource, ResourceUsage::ColorAttachment, attachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+        }
+        if (pass.useDepth)
+        {
+            addAccess(pass.depthAttachment.resource, ResourceUsage::DepthAttachment,
+                      pass.depthAttachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+        }
+        for (const PassResourceAccess& access : pass.reads)
+        {
+            addAccess(access.resource, access.usage, true);
+        }
+        for (const PassResourceAccess& access : pass.writes)
+        {
+            addAccess(access.resource, access.usage, true);
+        }
+    }
+
+    // Only used to notice the graph changed shape
+    uint64_t RenderGraph::computeHash() const
+    {
+        uint64_t hash = FnvOffsetBasis;
+        hashValue(hash, m_queueFamilies);
+
+        hashValue(hash, m_resources.size());
+        for (const Resource& resource : m_resources)
+        {
+            hashValue(hash, resource.m_isImage);
+            hashValue(hash, resource.m_transient);
+            hashValue(hash, resource.m_aspect);
+            hashValue(hash, resource.m_image.format);
+            hashValue(hash, resource.m_initialLayout);
+            hashValue(hash, resource.m_finalLayout);
+            hashValue(hash, resource.m_initialStage);
+            hashValue(hash, resource.m_initialAccess);
+            if (resource.m_transient)
+            {
+                const TransientTargetDesc& desc = resource.m_transientDesc;
+                hashValue(hash, desc.m_width);
+                hashValue(hash, desc.m_height);
+                hashValue(hash, desc.m_format);
+                hashValue(hash, desc.m_usage);
+                hashValue(hash, desc.m_aspect);
+            }
+        }
+
+        hashValue(hash, m_passes.size());
+        for (const Pass& pass : m_passes)
+        {
+            hashValue(hash, pass.type);
+            hashValue(hash, pass.queue);
+            hashValue(hash, pass.sideEffects);
+            hashValue(hash, pass.useDepth);
+            hashValue(hash, pass.colorAttachments.size());
+            for (const PassAttachment& attachment : pass.colorAttachments)
+            {
+                hashValue(hash, attachment.resource);
+                hashValue(hash, attachment.loadOp);
+            }
+            if (pass.useDepth)
+            {
+                hashValue(hash, pass.depthAttachment.resource);
+                hashValue(hash, pass.depthAttachment.loadOp);
+            }
+            hashValue(hash, pass.reads.size());
+            for (const PassResourceAccess& access : pass.reads)
+            {
+                hashValue(hash, access.resource);
+                hashValue(hash, access.usage);
+            }
+            hashValue(hash, pass.writes.size());
+            for (const PassResourceAccess& access : pass.writes)
+            {
+                hashValue(hash, access.resource);
+                hashValue(hash, access.usage);
+            }
+        }
+
+        return hash;
+    }
+
+    void RenderGraph::cullPasses()
+    {
+        // Who produced what each pass needs, in declaration order like the sort
+        const uint32_t passCount = (uint32_t)m_passes.size();
+        std::vector<std::vector<uint32_t>> producers(passCount);
+        std::vector<uint32_t> lastWriter(m_resources.size(), ~0u);
+        std::vector<uint32_t> alive;
+        std::vector<MergedAccess> accesses;
+        m_culled.assign(passCount, 1);
+
+        for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex)
+        {
+            bool root = m_passes[passIndex].sideEffects;
+            collectAccesses(m_passes[passIndex], accesses);
+            for (const MergedAccess& access : accesses)
+            {
+                if (access.readsContents && lastWriter[access.resource] != ~0u)
+                {
+                    producers[passIndex].push_back(lastWriter[access.resource]);
+                }
+                if (access.write)
+                {
+                    lastWriter[access.resource] = passIndex;
+                    // Imported resources outlive the graph, writing them is the point
+                    root |= !m_resources[access.resource].m_transient;
+                }
+            }
+
+            if (root)
+            {
+                m_culled[passIndex] = 0;
+                alive.push_back(passIndex);
+            }
+        }
+
+        while (!alive.empty())
+        {
+            uint32_t passIndex = alive.back();
+            alive.pop_back();
+            for (uint32_t producer : producers[passIndex])
+            {
+                if (m_culled[producer])
+                {
+                    m_culled[producer] = 0;
+                    alive.push_back(producer);
+                }
+            }
+        }
+    }
+
+    bool RenderGraph::sortPasses()
+    {
+        const uint32_t passCount = (uint32_t)m_passes.size();
+        std::vector<std::vector<uint32_t>> dependents(passCount);
+        std::vector<uint32_t> dependencyCount(passCount, 0);
+
+        auto addEdge = [&](uint32_t from, uint32_t to)
+        {
+            if (from == to || m_culled[from] || m_culled[to] || std::find(dependents[from].begin(), dependents[from].end(), to) != dependents[from].end())
+            {
+                return;
+            }
+            dependents[from].push_back(to);
+            ++dependencyCount[to];
+        };
+
+        // Declaration order decides who sees which write: reads depend on the last writer,
+        // writes on the last writer and every reader since. Culled passes are left out entirely
+        std::vector<uint32_t> lastWriter(m_resources.size(), ~0u);
+        std::vector<std::vector<uint32_t>> readersSinceWrite(m_resources.size());
+        std::vector<MergedAccess> accesses;
+        uint32_t alivePassCount = 0;
+        for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex)
+        {
+            if (m_culled[passIndex])
+            {
+                continue;
+            }
+            ++alivePassCount;
+
+            collectAccesses(m_passes[passIndex], accesses);
+            for (const MergedAccess& access : accesses)
+            {
+                if (lastWriter[access.resource] != ~0u)
+                {
+                    addEdge(lastWriter[access.resource], passIndex);
+                }
+
+                if (access.write)
+                {
+                    for (uint32_t reader : readersSinceWrite[access.resource])
+                    {
+                        addEdge(reader, passIndex);
+                    }
+                    readersSinceWrite[access.resource].clear();
+                    lastWriter[access.resource] = passIndex;
+                }
+                else
+                {
+                    readersSinceWrite[access.resource].push_back(passIndex);
+                }
+            }
+        }
+
+        // Kahn, lowest pass index first among the ready ones so independent passes keep declaration order
+        m_order.clear();
+        std::vector<uint32_t> ready;
+        for (uint32_t passIndex = 0; passIndex < passCount; ++passIndex)
+        {
+            if (!m_culled[passIndex] && dependencyCount[passIndex] == 0)
+            {
+                ready.push_back(passIndex);
+            }
+        }
+
+        while (!ready.empty())
+        {
+            auto next = std::min_element(ready.begin(), ready.end());
+            uint32_t passIndex = *next;
+            ready.erase(next);
+            m_order.push_back(passIndex);
+
+            for (uint32_t dependent : dependents[passIndex])
+            {
+                if (--dependencyCount[dependent] == 0)
+                {
+                    ready.push_back(dependent);
+                }
+            }
+        }
+
+        return m_order.size() == alivePassCount;
+    }
+
+    void RenderGraph::buildSegments()
+    {
+        const bool asyncCompute = m_queueFamilies[(uint32_t)QueueType::AsyncCompute] != ~0u;
+
+        m_orderQueues.resize(m_order.size());
+        m_segments.clear();
+        bool hasAsyncSegment = false;
+        for (uint32_t orderIndex = 0; orderIndex < m_order.size(); ++orderIndex)
+        {
+            const Pass& pass = m_passes[m_order[orderIndex]];
+            const QueueType queue = asyncCompute && pass.type == PassType::Compute && pass.queue == QueueType::AsyncCompute
+                ? QueueType::AsyncCompute
+                : QueueType::Graphics;
+            m_orderQueues[orderIndex] = queue;
+
+            if (m_segments.empty() || m_segments.back().queue != queue)
+            {
+                GraphSegment segment;
+                segment.queue = queue;
+                segment.firstOrderIndex = orderIndex;
+                m_segments.push_back(segment);
+                hasAsyncSegment |= queue == QueueType::AsyncCompute;
+            }
+            m_segments.back().endOrderIndex = orderIndex + 1;
+        }
+
+        // With async work around, segment 0 is left empty: async segments wait on it and shouldn't wait
+        // on graphics passes they don't depend on
+        if (hasAsyncSegment || m_segments.empty() || m_segments[0].queue != QueueType::Graphics)
+        {
+            m_segments.insert(m_segments.begin(), GraphSegment{});
+        }
+
+        // Final barriers (and whatever presents after) are on graphics
+        if (m_segments.back().queue != QueueType::Graphics)
+        {
+            GraphSegment segment;
+            segment.firstOrderIndex = (uint32_t)m_order.size();
+            segment.endOrderIndex = (uint32_t)m_order.size();
+            m_segments.push_back(segment);
+        }
+
+        for (GraphSegment& segment : m_segments)
+        {
+            if (segment.queue == QueueType::AsyncCompute)
+            {
+                segment.waits.push_back({0, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT});
+            }
+        }
+    }
+
+    void RenderGraph::computeBarriers()
+    {
+        struct TrackedState
+        {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            // Last write, and what it has been made visible to already
+            VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+            VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+            // Readers since the last write, a new write has to wait for them
+            VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+            // Owning queue and the segment of the last access, where a release would go
+            QueueType queue = QueueType::Graphics;
+            uint32_t segment = 0;
+            // Undefined content doesn't need an ownership transfer, the next queue just discards it
+            bool hasContents = false;
+        };
+
+        std::vector<TrackedState> states(m_resources.size());
+        for (uint32_t i = 0; i < m_resources.size(); ++i)
+        {
+            const Resource& resource = m_resources[i];
+            states[i].layout = resource.m_initialLayout;
+            states[i].writeStage = resource.m_initialStage;
+            states[i].writeAccess = resource.m_initialAccess;
+            states[i].hasContents = !resource.m_transient &&
+                (!resource.m_isImage || resource.m_initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+        }
+
+        for (GraphSegment& segment : m_segments)
+        {
+            segment.releaseBarriers.clear();
+        }
+
+        auto addWait = [&](uint32_t segmentIndex, uint32_t waitedSegment, VkPipelineStageFlags2 stage)
+        {
+            GraphSegment& segment = m_segments[segmentIndex];
+            if (segment.queue == m_segments[waitedSegment].queue)
+            {
+                return;
+            }
+
+            stage = stage != VK_PIPELINE_STAGE_2_NONE ? stage : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            for (GraphSegmentWait& wait : segment.waits)
+            {
+                if (wait.segment == waitedSegment)
+                {
+                    wait.stage |= stage;
+                    return;
+                }
+            }
+            segment.waits.push_back({waitedSegment, stage});
+        };
+
+        // Release goes at the end of the segment that last used the resource, the acquire is returned for the caller
+        // to place. Both halves carry the same layout transition
+        auto transferOwnership = [&](GraphResource resourceIndex, TrackedState& state, QueueType dstQueue,
+                                     VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess, VkImageLayout newLayout)
+        {
+            const bool isImage = m_resources[resourceIndex].m_isImage;
+
+            GraphBarrier release;
+            release.resource = resourceIndex;
+            release.srcStage = state.writeStage | state.readStages;
+            release.srcAccess = state.writeAccess;
+            release.oldLayout = isImage ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+            release.newLayout = isImage ? newLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+            release.srcQueue = state.queue;
+            release.dstQueue = dstQueue;
+            m_segments[state.segment].releaseBarriers.push_back(release);
+
+            GraphBarrier acquire = release;
+            acquire.srcStage = VK_PIPELINE_STAGE_2_NONE;
+            acquire.srcAccess = VK_ACCESS_2_NONE;
+            acquire.dstStage = dstStage;
+            acquire.dstAccess = dstAccess;
+            return acquire;
+        };
+
+        m_barriers.assign(m_order.size(), {});
+        std::vector<MergedAccess> accesses;
+        for (uint32_t segmentIndex = 0; segmentIndex < m_segments.size(); ++segmentIndex)
+        {
+            const QueueType queue = m_segments[segmentIndex].queue;
+            for (uint32_t orderIndex = m_segments[segmentIndex].firstOrderIndex;
+                 orderIndex < m_segments[segmentIndex].endOrderIndex; ++orderIndex)
+            {
+                collectAccesses(m_passes[m_order[orderIndex]], accesses);
+                for (const MergedAccess& access : accesses)
+                {
+                    const Resource& resource = m_resources[access.resource];
+                    TrackedState& state = states[access.resource];
+
+                    if (state.queue != queue)
+                    {
+                        addWait(segmentIndex, state.segment, access.state.stage);
+                        if (state.hasContents)
+                        {
+                            m_barriers[orderIndex].push_back(transferOwnership(access.resource, state, queue,
+                                                                               access.state.stage, access.state.access,
+                                                                               access.state.layout));
+
+                            // Acquired straight into this access, nothing else to sync with on this queue
+                            state.layout = resource.m_isImage ? access.state.layout : state.layout;
+                            state.writeStage = access.state.stage;
+                            state.writeAccess = access.write ? access.state.access : VK_ACCESS_2_NONE;
+                            state.visibleStages = access.write ? VK_PIPELINE_STAGE_2_NONE : access.state.stage;
+                            state.visibleAccess = access.write ? VK_ACCESS_2_NONE : access.state.access;
+                            state.readStages = access.write ? VK_PIPELINE_STAGE_2_NONE : access.state.stage;
+                            state.queue = queue;
+                            state.segment = segmentIndex;
+                            state.hasContents |= access.write;
+                            continue;
+                        }
+
+                        // The other queue's stages mean nothing here, the wait above covers them. Start over
+                        const uint32_t previousSegment = state.segment;
+                        state = TrackedState{};
+                        state.segment = previousSegment;
+                    }
+                    state.queue = queue;
+                    state.segment = segmentIndex;
+                    state.hasContents |= access.write;
+
+                    const bool layoutChange = resource.m_isImage && state.layout != access.state.layout;
+                    if (layoutChange || access.write)
+                    {
+                        GraphBarrier barrier;
+                        barrier.resource = access.resource;
+                        barrier.srcStage = state.writeStage | state.readStages;
+                        barrier.srcAccess = state.writeAccess;
+                        barrier.dstStage = access.state.stage;
+                        barrier.dstAccess = access.state.access;
+                        barrier.oldLayout = resource.m_isImage ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                        barrier.newLayout = resource.m_isImage ? access.state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                        barrier.srcQueue = queue;
+                        barrier.dstQueue = queue;
+
+                        // Buffer written for the first time and imported without an initial stage, nothing to wait on
+                        if (barrier.srcStage != VK_PIPELINE_STAGE_2_NONE || layoutChange)
+                        {
+                            m_barriers[orderIndex].push_back(barrier);
+                        }
+
+                        state.layout = resource.m_isImage ? access.state.layout : state.layout;
+                        if (access.write)
+                        {
+                            state.writeStage = access.state.stage;
+                            state.writeAccess = access.state.access;
+                            state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+                            state.visibleAccess = VK_ACCESS_2_NONE;
+                            state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                        }
+                        else
+                        {
+                            // A layout transition behaves like a write done by the barrier itself
+                            state.writeStage = access.state.stage;
+                            state.writeAccess = VK_ACCESS_2_NONE;
+                            state.visibleStages = access.state.stage;
+                            state.visibleAccess = access.state.access;
+                            state.readStages = access.state.stage;
+                        }
+                        continue;
+                    }
+
+                    // Read on the same layout, only needs something if the last write is not visible to it yet
+                    const bool needsVisibility = (access.state.stage & ~state.visibleStages) ||
+                        (access.state.access & ~state.visibleAccess);
+                    if (state.writeStage != VK_PIPELINE_STAGE_2_NONE && needsVisibility)
+                    {
+                        GraphBarrier barrier;
+                        barrier.resource = access.resource;
+                        barrier.srcStage = state.writeStage;
+                        barrier.srcAccess = state.writeAccess;
+                        barrier.dstStage = access.state.stage;
+                        barrier.dstAccess = access.state.access;
+                        barrier.oldLayout = state.layout;
+                        barrier.newLayout = state.layout;
+                        barrier.srcQueue = queue;
+                        barrier.dstQueue = queue;
+                        m_barriers[orderIndex].push_back(barrier);
+
+                        state.visibleStages |= access.state.stage;
+                        state.visibleAccess |= access.state.access;
+                    }
+                    state.readStages |= access.state.stage;
+                }
+            }
+        }
+
+        // Whatever comes next (present, next submit) syncs through semaphores signaled on all commands
+        const uint32_t lastSegment = (uint32_t)m_segments.size() - 1;
+        m_finalBarriers.clear();
+        for (uint32_t i = 0; i < m_resources.size(); ++i)
+        {
+            const Resource& resource = m_resources[i];
+            TrackedState& state = states[i];
+            const VkImageLayout finalLayout = resource.m_finalLayout != VK_IMAGE_LAYOUT_UNDEFINED
+                ? resource.m_finalLayout
+                : state.layout;
+
+            // Imported resources go back to graphics for the next frame
+            if (!resource.m_transient && state.queue != QueueType::Graphics)
+            {
+                addWait(lastSegment, state.segment, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+                if (state.hasContents || finalLayout != state.layout)
+                {
+                    m_finalBarriers.push_back(transferOwnership(i, state, QueueType::Graphics,
+                                                                VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                                                VK_ACCESS_2_NONE, finalLayout));
+                }
+                continue;
+            }
+
+            if (!resource.m_isImage || resource.m_transient || finalLayout == state.layout)
+            {
+                continue;
+            }
+
+            GraphBarrier barrier;
+            barrier.resource = i;
+            barrier.srcStage = state.writeStage | state.readStages;
+            barrier.srcAccess = state.writeAccess;
+            barrier.dstStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            barrier.dstAccess = VK_ACCESS_2_NONE;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = finalLayout;
+            m_finalBarriers.push_back(barrier);
+        }
+    }
+
+    bool RenderGraph::compile()
+    {
+        const uint64_t hash = computeHash();
+        if (m_compiled && hash == m_compiledHash)
+        {
+            return true;
+        }
+
+        m_compiled = false;
+        m_transientsBound = false;
+        ++m_compileCount;
+
+        cullPasses();
+        if (!sortPasses())
+        {
+            printf("RenderGraph: dependency cycle, %zu of %zu passes could be ordered\n", m_order.size(), m_passes.size());
+            assert(false);
+            return false;
+        }
+
+        buildSegments();
+        computeBarriers();
+        m_compiledHash = hash;
+        m_compiled = true;
+        return true;
+    }
+
+    void RenderGraph::allocateTransients(TransientTargetPool& pool, ResourceManager& resourceManager)
+    {
+        assert(m_compiled);
+        if (m_transientsBound)
+        {
+            return;
+        }
+
+        pool.beginFrame();
+
+        // Lifetimes in compiled order, that is what decides who can alias with who.
+        // Targets only touched by culled passes never get declared
+        m_transientPool = &pool;
+        m_poolTargets.assign(m_resources.size(), ~0u);
+        std::vector<uint32_t>& poolTargets = m_poolTargets;
+        std::vector<MergedAccess> accesses;
+        for (uint32_t orderIndex = 0; orderIndex < m_order.size(); ++orderIndex)
+        {
+            collectAccesses(m_passes[m_order[orderIndex]], accesses);
+            for (const MergedAccess& access : accesses)
+            {
+                if (!m_resources[access.resource].m_transient)
+                {
+                    continue;
+                }
+                if (poolTargets[access.resource] == ~0u)
+                {
+                    poolTargets[access.resource] = pool.declare(m_resources[access.resource].m_transientDesc);
+                }
+                pool.use(poolTargets[access.resource], orderIndex);
+
+                // Async passes overlap graphics ones regardless of the order, their targets don't alias with anything
+                if (m_orderQueues[orderIndex] != QueueType::Graphics)
+                {
+                    pool.use(poolTargets[access.resource], 0);
+                    pool.use(poolTargets[access.resource], (uint32_t)m_order.size() - 1);
+                }
+            }
+        }
+
+        pool.compile();
+
+        for (uint32_t i = 0; i < m_resources.size(); ++i)
+        {
+            if (poolTargets[i] == ~0u)
+            {
+                continue;
+            }
+
+            RenderTarget* rt = resourceManager.getRenderTarget(pool.get(poolTargets[i]));
+            m_resources[i].m_image = {rt->m_image, rt->m_view, rt->m_width, rt->m_height, rt->m_format};
+        }
+        m_transientsBound = true;
+    }
+
+    void RenderGraph::recordBarriers(VkCommandBuffer cmd, const std::vector<GraphBarrier>& barriers,
+                                     FrameArena* arena) const
+    {
+        if (barriers.empty())
+        {
+            return;
+        }
+
+        ArenaVector<VkImageMemoryBarrier2> imageBarriers{ArenaAllocator<VkImageMemoryBarrier2>(arena)};
+        ArenaVector<VkBufferMemoryBarrier2> bufferBarriers{ArenaAllocator<VkBufferMemoryBarrier2>(arena)};
+        imageBarriers.reserve(barriers.size());
+        for (const GraphBarrier& barrier : barriers)
+        {
+            const Resource& resource = m_resources[barrier.resource];
+            const bool ownershipTransfer = barrier.srcQueue != barrier.dstQueue;
+            const uint32_t srcFamily = ownershipTransfer ? m_queueFamilies[(uint32_t)barrier.srcQueue] : VK_QUEUE_FAMILY_IGNORED;
+            const uint32_t dstFamily = ownershipTransfer ? m_queueFamilies[(uint32_t)barrier.dstQueue] : VK_QUEUE_FAMILY_IGNORED;
+            if (resource.m_isImage)
+            {
+                VkImageMemoryBarrier2 imageBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+                imageBarrier.srcStageMask = barrier.srcStage;
+                imageBarrier.srcAccessMask = barrier.srcAccess;
+                imageBarrier.dstStageMask = barrier.dstStage;
+                imageBarrier.dstAccessMask = barrier.dstAccess;
+                imageBarrier.oldLayout = barrier.oldLayout;
+                imageBarrier.newLayout = barrier.newLayout;
+                imageBarrier.srcQueueFamilyIndex = srcFamily;
+                imageBarrier.dstQueueFamilyIndex = dstFamily;
+                imageBarrier.image = resource.m_image.image;
+                imageBarrier.subresourceRange.aspectMask = resource.m_aspect;
+                imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+                imageBarriers.push_back(imageBarrier);
+            }
+            else
+            {
+                VkBufferMemoryBarrier2 bufferBarrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+                bufferBarrier.srcStageMask = barrier.srcStage;
+                bufferBarrier.srcAccessMask = barrier.srcAccess;
+                bufferBarrier.dstStageMask = barrier.dstStage;
+                bufferBarrier.dstAccessMask = barrier.dstAccess;
+                bufferBarrier.srcQueueFamilyIndex = srcFamily;
+                bufferBarrier.dstQueueFamilyIndex = dstFamily;
+                bufferBarrier.buffer = resource.m_buffer;
+                bufferBarrier.offset = 0;
+                bufferBarrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(bufferBarrier);
+            }
+        }
+
+        VkDependencyInfo dependencyInfo{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        dependencyInfo.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+        dependencyInfo.bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size();
+        dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+        vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+    }
+
+    void RenderGraph::executeSegment(VkCommandBuffer cmd, uint32_t segmentIndex, PassContext& ctx,
+                                     PassExecutor& executor) const
+    {
+        const GraphSegment& segment = m_segments[segmentIndex];
+        for (uint32_t orderIndex = segment.firstOrderIndex; orderIndex < segment.endOrderIndex; ++orderIndex)
+        {
+            const uint32_t passIndex = m_order[orderIndex];
+            TOY_PROFILE_SCOPE(m_passes[passIndex].name.c_str());
+            const auto cpuStart = std::chrono::high_resolution_clock::now();
+            // Zone goes around the barriers too, outside of the pass rendering scope
+            const uint32_t zone = ctx.gpuProfiler
+                ? ctx.gpuProfiler->beginScope(cmd, segment.queue, m_passes[passIndex].name.c_str(), passIndex)
+                : ~0u;
+
+            recordBarriers(cmd, m_barriers[orderIndex], ctx.frameArena);
+            // Statistics include graphics bits, the compute queue can't take them
+            const uint32_t statsQuery = ctx.pipelineStats && segment.queue == QueueType::Graphics
+                ? ctx.pipelineStats->beginQuery(cmd, passIndex)
+                : ~0u;
+            executor.execute(cmd, m_passes[passIndex], ctx);
+            if (ctx.pipelineStats)
+            {
+                ctx.pipelineStats->endQuery(cmd, statsQuery);
+            }
+
+            if (ctx.gpuProfiler)
+            {
+                ctx.gpuProfiler->endScope(cmd, zone);
+            }
+            if (ctx.timings)
+            {
+                const std::chrono::duration<double, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - cpuStart;
+                ctx.timings->addCpuTime(passIndex, cpuTime.count());
+            }
+        }
+
+        recordBarriers(cmd, segment.releaseBarriers, ctx.frameArena);
+        if (segmentIndex == m_segments.size() - 1)
+        {
+            recordBarriers(cmd, m_finalBarriers, ctx.frameArena);
+        }
+    }
+
+    static const char* getLayoutName(VkImageLayout layout)
+    {
+        switch (layout)
+        {
+        case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+        case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL: return "DEPTH_ATTACHMENT";
+        case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL: return "DEPTH_READ_ONLY";
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY";
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC";
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST";
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+        default: return "OTHER";
+        }
+    }
+
+    static void writeJsonBarriers(FILE* file, const RenderGraph& graph, const std::vector<GraphBarrier>& barriers,
+                                  const char* indent)
+    {
+        fprintf(file, "[");
+        for (uint32_t i = 0; i < barriers.size(); ++i)
+        {
+            const GraphBarrier& barrier = barriers[i];
+            fprintf(file, "\n%s  { \"resource\": \"%s\", \"srcStage\": \"0x%llx\", \"srcAccess\": \"0x%llx\", \"dstStage\": \"0x%llx\", \"dstAccess\": \"0x%llx\", \"oldLayout\": \"%s\", \"newLayout\": \"%s\", \"srcQueue\": \"%s\", \"dstQueue\": \"%s\" }%s",
+                    indent, graph.getResourceName(barrier.resource), (unsigned long long)barrier.srcStage,
+                    (unsigned long long)barrier.srcAccess, (unsigned long long)barrier.dstStage,
+                    (unsigned long long)barrier.dstAccess, getLayoutName(barrier.oldLayout),
+                    getLayoutName(barrier.newLayout), getQueueTypeName(barrier.srcQueue),
+                    getQueueTypeName(barrier.dstQueue), i + 1 < barriers.size() ? "," : "");
+        }
+        if (barriers.empty())
+        {
+            fprintf(file, "]");
+        }
+        else
+        {
+            fprintf(file, "\n%s]", indent);
+        }
+    }
+
+    bool RenderGraph::exportDot(const char* path, const PassTimings* timings) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+        {
+            printf("RenderGraph: could not open %s\n", path);
+            return false;
+        }
+
+        std::vector<uint32_t> orderIndices(m_passes.size(), ~0u);
+        for (uint32_t orderIndex = 0; orderIndex < m_order.size(); ++orderIndex)
+        {
+            orderIndices[m_order[orderIndex]] = orderIndex;
+        }
+
+        fprintf(file, "digraph FrameGraph {\n");
+        fprintf(file, "  rankdir=LR;\n");
+        fprintf(file, "  node [fontname=\"Helvetica\", fontsize=10];\n");
+
+        // Passes are boxes, async ones filled, culled ones dashed and gray
+        for (uint32_t i = 0; i < m_passes.size(); ++i)
+        {
+            const Pass& pass = m_passes[i];
+            const bool culled = isPassCulled(i);
+            fprintf(file, "  p%u [shape=box, label=\"%s\\n%s", i, pass.name.c_str(), getPassTypeName(pass.type));
+            if (!culled)
+            {
+                fprintf(file, " #%u, %s", orderIndices[i], getQueueTypeName(m_orderQueues[orderIndices[i]]));
+                fprintf(file, "\\n%zu barriers", m_barriers[orderIndices[i]].size());
+                if (timings)
+                {
+                    const PassTiming& timing = timings->get(i);
+                    fprintf(file, "\\ncpu %.3f ms", timing.m_cpuMs);
+                    if (timing.m_gpuValid)
+                    {
+                        fprintf(file, ", gpu %.3f ms", timing.m_gpuMs);
+                    }
+                }
+            }
+            fprintf(file, "\"");
+            if (culled)
+            {
+                fprintf(file, ", style=dashed, color=gray, fontcolor=gray");
+            }
+            else if (m_orderQueues[orderIndices[i]] == QueueType::AsyncCompute)
+            {
+                fprintf(file, ", style=filled, fillcolor=lightblue");
+            }
+            fprintf(file, "];\n");
+        }
+
+        // Resources are ellipses, transients show where they landed in the pool
+        for (uint32_t i = 0; i < m_resources.size(); ++i)
+        {
+            const Resource& resource = m_resources[i];
+            fprintf(file, "  r%u [shape=ellipse, label=\"%s", i, resource.m_name.c_str());
+            if (resource.m_transient)
+            {
+                fprintf(file, "\\n%ux%u", resource.m_transientDesc.m_width, resource.m_transientDesc.m_height);
+                if (m_transientPool && i < m_poolTargets.size() && m_poolTargets[i] != ~0u)
+                {
+                    fprintf(file, "\\nheap %u @ %llu", m_transientPool->getHeap(m_poolTargets[i]),
+                            (unsigned long long)m_transientPool->getOffset(m_poolTargets[i]));
+                }
+            }
+            else
+            {
+                fprintf(file, "\\nimported");
+            }
+            fprintf(file, "\"%s];\n", resource.m_transient ? ", style=dashed" : ", style=bold");
+        }
+
+        // Writes go pass -> resource, reads resource -> pass
+        for (uint32_t i = 0; i < m_passes.size(); ++i)
+        {
+            const Pass& pass = m_passes[i];
+            const char* edgeStyle = isPassCulled(i) ? ", style=dashed, color=gray" : "";
+            for (const PassAttachment& attachment : pass.colorAttachments)
+            {
+                fprintf(file, "  p%u -> r%u [label=\"%s\"%s];\n", i, attachment.resource,
+                        getResourceUsageName(ResourceUsage::ColorAttachment), edgeStyle);
+            }
+            if (pass.useDepth)
+            {
+                fprintf(file, "  p%u -> r%u [label=\"%s\"%s];\n", i, pass.depthAttachment.resource,
+                        getResourceUsageName(ResourceUsage::DepthAttachment), edgeStyle);
+            }
+            for (const PassResourceAccess& access : pass.reads)
+            {
+                fprintf(file, "  r%u -> p%u [label=\"%s\"%s];\n", access.resource, i, getResourceUsageName(access.usage),
+                        edgeStyle);
+            }
+            for (const PassResourceAccess& access : pass.writes)
+            {
+                fprintf(file, "  p%u -> r%u [label=\"%s\"%s];\n", i, access.resource, getResourceUsageName(access.usage),
+                        edgeStyle);
+            }
+        }
+
+        fprintf(file, "}\n");
+        fclose(file);
+        return true;
+    }
+
+    bool RenderGraph::exportJson(const char* path, const PassTimings* timings) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+        {
+            printf("RenderGraph: could not open %s\n", path);
+            return false;
+        }
+
+        std::vector<uint32_t> orderIndices(m_passes.size(), ~0u);
+        for (uint32_t orderIndex = 0; orderIndex < m_order.size(); ++orderIndex)
+        {
+            orderIndices[m_order[orderIndex]] = orderIndex;
+        }
+
+        fprintf(file, "{\n");
+        fprintf(file, "  \"compileCount\": %u,\n", m_compileCount);
+        fprintf(file, "  \"culledPasses\": %u,\n", getCulledPassCount());
+        fprintf(file, "  \"gpuTimings\": %s,\n", timings && timings->hasGpuTimings() ? "true" : "false");
+
+        fprintf(file, "  \"passes\": [\n");
+        for (uint32_t i = 0; i < m_passes.size(); ++i)
+        {
+            const Pass& pass = m_passes[i];
+            const bool culled = isPassCulled(i);
+            fprintf(file, "    {\n");
+            fprintf(file, "      \"index\": %u,\n", i);
+            fprintf(file, "      \"name\": \"%s\",\n", pass.name.c_str());
+            fprintf(file, "      \"type\": \"%s\",\n", getPassTypeName(pass.type));
+            fprintf(file, "      \"queue\": \"%s\",\n",
+                    getQueueTypeName(culled ? pass.queue : m_orderQueues[orderIndices[i]]));
+            fprintf(file, "      \"culled\": %s,\n", culled ? "true" : "false");
+            fprintf(file, "      \"order\": %d,\n", culled ? -1 : (int)orderIndices[i]);
+            if (timings)
+            {
+                const PassTiming& timing = timings->get(i);
+                fprintf(file, "      \"cpuMs\": %.4f,\n", timing.m_cpuMs);
+                if (timing.m_gpuValid)
+                {
+                    fprintf(file, "      \"gpuMs\": %.4f,\n", timing.m_gpuMs);
+                }
+            }
+
+            std::vector<std::pair<GraphResource, ResourceUsage>> accesses;
+            for (const PassAttachment& attachment : pass.colorAttachments)
+            {
+                accesses.push_back({attachment.resource, ResourceUsage::ColorAttachment});
+            }
+            if (pass.useDepth)
+            {
+                accesses.push_back({pass.depthAttachment.resource, ResourceUsage::DepthAttachment});
+            }
+            for (const PassResourceAccess& access : pass.reads)
+            {
+                accesses.push_back({access.resource, access.usage});
+            }
+            for (const PassResourceAccess& access : pass.writes)
+            {
+                accesses.push_back({access.resource, access.usage});
+            }
+            fprintf(file, "      \"accesses\": [");
+            for (uint32_t a = 0; a < accesses.size(); ++a)
+            {
+                fprintf(file, "%s{ \"resource\": \"%s\", \"usage\": \"%s\", \"write\": %s }", a > 0 ? ", " : "",
+                        m_resources[accesses[a].first].m_name.c_str(), getResourceUsageName(accesses[a].second),
+                        isWriteUsage(accesses[a].second) ? "true" : "false");
+            }
+            fprintf(file, "],\n");
+
+            fprintf(file, "      \"barriers\": ");
+            writeJsonBarriers(file, *this, culled ? std::vector<GraphBarrier>() : m_barriers[orderIndices[i]], "      ");
+            fprintf(file, "\n    }%s\n", i + 1 < m_passes.size() ? "," : "");
+        }
+        fprintf(file, "  ],\n");
+
+        fprintf(file, "  \"resources\": [\n");
+        for (uint32_t i = 0; i < m_resources.size(); ++i)
+        {
+            const Resource& resource = m_resources[i];
+            fprintf(file, "    { \"index\": %u, \"name\": \"%s\", \"kind\": \"%s\", \"transient\": %s", i,
+                    resource.m_name.c_str(), resource.m_isImage ? "image" : "buffer",
+                    resource.m_transient ? "true" : "false");
+            if (resource.m_transient)
+            {
+                const TransientTargetDesc& desc = resource.m_transientDesc;
+                fprintf(file, ", \"width\": %u, \"height\": %u, \"format\": %u", desc.m_width, desc.m_height,
+                        (uint32_t)desc.m_format);
+                // Resources sharing a heap with overlapping ranges alias each other
+                if (m_transientPool && i < m_poolTargets.size() && m_poolTargets[i] != ~0u)
+                {
+                    const uint32_t target = m_poolTargets[i];
+                    fprintf(file, ", \"heap\": %u, \"offset\": %llu, \"size\": %llu", m_transientPool->getHeap(target),
+                            (unsigned long long)m_transientPool->getOffset(target),
+                            (unsigned long long)m_transientPool->getSize(target));
+                }
+            }
+            fprintf(file, " }%s\n", i + 1 < m_resources.size() ? "," : "");
+        }
+        fprintf(file, "  ],\n");
+
+        fprintf(file, "  \"segments\": [\n");
+        for (uint32_t i = 0; i < m_segments.size(); ++i)
+        {
+            const GraphSegment& segment = m_segments[i];
+            fprintf(file, "    { \"queue\": \"%s\", \"firstOrder\": %u, \"endOrder\": %u, \"waits\": [",
+                    getQueueTypeName(segment.queue), segment.firstOrderIndex, segment.endOrderIndex);
+            for (uint32_t w = 0; w < segment.waits.size(); ++w)
+            {
+                fprintf(file, "%s{ \"segment\": %u, \"stage\": \"0x%llx\" }", w > 0 ? ", " : "", segment.waits[w].segment,
+                        (unsigned long long)segment.waits[w].stage);
+            }
+            fprintf(file, "], \"releaseBarriers\": ");
+            writeJsonBarriers(file, *this, segment.releaseBarriers, "    ");
+            fprintf(file, " }%s\n", i + 1 < m_segments.size() ? "," : "");
+        }
+        fprintf(file, "  ],\n");
+
+        fprintf(file, "  \"finalBarriers\": ");
+        writeJsonBarriers(file, *this, m_finalBarriers, "  ");
+        fprintf(file, "\n}\n");
+
+        fclose(file);
+        return true;
+    }
+
+}
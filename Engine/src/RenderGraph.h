@@ -0,0 +1,198 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Pass.h"
+#include "TransientTargets.h"
+
+namespace ToyEngine
+{
+
+    class PassExecutor;
+    class PassTimings;
+    class FrameArena;
+
+    // One resource transition/dependency, still in graph terms so compile() can run (and be checked) without a device
+    struct GraphBarrier
+    {
+        GraphResource resource = InvalidGraphResource;
+        VkPipelineStageFlags2 srcStage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 dstStage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 dstAccess = VK_ACCESS_2_NONE;
+        VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // Different queues make this one half (release or acquire) of a queue family ownership transfer
+        QueueType srcQueue = QueueType::Graphics;
+        QueueType dstQueue = QueueType::Graphics;
+    };
+
+    struct GraphSegmentWait
+    {
+        uint32_t segment = 0;
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+    };
+
+    // Run of consecutive passes (in compiled order) on the same queue, ends up as one submit.
+    // Segment 0 is always graphics, it is where the frame records its own work before the graph
+    // (uploads, defrag copies) and every async segment waits on it
+    struct GraphSegment
+    {
+        QueueType queue = QueueType::Graphics;
+        uint32_t firstOrderIndex = 0;
+        uint32_t endOrderIndex = 0;
+        // Segments on the other queue this one waits on (their timeline signal), from the given stages
+        std::vector<GraphSegmentWait> waits;
+        // Ownership releases for resources the other queue uses next, recorded after the last pass
+        std::vector<GraphBarrier> releaseBarriers;
+    };
+
+    struct GraphImage
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+    };
+
+    // Passes declare what they read and write (attachments count as writes), compile() orders them and works out
+    // the barriers in between: layouts are tracked per image, each pass gets one batched vkCmdPipelineBarrier2 with
+    // only the dependencies it needs (read after read on the same layout is free).
+    // Transient images have undefined content on first use and get their memory from a TransientTargetPool,
+    // imported ones (swapchain, persistent buffers) start from the given layout/stage and can end on a final layout.
+    // Passes whose results never reach an imported resource are culled (unless flagged sideEffects).
+    // Compute passes tagged AsyncCompute go to the async queue when there is one. The order is cut in segments per
+    // queue, cross queue dependencies become timeline waits between segments plus release/acquire barrier pairs
+    // (resources are all exclusive). Imported resources are owned by the graphics queue before and after the graph.
+    // Compile results are cached on a hash of the declarations, the graph is meant to be built once and only
+    // have its imported handles rebound every frame (setImportedImage), re-declaring the same shape is a cache hit.
+    class RenderGraph
+    {
+    public:
+        // Drops the declarations, compile results are kept until a compile() with a different shape
+        void reset();
+
+        GraphResource createTransientImage(const char* name, const TransientTargetDesc& desc);
+
+        // initialStage is where the external sync leaves the image (semaphore wait stage for the swapchain).
+        // finalLayout UNDEFINED means the graph doesn't care how the image is left
+        GraphResource importImage(const char* name, VkImage image, VkImageView view, uint32_t width, uint32_t height,
+                                  VkFormat format, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+                                  VkPipelineStageFlags2 initialStage, VkImageLayout finalLayout);
+
+        // initialStage/initialAccess is the last write before the graph (last frame for buffers kept across frames),
+        // the first access this frame waits on it. NONE when nothing before the graph writes the buffer
+        GraphResource importBuffer(const char* name, VkBuffer buffer,
+                                   VkPipelineStageFlags2 initialStage = VK_PIPELINE_STAGE_2_NONE,
+                                   VkAccessFlags2 initialAccess = VK_ACCESS_2_NONE);
+
+        // Rebinds an imported resource (swapchain image of the frame...), handles are not part of the graph shape.
+        // Format stays the one given on import
+        void setImportedImage(GraphResource resource, VkImage image, VkImageView view, uint32_t width, uint32_t height);
+        void setImportedBuffer(GraphResource resource, VkBuffer buffer);
+
+        uint32_t addPass(const Pass& pass);
+
+        // asyncComputeFamily ~0u (or the graphics family) keeps everything on the graphics queue
+        void setQueueFamilies(uint32_t graphicsFamily, uint32_t asyncComputeFamily);
+
+        // Device free, only looks at the declarations. Returns false on a dependency cycle.
+        // Does nothing when the declarations hash the same as the last compile
+        bool compile();
+
+        // Declares the transient images on the pool with their lifetimes over the compiled order and binds them.
+        // Only does work after a recompile or a reset
+        void allocateTransients(TransientTargetPool& pool, ResourceManager& resourceManager);
+
+        // Records one segment: barriers + passes, releases for the other queue, final barriers on the last segment
+        void executeSegment(VkCommandBuffer cmd, uint32_t segment, PassContext& ctx, PassExecutor& executor) const;
+
+        // Graphviz / JSON dumps: passes with their accesses and barriers, resources with where their memory aliases,
+        // culled passes, queue segments and the timings when given
+        bool exportDot(const char* path, const PassTimings* timings) const;
+        bool exportJson(const char* path, const PassTimings* timings) const;
+
+        const GraphImage& getImage(GraphResource resource) const { return m_resources[resource].m_image; }
+        VkBuffer getBuffer(GraphResource resource) const { return m_resources[resource].m_buffer; }
+        const char* getResourceName(GraphResource resource) const { return m_resources[resource].m_name.c_str(); }
+        uint32_t getResourceCount() const { return (uint32_t)m_resources.size(); }
+
+        const Pass& getPass(uint32_t passIndex) const { return m_passes[passIndex]; }
+        uint32_t getPassCount() const { return (uint32_t)m_passes.size(); }
+
+        // Compile results. Order holds pass indices (addPass order), barriers are indexed by position in that order
+        const std::vector<uint32_t>& getExecutionOrder() const { return m_order; }
+        const std::vector<GraphBarrier>& getBarriers(uint32_t orderIndex) const { return m_barriers[orderIndex]; }
+        const std::vector<GraphBarrier>& getFinalBarriers() const { return m_finalBarriers; }
+        const std::vector<GraphSegment>& getSegments() const { return m_segments; }
+        QueueType getPassQueue(uint32_t orderIndex) const { return m_orderQueues[orderIndex]; }
+        uint32_t getAsyncPassCount() const;
+
+        bool isPassCulled(uint32_t passIndex) const { return m_culled[passIndex] != 0; }
+        uint32_t getCulledPassCount() const { return (uint32_t)(m_passes.size() - m_order.size()); }
+        uint32_t getCompileCount() const { return m_compileCount; }
+
+    private:
+        struct Resource
+        {
+            std::string m_name;
+            bool m_isImage = true;
+            bool m_transient = false;
+            TransientTargetDesc m_transientDesc;
+            VkImageAspectFlags m_aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+            VkImageLayout m_initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkImageLayout m_finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags2 m_initialStage = VK_PIPELINE_STAGE_2_NONE;
+            // Buffers only, images get theirs made available by the initial layout transition
+            VkAccessFlags2 m_initialAccess = VK_ACCESS_2_NONE;
+
+            GraphImage m_image;
+            VkBuffer m_buffer = VK_NULL_HANDLE;
+        };
+
+        // Everything a pass does to one resource, attachments + reads + writes merged together
+        struct MergedAccess
+        {
+            GraphResource resource = InvalidGraphResource;
+            ResourceState state;
+            bool write = false;
+            // Needs what was there before: reads, loaded attachments, storage/transfer writes that might be partial
+            bool readsContents = false;
+        };
+
+        void collectAccesses(const Pass& pass, std::vector<MergedAccess>& accesses) const;
+        uint64_t computeHash() const;
+        void cullPasses();
+        bool sortPasses();
+        void buildSegments();
+        void computeBarriers();
+        void recordBarriers(VkCommandBuffer cmd, const std::vector<GraphBarrier>& barriers, FrameArena* arena) const;
+
+        std::vector<Resource> m_resources;
+        std::vector<Pass> m_passes;
+
+        uint32_t m_queueFamilies[(uint32_t)QueueType::Count] = {0, ~0u};
+
+        // Pool slot per resource (~0u for non transient), kept for the dumps
+        const TransientTargetPool* m_transientPool = nullptr;
+        std::vector<uint32_t> m_poolTargets;
+
+        // Compiled state, survives reset() so rebuilding the same graph is a cache hit
+        uint64_t m_compiledHash = 0;
+        bool m_compiled = false;
+        bool m_transientsBound = false;
+        uint32_t m_compileCount = 0;
+
+        std::vector<uint8_t> m_culled;
+        std::vector<uint32_t> m_order;
+        std::vector<QueueType> m_orderQueues;
+        std::vector<GraphSegment> m_segments;
+        std::vector<std::vector<GraphBarrier>> m_barriers;
+        std::vector<GraphBarrier> m_finalBarriers;
+    };
+
+}
@@ -2,19 +2,67 @@
 #include "Common/Common.h"
 #include "Pipeline.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <utility>
 
 namespace ToyEngine
 {
 
+    // Over the createPipeline arguments, field by field so struct padding stays out of it
+    static uint64_t hashPipelineKey(const PipelineConfig& config, const std::vector<VkDescriptorSetLayout>& descriptorLayouts,
+                                    const std::vector<VkPushConstantRange>& pushConstantRanges)
+    {
+        uint64_t hash = FnvOffsetBasis;
+        hashValue(hash, config.m_vertexShader);
+        hashValue(hash, config.m_taskShader);
+        hashValue(hash, config.m_meshShader);
+        hashValue(hash, config.m_fragmentShader);
+        hashValue(hash, config.m_computeShader);
+        hashValue(hash, config.m_colorFormat);
+        hashValue(hash, config.m_depthFormat);
+        hashValue(hash, config.m_cullMode);
+        hashValue(hash, config.m_frontFace);
+        hashValue(hash, config.m_depthTest);
+        hashValue(hash, config.m_depthWrite);
+        hashValue(hash, config.m_blending);
+        hashValue(hash, config.m_useMeshShaders);
+        hashValue(hash, config.m_depthCompareOp);
+        hashBytes(hash, config.m_specConstants, sizeof(config.m_specConstants));
+        hashValue(hash, config.m_specConstantCount);
+        for (VkDescriptorSetLayout layout : descriptorLayouts)
+        {
+            hashValue(hash, layout);
+        }
+        for (const VkPushConstantRange& range : pushConstantRanges)
+        {
+            hashValue(hash, range.stageFlags);
+            hashValue(hash, range.offset);
+            hashValue(hash, range.size);
+        }
+        // 0 marks slots outside the cache
+        return hash != 0 ? hash : 1;
+    }
+
+    static bool isSamePushConstantRanges(const std::vector<VkPushConstantRange>& a, const std::vector<VkPushConstantRange>& b)
+    {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(VkPushConstantRange)) == 0);
+    }
+
     ResourceManager::~ResourceManager()
     {
         cleanup();
     }
 
-    void ResourceManager::init(GpuContext& ctx)
+    void ResourceManager::init(GpuContext& ctx, bool memoryBudgetSupported)
     {
         m_ctx = &ctx;
+
+        m_memoryTracker.init(ctx.m_physicalDevice, ctx.m_memoryProperties, memoryBudgetSupported);
+        ctx.m_memoryTracker = &m_memoryTracker;
+
+        m_bufferPool.init(ctx);
     }
 
     void ResourceManager::cleanup()
@@ -24,6 +72,11 @@ namespace ToyEngine
             return;
         }
 
+        m_uploadBatch.submit();
+
+        // Called once the device is idle, everything pending can go
+        collectGarbage(~0ull);
+
         for (auto& slot : m_buffers)
         {
             if (slot.alive)
@@ -36,6 +89,8 @@ namespace ToyEngine
         m_buffers.clear();
         m_freeBuffers.clear();
 
+        m_bufferPool.destroy();
+
         for (auto& slot : m_textures)
         {
             if (slot.alive)
@@ -71,6 +126,8 @@ namespace ToyEngine
         }
         m_pipelines.clear();
         m_freePipelines.clear();
+        m_pipelineVariants.clear();
+        m_pipelineKeys.clear();
 
         for (auto semaphore : m_semaphores)
         {
@@ -89,10 +146,19 @@ namespace ToyEngine
             }
         }
         m_commandPools.clear();
+
+        if (m_memoryTracker.getTotalBytes() != 0)
+        {
+            printf("ResourceManager: %llu bytes of device memory still allocated on cleanup\n",
+                   (unsigned long long)m_memoryTracker.getTotalBytes());
+        }
+        m_ctx->m_memoryTracker = nullptr;
+        m_ctx = nullptr;
     }
 
     BufferHandle ResourceManager::createBuffer(uint32_t size, VkBufferUsageFlags usage,
-                                              VkMemoryPropertyFlags properties, const void* initialData)
+                                              VkMemoryPropertyFlags properties, const void* initialData,
+                                              MemoryCategory category)
     {
         uint32_t index = 0;
         if (!m_freeBuffers.empty())
@@ -106,8 +172,11 @@ namespace ToyEngine
             m_buffers.emplace_back();
         }
 
+        // Device local buffers get sub-allocated so they can be compacted later, mapped ones keep their own memory
+        BufferMemoryPool* pool = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? nullptr : &m_bufferPool;
+
         auto& slot = m_buffers[index];
-        slot.resource.create(*m_ctx, size, usage, properties, initialData);
+        slot.resource.create(*m_ctx, size, usage, properties, initialData, &m_uploadBatch, category, pool);
         slot.alive = true;
         return {index, slot.generation};
     }
@@ -142,14 +211,168 @@ namespace ToyEngine
         }
 
         auto& slot = m_buffers[handle.index];
-        buffer->destroy(*m_ctx);
+        deferDestruction([this, resource = *buffer]() mutable { resource.destroy(*m_ctx); });
+        slot.resource = {};
         slot.alive = false;
         ++slot.generation;
         m_freeBuffers.push_back(handle.index);
     }
 
+    void ResourceManager::beginFrame(uint64_t frameTimelineValue, uint64_t completedTimelineValue)
+    {
+        m_frameTimelineValue = frameTimelineValue;
+        collectGarbage(completedTimelineValue);
+    }
+
+    void ResourceManager::deferDestruction(std::function<void()> destroy)
+    {
+        m_pendingDestructions.push_back({m_frameTimelineValue, std::move(destroy)});
+    }
+
+    void ResourceManager::collectGarbage(uint64_t completedTimelineValue)
+    {
+        while (!m_pendingDestructions.empty() && m_pendingDestructions.front().m_timelineValue <= completedTimelineValue)
+        {
+            m_pendingDestructions.front().m_destroy();
+            m_pendingDestructions.pop_front();
+        }
+
+        uint32_t retiredCount = 0;
+        while (retiredCount < m_retiredPoolBuffers.size() &&
+               m_retiredPoolBuffers[retiredCount].m_timelineValue <= completedTimelineValue)
+        {
+            vkDestroyBuffer(m_ctx->m_device, m_retiredPoolBuffers[retiredCount].m_buffer, nullptr);
+            m_bufferPool.free(m_retiredPoolBuffers[retiredCount].m_allocation);
+            ++retiredCount;
+        }
+        m_retiredPoolBuffers.erase(m_retiredPoolBuffers.begin(), m_retiredPoolBuffers.begin() + retiredCount);
+    }
+
+    DefragmentStats ResourceManager::defragmentBuffers(VkCommandBuffer cmd, VkDeviceSize maxBytes)
+    {
+        DefragmentStats stats;
+        if (!m_bufferPool.isDirty())
+        {
+            return stats;
+        }
+
+        m_bufferPool.releaseEmptyBlocks();
+
+        // Buffers placed last go first, that is what empties the tail blocks
+        std::vector<uint32_t>& candidates = m_defragmentCandidates;
+        candidates.clear();
+        for (uint32_t i = 0; i < m_buffers.size(); ++i)
+        {
+            if (m_buffers[i].alive && m_buffers[i].resource.m_pool)
+            {
+                candidates.push_back(i);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+        {
+            const BufferPoolAllocation& allocA = m_buffers[a].resource.m_poolAllocation;
+            const BufferPoolAllocation& allocB = m_buffers[b].resource.m_poolAllocation;
+            return allocA.m_block != allocB.m_block ? allocA.m_block > allocB.m_block : allocA.m_offset > allocB.m_offset;
+        });
+
+        // Stays dirty while the byte cap cuts a pass short
+        bool finished = true;
+        bool barrierRecorded = false;
+        for (uint32_t index : candidates)
+        {
+            Buffer& buffer = m_buffers[index].resource;
+            if (buffer.m_allocationSize > maxBytes)
+            {
+                continue;
+            }
+            if (stats.m_movedBytes + buffer.m_allocationSize > maxBytes)
+            {
+                finished = false;
+                break;
+            }
+
+            // Same create info means same memory requirements, so the spot can be looked for before creating anything
+            const BufferPoolAllocation& current = buffer.m_poolAllocation;
+            BufferPoolAllocation newAllocation = m_bufferPool.allocateBefore(current, buffer.m_memoryTypeIndex,
+                                                                             current.m_size, current.m_alignment);
+            if (!newAllocation.isValid())
+            {
+                continue;
+            }
+
+            VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+            bufferInfo.size = buffer.m_size;
+            bufferInfo.usage = buffer.m_usage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            VkBuffer newBuffer = VK_NULL_HANDLE;
+            VK_CHECK(vkCreateBuffer(m_ctx->m_device, &bufferInfo, nullptr, &newBuffer));
+            VK_CHECK(vkBindBufferMemory(m_ctx->m_device, newBuffer, m_bufferPool.getMemory(newAllocation.m_block),
+                                        newAllocation.m_offset));
+
+            // Anything written on the old buffer by previous work has to land before the copy reads it. Only orders
+            // graphics queue work, see the header about async compute
+            if (!barrierRecorded)
+            {
+                VkMemoryBarrier2 memoryBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+                memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                memoryBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+                memoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+                memoryBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+                VkDependencyInfo dependency{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+                dependency.memoryBarrierCount = 1;
+                dependency.pMemoryBarriers = &memoryBarrier;
+                vkCmdPipelineBarrier2(cmd, &dependency);
+                barrierRecorded = true;
+            }
+
+            VkBufferCopy copyRegion{};
+            copyRegion.size = buffer.m_size;
+            vkCmdCopyBuffer(cmd, buffer.m_buffer, newBuffer, 1, &copyRegion);
+
+            // Frames in flight still read the old one
+            m_retiredPoolBuffers.push_back({m_frameTimelineValue, buffer.m_buffer, buffer.m_poolAllocation});
+
+            buffer.m_buffer = newBuffer;
+            buffer.m_memory = m_bufferPool.getMemory(newAllocation.m_block);
+            buffer.m_poolAllocation = newAllocation;
+            if (buffer.m_usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+            {
+                VkBufferDeviceAddressInfo addressInfo{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
+                addressInfo.buffer = newBuffer;
+                buffer.m_gpuAddress = vkGetBufferDeviceAddress(m_ctx->m_device, &addressInfo);
+            }
+
+            stats.m_movedBytes += buffer.m_allocationSize;
+            ++stats.m_movedBuffers;
+        }
+
+        if (barrierRecorded)
+        {
+            VkMemoryBarrier2 memoryBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+            memoryBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            memoryBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            memoryBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+            VkDependencyInfo dependency{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+            dependency.memoryBarrierCount = 1;
+            dependency.pMemoryBarriers = &memoryBarrier;
+            vkCmdPipelineBarrier2(cmd, &dependency);
+        }
+
+        // Nothing left that could move until the next free, the ranges the moves above leave behind count as one
+        if (finished)
+        {
+            m_bufferPool.clearDirty();
+        }
+
+        return stats;
+    }
+
     TextureHandle ResourceManager::createTexture(uint32_t width, uint32_t height, VkFormat format,
-                                                VkImageUsageFlags usage, VkImageAspectFlags aspect)
+                                                VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                                                MemoryCategory category)
     {
         uint32_t index = 0;
         if (!m_freeTextures.empty())
@@ -164,7 +387,7 @@ namespace ToyEngine
         }
 
         auto& slot = m_textures[index];
-        slot.resource.create(*m_ctx, width, height, format, usage, aspect);
+        slot.resource.create(*m_ctx, width, height, format, usage, aspect, category);
         slot.alive = true;
         return {index, slot.generation};
     }
@@ -184,7 +407,7 @@ namespace ToyEngine
         }
 
         auto& slot = m_textures[index];
-        slot.resource.load(*m_ctx, path);
+        slot.resource.load(*m_ctx, path, &m_uploadBatch);
         slot.alive = true;
         return {index, slot.generation};
     }
@@ -219,14 +442,25 @@ namespace ToyEngine
         }
 
         auto& slot = m_textures[handle.index];
-        texture->destroy(*m_ctx);
+        deferDestruction([this, resource = *texture]() mutable { resource.destroy(*m_ctx); });
+        slot.resource = {};
         slot.alive = false;
         ++slot.generation;
         m_freeTextures.push_back(handle.index);
     }
 
-    RenderTargetHandle ResourceManager::createRenderTarget(uint32_t width, uint32_t height, VkFormat format,
-                                                          VkImageUsageFlags usage, VkImageAspectFlags aspect)
+    void ResourceManager::uploadTextureData(TextureHandle handle, const void* data, uint32_t size)
+    {
+        Texture* texture = getTexture(handle);
+        if (!texture)
+        {
+            return;
+        }
+
+        texture->uploadData(*m_ctx, data, size, &m_uploadBatch);
+    }
+
+    uint32_t ResourceManager::allocRenderTargetSlot()
     {
         uint32_t index = 0;
         if (!m_freeRenderTargets.empty())
@@ -239,6 +473,13 @@ namespace ToyEngine
             index = static_cast<uint32_t>(m_renderTargets.size());
             m_renderTargets.emplace_back();
         }
+        return index;
+    }
+
+    RenderTargetHandle ResourceManager::createRenderTarget(uint32_t width, uint32_t height, VkFormat format,
+                                                          VkImageUsageFlags usage, VkImageAspectFlags aspect)
+    {
+        uint32_t index = allocRenderTargetSlot();
 
         auto& slot = m_renderTargets[index];
         slot.resource.create(*m_ctx, width, height, format, usage, aspect);
@@ -246,6 +487,41 @@ namespace ToyEngine
         return {index, slot.generation};
     }
 
+    RenderTargetHandle ResourceManager::createUnboundRenderTarget(uint32_t width, uint32_t height, VkFormat format,
+                                                                 VkImageUsageFlags usage, VkImageAspectFlags aspect)
+    {
+        uint32_t index = allocRenderTargetSlot();
+
+        auto& slot = m_renderTargets[index];
+        slot.resource.createImage(*m_ctx, width, height, format, usage, aspect);
+        slot.resource.m_ownsMemory = false;
+        slot.alive = true;
+        return {index, slot.generation};
+    }
+
+    VkMemoryRequirements ResourceManager::getRenderTargetMemoryRequirements(RenderTargetHandle handle) const
+    {
+        VkMemoryRequirements requirements{};
+        const RenderTarget* rt = getRenderTarget(handle);
+        if (rt)
+        {
+            vkGetImageMemoryRequirements(m_ctx->m_device, rt->m_image, &requirements);
+        }
+        return requirements;
+    }
+
+    void ResourceManager::bindRenderTargetMemory(RenderTargetHandle handle, VkDeviceMemory memory, VkDeviceSize offset)
+    {
+        RenderTarget* rt = getRenderTarget(handle);
+        if (!rt)
+        {
+            return;
+        }
+
+        rt->bindMemory(*m_ctx, memory, offset);
+        rt->m_ownsMemory = false;
+    }
+
     RenderTarget* ResourceManager::getRenderTarget(RenderTargetHandle handle)
     {
         if (!handle.isValid() || handle.index >= m_renderTargets.size())
@@ -276,7 +552,8 @@ namespace ToyEngine
         }
 
         auto& slot = m_renderTargets[handle.index];
-        rt->destroy(*m_ctx);
+        deferDestruction([this, resource = *rt]() mutable { resource.destroy(*m_ctx); });
+        slot.resource = {};
         slot.alive = false;
         ++slot.generation;
         m_freeRenderTargets.push_back(handle.index);
@@ -359,6 +636,16 @@ namespace ToyEngine
         }
     }
 
+    void ResourceManager::beginUploadBatch()
+    {
+        m_uploadBatch.begin(*m_ctx);
+    }
+
+    void ResourceManager::submitUploadBatch()
+    {
+        m_uploadBatch.submit();
+    }
+
     PipelineHandle ResourceManager::createPipeline(const PipelineConfig& config, VkDescriptorSetLayout descriptorLayout, const std::vector<VkPushConstantRange>& pushConstantRanges)
     {
         return createPipeline(config, std::vector<VkDescriptorSetLayout>{descriptorLayout}, pushConstantRanges);
@@ -366,6 +653,20 @@ namespace ToyEngine
 
     PipelineHandle ResourceManager::createPipeline(const PipelineConfig& config, const std::vector<VkDescriptorSetLayout>& descriptorLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
     {
+        const uint64_t key = hashPipelineKey(config, descriptorLayouts, pushConstantRanges);
+        auto cached = m_pipelineVariants.find(key);
+        if (cached != m_pipelineVariants.end())
+        {
+            PipelineVariant& variant = cached->second;
+            const auto& cachedSlot = m_pipelines[variant.m_index];
+            if (cachedSlot.resource.getConfig() == config && variant.m_descriptorLayouts == descriptorLayouts &&
+                isSamePushConstantRanges(variant.m_pushConstantRanges, pushConstantRanges))
+            {
+                ++variant.m_refCount;
+                return {variant.m_index, cachedSlot.generation};
+            }
+        }
+
         uint32_t index = 0;
         if (!m_freePipelines.empty())
         {
@@ -383,6 +684,18 @@ namespace ToyEngine
         slot.resource.create(*m_ctx, descriptorLayouts, pushConstantRanges);
         slot.alive = true;
 
+        m_pipelineKeys.resize(m_pipelines.size(), 0);
+        m_pipelineKeys[index] = 0;
+        if (cached == m_pipelineVariants.end())
+        {
+            PipelineVariant& variant = m_pipelineVariants[key];
+            variant.m_descriptorLayouts = descriptorLayouts;
+            variant.m_pushConstantRanges = pushConstantRanges;
+            variant.m_index = index;
+            variant.m_refCount = 1;
+            m_pipelineKeys[index] = key;
+        }
+
         return {index, slot.generation};
     }
 
@@ -408,7 +721,17 @@ namespace ToyEngine
         auto& slot = m_pipelines[handle.index];
         if (!slot.alive || slot.generation != handle.generation) return;
 
-        slot.resource.destroy(*m_ctx);
+        // Cached variants only lose a reference, the pipeline stays for the next createPipeline asking for it
+        if (m_pipelineKeys[handle.index] != 0)
+        {
+            PipelineVariant& variant = m_pipelineVariants[m_pipelineKeys[handle.index]];
+            assert(variant.m_index == handle.index && variant.m_refCount > 0);
+            --variant.m_refCount;
+            return;
+        }
+
+        deferDestruction([this, resource = slot.resource]() mutable { resource.destroy(*m_ctx); });
+        slot.resource = {};
         slot.alive = false;
         ++slot.generation;
         m_freePipelines.push_back(handle.index);
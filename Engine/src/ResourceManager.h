@@ -2,9 +2,15 @@
 
 #include <volk.h>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 
 #include "GpuResources.h"
+#include "UploadBatch.h"
+#include "MemoryTracker.h"
+#include "BufferMemoryPool.h"
 
 namespace ToyEngine
 {
@@ -48,6 +54,12 @@ namespace ToyEngine
     class Pipeline;
     struct PipelineConfig;
 
+    struct DefragmentStats
+    {
+        uint64_t m_movedBytes = 0;
+        uint32_t m_movedBuffers = 0;
+    };
+
     class ResourceManager
     {
     public:
@@ -55,31 +67,51 @@ namespace ToyEngine
 
         ~ResourceManager();
 
-        void init(GpuContext& ctx);
+        // memoryBudgetSupported: VK_EXT_memory_budget got enabled on the device
+        void init(GpuContext& ctx, bool memoryBudgetSupported = false);
 
         void cleanup();
 
-        BufferHandle createBuffer(uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const void* initialData = nullptr);
+        // frameTimelineValue is what the timeline semaphore gets signaled to when the frame being recorded is done,
+        // completedTimelineValue what the GPU already reached. Destructions queued up to now and already passed get run
+        void beginFrame(uint64_t frameTimelineValue, uint64_t completedTimelineValue);
+
+        // Runs destroy once the GPU is done with every frame submitted so far (including the one being recorded).
+        // All destroy* functions go through here, handles are invalid right away but the vulkan objects live on
+        void deferDestruction(std::function<void()> destroy);
+
+        BufferHandle createBuffer(uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const void* initialData = nullptr, MemoryCategory category = MemoryCategory::Geometry);
         Buffer* getBuffer(BufferHandle handle);
         const Buffer* getBuffer(BufferHandle handle) const;
         void destroyBuffer(BufferHandle handle);
 
-        TextureHandle createTexture(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+        TextureHandle createTexture(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryCategory category = MemoryCategory::Textures);
         TextureHandle loadTexture(const char* path);
         Texture* getTexture(TextureHandle handle);
         const Texture* getTexture(TextureHandle handle) const;
         void destroyTexture(TextureHandle handle);
+        void uploadTextureData(TextureHandle handle, const void* data, uint32_t size);
 
         RenderTargetHandle createRenderTarget(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
         RenderTarget* getRenderTarget(RenderTargetHandle handle);
         const RenderTarget* getRenderTarget(RenderTargetHandle handle) const;
         void destroyRenderTarget(RenderTargetHandle handle);
 
+        // Render target without memory, bindRenderTargetMemory has to be called before using it.
+        // Memory stays owned by the caller, used to alias transient targets on a shared allocation
+        RenderTargetHandle createUnboundRenderTarget(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect);
+        VkMemoryRequirements getRenderTargetMemoryRequirements(RenderTargetHandle handle) const;
+        void bindRenderTargetMemory(RenderTargetHandle handle, VkDeviceMemory memory, VkDeviceSize offset);
+
+        // Pipelines are cached on everything that goes in them (config with its specialization constants, set layouts,
+        // push constant ranges), asking for the same variant again returns the same handle. destroyPipeline drops a
+        // reference, variants nobody references stay cached until cleanup so switching back to them is free
         PipelineHandle createPipeline(const PipelineConfig& config, VkDescriptorSetLayout descriptorLayout, const std::vector<VkPushConstantRange>& pushConstantRanges = {});
         PipelineHandle createPipeline(const PipelineConfig& config, const std::vector<VkDescriptorSetLayout>& descriptorLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges = {});
         Pipeline* getPipeline(PipelineHandle handle);
         const Pipeline* getPipeline(PipelineHandle handle) const;
         void destroyPipeline(PipelineHandle handle);
+        uint32_t getPipelineVariantCount() const { return (uint32_t)m_pipelineVariants.size(); }
 
         VkSemaphore createSemaphore(uint64_t initialValue = 0);
         VkSemaphore createBinarySemaphore();
@@ -88,7 +120,30 @@ namespace ToyEngine
         VkCommandPool createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags = 0);
         void destroyCommandPool(VkCommandPool commandPool);
 
+        // Every buffer/texture initial data uploaded between begin and submit goes in a single
+        // staging arena and command buffer, submitted (and waited on) once
+        void beginUploadBatch();
+        void submitUploadBatch();
+        const UploadBatch& getUploadBatch() const { return m_uploadBatch; }
+
+        MemoryTracker& getMemoryTracker() { return m_memoryTracker; }
+        const MemoryTracker& getMemoryTracker() const { return m_memoryTracker; }
+
+        const BufferMemoryPool& getBufferPool() const { return m_bufferPool; }
+
+        // Incremental compaction of the device local buffer pool. Moves live buffers towards the start of the pool
+        // with copies recorded on cmd, at most maxBytes per call, handles stay the same and m_gpuAddress gets updated.
+        // Old buffers go through the deferred destruction queue. Buffers bigger than maxBytes are never moved.
+        // Returns right away until a pool range gets freed again.
+        // The copy is recorded on the graphics queue: buffers an async compute pass touches must not live in the
+        // pool, the copy would read them without the ownership transfer back
+        DefragmentStats defragmentBuffers(VkCommandBuffer cmd, VkDeviceSize maxBytes);
+
     private:
+        uint32_t allocRenderTargetSlot();
+
+        void collectGarbage(uint64_t completedTimelineValue);
+
         template <typename T>
         struct ResourceSlot
         {
@@ -109,8 +164,46 @@ namespace ToyEngine
         std::vector<uint32_t> m_freeRenderTargets;
         std::vector<uint32_t> m_freePipelines;
 
+        struct PipelineVariant
+        {
+            std::vector<VkDescriptorSetLayout> m_descriptorLayouts;
+            std::vector<VkPushConstantRange> m_pushConstantRanges;
+            uint32_t m_index = 0;
+            uint32_t m_refCount = 0;
+        };
+        // Keyed on a hash of the createPipeline arguments. A pipeline whose key is taken by a different variant
+        // (hash collision) is created outside the cache
+        std::unordered_map<uint64_t, PipelineVariant> m_pipelineVariants;
+        // Per pipeline slot, 0 when the slot isn't in the cache
+        std::vector<uint64_t> m_pipelineKeys;
+
         std::vector<VkSemaphore> m_semaphores;
         std::vector<VkCommandPool> m_commandPools;
+
+        UploadBatch m_uploadBatch;
+        MemoryTracker m_memoryTracker;
+
+        BufferMemoryPool m_bufferPool;
+
+        struct PendingDestruction
+        {
+            uint64_t m_timelineValue = 0;
+            std::function<void()> m_destroy;
+        };
+        // Timeline values only grow, so the queue stays sorted
+        std::deque<PendingDestruction> m_pendingDestructions;
+        uint64_t m_frameTimelineValue = 0;
+
+        // Buffers the defragmenter moved away from, same rules as m_pendingDestructions but without a std::function
+        // per move. Both vectors keep their capacity, a steady state defragment pass doesn't touch the heap
+        struct RetiredPoolBuffer
+        {
+            uint64_t m_timelineValue = 0;
+            VkBuffer m_buffer = VK_NULL_HANDLE;
+            BufferPoolAllocation m_allocation;
+        };
+        std::vector<RetiredPoolBuffer> m_retiredPoolBuffers;
+        std::vector<uint32_t> m_defragmentCandidates;
     };
 
 }
@@ -1,5 +1,7 @@
 #include "Scene.h"
 #include "Common/Common.h"
+#include "CpuProfiler.h"
+#include "Culling.h"
 
 namespace ToyEngine
 {
@@ -17,6 +19,7 @@ namespace ToyEngine
 
     void Scene::update()
     {
+        TOY_PROFILE_SCOPE("Scene::update");
         // Right now builds a list of what needs to be rendered
         // Sorted by Mesh id
         auto view = getRegistry().view<Mesh*, TransformIndex>();
@@ -33,26 +36,51 @@ namespace ToyEngine
         return TransformsData[transIdx.index];
     }
 
+    void TransformManager::setLocalBounds(Actor& actor, const float center[3], float radius)
+    {
+        const TransformIndex& transIdx = actor.getComponent<TransformIndex>();
+        LocalBounds[transIdx.index] = glm::vec4(center[0], center[1], center[2], radius);
+        ++BoundsVersion;
+    }
+
     uint32_t TransformManager::alloc()
     {
+        ++BoundsVersion;
         if (!freeList.empty())
         {
             uint32_t idx = freeList.back();
             freeList.pop_back();
+            LocalBounds[idx] = glm::vec4(0.0f);
             return idx;
         }
         TransformsData.push_back({});
+        LocalBounds.push_back(glm::vec4(0.0f));
+        WorldBounds.resize((uint32_t)TransformsData.size());
         return (uint32_t)TransformsData.size() - 1;
     }
 
     void TransformManager::free(uint32_t idx)
     {
+        // No bounds, culling and the BVH skip the slot until it is reused
+        LocalBounds[idx] = glm::vec4(0.0f);
+        ++BoundsVersion;
         freeList.push_back(idx);
     }
 
+    void SphereBoundsSoA::resize(uint32_t count)
+    {
+        m_centerX.resize(count);
+        m_centerY.resize(count);
+        m_centerZ.resize(count);
+        m_radius.resize(count);
+    }
+
     void TransformManager::update()
     {
-        for (Transform& transform : TransformsData) {
+        TOY_PROFILE_SCOPE("TransformManager::update");
+        MovedBounds.clear();
+        for (uint32_t i = 0; i < TransformsData.size(); ++i) {
+            Transform& transform = TransformsData[i];
             glm::mat4 t = glm::translate(glm::mat4(1.f), glm::vec3(transform.m_position));
 
             glm::mat4 rx = glm::rotate(glm::mat4(1.f), glm::radians(transform.m_rotation.x), glm::vec3(1, 0, 0));
@@ -62,6 +90,19 @@ namespace ToyEngine
             glm::mat4 s = glm::scale(glm::mat4(1.f), glm::vec3(transform.m_scale));
                 
             transform.modelMatrix = t * (rz * ry * rx) * s;
+
+            const glm::vec4& local = LocalBounds[i];
+            const glm::vec4 center = transform.modelMatrix * glm::vec4(glm::vec3(local), 1.0f);
+            const float radius = local.w * getMaxAxisScale(transform.modelMatrix);
+            if (WorldBounds.m_centerX[i] != center.x || WorldBounds.m_centerY[i] != center.y ||
+                WorldBounds.m_centerZ[i] != center.z || WorldBounds.m_radius[i] != radius)
+            {
+                MovedBounds.push_back(i);
+            }
+            WorldBounds.m_centerX[i] = center.x;
+            WorldBounds.m_centerY[i] = center.y;
+            WorldBounds.m_centerZ[i] = center.z;
+            WorldBounds.m_radius[i] = radius;
         }
     }
 
@@ -14,12 +14,34 @@
 
 namespace ToyEngine
 {
+    // World space bounding spheres, one per transform slot. Split per component so the culling loads
+    // 4 or 8 spheres with a single instruction per component
+    struct SphereBoundsSoA
+    {
+        std::vector<float> m_centerX;
+        std::vector<float> m_centerY;
+        std::vector<float> m_centerZ;
+        std::vector<float> m_radius;
+
+        uint32_t size() const { return (uint32_t)m_radius.size(); }
+        void resize(uint32_t count);
+    };
+
     struct TransformManager
     {
         std::vector<Transform> TransformsData;
+        // Object space sphere of what the transform places (xyz center, w radius), 0 until a mesh sets it
+        std::vector<glm::vec4> LocalBounds;
+        // LocalBounds through the model matrix, refreshed by update(). Same math as the cull shader
+        SphereBoundsSoA WorldBounds;
+        // Slots whose world sphere changed in the last update(), what the instance BVH refits
+        std::vector<uint32_t> MovedBounds;
+        // Bumped when slots are added, freed or get new local bounds, spatial structures rebuild on a change
+        uint64_t BoundsVersion = 0;
         std::vector<uint32_t> freeList;
 
         Transform& getTransform(Actor& actor);
+        void setLocalBounds(Actor& actor, const float center[3], float radius);
         uint32_t alloc();
         void free(uint32_t idx);
         void update();
@@ -0,0 +1,60 @@
+#include "ThreadCommandPools.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    void ThreadCommandPools::init(ResourceManager& resourceManager, VkDevice device, uint32_t queueFamilyIndex,
+                                  uint32_t threadCount)
+    {
+        m_device = device;
+        for (uint32_t frame = 0; frame < MaxFramesInFlight; ++frame)
+        {
+            m_pools[frame].resize(threadCount);
+            for (ThreadPool& pool : m_pools[frame])
+            {
+                // Owned by the resource manager, goes away with the rest on cleanup
+                pool.m_pool = resourceManager.createCommandPool(queueFamilyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            }
+        }
+    }
+
+    void ThreadCommandPools::beginFrame(uint32_t frameIndex)
+    {
+        m_frameIndex = frameIndex;
+        for (ThreadPool& pool : m_pools[frameIndex])
+        {
+            vkResetCommandPool(m_device, pool.m_pool, 0);
+            pool.m_used = 0;
+        }
+    }
+
+    VkCommandBuffer ThreadCommandPools::acquireSecondary(uint32_t thread)
+    {
+        ThreadPool& pool = m_pools[m_frameIndex][thread];
+        if (pool.m_used == pool.m_buffers.size())
+        {
+            VkCommandBufferAllocateInfo allocateInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+            allocateInfo.commandPool = pool.m_pool;
+            allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocateInfo.commandBufferCount = 1;
+
+            VkCommandBuffer buffer = VK_NULL_HANDLE;
+            VK_CHECK(vkAllocateCommandBuffers(m_device, &allocateInfo, &buffer));
+            pool.m_buffers.push_back(buffer);
+        }
+
+        return pool.m_buffers[pool.m_used++];
+    }
+
+    uint32_t ThreadCommandPools::getSecondaryCount() const
+    {
+        uint32_t count = 0;
+        for (const ThreadPool& pool : m_pools[m_frameIndex])
+        {
+            count += pool.m_used;
+        }
+        return count;
+    }
+
+}
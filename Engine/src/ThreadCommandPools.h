@@ -0,0 +1,45 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <vector>
+
+#include "Common/Common.h"
+
+namespace ToyEngine
+{
+
+    class ResourceManager;
+
+    // One command pool per recording thread per frame in flight, so workers never share a pool.
+    // Secondaries are allocated on demand and kept around, beginFrame resets the frame's pools
+    // (only once the GPU is done with that frame) and hands the same buffers out again
+    class ThreadCommandPools
+    {
+    public:
+        void init(ResourceManager& resourceManager, VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount);
+
+        void beginFrame(uint32_t frameIndex);
+
+        // Only ever called from the thread owning that index
+        VkCommandBuffer acquireSecondary(uint32_t thread);
+
+        uint32_t getThreadCount() const { return (uint32_t)m_pools[0].size(); }
+        // Secondaries handed out this frame, all threads
+        uint32_t getSecondaryCount() const;
+
+    private:
+        struct ThreadPool
+        {
+            VkCommandPool m_pool = VK_NULL_HANDLE;
+            std::vector<VkCommandBuffer> m_buffers;
+            uint32_t m_used = 0;
+        };
+
+        VkDevice m_device = VK_NULL_HANDLE;
+        uint32_t m_frameIndex = 0;
+        // [frame][thread]
+        std::vector<ThreadPool> m_pools[MaxFramesInFlight];
+    };
+
+}
@@ -0,0 +1,84 @@
+#include "TransientAllocator.h"
+#include "Common/Common.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace ToyEngine
+{
+
+    void TransientAllocator::init(ResourceManager& resourceManager, uint32_t bytesPerFrame, uint32_t framesInFlight)
+    {
+        m_resourceManager = &resourceManager;
+        m_bytesPerFrame = bytesPerFrame;
+        m_framesInFlight = framesInFlight;
+        m_regionTimelineValues.assign(framesInFlight, 0);
+
+        // Host visible + coherent, mapped once on creation and never unmapped
+        m_buffer = m_resourceManager->createBuffer(bytesPerFrame * framesInFlight,
+                                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                   VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                                                   VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                                                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                   nullptr, MemoryCategory::Upload);
+
+        m_regionStart = 0;
+        m_regionEnd = bytesPerFrame;
+        m_offset = 0;
+    }
+
+    void TransientAllocator::destroy()
+    {
+        if (m_resourceManager)
+        {
+            m_resourceManager->destroyBuffer(m_buffer);
+        }
+        m_buffer = {};
+        m_resourceManager = nullptr;
+    }
+
+    void TransientAllocator::beginFrame(uint64_t frameTimelineValue, uint64_t completedTimelineValue)
+    {
+        const uint32_t region = (uint32_t)(frameTimelineValue % m_framesInFlight);
+
+        // The region must not be touched by the cpu until the gpu is done with the frame that used it,
+        // the frame loop already waits on that value, this only makes sure nobody breaks that order
+        assert(m_regionTimelineValues[region] <= completedTimelineValue);
+        (void)completedTimelineValue;
+
+        m_regionTimelineValues[region] = frameTimelineValue;
+        m_regionStart = region * m_bytesPerFrame;
+        m_regionEnd = m_regionStart + m_bytesPerFrame;
+        m_offset = m_regionStart;
+    }
+
+    TransientAllocation TransientAllocator::allocate(uint32_t size, uint32_t alignment)
+    {
+        TransientAllocation allocation{};
+
+        const uint32_t alignedOffset = (m_offset + alignment - 1) & ~(alignment - 1);
+        if (alignedOffset + size > m_regionEnd)
+        {
+            // Callers size their uploads from the budget the region was made for, going past it is a bug and a
+            // null address would only turn into a GPU fault later
+            printf("TransientAllocator: out of space (%u bytes requested, %u of %u used)\n", size,
+                   m_offset - m_regionStart, m_bytesPerFrame);
+            fflush(stdout);
+            abort();
+        }
+
+        Buffer* buffer = m_resourceManager->getBuffer(m_buffer);
+        allocation.m_data = (uint8_t*)buffer->m_data + alignedOffset;
+        allocation.m_buffer = buffer->m_buffer;
+        allocation.m_offset = alignedOffset;
+        allocation.m_gpuAddress = buffer->m_gpuAddress + alignedOffset;
+        allocation.m_size = size;
+
+        m_offset = alignedOffset + size;
+        return allocation;
+    }
+
+}
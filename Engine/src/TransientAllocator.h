@@ -0,0 +1,72 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "GpuResources.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    struct TransientAllocation
+    {
+        void* m_data = nullptr;
+        VkBuffer m_buffer = VK_NULL_HANDLE;
+        VkDeviceSize m_offset = 0;
+        VkDeviceAddress m_gpuAddress = 0;
+        uint32_t m_size = 0;
+
+        bool isValid() const { return m_data != nullptr; }
+    };
+
+    // Linear allocator for anything that only lives for one frame (camera, transforms, imgui geometry, per draw constants...)
+    // A single persistently mapped buffer is split in one region per frame in flight, each frame bumps
+    // through its own region and the whole region is recycled at once once the timeline value
+    // of the frame that last wrote on it has been reached. No reallocation, no waits here.
+    // bytesPerFrame is the worst case of a frame, allocate aborts past it instead of returning a null address
+    class TransientAllocator
+    {
+    public:
+        void init(ResourceManager& resourceManager, uint32_t bytesPerFrame, uint32_t framesInFlight);
+
+        void destroy();
+
+        // frameTimelineValue is the value the frame about to be recorded will signal,
+        // completedTimelineValue is a value the caller already knows the gpu has reached
+        void beginFrame(uint64_t frameTimelineValue, uint64_t completedTimelineValue);
+
+        TransientAllocation allocate(uint32_t size, uint32_t alignment = 16);
+
+        template <typename T>
+        TransientAllocation upload(const T* data, uint32_t count, uint32_t alignment = 16)
+        {
+            TransientAllocation allocation = allocate(sizeof(T) * count, alignment);
+            if (allocation.isValid() && data)
+            {
+                memcpy(allocation.m_data, data, sizeof(T) * count);
+            }
+            return allocation;
+        }
+
+        uint32_t getUsedBytes() const { return m_offset - m_regionStart; }
+        uint32_t getBytesPerFrame() const { return m_bytesPerFrame; }
+
+    private:
+        ResourceManager* m_resourceManager = nullptr;
+        BufferHandle m_buffer;
+
+        uint32_t m_bytesPerFrame = 0;
+        uint32_t m_framesInFlight = 0;
+
+        uint32_t m_regionStart = 0;
+        uint32_t m_regionEnd = 0;
+        uint32_t m_offset = 0;
+
+        // last timeline value that used each region
+        std::vector<uint64_t> m_regionTimelineValues;
+    };
+
+}
@@ -0,0 +1,215 @@
+#include "TransientTargets.h"
+#include "Common/Common.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+namespace ToyEngine
+{
+
+    void TransientTargetPool::init(const GpuContext& ctx, ResourceManager& resourceManager)
+    {
+        m_ctx = &ctx;
+        m_resourceManager = &resourceManager;
+    }
+
+    void TransientTargetPool::destroy()
+    {
+        releaseResources();
+        m_targets.clear();
+        m_compiledTargets.clear();
+    }
+
+    void TransientTargetPool::beginFrame()
+    {
+        m_targets.clear();
+    }
+
+    uint32_t TransientTargetPool::declare(const TransientTargetDesc& desc)
+    {
+        TransientTarget target{};
+        target.m_desc = desc;
+        m_targets.push_back(target);
+        return (uint32_t)m_targets.size() - 1;
+    }
+
+    void TransientTargetPool::use(uint32_t target, uint32_t passIndex)
+    {
+        TransientTarget& transient = m_targets[target];
+        transient.m_firstPass = std::min(transient.m_firstPass, passIndex);
+        transient.m_lastPass = std::max(transient.m_lastPass, passIndex);
+    }
+
+    bool TransientTargetPool::matchesCompiled() const
+    {
+        if (m_targets.size() != m_compiledTargets.size())
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < m_targets.size(); ++i)
+        {
+            const TransientTarget& current = m_targets[i];
+            const TransientTarget& compiled = m_compiledTargets[i];
+            if (!(current.m_desc == compiled.m_desc) || current.m_firstPass != compiled.m_firstPass ||
+                current.m_lastPass != compiled.m_lastPass)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void TransientTargetPool::releaseResources()
+    {
+        if (m_compiledTargets.empty() && m_heaps.empty())
+        {
+            return;
+        }
+
+        // Only happens when the declarations change (mostly resizes). Frames in flight might still be
+        // using the old targets, both targets and heaps go through the deferred destruction queue
+        for (TransientTarget& target : m_compiledTargets)
+        {
+            m_resourceManager->destroyRenderTarget(target.m_handle);
+        }
+        m_compiledTargets.clear();
+
+        for (Heap& heap : m_heaps)
+        {
+            m_resourceManager->deferDestruction([ctx = m_ctx, heap]()
+            {
+                ctx->freeMemory(heap.m_memory, MemoryCategory::RenderTargets, heap.m_memoryTypeIndex, heap.m_size);
+            });
+        }
+        m_heaps.clear();
+    }
+
+    bool TransientTargetPool::compile()
+    {
+        if (matchesCompiled())
+        {
+            for (uint32_t i = 0; i < m_targets.size(); ++i)
+            {
+                m_targets[i] = m_compiledTargets[i];
+            }
+            return false;
+        }
+
+        releaseResources();
+
+        std::vector<VkDeviceSize> alignments(m_targets.size());
+        for (uint32_t i = 0; i < m_targets.size(); ++i)
+        {
+            TransientTarget& target = m_targets[i];
+            const TransientTargetDesc& desc = target.m_desc;
+            target.m_handle = m_resourceManager->createUnboundRenderTarget(desc.m_width, desc.m_height, desc.m_format,
+                                                                           desc.m_usage, desc.m_aspect);
+
+            VkMemoryRequirements requirements = m_resourceManager->getRenderTargetMemoryRequirements(target.m_handle);
+            target.m_size = requirements.size;
+            alignments[i] = requirements.alignment;
+
+            // Targets that can't share a memory type can't alias, each memory type gets its own heap
+            uint32_t memoryTypeIndex = m_ctx->findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            auto heapIt = std::find_if(m_heaps.begin(), m_heaps.end(),
+                                       [memoryTypeIndex](const Heap& heap) { return heap.m_memoryTypeIndex == memoryTypeIndex; });
+            if (heapIt == m_heaps.end())
+            {
+                Heap heap{};
+                heap.m_memoryTypeIndex = memoryTypeIndex;
+                m_heaps.push_back(heap);
+                heapIt = m_heaps.end() - 1;
+            }
+            target.m_heap = (uint32_t)(heapIt - m_heaps.begin());
+        }
+
+        // Greedy placement, biggest targets first. Each target goes on the lowest offset
+        // that does not overlap any already placed target alive at the same time
+        std::vector<uint32_t> order(m_targets.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+        {
+            return m_targets[a].m_size > m_targets[b].m_size;
+        });
+
+        std::vector<uint32_t> placed;
+        for (uint32_t targetIndex : order)
+        {
+            TransientTarget& target = m_targets[targetIndex];
+            const VkDeviceSize alignment = alignments[targetIndex];
+
+            std::vector<VkDeviceSize> candidates = {0};
+            for (uint32_t other : placed)
+            {
+                const TransientTarget& placedTarget = m_targets[other];
+                candidates.push_back(placedTarget.m_offset + placedTarget.m_size);
+            }
+            for (VkDeviceSize& candidate : candidates)
+            {
+                candidate = (candidate + alignment - 1) / alignment * alignment;
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            for (VkDeviceSize candidate : candidates)
+            {
+                bool fits = true;
+                for (uint32_t other : placed)
+                {
+                    const TransientTarget& placedTarget = m_targets[other];
+                    const bool sameHeap = placedTarget.m_heap == target.m_heap;
+                    const bool lifetimesOverlap = target.m_firstPass <= placedTarget.m_lastPass &&
+                        placedTarget.m_firstPass <= target.m_lastPass;
+                    const bool memoryOverlaps = candidate < placedTarget.m_offset + placedTarget.m_size &&
+                        placedTarget.m_offset < candidate + target.m_size;
+                    if (sameHeap && lifetimesOverlap && memoryOverlaps)
+                    {
+                        fits = false;
+                        break;
+                    }
+                }
+
+                if (fits)
+                {
+                    target.m_offset = candidate;
+                    break;
+                }
+            }
+
+            Heap& heap = m_heaps[target.m_heap];
+            heap.m_size = std::max(heap.m_size, target.m_offset + target.m_size);
+            placed.push_back(targetIndex);
+        }
+
+        m_report = {};
+        m_report.m_targetCount = (uint32_t)m_targets.size();
+        m_report.m_heapCount = (uint32_t)m_heaps.size();
+
+        for (Heap& heap : m_heaps)
+        {
+            VkMemoryAllocateInfo allocInfo{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+            allocInfo.allocationSize = heap.m_size;
+            allocInfo.memoryTypeIndex = heap.m_memoryTypeIndex;
+            heap.m_memory = m_ctx->allocateMemory(allocInfo, MemoryCategory::RenderTargets);
+
+            m_report.m_aliasedBytes += heap.m_size;
+        }
+
+        for (TransientTarget& target : m_targets)
+        {
+            m_resourceManager->bindRenderTargetMemory(target.m_handle, m_heaps[target.m_heap].m_memory, target.m_offset);
+            m_report.m_unaliasedBytes += target.m_size;
+        }
+
+        printf("Transient targets: %u targets on %u heaps, %.2f MB (%.2f MB without aliasing, %.2f MB saved)\n",
+               m_report.m_targetCount, m_report.m_heapCount, (double)m_report.m_aliasedBytes / (1024.0 * 1024.0),
+               (double)m_report.m_unaliasedBytes / (1024.0 * 1024.0),
+               (double)m_report.getSavedBytes() / (1024.0 * 1024.0));
+
+        m_compiledTargets = m_targets;
+        return true;
+    }
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <vector>
+
+#include "GpuResources.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    struct TransientTargetDesc
+    {
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        VkFormat m_format = VK_FORMAT_UNDEFINED;
+        VkImageUsageFlags m_usage = 0;
+        VkImageAspectFlags m_aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        bool operator==(const TransientTargetDesc& other) const
+        {
+            return m_width == other.m_width && m_height == other.m_height && m_format == other.m_format &&
+                m_usage == other.m_usage && m_aspect == other.m_aspect;
+        }
+    };
+
+    struct TransientMemoryReport
+    {
+        // what every target would cost with its own allocation
+        uint64_t m_unaliasedBytes = 0;
+        // what the shared heaps actually take
+        uint64_t m_aliasedBytes = 0;
+        uint32_t m_targetCount = 0;
+        uint32_t m_heapCount = 0;
+
+        uint64_t getSavedBytes() const { return m_unaliasedBytes - m_aliasedBytes; }
+    };
+
+    // Render targets that only live for a frame. They get declared every frame together with the passes
+    // that touch them, the pool works out each target lifetime over the pass sequence and places targets
+    // whose lifetimes do not overlap on the same memory.
+    // Content of a transient target is undefined on its first use, so first use has to be a clear/full write
+    // (and start from VK_IMAGE_LAYOUT_UNDEFINED).
+    // Actual vulkan objects are only recreated when the declarations change (resize, new targets...)
+    class TransientTargetPool
+    {
+    public:
+        void init(const GpuContext& ctx, ResourceManager& resourceManager);
+
+        void destroy();
+
+        void beginFrame();
+
+        uint32_t declare(const TransientTargetDesc& desc);
+
+        // Extends the target lifetime to cover passIndex
+        void use(uint32_t target, uint32_t passIndex);
+
+        // Returns true if resources got recreated
+        bool compile();
+
+        RenderTargetHandle get(uint32_t target) const { return m_targets[target].m_handle; }
+
+        const TransientMemoryReport& getReport() const { return m_report; }
+
+        // Where compile() placed a target, for the graph dumps
+        uint32_t getHeap(uint32_t target) const { return m_targets[target].m_heap; }
+        VkDeviceSize getOffset(uint32_t target) const { return m_targets[target].m_offset; }
+        VkDeviceSize getSize(uint32_t target) const { return m_targets[target].m_size; }
+
+    private:
+        struct TransientTarget
+        {
+            TransientTargetDesc m_desc;
+            uint32_t m_firstPass = ~0u;
+            uint32_t m_lastPass = 0;
+
+            RenderTargetHandle m_handle;
+            uint32_t m_heap = 0;
+            VkDeviceSize m_offset = 0;
+            VkDeviceSize m_size = 0;
+        };
+
+        struct Heap
+        {
+            VkDeviceMemory m_memory = VK_NULL_HANDLE;
+            uint32_t m_memoryTypeIndex = 0;
+            VkDeviceSize m_size = 0;
+        };
+
+        bool matchesCompiled() const;
+        void releaseResources();
+
+        const GpuContext* m_ctx = nullptr;
+        ResourceManager* m_resourceManager = nullptr;
+
+        std::vector<TransientTarget> m_targets;
+        std::vector<TransientTarget> m_compiledTargets;
+        std::vector<Heap> m_heaps;
+
+        TransientMemoryReport m_report;
+    };
+
+}
@@ -0,0 +1,150 @@
+#include "UploadBatch.h"
+#include "Common/Common.h"
+
+#include <cstring>
+
+namespace ToyEngine
+{
+
+    void UploadBatch::begin(const GpuContext& ctx)
+    {
+        assert(!isRecording());
+
+        m_ctx = &ctx;
+        m_blockOffset = 0;
+        m_uploadCount = 0;
+        m_stagedBytes = 0;
+
+        VkCommandBufferAllocateInfo cbAllocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbAllocInfo.commandPool = ctx.m_commandPool;
+        cbAllocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(ctx.m_device, &cbAllocInfo, &m_cmd));
+
+        VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(m_cmd, &beginInfo);
+    }
+
+    void* UploadBatch::stage(const void* data, uint32_t size, VkBuffer& srcBuffer, VkDeviceSize& srcOffset)
+    {
+        // 16 is enough for both buffer copies and texel copies of the formats we upload
+        uint32_t alignedOffset = (m_blockOffset + 15) & ~15u;
+
+        if (m_stagingBlocks.empty() || alignedOffset + size > m_stagingBlocks.back().m_size)
+        {
+            // Big uploads just get a block on their own
+            Buffer block;
+            block.create(*m_ctx, size > StagingBlockSize ? size : StagingBlockSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, nullptr, nullptr,
+                         MemoryCategory::Upload);
+            m_stagingBlocks.push_back(block);
+            alignedOffset = 0;
+        }
+
+        Buffer& block = m_stagingBlocks.back();
+        void* dst = (uint8_t*)block.m_data + alignedOffset;
+        memcpy(dst, data, size);
+
+        srcBuffer = block.m_buffer;
+        srcOffset = alignedOffset;
+        m_blockOffset = alignedOffset + size;
+
+        ++m_uploadCount;
+        m_stagedBytes += size;
+
+        return dst;
+    }
+
+    void UploadBatch::uploadBuffer(VkBuffer dst, const void* data, uint32_t size, VkDeviceSize dstOffset)
+    {
+        assert(isRecording());
+
+        VkBuffer srcBuffer = VK_NULL_HANDLE;
+        VkDeviceSize srcOffset = 0;
+        stage(data, size, srcBuffer, srcOffset);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(m_cmd, srcBuffer, dst, 1, &copyRegion);
+    }
+
+    void UploadBatch::uploadImage(VkImage dst, uint32_t width, uint32_t height, const void* data, uint32_t size)
+    {
+        assert(isRecording());
+
+        VkBuffer srcBuffer = VK_NULL_HANDLE;
+        VkDeviceSize srcOffset = 0;
+        stage(data, size, srcBuffer, srcOffset);
+
+        VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = dst;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = srcOffset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {width, height, 1};
+        vkCmdCopyBufferToImage(m_cmd, srcBuffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        m_imageReleaseBarriers.push_back(barrier);
+    }
+
+    void UploadBatch::submit()
+    {
+        if (!isRecording())
+        {
+            return;
+        }
+
+        // One barrier for every buffer copy, plus all the image transitions at once
+        VkMemoryBarrier memoryBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+        vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1,
+                             &memoryBarrier, 0, nullptr, (uint32_t)m_imageReleaseBarriers.size(),
+                             m_imageReleaseBarriers.data());
+
+        vkEndCommandBuffer(m_cmd);
+
+        VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_cmd;
+
+        vkQueueSubmit(m_ctx->m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(m_ctx->m_graphicsQueue);
+
+        vkFreeCommandBuffers(m_ctx->m_device, m_ctx->m_commandPool, 1, &m_cmd);
+        m_cmd = VK_NULL_HANDLE;
+
+        for (Buffer& block : m_stagingBlocks)
+        {
+            block.destroy(*m_ctx);
+        }
+        m_stagingBlocks.clear();
+        m_imageReleaseBarriers.clear();
+        m_blockOffset = 0;
+    }
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <vector>
+
+#include "GpuResources.h"
+
+namespace ToyEngine
+{
+
+    // Collects initial data uploads (buffers and textures) into one staging arena and a single
+    // command buffer, so a whole load phase costs one submit and one wait instead of one per resource.
+    // Resources created with a batch open get their data staged right away (source memory can be freed
+    // after the call), the copies themselves only happen on submit.
+    class UploadBatch
+    {
+    public:
+        void begin(const GpuContext& ctx);
+
+        bool isRecording() const { return m_cmd != VK_NULL_HANDLE; }
+
+        void uploadBuffer(VkBuffer dst, const void* data, uint32_t size, VkDeviceSize dstOffset = 0);
+
+        // Leaves the image on VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once submitted
+        void uploadImage(VkImage dst, uint32_t width, uint32_t height, const void* data, uint32_t size);
+
+        void submit();
+
+        uint32_t getUploadCount() const { return m_uploadCount; }
+        uint64_t getStagedBytes() const { return m_stagedBytes; }
+
+    private:
+        void* stage(const void* data, uint32_t size, VkBuffer& srcBuffer, VkDeviceSize& srcOffset);
+
+        static constexpr uint32_t StagingBlockSize = 64 * 1024 * 1024;
+
+        const GpuContext* m_ctx = nullptr;
+        VkCommandBuffer m_cmd = VK_NULL_HANDLE;
+
+        std::vector<Buffer> m_stagingBlocks;
+        uint32_t m_blockOffset = 0;
+
+        // final transitions are emitted all together right before submitting
+        std::vector<VkImageMemoryBarrier> m_imageReleaseBarriers;
+
+        uint32_t m_uploadCount = 0;
+        uint64_t m_stagedBytes = 0;
+    };
+
+}
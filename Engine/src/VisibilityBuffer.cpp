@@ -0,0 +1,86 @@
+#include "VisibilityBuffer.h"
+#include "PipelineManager.h"
+
+namespace ToyEngine
+{
+
+    void VisibilityBuffer::init(GpuContext& ctx, ResourceManager& resourceManager, PipelineManager& pipelineManager)
+    {
+        m_ctx = &ctx;
+        m_resourceManager = &resourceManager;
+        m_pipelineManager = &pipelineManager;
+
+        VkSamplerCreateInfo samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = 0.0f;
+        VK_CHECK(vkCreateSampler(ctx.m_device, &samplerInfo, nullptr, &m_sampler));
+        m_samplerIndex = pipelineManager.addSampler(m_sampler);
+    }
+
+    void VisibilityBuffer::destroy()
+    {
+        if (!m_ctx)
+        {
+            return;
+        }
+
+        // Device is idle here, the deferred part runs with the resource manager cleanup
+        destroyTarget();
+        vkDestroySampler(m_ctx->m_device, m_sampler, nullptr);
+        m_sampler = VK_NULL_HANDLE;
+        m_ctx = nullptr;
+    }
+
+    void VisibilityBuffer::resize(uint32_t width, uint32_t height)
+    {
+        if (isValid() && width == m_width && height == m_height)
+        {
+            return;
+        }
+        destroyTarget();
+
+        m_width = width;
+        m_height = height;
+        m_target = m_resourceManager->createRenderTarget(width, height, Format,
+                                                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                                         VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                         VK_IMAGE_ASPECT_COLOR_BIT);
+        m_bindlessIndex = m_pipelineManager->addImage(getView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    VkImage VisibilityBuffer::getImage() const
+    {
+        const RenderTarget* target = m_resourceManager->getRenderTarget(m_target);
+        return target ? target->m_image : VK_NULL_HANDLE;
+    }
+
+    VkImageView VisibilityBuffer::getView() const
+    {
+        const RenderTarget* target = m_resourceManager->getRenderTarget(m_target);
+        return target ? target->m_view : VK_NULL_HANDLE;
+    }
+
+    void VisibilityBuffer::destroyTarget()
+    {
+        if (!isValid())
+        {
+            return;
+        }
+
+        // The render target is deferred by the resource manager already, the bindless slot has to wait as long
+        m_resourceManager->destroyRenderTarget(m_target);
+        m_resourceManager->deferDestruction(
+            [pipelineManager = m_pipelineManager, bindlessIndex = m_bindlessIndex]()
+            {
+                pipelineManager->releaseImage(bindlessIndex);
+            });
+        m_target = {};
+    }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+
+#include "Common/Common.h"
+#include "ResourceManager.h"
+
+namespace ToyEngine
+{
+
+    class PipelineManager;
+
+    // Target of the forward passes in visibility buffer mode: per pixel (instance + 1, meshlet << 7 | triangle),
+    // 0 is background. The resolve pass reads it back through the bindless set in SHADER_READ_ONLY_OPTIMAL with
+    // texelFetch, integer formats only take a NEAREST sampler
+    class VisibilityBuffer
+    {
+    public:
+        static constexpr VkFormat Format = VK_FORMAT_R32G32_UINT;
+
+        void init(GpuContext& ctx, ResourceManager& resourceManager, PipelineManager& pipelineManager);
+        void destroy();
+
+        // Recreates the target for a new size, the old one is destroyed once the frames in flight are done
+        void resize(uint32_t width, uint32_t height);
+
+        VkImage getImage() const;
+        VkImageView getView() const;
+        uint32_t getWidth() const { return m_width; }
+        uint32_t getHeight() const { return m_height; }
+        bool isValid() const { return m_target.isValid(); }
+
+        uint32_t getBindlessIndex() const { return m_bindlessIndex; }
+        uint32_t getSamplerIndex() const { return m_samplerIndex; }
+
+    private:
+        void destroyTarget();
+
+        GpuContext* m_ctx = nullptr;
+        ResourceManager* m_resourceManager = nullptr;
+        PipelineManager* m_pipelineManager = nullptr;
+
+        RenderTargetHandle m_target;
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_bindlessIndex = 0;
+
+        VkSampler m_sampler = VK_NULL_HANDLE;
+        uint32_t m_samplerIndex = 0;
+    };
+
+}
@@ -0,0 +1,109 @@
+#include "WorkerPool.h"
+#include "Common/Common.h"
+#include "CpuProfiler.h"
+
+#include <cstdio>
+
+namespace ToyEngine
+{
+
+    void WorkerPool::init(uint32_t threadCount)
+    {
+        assert(threadCount > 0 && m_threads.empty());
+        m_quit = false;
+        for (uint32_t i = 1; i < threadCount; ++i)
+        {
+            m_threads.emplace_back(&WorkerPool::workerLoop, this, i);
+        }
+    }
+
+    void WorkerPool::destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+        m_threads.clear();
+    }
+
+    void WorkerPool::runJobs(uint32_t thread)
+    {
+        for (uint32_t job = m_nextJob.fetch_add(1); job < m_jobCount; job = m_nextJob.fetch_add(1))
+        {
+            m_function(m_context, job, thread);
+        }
+    }
+
+    void WorkerPool::workerLoop(uint32_t thread)
+    {
+        char threadName[32];
+        snprintf(threadName, sizeof(threadName), "Worker %u", thread);
+        CpuProfiler::setThreadName(threadName);
+
+        uint64_t seenGeneration = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&]() { return m_quit || m_generation != seenGeneration; });
+                if (m_quit)
+                {
+                    return;
+                }
+                seenGeneration = m_generation;
+            }
+
+            runJobs(thread);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_busyWorkers;
+            }
+            m_done.notify_one();
+        }
+    }
+
+    void WorkerPool::run(uint32_t jobCount, JobFunction function, const void* context)
+    {
+        if (jobCount == 0)
+        {
+            return;
+        }
+
+        // Not worth waking anybody up
+        if (m_threads.empty() || jobCount == 1)
+        {
+            for (uint32_t job = 0; job < jobCount; ++job)
+            {
+                function(context, job, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_function = function;
+            m_context = context;
+            m_jobCount = jobCount;
+            m_nextJob = 0;
+            m_busyWorkers = (uint32_t)m_threads.size();
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        runJobs(0);
+
+        // Workers still touch m_function until they check in, wait for all of them
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&]() { return m_busyWorkers == 0; });
+        m_function = nullptr;
+        m_context = nullptr;
+    }
+
+}
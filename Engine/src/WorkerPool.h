@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ToyEngine
+{
+
+    // Fixed set of threads for fork/join work inside a frame. The calling thread takes jobs as well,
+    // so thread index 0 is always the caller and a pool of 1 thread just runs everything inline
+    class WorkerPool
+    {
+    public:
+        // threadCount includes the calling thread
+        void init(uint32_t threadCount);
+        void destroy();
+
+        uint32_t getThreadCount() const { return (uint32_t)m_threads.size() + 1; }
+
+        // Blocks until every job ran. Jobs are handed out in order, thread is the index of the thread running it.
+        // function(job, thread) is only referenced for the call, no std::function so capturing lambdas don't allocate
+        template<typename Function>
+        void parallelFor(uint32_t jobCount, const Function& function)
+        {
+            run(jobCount, [](const void* context, uint32_t job, uint32_t thread)
+                {
+                    (*(const Function*)context)(job, thread);
+                }, &function);
+        }
+
+    private:
+        using JobFunction = void (*)(const void* context, uint32_t job, uint32_t thread);
+
+        void run(uint32_t jobCount, JobFunction function, const void* context);
+        void workerLoop(uint32_t thread);
+        void runJobs(uint32_t thread);
+
+        std::vector<std::thread> m_threads;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+
+        JobFunction m_function = nullptr;
+        const void* m_context = nullptr;
+        std::atomic<uint32_t> m_nextJob{0};
+        uint32_t m_jobCount = 0;
+        uint32_t m_busyWorkers = 0;
+        uint64_t m_generation = 0;
+        bool m_quit = false;
+    };
+
+}
@@ -0,0 +1,203 @@
+#include "Test.h"
+#include "src/Culling.h"
+#include "src/Camera.h"
+#include "src/Mesh.h"
+#include "src/Scene.h"
+
+#include <cmath>
+
+// The CPU reference of the shader culling, fed what the shaders get: planes from Camera::getFrustumPlanes (they
+// land in CameraData as is), model matrices as in TransformData and meshlets as meshoptimizer leaves them
+namespace ToyEngine
+{
+
+    enum class MeshletDecision
+    {
+        FrustumCulled,
+        ConeCulled,
+        Drawn
+    };
+
+    // Eye at the origin looking down -z, 90 degrees square: the side planes are x = +-z and y = +-z
+    static Camera makeCamera()
+    {
+        Camera camera;
+        camera.setPosition(glm::vec3(0.0f));
+        camera.setTarget(glm::vec3(0.0f, 0.0f, -1.0f));
+        camera.setPerspective(90.0f, 1.0f);
+        camera.update();
+        return camera;
+    }
+
+    static glm::vec3 projectOnPlane(const glm::vec4& plane, const glm::vec3& point)
+    {
+        const glm::vec3 normal = glm::vec3(plane);
+        return point - normal * (glm::dot(normal, point) + plane.w);
+    }
+
+    // Goes through cullMeshlets so the decision comes out of the same code (and order) the counters use
+    static MeshletDecision cullMeshlet(const Meshlet& meshlet, const glm::mat4& model, const Camera& camera)
+    {
+        glm::vec4 planes[6];
+        camera.getFrustumPlanes(planes);
+
+        Mesh mesh;
+        mesh.m_meshlets = {meshlet};
+        MeshletCullCounts counts;
+        cullMeshlets(mesh, model, planes, camera.getPosition(), counts);
+        if (counts.m_frustumCulled > 0)
+        {
+            return MeshletDecision::FrustumCulled;
+        }
+        return counts.m_coneCulled > 0 ? MeshletDecision::ConeCulled : MeshletDecision::Drawn;
+    }
+
+    static Meshlet makeMeshlet(float radius, glm::vec3 coneAxis, float coneCutoff)
+    {
+        Meshlet meshlet;
+        meshlet.m_radius = radius;
+        meshlet.m_coneAxis[0] = coneAxis.x;
+        meshlet.m_coneAxis[1] = coneAxis.y;
+        meshlet.m_coneAxis[2] = coneAxis.z;
+        meshlet.m_coneCutoff = coneCutoff;
+        return meshlet;
+    }
+
+}
+
+using namespace ToyEngine;
+
+// A unit sphere half out of each finite plane is kept, one and a half out is dropped. Far is infinite (reverse Z),
+// it keeps everything. The SIMD path has to agree with the scalar one on every sphere
+TOY_TEST(SphereStraddlingPlanes)
+{
+    const Camera camera = makeCamera();
+    glm::vec4 planes[6];
+    camera.getFrustumPlanes(planes);
+
+    const glm::vec3 inside(0.0f, 0.0f, -10.0f);
+    TOY_CHECK(planes[5] == glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    SphereBoundsSoA bounds;
+    std::vector<uint8_t> expected;
+    auto addSphere = [&](const glm::vec3& center, float radius, bool visible)
+    {
+        TOY_CHECK(isSphereInFrustum(planes, center, radius) == visible);
+        bounds.m_centerX.push_back(center.x);
+        bounds.m_centerY.push_back(center.y);
+        bounds.m_centerZ.push_back(center.z);
+        bounds.m_radius.push_back(radius);
+        expected.push_back(visible ? 1 : 0);
+    };
+
+    // Left, right, bottom, top, near
+    for (uint32_t p = 0; p < 5; ++p)
+    {
+        const glm::vec3 normal = glm::vec3(planes[p]);
+        const glm::vec3 onPlane = projectOnPlane(planes[p], inside);
+        addSphere(onPlane + normal * 0.5f, 1.0f, true);
+        addSphere(onPlane - normal * 0.5f, 1.0f, true);
+        addSphere(onPlane - normal * 1.5f, 1.0f, false);
+    }
+    addSphere(glm::vec3(0.0f, 0.0f, -1.0e6f), 1.0f, true);
+    addSphere(glm::vec3(0.0f, 0.0f, 1.0e6f), 1.0f, false);
+
+    std::vector<uint8_t> visibility(bounds.size(), 2);
+    cullSpheres(bounds, planes, visibility.data());
+    TOY_CHECK(visibility == expected);
+}
+
+// Touching from outside is out, like the shader's > -radius
+TOY_TEST(SphereTouchingPlane)
+{
+    const glm::vec4 planes[6] = {
+        {1.0f, 0.0f, 0.0f, 0.0f},
+        {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f},
+        {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}
+    };
+    TOY_CHECK(!isSphereInFrustum(planes, glm::vec3(-2.0f, 0.0f, 0.0f), 2.0f));
+    TOY_CHECK(isSphereInFrustum(planes, glm::vec3(-2.0f, 0.0f, 0.0f), 2.5f));
+}
+
+// Meshlet radius scales with the biggest axis, a sphere squashed on x still reaches as far as its y axis does
+TOY_TEST(MeshletNonUniformScale)
+{
+    const Camera camera = makeCamera();
+    glm::vec4 planes[6];
+    camera.getFrustumPlanes(planes);
+
+    // Two units out of the left plane
+    const glm::vec3 onPlane = projectOnPlane(planes[0], glm::vec3(0.0f, 0.0f, -10.0f));
+    const glm::vec3 center = onPlane - glm::vec3(planes[0]) * 2.0f;
+    const glm::mat4 translation = glm::translate(glm::mat4(1.0f), center);
+    const Meshlet meshlet = makeMeshlet(1.0f, glm::vec3(0.0f), 0.0f);
+
+    TOY_CHECK(getMaxAxisScale(glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 4.0f, 1.0f))) == 4.0f);
+    TOY_CHECK(std::fabs(getMaxAxisScale(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0, 0, 1)) *
+                                        glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, 4.0f, 1.0f))) - 4.0f) < 1e-5f);
+
+    TOY_CHECK(cullMeshlet(meshlet, translation, camera) == MeshletDecision::FrustumCulled);
+    TOY_CHECK(cullMeshlet(meshlet, translation * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 4.0f, 1.0f)), camera) ==
+              MeshletDecision::Drawn);
+    TOY_CHECK(cullMeshlet(meshlet, translation * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.5f, 1.0f)), camera) ==
+              MeshletDecision::FrustumCulled);
+    TOY_CHECK(cullMeshlet(meshlet, translation * glm::scale(glm::mat4(1.0f), glm::vec3(0.25f, 3.0f, 0.25f)), camera) ==
+              MeshletDecision::Drawn);
+}
+
+// The cone axis goes through the model's upper 3x3 and gets normalized, a stretch on y tilts it towards y
+TOY_TEST(MeshletConeNonUniformScale)
+{
+    const Camera camera = makeCamera();
+    const glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f));
+    const Meshlet meshlet = makeMeshlet(1.0f, glm::normalize(glm::vec3(0.0f, 1.0f, -1.0f)), 0.5f);
+
+    // Eye to apex is -z: 45 degrees off the axis is inside the 60 degree cutoff, culled
+    TOY_CHECK(cullMeshlet(meshlet, translation, camera) == MeshletDecision::ConeCulled);
+    // Axis ends up about 76 degrees off -z, some triangles might face the eye
+    TOY_CHECK(cullMeshlet(meshlet, translation * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 4.0f, 1.0f)), camera) ==
+              MeshletDecision::Drawn);
+    // Stretch on z tilts it back towards -z
+    TOY_CHECK(cullMeshlet(meshlet, translation * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 4.0f)), camera) ==
+              MeshletDecision::ConeCulled);
+}
+
+// No cone (zero axis) and meshoptimizer's too-wide cone (cutoff 1) never cull, even with the eye right on the
+// axis. Frustum comes first, a backfacing meshlet off screen counts as frustum culled
+TOY_TEST(MeshletDegenerateCones)
+{
+    const Camera camera = makeCamera();
+    const glm::mat4 inFront = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f));
+    const glm::mat4 behind = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 10.0f));
+
+    TOY_CHECK(cullMeshlet(makeMeshlet(1.0f, glm::vec3(0.0f), -1.0f), inFront, camera) == MeshletDecision::Drawn);
+    TOY_CHECK(cullMeshlet(makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, -1.0f), 1.0f), inFront, camera) ==
+              MeshletDecision::Drawn);
+    TOY_CHECK(cullMeshlet(makeMeshlet(1.0f, glm::vec3(1.0f, 0.0f, 0.0f), 1.0f), inFront, camera) ==
+              MeshletDecision::Drawn);
+
+    // Half space cones: away from the eye is culled, towards it is not
+    TOY_CHECK(cullMeshlet(makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, -1.0f), 0.0f), inFront, camera) ==
+              MeshletDecision::ConeCulled);
+    TOY_CHECK(cullMeshlet(makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, 1.0f), 0.0f), inFront, camera) ==
+              MeshletDecision::Drawn);
+    TOY_CHECK(cullMeshlet(makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, 1.0f), 0.0f), behind, camera) ==
+              MeshletDecision::FrustumCulled);
+
+    // Same meshlets in one mesh, the totals are what the task shader counters should read
+    glm::vec4 planes[6];
+    camera.getFrustumPlanes(planes);
+    Mesh mesh;
+    mesh.m_meshlets = {
+        makeMeshlet(1.0f, glm::vec3(0.0f), -1.0f),
+        makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, -1.0f), 1.0f),
+        makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, -1.0f), 0.0f),
+        makeMeshlet(1.0f, glm::vec3(0.0f, 0.0f, 1.0f), 0.0f)
+    };
+    MeshletCullCounts counts;
+    cullMeshlets(mesh, inFront, planes, camera.getPosition(), counts);
+    cullMeshlets(mesh, behind, planes, camera.getPosition(), counts);
+    TOY_CHECK(counts.m_tested == 8);
+    TOY_CHECK(counts.m_frustumCulled == 4);
+    TOY_CHECK(counts.m_coneCulled == 1);
+}
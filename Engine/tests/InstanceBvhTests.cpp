@@ -0,0 +1,67 @@
+#include "Test.h"
+#include "src/InstanceBvh.h"
+#include "src/Scene.h"
+
+#include <thread>
+
+// Background rebuilds through update(), with the bounds filled in by hand instead of TransformManager::update
+namespace ToyEngine
+{
+
+    static void addSphere(TransformManager& transforms, float x, float radius)
+    {
+        transforms.WorldBounds.m_centerX.push_back(x);
+        transforms.WorldBounds.m_centerY.push_back(0.0f);
+        transforms.WorldBounds.m_centerZ.push_back(0.0f);
+        transforms.WorldBounds.m_radius.push_back(radius);
+        ++transforms.BoundsVersion;
+    }
+
+    // Keeps calling update() until the kicked rebuild got swapped in
+    static void waitForRebuild(InstanceBvh& bvh, const TransformManager& transforms)
+    {
+        while (bvh.isRebuilding())
+        {
+            std::this_thread::yield();
+            bvh.update(transforms, nullptr);
+        }
+    }
+
+}
+
+using namespace ToyEngine;
+
+// Each new slot kicks one rebuild on the same thread, and the slot only shows up once it is swapped in
+TOY_TEST(BvhBackgroundRebuilds)
+{
+    constexpr uint32_t RebuildCount = 100;
+    TransformManager transforms;
+    addSphere(transforms, 0.0f, 1.0f);
+
+    InstanceBvh bvh;
+    bvh.init();
+    bvh.update(transforms, nullptr);
+    TOY_CHECK(bvh.getItemCount() == 1);
+    TOY_CHECK(!bvh.isRebuilding());
+
+    for (uint32_t i = 1; i <= RebuildCount; ++i)
+    {
+        addSphere(transforms, 10.0f * (float)i, 1.0f);
+        bvh.update(transforms, nullptr);
+        TOY_CHECK(bvh.isRebuilding());
+        waitForRebuild(bvh, transforms);
+        TOY_CHECK(bvh.getItemCount() == i + 1);
+    }
+    TOY_CHECK(bvh.getRebuildCount() == RebuildCount);
+
+    std::vector<uint32_t> items;
+    bvh.queryAabb(glm::vec3(995.0f, -1.0f, -1.0f), glm::vec3(1005.0f, 1.0f, 1.0f), items);
+    TOY_CHECK(items.size() == 1 && items[0] == RebuildCount);
+
+    // Stopping with a rebuild in flight waits for it instead of leaving the thread running
+    addSphere(transforms, -10.0f, 1.0f);
+    bvh.update(transforms, nullptr);
+    bvh.destroy();
+    TOY_CHECK(!bvh.isRebuilding());
+    bvh.destroy();
+}
@@ -0,0 +1,472 @@
+#include "Test.h"
+#include "src/RenderGraph.h"
+
+// compile() only looks at the declarations, the graphs below never touch a device (null handles everywhere)
+namespace ToyEngine
+{
+
+    static TransientTargetDesc makeDesc(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect)
+    {
+        TransientTargetDesc desc;
+        desc.m_width = 64;
+        desc.m_height = 64;
+        desc.m_format = format;
+        desc.m_usage = usage;
+        desc.m_aspect = aspect;
+        return desc;
+    }
+
+    static Pass makePass(const char* name, PassType type)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.type = type;
+        return pass;
+    }
+
+    static const GraphBarrier* findBarrier(const std::vector<GraphBarrier>& barriers, GraphResource resource)
+    {
+        for (const GraphBarrier& barrier : barriers)
+        {
+            if (barrier.resource == resource)
+            {
+                return &barrier;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool waitsOn(const GraphSegment& segment, uint32_t waitedSegment)
+    {
+        for (const GraphSegmentWait& wait : segment.waits)
+        {
+            if (wait.segment == waitedSegment)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
+
+using namespace ToyEngine;
+
+// Forward into a transient color target, copied to the swapchain that ends up in PRESENT
+TOY_TEST(SwapchainCopy)
+{
+    RenderGraph graph;
+    GraphResource color = graph.createTransientImage("Color", makeDesc(VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT));
+    GraphResource swapchain = graph.importImage("Swapchain", VK_NULL_HANDLE, VK_NULL_HANDLE, 64, 64,
+                                                VK_FORMAT_B8G8R8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT,
+                                                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    Pass forward = makePass("Forward", PassType::Graphics);
+    forward.colorAttachments = {{color, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {}}};
+    graph.addPass(forward);
+
+    Pass copy = makePass("Copy", PassType::Transfer);
+    copy.reads = {{color, ResourceUsage::TransferSrc}};
+    copy.writes = {{swapchain, ResourceUsage::TransferDst}};
+    graph.addPass(copy);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({0, 1}));
+    TOY_CHECK(graph.getSegments().size() == 1);
+
+    // Transient starts undefined, its memory might have been someone else's right before
+    const GraphBarrier* colorInit = findBarrier(graph.getBarriers(0), color);
+    TOY_CHECK(colorInit && colorInit->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+              colorInit->newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+              colorInit->srcStage == VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+    const GraphBarrier* colorToCopy = findBarrier(graph.getBarriers(1), color);
+    TOY_CHECK(colorToCopy && colorToCopy->oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+              colorToCopy->newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL &&
+              colorToCopy->srcStage == VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT &&
+              (colorToCopy->srcAccess & VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT) &&
+              colorToCopy->dstStage == VK_PIPELINE_STAGE_2_TRANSFER_BIT &&
+              colorToCopy->dstAccess == VK_ACCESS_2_TRANSFER_READ_BIT);
+
+    // Waits on the acquire semaphore stage, nothing before it in the graph
+    const GraphBarrier* swapchainToCopy = findBarrier(graph.getBarriers(1), swapchain);
+    TOY_CHECK(swapchainToCopy && swapchainToCopy->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+              swapchainToCopy->newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
+              swapchainToCopy->srcStage == VK_PIPELINE_STAGE_2_TRANSFER_BIT &&
+              swapchainToCopy->dstAccess == VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+    // Only the imported image gets a final layout
+    TOY_CHECK(graph.getFinalBarriers().size() == 1);
+    const GraphBarrier* present = findBarrier(graph.getFinalBarriers(), swapchain);
+    TOY_CHECK(present && present->oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
+              present->newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR &&
+              present->srcAccess == VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+    // Same shape again is a cache hit
+    graph.reset();
+    graph.createTransientImage("Color", makeDesc(VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT));
+    graph.importImage("Swapchain", VK_NULL_HANDLE, VK_NULL_HANDLE, 64, 64, VK_FORMAT_B8G8R8A8_SRGB,
+                      VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                      VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    graph.addPass(forward);
+    graph.addPass(copy);
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getCompileCount() == 1);
+}
+
+// Depth attachment sampled by a compute pass afterwards
+TOY_TEST(TransientLayoutTransition)
+{
+    RenderGraph graph;
+    GraphResource depth = graph.createTransientImage("Depth", makeDesc(VK_FORMAT_D32_SFLOAT,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT));
+    GraphResource output = graph.importBuffer("Output", VK_NULL_HANDLE);
+
+    Pass prepass = makePass("DepthPrepass", PassType::Graphics);
+    prepass.depthAttachment = {depth, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {}};
+    prepass.useDepth = true;
+    graph.addPass(prepass);
+
+    Pass sample = makePass("SampleDepth", PassType::Compute);
+    sample.reads = {{depth, ResourceUsage::ShaderRead}};
+    sample.writes = {{output, ResourceUsage::StorageWrite}};
+    graph.addPass(sample);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({0, 1}));
+
+    const GraphBarrier* init = findBarrier(graph.getBarriers(0), depth);
+    TOY_CHECK(init && init->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+              init->newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+    const GraphBarrier* toRead = findBarrier(graph.getBarriers(1), depth);
+    TOY_CHECK(toRead && toRead->oldLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL &&
+              toRead->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+              toRead->srcStage == (VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT) &&
+              (toRead->srcAccess & VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT) &&
+              toRead->dstStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT &&
+              (toRead->dstAccess & VK_ACCESS_2_SHADER_SAMPLED_READ_BIT));
+
+    // First write of the buffer has nothing to wait on
+    TOY_CHECK(findBarrier(graph.getBarriers(1), output) == nullptr);
+    // Transients are left however the last pass had them
+    TOY_CHECK(graph.getFinalBarriers().empty());
+}
+
+// Compute writes, graphics reads, compute writes again: the second write waits on the graphics read
+TOY_TEST(BufferWriteAfterRead)
+{
+    RenderGraph graph;
+    GraphResource data = graph.importBuffer("Data", VK_NULL_HANDLE);
+    GraphResource result = graph.importBuffer("Result", VK_NULL_HANDLE);
+
+    Pass produce = makePass("Produce", PassType::Compute);
+    produce.writes = {{data, ResourceUsage::StorageWrite}};
+    graph.addPass(produce);
+
+    Pass consume = makePass("Consume", PassType::Graphics);
+    consume.reads = {{data, ResourceUsage::StorageRead}};
+    consume.writes = {{result, ResourceUsage::StorageWrite}};
+    graph.addPass(consume);
+
+    Pass overwrite = makePass("Overwrite", PassType::Compute);
+    overwrite.writes = {{data, ResourceUsage::StorageWrite}};
+    graph.addPass(overwrite);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({0, 1, 2}));
+
+    TOY_CHECK(graph.getBarriers(0).empty());
+
+    // Read after write
+    const GraphBarrier* raw = findBarrier(graph.getBarriers(1), data);
+    TOY_CHECK(raw && raw->srcStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT &&
+              (raw->srcAccess & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) &&
+              (raw->dstStage & VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT) &&
+              raw->dstAccess == VK_ACCESS_2_SHADER_STORAGE_READ_BIT &&
+              raw->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && raw->newLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+
+    // Write after read: has to wait for the graphics stages that read it, not only the last write
+    const GraphBarrier* war = findBarrier(graph.getBarriers(2), data);
+    TOY_CHECK(war && (war->srcStage & VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT) &&
+              (war->srcStage & VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT) &&
+              war->dstStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT &&
+              (war->dstAccess & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+}
+
+// Nothing reaches an imported resource from Unused/Downsample, they go. Side effect passes stay
+TOY_TEST(CulledPass)
+{
+    RenderGraph graph;
+    GraphResource unused = graph.createTransientImage("Unused", makeDesc(VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT));
+    GraphResource half = graph.createTransientImage("Half", makeDesc(VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT));
+    GraphResource scratch = graph.createTransientImage("Scratch", makeDesc(VK_FORMAT_R8G8B8A8_UNORM,
+        VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT));
+    GraphResource output = graph.importBuffer("Output", VK_NULL_HANDLE);
+
+    Pass dead = makePass("Unused", PassType::Graphics);
+    dead.colorAttachments = {{unused, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {}}};
+    const uint32_t deadIndex = graph.addPass(dead);
+
+    Pass deadChain = makePass("Downsample", PassType::Compute);
+    deadChain.reads = {{unused, ResourceUsage::ShaderRead}};
+    deadChain.writes = {{half, ResourceUsage::StorageWrite}};
+    const uint32_t deadChainIndex = graph.addPass(deadChain);
+
+    Pass live = makePass("Live", PassType::Compute);
+    live.writes = {{output, ResourceUsage::StorageWrite}};
+    const uint32_t liveIndex = graph.addPass(live);
+
+    Pass sideEffects = makePass("Readback", PassType::Compute);
+    sideEffects.writes = {{scratch, ResourceUsage::StorageWrite}};
+    sideEffects.sideEffects = true;
+    const uint32_t sideEffectsIndex = graph.addPass(sideEffects);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.isPassCulled(deadIndex));
+    TOY_CHECK(graph.isPassCulled(deadChainIndex));
+    TOY_CHECK(!graph.isPassCulled(liveIndex));
+    TOY_CHECK(!graph.isPassCulled(sideEffectsIndex));
+    TOY_CHECK(graph.getCulledPassCount() == 2);
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({liveIndex, sideEffectsIndex}));
+}
+
+// Depth from graphics, pyramid built on the async queue, sampled back on graphics. Every queue change is a
+// release at the end of the producing segment plus an acquire before the consumer, and a timeline wait
+TOY_TEST(CrossQueueOwnershipTransfer)
+{
+    RenderGraph graph;
+    graph.setQueueFamilies(0, 1);
+    GraphResource depth = graph.createTransientImage("Depth", makeDesc(VK_FORMAT_D32_SFLOAT,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT));
+    GraphResource pyramid = graph.importImage("Pyramid", VK_NULL_HANDLE, VK_NULL_HANDLE, 32, 32,
+                                              VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT,
+                                              VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                              VK_IMAGE_LAYOUT_UNDEFINED);
+    GraphResource output = graph.importBuffer("Output", VK_NULL_HANDLE);
+
+    Pass prepass = makePass("DepthPrepass", PassType::Graphics);
+    prepass.depthAttachment = {depth, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {}};
+    prepass.useDepth = true;
+    graph.addPass(prepass);
+
+    Pass build = makePass("BuildPyramid", PassType::Compute);
+    build.queue = QueueType::AsyncCompute;
+    build.reads = {{depth, ResourceUsage::ShaderRead}};
+    build.writes = {{pyramid, ResourceUsage::StorageWrite}};
+    graph.addPass(build);
+
+    Pass consume = makePass("Consume", PassType::Graphics);
+    consume.reads = {{pyramid, ResourceUsage::ShaderRead}};
+    consume.writes = {{output, ResourceUsage::StorageWrite}};
+    graph.addPass(consume);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({0, 1, 2}));
+    TOY_CHECK(graph.getPassQueue(1) == QueueType::AsyncCompute);
+    TOY_CHECK(graph.getAsyncPassCount() == 1);
+
+    // Empty graphics segment first (the frame's own work), then graphics / async / graphics
+    const std::vector<GraphSegment>& segments = graph.getSegments();
+    TOY_CHECK(segments.size() == 4);
+    if (segments.size() != 4)
+    {
+        return;
+    }
+    TOY_CHECK(segments[0].queue == QueueType::Graphics && segments[0].firstOrderIndex == segments[0].endOrderIndex);
+    TOY_CHECK(segments[1].queue == QueueType::Graphics);
+    TOY_CHECK(segments[2].queue == QueueType::AsyncCompute);
+    TOY_CHECK(segments[3].queue == QueueType::Graphics);
+    TOY_CHECK(waitsOn(segments[2], 0) && waitsOn(segments[2], 1));
+    TOY_CHECK(waitsOn(segments[3], 2));
+
+    // Depth: released by the graphics segment that wrote it, acquired by the async pass, same transition in both
+    const GraphBarrier* depthRelease = findBarrier(segments[1].releaseBarriers, depth);
+    TOY_CHECK(depthRelease && depthRelease->srcQueue == QueueType::Graphics &&
+              depthRelease->dstQueue == QueueType::AsyncCompute &&
+              depthRelease->oldLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL &&
+              depthRelease->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+              (depthRelease->srcAccess & VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT) &&
+              depthRelease->dstStage == VK_PIPELINE_STAGE_2_NONE);
+
+    const GraphBarrier* depthAcquire = findBarrier(graph.getBarriers(1), depth);
+    TOY_CHECK(depthAcquire && depthAcquire->srcQueue == QueueType::Graphics &&
+              depthAcquire->dstQueue == QueueType::AsyncCompute &&
+              depthAcquire->oldLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL &&
+              depthAcquire->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+              depthAcquire->srcStage == VK_PIPELINE_STAGE_2_NONE &&
+              depthAcquire->dstStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+    // Pyramid starts undefined, nothing to transfer going in, only a plain transition on the async queue
+    const GraphBarrier* pyramidInit = findBarrier(graph.getBarriers(1), pyramid);
+    TOY_CHECK(pyramidInit && pyramidInit->srcQueue == QueueType::AsyncCompute &&
+              pyramidInit->dstQueue == QueueType::AsyncCompute &&
+              pyramidInit->newLayout == VK_IMAGE_LAYOUT_GENERAL);
+    TOY_CHECK(findBarrier(segments[0].releaseBarriers, pyramid) == nullptr);
+
+    // Written on async, read on graphics
+    const GraphBarrier* pyramidRelease = findBarrier(segments[2].releaseBarriers, pyramid);
+    TOY_CHECK(pyramidRelease && pyramidRelease->srcQueue == QueueType::AsyncCompute &&
+              pyramidRelease->dstQueue == QueueType::Graphics &&
+              pyramidRelease->oldLayout == VK_IMAGE_LAYOUT_GENERAL &&
+              pyramidRelease->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+              pyramidRelease->srcStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+    const GraphBarrier* pyramidAcquire = findBarrier(graph.getBarriers(2), pyramid);
+    TOY_CHECK(pyramidAcquire && pyramidAcquire->srcQueue == QueueType::AsyncCompute &&
+              pyramidAcquire->dstQueue == QueueType::Graphics &&
+              pyramidAcquire->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+              (pyramidAcquire->dstStage & VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT));
+
+    // Back on graphics already, no final transfer
+    TOY_CHECK(graph.getFinalBarriers().empty());
+}
+
+// Occlusion frame shape with the pyramid on the async queue: the late forward loads the depth the early one left,
+// so depth has to come back to graphics after the pyramid sampled it. Without an async family it is all one submit
+TOY_TEST(AsyncDepthPyramidFrame)
+{
+    auto buildFrame = [](RenderGraph& graph, GraphResource& depth, GraphResource& pyramid)
+    {
+        depth = graph.createTransientImage("Depth", makeDesc(VK_FORMAT_D32_SFLOAT,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT));
+        pyramid = graph.importImage("DepthPyramid", VK_NULL_HANDLE, VK_NULL_HANDLE, 32, 32, VK_FORMAT_R32_SFLOAT,
+                                    VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT,
+                                    VK_IMAGE_LAYOUT_UNDEFINED);
+        GraphResource drawCommands = graph.importBuffer("LateDrawCommands", VK_NULL_HANDLE);
+
+        Pass early = makePass("EarlyForward", PassType::Graphics);
+        early.depthAttachment = {depth, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, {}};
+        early.useDepth = true;
+        graph.addPass(early);
+
+        Pass build = makePass("DepthPyramidPass", PassType::Compute);
+        build.queue = QueueType::AsyncCompute;
+        build.reads = {{depth, ResourceUsage::ShaderRead}};
+        build.writes = {{pyramid, ResourceUsage::StorageWrite}};
+        graph.addPass(build);
+
+        Pass cull = makePass("LateCull", PassType::Compute);
+        cull.reads = {{pyramid, ResourceUsage::ShaderRead}};
+        cull.writes = {{drawCommands, ResourceUsage::StorageWrite}};
+        graph.addPass(cull);
+
+        Pass late = makePass("LateForward", PassType::Graphics);
+        late.reads = {{drawCommands, ResourceUsage::IndirectRead}, {pyramid, ResourceUsage::ShaderRead}};
+        late.depthAttachment = {depth, VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_DONT_CARE, {}};
+        late.useDepth = true;
+        late.sideEffects = true;
+        graph.addPass(late);
+    };
+
+    RenderGraph graph;
+    graph.setQueueFamilies(0, 1);
+    GraphResource depth = InvalidGraphResource;
+    GraphResource pyramid = InvalidGraphResource;
+    buildFrame(graph, depth, pyramid);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({0, 1, 2, 3}));
+    TOY_CHECK(graph.getPassQueue(1) == QueueType::AsyncCompute);
+    TOY_CHECK(graph.getPassQueue(2) == QueueType::Graphics);
+
+    const std::vector<GraphSegment>& segments = graph.getSegments();
+    TOY_CHECK(segments.size() == 4);
+    if (segments.size() != 4)
+    {
+        return;
+    }
+    TOY_CHECK(segments[2].queue == QueueType::AsyncCompute && segments[2].firstOrderIndex == 1 &&
+              segments[2].endOrderIndex == 2);
+    TOY_CHECK(waitsOn(segments[3], 2));
+
+    // Depth goes back to graphics once the pyramid has sampled it, straight into the attachment layout
+    const GraphBarrier* depthRelease = findBarrier(segments[2].releaseBarriers, depth);
+    TOY_CHECK(depthRelease && depthRelease->srcQueue == QueueType::AsyncCompute &&
+              depthRelease->dstQueue == QueueType::Graphics &&
+              depthRelease->srcStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT &&
+              depthRelease->oldLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+              depthRelease->newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+    const GraphBarrier* depthAcquire = findBarrier(graph.getBarriers(3), depth);
+    TOY_CHECK(depthAcquire && depthAcquire->srcQueue == QueueType::AsyncCompute &&
+              depthAcquire->dstQueue == QueueType::Graphics &&
+              depthAcquire->newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL &&
+              (depthAcquire->dstAccess & VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT));
+    TOY_CHECK(findBarrier(graph.getBarriers(2), depth) == nullptr);
+
+    // The late cull is the first graphics user of the pyramid, it takes the acquire
+    const GraphBarrier* pyramidAcquire = findBarrier(graph.getBarriers(2), pyramid);
+    TOY_CHECK(pyramidAcquire && pyramidAcquire->srcQueue == QueueType::AsyncCompute &&
+              pyramidAcquire->dstQueue == QueueType::Graphics &&
+              pyramidAcquire->dstStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT);
+
+    // Same declarations without an async family: the tag is ignored, one graphics segment and no transfers
+    RenderGraph single;
+    single.setQueueFamilies(0, ~0u);
+    buildFrame(single, depth, pyramid);
+    TOY_CHECK(single.compile());
+    TOY_CHECK(single.getAsyncPassCount() == 0);
+    TOY_CHECK(single.getSegments().size() == 1);
+    for (uint32_t i = 0; i < single.getExecutionOrder().size(); ++i)
+    {
+        for (const GraphBarrier& barrier : single.getBarriers(i))
+        {
+            TOY_CHECK(barrier.srcQueue == QueueType::Graphics && barrier.dstQueue == QueueType::Graphics);
+        }
+    }
+}
+
+// Visibility buffers kept across frames: last frame's late phase wrote them, the first read and the first write of
+// this frame both wait on that write
+TOY_TEST(ImportedBufferInitialAccess)
+{
+    const VkPipelineStageFlags2 lastFrameStages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+        VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT;
+
+    RenderGraph graph;
+    GraphResource instances = graph.importBuffer("InstanceVisibility", VK_NULL_HANDLE, lastFrameStages,
+                                                 VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    GraphResource meshlets = graph.importBuffer("MeshletVisibility", VK_NULL_HANDLE, lastFrameStages,
+                                                VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    Pass earlyCull = makePass("EarlyCull", PassType::Compute);
+    earlyCull.reads = {{instances, ResourceUsage::StorageRead}};
+    earlyCull.sideEffects = true;
+    graph.addPass(earlyCull);
+
+    Pass lateForward = makePass("LateForward", PassType::Graphics);
+    lateForward.writes = {{meshlets, ResourceUsage::StorageWrite}};
+    graph.addPass(lateForward);
+
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getExecutionOrder() == std::vector<uint32_t>({0, 1}));
+
+    const GraphBarrier* read = findBarrier(graph.getBarriers(0), instances);
+    TOY_CHECK(read && read->srcStage == lastFrameStages &&
+              read->srcAccess == VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT &&
+              read->dstStage == VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT &&
+              read->dstAccess == VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+    const GraphBarrier* write = findBarrier(graph.getBarriers(1), meshlets);
+    TOY_CHECK(write && write->srcStage == lastFrameStages &&
+              write->srcAccess == VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT &&
+              (write->dstAccess & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT));
+
+    // The initial access is part of the graph shape
+    graph.reset();
+    graph.importBuffer("InstanceVisibility", VK_NULL_HANDLE);
+    graph.importBuffer("MeshletVisibility", VK_NULL_HANDLE, lastFrameStages, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    graph.addPass(earlyCull);
+    graph.addPass(lateForward);
+    TOY_CHECK(graph.compile());
+    TOY_CHECK(graph.getCompileCount() == 2);
+    TOY_CHECK(findBarrier(graph.getBarriers(0), instances) == nullptr);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Minimal test runner for the device free parts of the engine (render graph compile, culling math, instance BVH).
+// TOY_TEST bodies register themselves, TOY_CHECK reports and counts a failure but keeps the test going
+namespace ToyEngine
+{
+
+    struct TestCase
+    {
+        const char* m_name = nullptr;
+        void (*m_function)() = nullptr;
+    };
+
+    std::vector<TestCase>& getTestCases();
+    void reportTestFailure(const char* file, int line, const char* expression);
+
+    struct TestRegistrar
+    {
+        TestRegistrar(const char* name, void (*function)()) { getTestCases().push_back({name, function}); }
+    };
+
+}
+
+#define TOY_TEST(name)                                                      \
+    static void name();                                                     \
+    static ToyEngine::TestRegistrar name##Registrar(#name, name);           \
+    static void name()
+
+#define TOY_CHECK(expression)                                               \
+    do                                                                      \
+    {                                                                       \
+        if (!(expression))                                                  \
+        {                                                                   \
+            ToyEngine::reportTestFailure(__FILE__, __LINE__, #expression);  \
+        }                                                                   \
+    } while (false)
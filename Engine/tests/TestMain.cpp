@@ -0,0 +1,38 @@
+#include "Test.h"
+
+namespace ToyEngine
+{
+
+    static uint32_t s_failureCount = 0;
+
+    std::vector<TestCase>& getTestCases()
+    {
+        static std::vector<TestCase> testCases;
+        return testCases;
+    }
+
+    void reportTestFailure(const char* file, int line, const char* expression)
+    {
+        printf("  %s(%d): TOY_CHECK(%s) failed\n", file, line, expression);
+        ++s_failureCount;
+    }
+
+}
+
+using namespace ToyEngine;
+
+int main()
+{
+    uint32_t failedTests = 0;
+    for (const TestCase& testCase : getTestCases())
+    {
+        const uint32_t failuresBefore = s_failureCount;
+        testCase.m_function();
+        const bool passed = s_failureCount == failuresBefore;
+        printf("[%s] %s\n", passed ? "PASS" : "FAIL", testCase.m_name);
+        failedTests += passed ? 0 : 1;
+    }
+
+    printf("%zu tests, %u failed\n", getTestCases().size(), failedTests);
+    return failedTests == 0 ? 0 : 1;
+}
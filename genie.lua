@@ -8,11 +8,20 @@ solution "ToyEngine"
     configurations { "Debug", "Release" }
     platforms { "x64" }
 
-project "Engine"
-    kind "ConsoleApp"
-    language "C++"
-    location "build"
-    
+-- CPU culling picks its SIMD path at compile time (see Culling.cpp), default is the x64 baseline (SSE2)
+newoption {
+    trigger = "simd",
+    value = "ISA",
+    description = "Vector instruction set the CPU side targets",
+    allowed = {
+        { "sse2", "SSE2 (x64 baseline)" },
+        { "avx2", "AVX2 + FMA (Haswell and later)" },
+        { "avx512", "AVX-512 F/BW/VL (Skylake-X and later)" },
+    }
+}
+
+-- Everything but the entry point, shared by the engine and the test runner
+local function engineProject()
     flags {
         "Cpp20",
         "Unicode",
@@ -33,21 +42,16 @@ project "Engine"
     }
 
     defines {
-        "WIN32_LEAN_AND_MEAN",
-        "NOMINMAX",
-        "_GLFW_WIN32",
-        "GLFW_EXPOSE_NATIVE_WIN32",
-        "VK_USE_PLATFORM_WIN32_KHR",
-        "_CRT_SECURE_NO_WARNINGS",
         "GLM_FORCE_DEPTH_ZERO_TO_ONE",
         "GLM_FORCE_RADIANS",
+        -- Scoped CPU zones, see CpuProfiler.h. Drop it to compile the zones out
+        "TOY_CPU_PROFILER",
         -- Global path defines as raw string literals
         "ENGINE_PROJECT_ROOT=R\"(" .. projectRoot .. ")\"",
         "ENGINE_DIR=R\"(" .. engineDir .. ")\""
     }
 
     files {
-        "Engine/main.cpp",
         "Engine/src/*.cpp",
         "Engine/src/*.h",
         "Engine/Common/**.h", -- Add Common directory files
@@ -58,7 +62,7 @@ project "Engine"
         "extern/meshoptimizer/tools/objloader.cpp",
         -- ImGui Source Files
         "extern/imgui/**.cpp",
-        -- GLFW Source Files (Windows specific)
+        -- GLFW Source Files (common + null platform, used by --headless)
         "extern/glfw/glfw-3.4/src/context.c",
         "extern/glfw/glfw-3.4/src/egl_context.c",
         "extern/glfw/glfw-3.4/src/init.c",
@@ -71,14 +75,6 @@ project "Engine"
         "extern/glfw/glfw-3.4/src/osmesa_context.c",
         "extern/glfw/glfw-3.4/src/platform.c",
         "extern/glfw/glfw-3.4/src/vulkan.c",
-        "extern/glfw/glfw-3.4/src/wgl_context.c",
-        "extern/glfw/glfw-3.4/src/win32_init.c",
-        "extern/glfw/glfw-3.4/src/win32_joystick.c",
-        "extern/glfw/glfw-3.4/src/win32_module.c",
-        "extern/glfw/glfw-3.4/src/win32_monitor.c",
-        "extern/glfw/glfw-3.4/src/win32_thread.c",
-        "extern/glfw/glfw-3.4/src/win32_time.c",
-        "extern/glfw/glfw-3.4/src/win32_window.c",
         "extern/glfw/glfw-3.4/src/window.c",
         --- GLM
         "extern/glm/glm/**.hpp",
@@ -97,17 +93,80 @@ project "Engine"
         ["Extern/glm"] = { "extern/glm/**" },
     }
 
-    links {
-        "vulkan-1"
-    }
+    -- File lists only work at project level, platform sources are picked by the host OS
+    if os.is("windows") then
+        defines {
+            "WIN32_LEAN_AND_MEAN",
+            "NOMINMAX",
+            "_GLFW_WIN32",
+            "GLFW_EXPOSE_NATIVE_WIN32",
+            "VK_USE_PLATFORM_WIN32_KHR",
+            "_CRT_SECURE_NO_WARNINGS",
+        }
 
-    libdirs {
-        "$(VULKAN_SDK)/lib"
-    }
+        files {
+            "extern/glfw/glfw-3.4/src/wgl_context.c",
+            "extern/glfw/glfw-3.4/src/win32_init.c",
+            "extern/glfw/glfw-3.4/src/win32_joystick.c",
+            "extern/glfw/glfw-3.4/src/win32_module.c",
+            "extern/glfw/glfw-3.4/src/win32_monitor.c",
+            "extern/glfw/glfw-3.4/src/win32_thread.c",
+            "extern/glfw/glfw-3.4/src/win32_time.c",
+            "extern/glfw/glfw-3.4/src/win32_window.c",
+        }
+
+        links {
+            "vulkan-1"
+        }
+
+        libdirs {
+            "$(VULKAN_SDK)/lib"
+        }
+    else
+        -- X11 for the windowed build, volk loads libvulkan at runtime so nothing to link for Vulkan
+        defines {
+            "_GLFW_X11",
+            "VK_USE_PLATFORM_XLIB_KHR",
+        }
+
+        files {
+            "extern/glfw/glfw-3.4/src/glx_context.c",
+            "extern/glfw/glfw-3.4/src/linux_joystick.c",
+            "extern/glfw/glfw-3.4/src/posix_module.c",
+            "extern/glfw/glfw-3.4/src/posix_poll.c",
+            "extern/glfw/glfw-3.4/src/posix_thread.c",
+            "extern/glfw/glfw-3.4/src/posix_time.c",
+            "extern/glfw/glfw-3.4/src/x11_init.c",
+            "extern/glfw/glfw-3.4/src/x11_monitor.c",
+            "extern/glfw/glfw-3.4/src/x11_window.c",
+            "extern/glfw/glfw-3.4/src/xkb_unicode.c",
+        }
+
+        links {
+            "dl",
+            "pthread",
+            "m",
+        }
+    end
+
+    if _OPTIONS["simd"] == "avx2" then
+        configuration "vs*"
+            buildoptions { "/arch:AVX2" }
+        configuration "not vs*"
+            buildoptions { "-mavx2", "-mfma" }
+        configuration {}
+    elseif _OPTIONS["simd"] == "avx512" then
+        configuration "vs*"
+            buildoptions { "/arch:AVX512" }
+        configuration "not vs*"
+            buildoptions { "-mavx512f", "-mavx512bw", "-mavx512vl", "-mavx2", "-mfma" }
+        configuration {}
+    end
 
     configuration "Debug"
         flags { "Symbols" }
-        defines { "_DEBUG" }
+        -- Counts every global new/delete, see HeapStats.h
+        defines { "_DEBUG", "TOY_COUNT_HEAP_ALLOCATIONS" }
         targetdir "bin/Debug"
 
     configuration "Release"
@@ -117,3 +176,24 @@ project "Engine"
     -- Fix the entry point for ConsoleApp on Windows when using main()
     configuration "windows"
         linkoptions { "/ENTRY:mainCRTStartup" }
+
+    configuration {}
+end
+
+project "Engine"
+    kind "ConsoleApp"
+    language "C++"
+    location "build"
+    files { "Engine/main.cpp" }
+    engineProject()
+
+-- Device free tests (render graph compile, culling math), exits non zero when one fails
+project "EngineTests"
+    kind "ConsoleApp"
+    language "C++"
+    location "build"
+    files {
+        "Engine/tests/*.cpp",
+        "Engine/tests/*.h",
+    }
+    engineProject()